@@ -0,0 +1,109 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file bench.c
+ *
+ * \author Eric Mueller
+ *
+ * \brief Implementation of the benchmark helpers.
+ */
+
+#include "bench.h"
+#include "pcg_variants.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <time.h>
+
+uint64_t bench_now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void bench_report(const char *name, unsigned long ops, uint64_t ns)
+{
+	fprintf(BENCH_OUT_FILE, "%-48s %10.2f ns/op %10.2f Mops/s\n", name,
+		(double)ns / ops, ns ? ops * 1000.0 / ns : 0.0);
+}
+
+double bench_rand_double(void)
+{
+	uint64_t x = ((uint64_t)pcg32_random() << 32) | pcg32_random();
+	return (x >> 11) * (1.0 / 9007199254740992.0);
+}
+
+void bench_shuffle(unsigned long *a, unsigned long n)
+{
+	unsigned long i;
+
+	/* fisher-yates */
+	for (i = n; i > 1; i--) {
+		unsigned long j = pcg32_boundedrand(i);
+		unsigned long tmp = a[i - 1];
+		a[i - 1] = a[j];
+		a[j] = tmp;
+	}
+}
+
+/* binary search the cdf for the first entry >= u */
+static unsigned long cdf_search(const double *cdf, unsigned long n, double u)
+{
+	unsigned long lo = 0, hi = n - 1;
+
+	while (lo < hi) {
+		unsigned long mid = lo + (hi - lo) / 2;
+		if (cdf[mid] < u)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+unsigned long *bench_zipf(unsigned long n, double s, unsigned long count)
+{
+	double *cdf = malloc(n * sizeof *cdf);
+	unsigned long *perm = malloc(n * sizeof *perm);
+	unsigned long *out = malloc(count * sizeof *out);
+	double sum = 0;
+	unsigned long i;
+
+	if (!cdf || !perm || !out) {
+		free(cdf);
+		free(perm);
+		free(out);
+		return NULL;
+	}
+
+	for (i = 0; i < n; i++) {
+		sum += pow((double)(i + 1), -s);
+		cdf[i] = sum;
+	}
+	for (i = 0; i < n; i++) {
+		cdf[i] /= sum;
+		perm[i] = i;
+	}
+
+	bench_shuffle(perm, n);
+
+	for (i = 0; i < count; i++)
+		out[i] = perm[cdf_search(cdf, n, bench_rand_double())];
+
+	free(cdf);
+	free(perm);
+	return out;
+}
@@ -0,0 +1,61 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file bench.h
+ *
+ * \author Eric Mueller
+ *
+ * \brief Header file for a few helpers shared by the benchmarks.
+ */
+
+#ifndef INCLUDE_BENCH_H
+#define INCLUDE_BENCH_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* where to write results */
+#define BENCH_OUT_FILE stdout
+
+/* monotonic clock, in nanoseconds */
+uint64_t bench_now_ns(void);
+
+/* print one result line: name, time per op, and throughput */
+void bench_report(const char *name, unsigned long ops, uint64_t ns);
+
+/* keep the compiler from optimizing away the computation of p */
+static inline void bench_use(const void *p)
+{
+	__asm__ volatile ("" : : "g" (p) : "memory");
+}
+
+/* a uniformly random double in [0, 1), from pcg32_random */
+double bench_rand_double(void);
+
+/* randomly permute an array */
+void bench_shuffle(unsigned long *a, unsigned long n);
+
+/*
+ * Generate count draws from a Zipfian distribution over [0, n), where the
+ * rank r (0 indexed) element is drawn with probability proportional to
+ * 1/(r + 1)^s. s = 0 is uniform, s around 1 is typical of caches. The ranks
+ * are randomly permuted before being returned so that the hot keys aren't
+ * simply the smallest ones. Returns a malloc'd array the caller frees, or
+ * NULL on allocation failure.
+ */
+unsigned long *bench_zipf(unsigned long n, double s, unsigned long count);
+
+#endif /* INCLUDE_BENCH_H */
@@ -0,0 +1,135 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file bigmem_bench.c
+ *
+ * \author Eric Mueller
+ *
+ * \brief Benchmark of random probes into a cuckoo_htable.h table and a
+ * bloom.h filter of over 1GB, allocated with different bigmem.h options.
+ *
+ * \detail Each structure is allocated, which is timed along with the
+ * prefaulting if there is any, then filled with some keys and probed at
+ * random. The keys only fill a fraction of the structure, but since they're
+ * hashed, the probes are spread over all of it regardless, and nearly every
+ * one of them misses in the TLB on 4K pages.
+ */
+
+#include "bench.h"
+#include "bigmem.h"
+#include "bloom.h"
+#include "cuckoo_htable.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* 2 arrays of 2^23 64 byte buckets: 1GB */
+#define CUCKOO_CAPACITY (1UL << 24)
+/* about 1.1GB of bits at the default false positive rate */
+#define BLOOM_KEYS (800UL << 20)
+
+#define NKEYS (1UL << 22)
+#define NPROBES (1UL << 22)
+
+static const struct {
+	const char *name;
+	struct bigmem_opts opts;
+} configs[] = {
+	{"default", {false, BIGMEM_POLICY_DEFAULT, 0, 0}},
+	{"hugepages", {true, BIGMEM_POLICY_DEFAULT, 0, 0}},
+	{"hugepages+interleave+prefault", {true, BIGMEM_POLICY_INTERLEAVE,
+					   0, 4}},
+};
+
+static uint64_t rng_state;
+
+static uint64_t next_rand(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return rng_state;
+}
+
+static void run_cuckoo(const char *config, const struct bigmem_opts *opts)
+{
+	CUCKOO_HASH_TABLE(t);
+	unsigned long i, found = 0;
+	uint64_t start, v;
+	char name[96];
+
+	t.mem = *opts;
+	start = bench_now_ns();
+	if (!cuckoo_htable_init(&t, CUCKOO_CAPACITY))
+		exit(1);
+	snprintf(name, sizeof name, "cuckoo init %s", config);
+	bench_report(name, 1, bench_now_ns() - start);
+
+	for (i = 0; i < NKEYS; i++)
+		cuckoo_htable_insert_u64(&t, i, i);
+	if (t.stat_resizes)
+		fprintf(BENCH_OUT_FILE, "warning: table grew\n");
+
+	rng_state = 88172645463325252ULL;
+	start = bench_now_ns();
+	for (i = 0; i < NPROBES; i++)
+		found += cuckoo_htable_get_u64(&t, next_rand() % NKEYS, &v);
+	snprintf(name, sizeof name, "cuckoo get  %s", config);
+	bench_report(name, NPROBES, bench_now_ns() - start);
+	if (found != NPROBES)
+		fprintf(BENCH_OUT_FILE, "warning: lookups missed\n");
+
+	cuckoo_htable_destroy(&t);
+}
+
+static void run_bloom(const char *config, const struct bigmem_opts *opts)
+{
+	BLOOM_FILTER(bf, BLOOM_KEYS, BLOOM_P_DEFAULT);
+	unsigned long i, found = 0;
+	uint64_t start;
+	char name[96];
+
+	bf.mem = *opts;
+	start = bench_now_ns();
+	if (!bloom_init(&bf))
+		exit(1);
+	snprintf(name, sizeof name, "bloom init  %s", config);
+	bench_report(name, 1, bench_now_ns() - start);
+
+	for (i = 0; i < NKEYS; i++)
+		bloom_insert(&bf, i);
+
+	rng_state = 88172645463325252ULL;
+	start = bench_now_ns();
+	for (i = 0; i < NPROBES; i++)
+		found += bloom_query(&bf, next_rand() % NKEYS);
+	snprintf(name, sizeof name, "bloom query %s", config);
+	bench_report(name, NPROBES, bench_now_ns() - start);
+	if (found != NPROBES)
+		fprintf(BENCH_OUT_FILE, "warning: queries missed\n");
+
+	bloom_destroy(&bf);
+}
+
+int main(void)
+{
+	unsigned i;
+
+	for (i = 0; i < sizeof configs / sizeof configs[0]; i++)
+		run_cuckoo(configs[i].name, &configs[i].opts);
+	for (i = 0; i < sizeof configs / sizeof configs[0]; i++)
+		run_bloom(configs[i].name, &configs[i].opts);
+	return 0;
+}
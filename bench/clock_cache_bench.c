@@ -0,0 +1,192 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file clock_cache_bench.c
+ *
+ * \author Eric Mueller
+ *
+ * \brief Benchmark for clock_cache.h on Zipfian traces, versus the usual
+ * hand rolled LRU (a hash table and a list under one mutex, with every hit
+ * moving its entry to the front). Reports throughput and hit rate.
+ */
+
+#include "bench.h"
+#include "clock_cache.h"
+#include "list.h"
+#include "swiss_htable.h"
+#include "pcg_variants.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NKEYS (1UL << 20)
+#define TRACE_LEN (1UL << 22)
+#define MAX_THREADS 4
+
+/* ===== the baseline ===== */
+
+struct lru_node {
+	struct list link;
+	uint64_t key;
+};
+
+struct lru {
+	pthread_mutex_t lock;
+	struct swiss_head table;
+	struct list_head list;
+	unsigned long capacity;
+};
+
+static bool lru_get_or_insert(struct lru *c, uint64_t key)
+{
+	struct lru_node *n;
+	const void *found;
+	bool hit;
+
+	pthread_mutex_lock(&c->lock);
+	hit = swiss_htable_get(&c->table, key, &found);
+	if (hit) {
+		n = (struct lru_node *)found;
+		list_delete(&c->list, n);
+		list_push_front(&c->list, n);
+	} else {
+		n = malloc(sizeof *n);
+		n->key = key;
+		swiss_htable_insert(&c->table, key, n);
+		list_push_front(&c->list, n);
+		if (c->list.length > c->capacity) {
+			n = list_pop_back(&c->list);
+			swiss_htable_remove(&c->table, n->key);
+			free(n);
+		}
+	}
+	pthread_mutex_unlock(&c->lock);
+	return hit;
+}
+
+/* ===== threads ===== */
+
+struct worker {
+	const unsigned long *trace;
+	unsigned id, nthreads;
+	struct lru *lru;
+	struct clock_cache *clock;
+	unsigned long hits;
+};
+
+static void *run_lru(void *arg)
+{
+	struct worker *w = arg;
+	unsigned long i;
+
+	w->hits = 0;
+	for (i = w->id; i < TRACE_LEN; i += w->nthreads)
+		w->hits += lru_get_or_insert(w->lru, w->trace[i]);
+	return NULL;
+}
+
+static void *run_clock(void *arg)
+{
+	struct worker *w = arg;
+	unsigned long i;
+
+	w->hits = 0;
+	for (i = w->id; i < TRACE_LEN; i += w->nthreads) {
+		struct clock_cache_entry *e;
+
+		e = clock_cache_lookup(w->clock, w->trace[i]);
+		if (e) {
+			bench_use(clock_cache_value(e));
+			clock_cache_release(w->clock, e);
+			w->hits++;
+		} else {
+			clock_cache_insert(w->clock, w->trace[i], w, 1);
+		}
+	}
+	return NULL;
+}
+
+static void run(const unsigned long *trace, double s, unsigned long capacity,
+		unsigned nthreads)
+{
+	static const char *const names[] = {"lru", "clock_cache"};
+	void *(*const fns[])(void *) = {run_lru, run_clock};
+	struct worker w[MAX_THREADS];
+	pthread_t tid[MAX_THREADS];
+	struct clock_cache clock;
+	struct lru lru;
+	char name[96];
+	unsigned long hits;
+	uint64_t start;
+	unsigned p, i;
+
+	for (p = 0; p < 2; p++) {
+		SWISS_HASH_TABLE(table);
+		LIST_HEAD(list, struct lru_node, link);
+
+		lru.table = table;
+		lru.list = list;
+		lru.capacity = capacity;
+		if (pthread_mutex_init(&lru.lock, NULL)
+		    || !swiss_htable_init(&lru.table, capacity)
+		    || !clock_cache_init(&clock, 16, capacity, NULL, NULL))
+			exit(1);
+
+		start = bench_now_ns();
+		for (i = 0; i < nthreads; i++) {
+			w[i].trace = trace;
+			w[i].id = i;
+			w[i].nthreads = nthreads;
+			w[i].lru = &lru;
+			w[i].clock = &clock;
+			pthread_create(&tid[i], NULL, fns[p], &w[i]);
+		}
+		for (i = 0, hits = 0; i < nthreads; i++) {
+			pthread_join(tid[i], NULL);
+			hits += w[i].hits;
+		}
+		snprintf(name, sizeof name,
+			 "%s s=%.2f cap=%lu threads=%u hit=%.1f%%", names[p], s,
+			 capacity, nthreads, 100.0 * hits / TRACE_LEN);
+		bench_report(name, TRACE_LEN, bench_now_ns() - start);
+
+		clock_cache_destroy(&clock);
+		while (lru.list.length)
+			free(list_pop_front(&lru.list));
+		swiss_htable_destroy(&lru.table);
+		pthread_mutex_destroy(&lru.lock);
+	}
+}
+
+int main(void)
+{
+	static const double skews[] = {0.8, 0.99};
+	static const unsigned long capacities[] = {NKEYS / 64, NKEYS / 8};
+	unsigned long *trace;
+	unsigned i, j, t;
+
+	pcg32_srandom(42u, 54u);
+	for (i = 0; i < sizeof skews / sizeof skews[0]; i++) {
+		trace = bench_zipf(NKEYS, skews[i], TRACE_LEN);
+		if (!trace)
+			exit(1);
+		for (j = 0; j < sizeof capacities / sizeof capacities[0]; j++)
+			for (t = 1; t <= MAX_THREADS; t *= 4)
+				run(trace, skews[i], capacities[j], t);
+		free(trace);
+	}
+	return 0;
+}
@@ -0,0 +1,378 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file cuckoo_htable_bench.c
+ *
+ * \author Eric Mueller
+ *
+ * \brief Benchmark for cuckoo_htable.h as the table fills up, with 2, 3 and 4
+ * hash functions.
+ *
+ * \detail A table is sized up front, then filled to its maximum load
+ * without growing. Inserts are timed separately for each band of load,
+ * since the cost of finding room for a key goes up sharply as the table gets
+ * full, and after each band the lookups of keys in the table are timed, to
+ * give a curve of throughput against load for each number of hash
+ * functions.
+ *
+ * Then counters are kept in a table both ways: as pointers to counters
+ * allocated one by one, and inline as integer values, and summed up through
+ * random lookups.
+ *
+ * Then a grown table loses most of its keys in a purge, which is timed
+ * along with the shrinking it causes, and lookups are timed before and
+ * after.
+ *
+ * Then the startup of a process that needs a table: building it from
+ * scratch, against attaching to one kept in a file.
+ *
+ * Then a full table is grown with different numbers of resize threads.
+ *
+ * Last, keys with several values each are kept two ways: as a table of
+ * pointers to linked lists of values, and as a multimap, and all the values
+ * of random keys are read back.
+ */
+
+#include "bench.h"
+#include "cuckoo_htable.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* upper edges of the load bands, in percent */
+static const unsigned bands[] = {50, 75, 90, 93, 97, 98};
+
+/* the load at which cuckoo_htable.c grows the table, by number of tables */
+static const unsigned max_load[] = {[2] = 93, [3] = 97, [4] = 98};
+
+#define NLOOKUPS (1UL << 22)
+
+static uint64_t rng_state;
+
+static uint64_t next_rand(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return rng_state;
+}
+
+static void run(unsigned long capacity, unsigned ntables)
+{
+	CUCKOO_HASH_TABLE(t);
+	unsigned long i, done, target, rehashes, found = 0;
+	unsigned b, lo = 0;
+	uint64_t *keys;
+	const void *out;
+	char name[96];
+	uint64_t start;
+
+	rng_state = 88172645463325252ULL;
+	if (!cuckoo_htable_init_ntables(&t, capacity, ntables))
+		exit(1);
+	keys = malloc(t.capacity * sizeof *keys);
+	if (!keys)
+		exit(1);
+
+	for (b = 0; b < sizeof bands / sizeof bands[0]; b++) {
+		if (bands[b] > max_load[ntables])
+			break;
+		target = t.capacity / 100 * bands[b];
+		done = t.nentries;
+		rehashes = t.stat_rehashes;
+		for (i = done; i < target; i++)
+			keys[i] = next_rand();
+
+		start = bench_now_ns();
+		for (i = done; i < target; i++)
+			cuckoo_htable_insert(&t, keys[i], &t);
+		snprintf(name, sizeof name, "insert d=%u slots=%lu "
+			 "load=%u-%u%% rehashes=%lu", ntables, t.capacity, lo,
+			 bands[b], t.stat_rehashes - rehashes);
+		bench_report(name, target - done, bench_now_ns() - start);
+
+		start = bench_now_ns();
+		for (i = 0; i < NLOOKUPS; i++)
+			found += cuckoo_htable_get(&t,
+						   keys[next_rand() % target],
+						   &out);
+		snprintf(name, sizeof name, "get    d=%u slots=%lu load=%u%%",
+			 ntables, t.capacity, bands[b]);
+		bench_report(name, NLOOKUPS, bench_now_ns() - start);
+		lo = bands[b];
+	}
+	if (t.stat_resizes)
+		fprintf(BENCH_OUT_FILE, "warning: table grew %lu times\n",
+			t.stat_resizes);
+	if (found != NLOOKUPS * b)
+		fprintf(BENCH_OUT_FILE, "warning: lookups missed\n");
+	cuckoo_htable_destroy(&t);
+	free(keys);
+}
+
+static void run_counters(unsigned long nkeys)
+{
+	CUCKOO_HASH_TABLE(ptrs);
+	CUCKOO_HASH_TABLE(vals);
+	uint64_t **counters = malloc(nkeys * sizeof *counters);
+	unsigned long i;
+	uint64_t start, sum = 0, v;
+	const void *p;
+	char name[96];
+
+	if (!counters || !cuckoo_htable_init(&ptrs, nkeys)
+	    || !cuckoo_htable_init(&vals, nkeys))
+		exit(1);
+	for (i = 0; i < nkeys; i++) {
+		counters[i] = malloc(sizeof **counters);
+		if (!counters[i])
+			exit(1);
+		*counters[i] = i;
+		cuckoo_htable_insert(&ptrs, i, counters[i]);
+		cuckoo_htable_insert_u64(&vals, i, i);
+	}
+
+	rng_state = 88172645463325252ULL;
+	start = bench_now_ns();
+	for (i = 0; i < NLOOKUPS; i++)
+		if (cuckoo_htable_get(&ptrs, next_rand() % nkeys, &p))
+			sum += *(const uint64_t *)p;
+	snprintf(name, sizeof name, "counter get, pointer values n=%lu",
+		 nkeys);
+	bench_report(name, NLOOKUPS, bench_now_ns() - start);
+
+	rng_state = 88172645463325252ULL;
+	start = bench_now_ns();
+	for (i = 0; i < NLOOKUPS; i++)
+		if (cuckoo_htable_get_u64(&vals, next_rand() % nkeys, &v))
+			sum -= v;
+	snprintf(name, sizeof name, "counter get, inline values n=%lu",
+		 nkeys);
+	bench_report(name, NLOOKUPS, bench_now_ns() - start);
+	if (sum)
+		fprintf(BENCH_OUT_FILE, "warning: sums differ\n");
+
+	for (i = 0; i < nkeys; i++)
+		free(counters[i]);
+	free(counters);
+	cuckoo_htable_destroy(&ptrs);
+	cuckoo_htable_destroy(&vals);
+}
+
+static void run_purge(unsigned long nkeys, unsigned long keep)
+{
+	CUCKOO_HASH_TABLE(t);
+	unsigned long i, before;
+	uint64_t start, v, sum = 0;
+	char name[96];
+
+	if (!cuckoo_htable_init(&t, 1024))
+		exit(1);
+	for (i = 0; i < nkeys; i++)
+		cuckoo_htable_insert_u64(&t, i, i);
+
+	rng_state = 88172645463325252ULL;
+	start = bench_now_ns();
+	for (i = 0; i < NLOOKUPS; i++)
+		if (cuckoo_htable_get_u64(&t, next_rand() % keep, &v))
+			sum += v;
+	snprintf(name, sizeof name, "get before purge slots=%lu", t.capacity);
+	bench_report(name, NLOOKUPS, bench_now_ns() - start);
+
+	before = t.capacity;
+	start = bench_now_ns();
+	for (i = keep; i < nkeys; i++)
+		cuckoo_htable_remove_u64(&t, i, &v);
+	snprintf(name, sizeof name, "purge %lu of %lu, shrinks=%lu",
+		 nkeys - keep, nkeys, t.stat_shrinks);
+	bench_report(name, nkeys - keep, bench_now_ns() - start);
+
+	rng_state = 88172645463325252ULL;
+	start = bench_now_ns();
+	for (i = 0; i < NLOOKUPS; i++)
+		if (cuckoo_htable_get_u64(&t, next_rand() % keep, &v))
+			sum -= v;
+	snprintf(name, sizeof name, "get after purge slots=%lu (was %lu)",
+		 t.capacity, before);
+	bench_report(name, NLOOKUPS, bench_now_ns() - start);
+	if (sum)
+		fprintf(BENCH_OUT_FILE, "warning: lookups differ\n");
+
+	cuckoo_htable_destroy(&t);
+}
+
+static void run_startup(unsigned long nkeys)
+{
+	static const char path[] = "/tmp/cuckoo_htable_bench.table";
+	CUCKOO_HASH_TABLE(t);
+	unsigned long i;
+	uint64_t start, v, sum = 0;
+	char name[96];
+
+	start = bench_now_ns();
+	if (!cuckoo_htable_init(&t, nkeys))
+		exit(1);
+	for (i = 0; i < nkeys; i++)
+		cuckoo_htable_insert_u64(&t, i, i);
+	snprintf(name, sizeof name, "startup: build n=%lu in memory", nkeys);
+	bench_report(name, 1, bench_now_ns() - start);
+	cuckoo_htable_destroy(&t);
+
+	start = bench_now_ns();
+	if (!cuckoo_htable_create_file(&t, path, nkeys, CUCKOO_HTABLE_NTABLES))
+		exit(1);
+	for (i = 0; i < nkeys; i++)
+		cuckoo_htable_insert_u64(&t, i, i);
+	snprintf(name, sizeof name, "startup: build n=%lu in a file", nkeys);
+	bench_report(name, 1, bench_now_ns() - start);
+
+	start = bench_now_ns();
+	cuckoo_htable_checkpoint(&t);
+	bench_report("startup: checkpoint", 1, bench_now_ns() - start);
+	cuckoo_htable_destroy(&t);
+
+	start = bench_now_ns();
+	if (!cuckoo_htable_open_file(&t, path))
+		exit(1);
+	snprintf(name, sizeof name, "startup: attach to the file (%lu keys)",
+		 t.nentries);
+	bench_report(name, 1, bench_now_ns() - start);
+
+	rng_state = 88172645463325252ULL;
+	start = bench_now_ns();
+	for (i = 0; i < NLOOKUPS; i++)
+		if (cuckoo_htable_get_u64(&t, next_rand() % nkeys, &v))
+			sum += v;
+	bench_report("startup: get after attaching", NLOOKUPS,
+		     bench_now_ns() - start);
+	bench_use(&sum);
+
+	cuckoo_htable_destroy(&t);
+	unlink(path);
+}
+
+static void run_resize(unsigned long capacity, unsigned nthreads)
+{
+	CUCKOO_HASH_TABLE(t);
+	unsigned long i, nkeys;
+	uint64_t start;
+	char name[96];
+
+	t.resize_threads = nthreads;
+	if (!cuckoo_htable_init(&t, capacity))
+		exit(1);
+	nkeys = t.capacity / 100 * 90;
+	for (i = 0; i < nkeys; i++)
+		cuckoo_htable_insert_u64(&t, i, i);
+
+	start = bench_now_ns();
+	if (!cuckoo_htable_resize(&t, true))
+		exit(1);
+	snprintf(name, sizeof name, "grow n=%lu threads=%u", nkeys, nthreads);
+	bench_report(name, nkeys, bench_now_ns() - start);
+	cuckoo_htable_destroy(&t);
+}
+
+struct value_node {
+	uint64_t val;
+	struct value_node *next;
+};
+
+/* key i has i % 4 + 1 values */
+static void run_multimap(unsigned long nkeys)
+{
+	CUCKOO_HASH_TABLE(lists);
+	CUCKOO_HASH_TABLE(multi);
+	struct value_node *node;
+	unsigned long i, j, k;
+	uint64_t start, vals[8], sum = 0;
+	const void *p;
+	char name[96];
+
+	if (!cuckoo_htable_init(&lists, nkeys)
+	    || !cuckoo_htable_init(&multi, nkeys))
+		exit(1);
+	for (i = 0; i < nkeys; i++) {
+		node = NULL;
+		for (j = 0; j <= i % 4; j++) {
+			struct value_node *n = malloc(sizeof *n);
+
+			if (!n || !cuckoo_htable_multi_insert(&multi, i, j))
+				exit(1);
+			n->val = j;
+			n->next = node;
+			node = n;
+		}
+		cuckoo_htable_insert(&lists, i, node);
+	}
+
+	rng_state = 88172645463325252ULL;
+	start = bench_now_ns();
+	for (i = 0; i < NLOOKUPS; i++)
+		if (cuckoo_htable_get(&lists, next_rand() % nkeys, &p))
+			for (node = (struct value_node *)p; node;
+			     node = node->next)
+				sum += node->val;
+	snprintf(name, sizeof name, "all values, linked lists n=%lu", nkeys);
+	bench_report(name, NLOOKUPS, bench_now_ns() - start);
+
+	rng_state = 88172645463325252ULL;
+	start = bench_now_ns();
+	for (i = 0; i < NLOOKUPS; i++) {
+		k = cuckoo_htable_get_all(&multi, next_rand() % nkeys, vals, 8);
+		for (j = 0; j < k; j++)
+			sum -= vals[j];
+	}
+	snprintf(name, sizeof name, "all values, multimap n=%lu", nkeys);
+	bench_report(name, NLOOKUPS, bench_now_ns() - start);
+	if (sum)
+		fprintf(BENCH_OUT_FILE, "warning: sums differ\n");
+
+	for (i = 0; i < nkeys; i++) {
+		cuckoo_htable_get(&lists, i, &p);
+		for (node = (struct value_node *)p; node; ) {
+			struct value_node *next = node->next;
+			free(node);
+			node = next;
+		}
+	}
+	cuckoo_htable_destroy(&lists);
+	cuckoo_htable_multi_destroy(&multi);
+}
+
+int main(void)
+{
+	unsigned d;
+
+	run_counters(1UL << 14);
+	run_counters(1UL << 22);
+
+	for (d = CUCKOO_HTABLE_MIN_TABLES; d <= CUCKOO_HTABLE_MAX_TABLES; d++)
+		run(1UL << 14, d);
+	for (d = CUCKOO_HTABLE_MIN_TABLES; d <= CUCKOO_HTABLE_MAX_TABLES; d++)
+		run(1UL << 22, d);
+
+	run_purge(1UL << 22, 1UL << 18);
+	run_startup(1UL << 22);
+
+	run_resize(1UL << 22, 1);
+	run_resize(1UL << 22, 2);
+	run_resize(1UL << 22, 4);
+
+	run_multimap(1UL << 14);
+	run_multimap(1UL << 21);
+	return 0;
+}
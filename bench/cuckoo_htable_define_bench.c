@@ -0,0 +1,113 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file cuckoo_htable_define_bench.c
+ *
+ * \author Eric Mueller
+ *
+ * \brief Benchmark of a table generated by cuckoo_htable_define.h against
+ * cuckoo_htable.h, with integer keys and values.
+ *
+ * \detail Both tables get the same keys, then are timed on inserts and on
+ * lookups of random keys that are in the table, at a size that fits in
+ * cache and one that doesn't.
+ */
+
+#include "bench.h"
+#include "cuckoo_htable.h"
+#include "cuckoo_htable_define.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NLOOKUPS (1UL << 22)
+
+static inline uint64_t mix64(uint64_t k, uint64_t seed)
+{
+	k ^= seed;
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+	return k;
+}
+
+#define U64_EQ(a, b) ((a) == (b))
+
+CUCKOO_HTABLE_DEFINE(u64_table, uint64_t, uint64_t, mix64, U64_EQ)
+
+static uint64_t rng_state;
+
+static uint64_t next_rand(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return rng_state;
+}
+
+static void run(unsigned long nkeys)
+{
+	CUCKOO_HASH_TABLE(generic);
+	struct u64_table special;
+	unsigned long i;
+	uint64_t start, v, sum = 0;
+	char name[96];
+
+	if (!cuckoo_htable_init(&generic, 16) || !u64_table_init(&special, 16))
+		exit(1);
+
+	start = bench_now_ns();
+	for (i = 0; i < nkeys; i++)
+		cuckoo_htable_insert_u64(&generic, i * 7, i);
+	snprintf(name, sizeof name, "insert cuckoo_htable n=%lu", nkeys);
+	bench_report(name, nkeys, bench_now_ns() - start);
+
+	start = bench_now_ns();
+	for (i = 0; i < nkeys; i++)
+		u64_table_insert(&special, i * 7, i);
+	snprintf(name, sizeof name, "insert generated     n=%lu", nkeys);
+	bench_report(name, nkeys, bench_now_ns() - start);
+
+	rng_state = 88172645463325252ULL;
+	start = bench_now_ns();
+	for (i = 0; i < NLOOKUPS; i++)
+		if (cuckoo_htable_get_u64(&generic, next_rand() % nkeys * 7,
+					  &v))
+			sum += v;
+	snprintf(name, sizeof name, "get    cuckoo_htable n=%lu", nkeys);
+	bench_report(name, NLOOKUPS, bench_now_ns() - start);
+
+	rng_state = 88172645463325252ULL;
+	start = bench_now_ns();
+	for (i = 0; i < NLOOKUPS; i++)
+		if (u64_table_get(&special, next_rand() % nkeys * 7, &v))
+			sum -= v;
+	snprintf(name, sizeof name, "get    generated     n=%lu", nkeys);
+	bench_report(name, NLOOKUPS, bench_now_ns() - start);
+	if (sum)
+		fprintf(BENCH_OUT_FILE, "warning: sums differ\n");
+
+	cuckoo_htable_destroy(&generic);
+	u64_table_destroy(&special);
+}
+
+int main(void)
+{
+	run(1UL << 14);
+	run(1UL << 22);
+	return 0;
+}
@@ -0,0 +1,125 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file fuse_filter_bench.c
+ *
+ * \author Eric Mueller
+ *
+ * \brief Benchmark for fuse_filter.h versus bloom.h at the same false
+ * positive rates: build time, query time for keys that are and aren't in
+ * the set, bits per key, and the measured false positive rate.
+ */
+
+#include "bench.h"
+#include "bloom.h"
+#include "fuse_filter.h"
+#include "pcg_variants.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NQUERIES (1UL << 22)
+
+static void report_size(const char *name, unsigned long nkeys, double bits,
+			unsigned long false_pos)
+{
+	fprintf(BENCH_OUT_FILE, "%-52s %8.2f bits/key  fpp=%.6f\n", name,
+		bits / nkeys, (double)false_pos / NQUERIES);
+}
+
+static void run(unsigned long nkeys, unsigned fp_bits)
+{
+	uint64_t *keys = malloc(nkeys * sizeof *keys);
+	uint64_t *misses = malloc(NQUERIES * sizeof *misses);
+	uint64_t *hits = malloc(NQUERIES * sizeof *hits);
+	BLOOM_FILTER(bloom, nkeys, 1.0 / (1UL << fp_bits));
+	FUSE_FILTER(fuse, fp_bits);
+	unsigned long i, found;
+	char name[64];
+	uint64_t start;
+
+	if (!keys || !misses || !hits)
+		exit(1);
+	for (i = 0; i < nkeys; i++)
+		keys[i] = pcg64_random();
+	for (i = 0; i < NQUERIES; i++) {
+		hits[i] = keys[pcg32_boundedrand(nkeys)];
+		misses[i] = pcg64_random();
+	}
+
+	start = bench_now_ns();
+	if (!bloom_init(&bloom))
+		exit(1);
+	for (i = 0; i < nkeys; i++)
+		bloom_insert(&bloom, keys[i]);
+	snprintf(name, sizeof name, "bloom build n=%lu p=1/%lu", nkeys,
+		 1UL << fp_bits);
+	bench_report(name, nkeys, bench_now_ns() - start);
+
+	start = bench_now_ns();
+	if (!fuse_filter_build(&fuse, keys, nkeys))
+		exit(1);
+	snprintf(name, sizeof name, "fuse%u build n=%lu", fp_bits, nkeys);
+	bench_report(name, nkeys, bench_now_ns() - start);
+
+	start = bench_now_ns();
+	for (i = 0, found = 0; i < NQUERIES; i++)
+		found += bloom_query(&bloom, hits[i]);
+	snprintf(name, sizeof name, "bloom_query hit n=%lu p=1/%lu", nkeys,
+		 1UL << fp_bits);
+	bench_report(name, NQUERIES, bench_now_ns() - start);
+	bench_use((void *)found);
+
+	start = bench_now_ns();
+	for (i = 0, found = 0; i < NQUERIES; i++)
+		found += fuse_filter_query(&fuse, hits[i]);
+	snprintf(name, sizeof name, "fuse%u query hit n=%lu", fp_bits, nkeys);
+	bench_report(name, NQUERIES, bench_now_ns() - start);
+	bench_use((void *)found);
+
+	start = bench_now_ns();
+	for (i = 0, found = 0; i < NQUERIES; i++)
+		found += bloom_query(&bloom, misses[i]);
+	snprintf(name, sizeof name, "bloom_query miss n=%lu p=1/%lu", nkeys,
+		 1UL << fp_bits);
+	bench_report(name, NQUERIES, bench_now_ns() - start);
+	report_size(name, nkeys, bloom.nbits, found);
+
+	start = bench_now_ns();
+	for (i = 0, found = 0; i < NQUERIES; i++)
+		found += fuse_filter_query(&fuse, misses[i]);
+	snprintf(name, sizeof name, "fuse%u query miss n=%lu", fp_bits, nkeys);
+	bench_report(name, NQUERIES, bench_now_ns() - start);
+	report_size(name, nkeys, (double)fuse.array_length * fp_bits, found);
+
+	bloom_destroy(&bloom);
+	fuse_filter_destroy(&fuse);
+	free(keys);
+	free(misses);
+	free(hits);
+}
+
+int main(void)
+{
+	pcg32_srandom(42u, 54u);
+	pcg64_srandom(42u, 54u);
+
+	/* fits in cache, then doesn't */
+	run(1UL << 14, 8);
+	run(1UL << 14, 16);
+	run(1UL << 22, 8);
+	run(1UL << 22, 16);
+	return 0;
+}
@@ -0,0 +1,142 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file htable_bench.c
+ *
+ * \author Eric Mueller
+ *
+ * \brief Benchmark for swiss_htable.h versus cuckoo_htable.h on insert,
+ * hit, miss, and mixed lookup workloads, in and out of cache, and for
+ * replacing values in a cuckoo_htable.
+ */
+
+#include "bench.h"
+#include "cuckoo_htable.h"
+#include "swiss_htable.h"
+#include "pcg_variants.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NLOOKUPS (1UL << 22)
+
+/* probe keys: hit_pct percent of them are in the table */
+static uint64_t *make_probes(const uint64_t *keys, unsigned long nkeys,
+			     unsigned hit_pct)
+{
+	uint64_t *probes = malloc(NLOOKUPS * sizeof *probes);
+	unsigned long i;
+
+	if (!probes)
+		return NULL;
+	for (i = 0; i < NLOOKUPS; i++) {
+		if (pcg32_boundedrand(100) < hit_pct)
+			probes[i] = keys[pcg32_boundedrand(nkeys)];
+		else
+			probes[i] = pcg64_random() | 1; /* keys are even */
+	}
+	return probes;
+}
+
+static void run(unsigned long nkeys)
+{
+	static const unsigned hit_pcts[] = {100, 50, 0};
+	CUCKOO_HASH_TABLE(cuckoo);
+	SWISS_HASH_TABLE(swiss);
+	uint64_t *keys = malloc(nkeys * sizeof *keys);
+	uint64_t *probes;
+	const void *val;
+	char name[64];
+	uint64_t start;
+	unsigned long i, h;
+
+	if (!keys || !cuckoo_htable_init(&cuckoo, 16)
+	    || !swiss_htable_init(&swiss, 16))
+		exit(1);
+	for (i = 0; i < nkeys; i++)
+		keys[i] = pcg64_random() & ~1ULL;
+
+	start = bench_now_ns();
+	for (i = 0; i < nkeys; i++)
+		cuckoo_htable_insert(&cuckoo, keys[i], &keys[i]);
+	snprintf(name, sizeof name, "cuckoo_htable_insert n=%lu", nkeys);
+	bench_report(name, nkeys, bench_now_ns() - start);
+
+	start = bench_now_ns();
+	for (i = 0; i < nkeys; i++)
+		swiss_htable_insert(&swiss, keys[i], &keys[i]);
+	snprintf(name, sizeof name, "swiss_htable_insert n=%lu", nkeys);
+	bench_report(name, nkeys, bench_now_ns() - start);
+
+	for (h = 0; h < sizeof hit_pcts / sizeof hit_pcts[0]; h++) {
+		probes = make_probes(keys, nkeys, hit_pcts[h]);
+		if (!probes)
+			exit(1);
+
+		start = bench_now_ns();
+		for (i = 0; i < NLOOKUPS; i++)
+			bench_use((void *)(uintptr_t)
+				  cuckoo_htable_get(&cuckoo, probes[i], &val));
+		snprintf(name, sizeof name, "cuckoo_htable_get n=%lu hit=%u%%",
+			 nkeys, hit_pcts[h]);
+		bench_report(name, NLOOKUPS, bench_now_ns() - start);
+
+		start = bench_now_ns();
+		for (i = 0; i < NLOOKUPS; i++)
+			bench_use((void *)(uintptr_t)
+				  swiss_htable_get(&swiss, probes[i], &val));
+		snprintf(name, sizeof name, "swiss_htable_get n=%lu hit=%u%%",
+			 nkeys, hit_pcts[h]);
+		bench_report(name, NLOOKUPS, bench_now_ns() - start);
+
+		free(probes);
+	}
+
+	/* replacing the values of keys that are already there */
+	probes = make_probes(keys, nkeys, 100);
+	if (!probes)
+		exit(1);
+
+	start = bench_now_ns();
+	for (i = 0; i < NLOOKUPS; i++) {
+		cuckoo_htable_remove(&cuckoo, probes[i]);
+		cuckoo_htable_insert(&cuckoo, probes[i], &probes[i]);
+	}
+	snprintf(name, sizeof name, "cuckoo_htable_remove+insert n=%lu",
+		 nkeys);
+	bench_report(name, NLOOKUPS, bench_now_ns() - start);
+
+	start = bench_now_ns();
+	for (i = 0; i < NLOOKUPS; i++)
+		cuckoo_htable_upsert(&cuckoo, probes[i], &probes[i], &val);
+	snprintf(name, sizeof name, "cuckoo_htable_upsert n=%lu", nkeys);
+	bench_report(name, NLOOKUPS, bench_now_ns() - start);
+	free(probes);
+
+	cuckoo_htable_destroy(&cuckoo);
+	swiss_htable_destroy(&swiss);
+	free(keys);
+}
+
+int main(void)
+{
+	pcg32_srandom(42u, 54u);
+	pcg64_srandom(42u, 54u);
+
+	/* fits in cache, then doesn't */
+	run(1UL << 14);
+	run(1UL << 22);
+	return 0;
+}
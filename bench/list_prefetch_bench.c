@@ -0,0 +1,156 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file list_prefetch_bench.c
+ *
+ * \author Eric Mueller
+ *
+ * \brief Benchmark for the prefetching and batched traversals in list.h and
+ * flist.h versus plain traversal, over objects scattered across the heap.
+ */
+
+#include "bench.h"
+#include "flist.h"
+#include "list.h"
+#include "pcg_variants.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NITEMS (1UL << 20)
+#define NPASSES 4
+
+/* two cache lines, and the body of each loop reads both */
+struct item {
+	struct list l;
+	struct flist fl;
+	unsigned long key;
+	char pad[88];
+	unsigned long state;
+};
+
+static unsigned long sum;
+
+/* how much work visit does per element */
+static unsigned long rounds;
+
+static void visit(void *data)
+{
+	struct item *it = data;
+	unsigned long h = it->key ^ it->state;
+
+	for (unsigned long r = 0; r < rounds; r++)
+		h = (h ^ (h >> 29)) * 0xbf58476d1ce4e5b9UL;
+	sum += h;
+}
+
+static void visit_batch(void **batch, size_t n, void *private)
+{
+	(void)private;
+	for (size_t i = 0; i < n; i++)
+		visit(batch[i]);
+}
+
+static void report(const char *what, uint64_t start)
+{
+	char name[64];
+
+	snprintf(name, sizeof name, "%s w=%lu", what, rounds);
+	bench_report(name, NPASSES * NITEMS, bench_now_ns() - start);
+}
+
+static void run(struct list_head *l, struct flist_head *fl)
+{
+	void *buf[32];
+	uint64_t start;
+	unsigned long p;
+
+	start = bench_now_ns();
+	for (p = 0; p < NPASSES; p++)
+		list_for_each(l, struct item, it)
+			visit(it);
+	report("list_for_each", start);
+
+	start = bench_now_ns();
+	for (p = 0; p < NPASSES; p++)
+		list_for_each_prefetch(l, struct item, it, 4)
+			visit(it);
+	report("list_for_each_prefetch d=4", start);
+
+	start = bench_now_ns();
+	for (p = 0; p < NPASSES; p++)
+		list_for_each_prefetch(l, struct item, it, 16)
+			visit(it);
+	report("list_for_each_prefetch d=16", start);
+
+	start = bench_now_ns();
+	for (p = 0; p < NPASSES; p++)
+		list_for_each_batch(l, buf, 32, visit_batch, NULL);
+	report("list_for_each_batch k=32", start);
+
+	start = bench_now_ns();
+	for (p = 0; p < NPASSES; p++)
+		flist_for_each(fl, visit);
+	report("flist_for_each", start);
+
+	start = bench_now_ns();
+	for (p = 0; p < NPASSES; p++)
+		flist_for_each_prefetch(fl, struct item, it, 16)
+			visit(it);
+	report("flist_for_each_prefetch d=16", start);
+
+	start = bench_now_ns();
+	for (p = 0; p < NPASSES; p++)
+		flist_for_each_batch(fl, buf, 32, visit_batch, NULL);
+	report("flist_for_each_batch k=32", start);
+}
+
+int main(void)
+{
+	LIST_HEAD(l, struct item, l);
+	FLIST_HEAD(fl, struct item, fl);
+	struct item *items = malloc(NITEMS * sizeof *items);
+	unsigned long *order = malloc(NITEMS * sizeof *order);
+	unsigned long i;
+
+	if (!items || !order)
+		return 1;
+
+	/* link the items in a random order, so each step is a jump in memory */
+	pcg32_srandom(42u, 54u);
+	for (i = 0; i < NITEMS; i++) {
+		items[i].key = i;
+		items[i].state = i * 3;
+		order[i] = i;
+	}
+	bench_shuffle(order, NITEMS);
+	for (i = 0; i < NITEMS; i++) {
+		list_push_back(&l, &items[order[i]]);
+		flist_push_front(&fl, &items[order[i]]);
+	}
+
+	/*
+	 * with no work per element the walk is bound by the chain of misses
+	 * however it's done; with some, the prefetching walks overlap the
+	 * misses with the work.
+	 */
+	for (rounds = 0; rounds <= 64; rounds += 32)
+		run(&l, &fl);
+
+	bench_use(&sum);
+	free(items);
+	free(order);
+	return 0;
+}
@@ -0,0 +1,156 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file list_sort_bench.c
+ *
+ * \author Eric Mueller
+ *
+ * \brief Benchmark for list_sort and flist_sort versus copying the list into
+ * an array, qsorting it, and relinking.
+ */
+
+#include "bench.h"
+#include "flist.h"
+#include "list.h"
+#include "pcg_variants.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NITEMS (1UL << 20)
+
+struct item {
+	unsigned long key;
+	struct list l;
+	struct flist fl;
+};
+
+static long item_cmp(void *lhs, void *rhs)
+{
+	unsigned long l = ((struct item *)lhs)->key;
+	unsigned long r = ((struct item *)rhs)->key;
+	return (l > r) - (l < r);
+}
+
+static int item_qsort_cmp(const void *lhs, const void *rhs)
+{
+	return item_cmp(*(struct item **)lhs, *(struct item **)rhs);
+}
+
+/* the obvious way to sort a list without a list sort */
+static void qsort_list(struct list_head *hd, struct item **tmp)
+{
+	unsigned long i = 0, n = hd->length;
+
+	list_for_each(hd, struct item, it)
+		tmp[i++] = it;
+	qsort(tmp, n, sizeof *tmp, item_qsort_cmp);
+	hd->first = hd->last = NULL;
+	hd->length = 0;
+	for (i = 0; i < n; i++)
+		list_push_back(hd, tmp[i]);
+}
+
+static void qsort_flist(struct flist_head *hd, struct item **tmp)
+{
+	unsigned long i = 0, n = hd->length;
+
+	for (struct item *it = flist_first(hd); it; it = flist_next(hd, it))
+		tmp[i++] = it;
+	qsort(tmp, n, sizeof *tmp, item_qsort_cmp);
+	hd->first = NULL;
+	hd->length = 0;
+	for (i = n; i > 0; i--)
+		flist_push_front(hd, tmp[i - 1]);
+}
+
+/*
+ * link the items into both lists in order, which is a random walk through
+ * memory, so the lists look like ones that were built up over time.
+ */
+static void build(struct list_head *l, struct flist_head *fl,
+		  struct item *items, unsigned long *order)
+{
+	unsigned long i;
+
+	l->first = l->last = NULL;
+	l->length = 0;
+	fl->first = NULL;
+	fl->length = 0;
+	for (i = 0; i < NITEMS; i++)
+		list_push_back(l, &items[order[i]]);
+	for (i = NITEMS; i > 0; i--)
+		flist_push_front(fl, &items[order[i - 1]]);
+}
+
+int main(void)
+{
+	LIST_HEAD(l, struct item, l);
+	FLIST_HEAD(fl, struct item, fl);
+	static const char *const shapes[] = {"random", "sorted", "reversed"};
+	struct item *items = malloc(NITEMS * sizeof *items);
+	struct item **tmp = malloc(NITEMS * sizeof *tmp);
+	unsigned long *order = malloc(NITEMS * sizeof *order);
+	char name[64];
+	uint64_t start;
+	unsigned long i, s;
+
+	if (!items || !tmp || !order)
+		return 1;
+
+	pcg32_srandom(42u, 54u);
+	for (i = 0; i < NITEMS; i++)
+		order[i] = i;
+	bench_shuffle(order, NITEMS);
+
+	for (s = 0; s < sizeof shapes / sizeof shapes[0]; s++) {
+		/* key order relative to list order */
+		for (i = 0; i < NITEMS; i++) {
+			unsigned long pos = order[i];
+			items[pos].key = s == 0 ? pcg32_random()
+				: s == 1 ? i : NITEMS - i;
+		}
+
+		build(&l, &fl, items, order);
+		start = bench_now_ns();
+		list_sort(&l, item_cmp);
+		snprintf(name, sizeof name, "list_sort %s", shapes[s]);
+		bench_report(name, NITEMS, bench_now_ns() - start);
+
+		build(&l, &fl, items, order);
+		start = bench_now_ns();
+		qsort_list(&l, tmp);
+		snprintf(name, sizeof name, "list copy+qsort %s", shapes[s]);
+		bench_report(name, NITEMS, bench_now_ns() - start);
+
+		build(&l, &fl, items, order);
+		start = bench_now_ns();
+		flist_sort(&fl, item_cmp);
+		snprintf(name, sizeof name, "flist_sort %s", shapes[s]);
+		bench_report(name, NITEMS, bench_now_ns() - start);
+
+		build(&l, &fl, items, order);
+		start = bench_now_ns();
+		qsort_flist(&fl, tmp);
+		snprintf(name, sizeof name, "flist copy+qsort %s", shapes[s]);
+		bench_report(name, NITEMS, bench_now_ns() - start);
+		bench_use(list_first(&l));
+	}
+
+	free(items);
+	free(tmp);
+	free(order);
+	return 0;
+}
@@ -0,0 +1,152 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file shard_htable_bench.c
+ *
+ * \author Eric Mueller
+ *
+ * \brief Scalability benchmark for shard_htable.h: a mixed read/write
+ * workload over 1 to 8 threads, with one shard (i.e. a single locked table)
+ * versus many, plus batched versus single-key lookups.
+ */
+
+#include "bench.h"
+#include "shard_htable.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NKEYS (1UL << 20)
+#define OPS_PER_THREAD (1UL << 20)
+#define MAX_THREADS 8
+#define GET_BATCH 64
+
+/* per thread xorshift, so threads don't share the global rng */
+static uint64_t next_key(uint64_t *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+	return *state;
+}
+
+struct worker {
+	struct shard_htable *t;
+	unsigned id;
+	unsigned write_pct;
+	bool batch;
+};
+
+/* write_pct percent of operations are writes, split between insert/remove */
+static void *mixed(void *arg)
+{
+	struct worker *w = arg;
+	uint64_t rng = 42 + w->id;
+	unsigned long i;
+
+	for (i = 0; i < OPS_PER_THREAD; i++) {
+		uint64_t r = next_key(&rng);
+		uint64_t key = r % (2 * NKEYS);
+		unsigned op = (r >> 32) % 100;
+		const void *val;
+
+		if (op < w->write_pct / 2)
+			shard_htable_insert(w->t, key, w);
+		else if (op < w->write_pct)
+			bench_use(shard_htable_remove(w->t, key));
+		else
+			bench_use((void *)(uintptr_t)
+				  shard_htable_get(w->t, key, &val));
+	}
+	return NULL;
+}
+
+/* lookups only, one key at a time or GET_BATCH at a time */
+static void *lookups(void *arg)
+{
+	struct worker *w = arg;
+	uint64_t keys[GET_BATCH];
+	const void *vals[GET_BATCH];
+	uint64_t rng = 42 + w->id;
+	unsigned long i;
+	unsigned j;
+
+	for (i = 0; i < OPS_PER_THREAD; i += GET_BATCH) {
+		for (j = 0; j < GET_BATCH; j++)
+			keys[j] = next_key(&rng) % (2 * NKEYS);
+		if (w->batch) {
+			bench_use((void *)(uintptr_t)
+				  shard_htable_get_batch(w->t, keys, vals,
+							 GET_BATCH));
+		} else {
+			for (j = 0; j < GET_BATCH; j++)
+				bench_use((void *)(uintptr_t)
+					  shard_htable_get(w->t, keys[j],
+							   &vals[j]));
+		}
+	}
+	return NULL;
+}
+
+static void run(const char *what, void *(*fn)(void *), unsigned nshards,
+		unsigned nthreads, unsigned write_pct, bool batch)
+{
+	struct shard_htable t;
+	struct worker w[MAX_THREADS];
+	pthread_t tid[MAX_THREADS];
+	char name[96];
+	uint64_t start;
+	unsigned long k;
+	unsigned i;
+
+	if (!shard_htable_init(&t, nshards, 2 * NKEYS))
+		exit(1);
+	for (k = 0; k < NKEYS; k++)
+		shard_htable_insert(&t, 2 * k, &t);
+
+	start = bench_now_ns();
+	for (i = 0; i < nthreads; i++) {
+		w[i].t = &t;
+		w[i].id = i;
+		w[i].write_pct = write_pct;
+		w[i].batch = batch;
+		pthread_create(&tid[i], NULL, fn, &w[i]);
+	}
+	for (i = 0; i < nthreads; i++)
+		pthread_join(tid[i], NULL);
+	snprintf(name, sizeof name, "%s shards=%u threads=%u", what, nshards,
+		 nthreads);
+	bench_report(name, nthreads * OPS_PER_THREAD, bench_now_ns() - start);
+
+	shard_htable_destroy(&t);
+}
+
+int main(void)
+{
+	static const unsigned shards[] = {1, 64};
+	unsigned s, n;
+
+	for (s = 0; s < sizeof shards / sizeof shards[0]; s++)
+		for (n = 1; n <= MAX_THREADS; n *= 2)
+			run("mixed 90/10", mixed, shards[s], n, 10, false);
+	for (s = 0; s < sizeof shards / sizeof shards[0]; s++)
+		for (n = 1; n <= MAX_THREADS; n *= 2)
+			run("mixed 50/50", mixed, shards[s], n, 50, false);
+	for (n = 1; n <= MAX_THREADS; n *= 2) {
+		run("get", lookups, 64, n, 0, false);
+		run("get_batch", lookups, 64, n, 0, true);
+	}
+	return 0;
+}
@@ -0,0 +1,120 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file splay_tree_bench.c
+ *
+ * \author Eric Mueller
+ *
+ * \brief Lookup benchmark for splay_tree.h versus rbtree.h and avl_tree.h on
+ * uniform and Zipfian key distributions.
+ */
+
+#include "bench.h"
+#include "avl_tree.h"
+#include "rbtree.h"
+#include "splay_tree.h"
+#include "pcg_variants.h"
+#include "util.h"
+
+#include <stdlib.h>
+
+#define NKEYS (1UL << 18)
+#define NLOOKUPS (1UL << 22)
+
+struct item {
+	unsigned long key;
+	struct splay_node splay;
+	struct rb_node rb;
+	struct avl_node avl;
+};
+
+static long item_cmp(void *lhs, void *rhs)
+{
+	unsigned long l = ((struct item *)lhs)->key;
+	unsigned long r = ((struct item *)rhs)->key;
+	return (l > r) - (l < r);
+}
+
+static int item_avl_cmp(struct avl_node *lhs, struct avl_node *rhs)
+{
+	return item_cmp(container_of(lhs, struct item, avl),
+			container_of(rhs, struct item, avl));
+}
+
+int main(void)
+{
+	SPLAY_TREE(splay, item_cmp, struct item, splay);
+	RB_TREE(rb, item_cmp, struct item, rb);
+	AVL_TREE(avl, item_avl_cmp, struct item);
+	static const double skews[] = {0.0, 0.8, 0.99, 1.2};
+	struct item *items = malloc(NKEYS * sizeof *items);
+	unsigned long *order;
+	struct item probe;
+	char name[64];
+	uint64_t start;
+	unsigned long i, j;
+
+	pcg32_srandom(42u, 54u);
+
+	/* insert in random order so the splay tree doesn't start out as a path */
+	order = malloc(NKEYS * sizeof *order);
+	for (i = 0; i < NKEYS; i++) {
+		items[i].key = i;
+		order[i] = i;
+	}
+	bench_shuffle(order, NKEYS);
+	for (i = 0; i < NKEYS; i++) {
+		struct item *it = &items[order[i]];
+		splay_insert(&splay, it);
+		rb_insert(&rb, it);
+		avl_insert(&avl, &it->avl);
+	}
+	free(order);
+
+	for (i = 0; i < sizeof skews / sizeof skews[0]; i++) {
+		unsigned long *keys = bench_zipf(NKEYS, skews[i], NLOOKUPS);
+		if (!keys)
+			return 1;
+
+		start = bench_now_ns();
+		for (j = 0; j < NLOOKUPS; j++) {
+			probe.key = keys[j];
+			bench_use(splay_find(&splay, &probe));
+		}
+		snprintf(name, sizeof name, "splay_find zipf s=%.2f", skews[i]);
+		bench_report(name, NLOOKUPS, bench_now_ns() - start);
+
+		start = bench_now_ns();
+		for (j = 0; j < NLOOKUPS; j++) {
+			probe.key = keys[j];
+			bench_use(rb_find(&rb, &probe));
+		}
+		snprintf(name, sizeof name, "rb_find zipf s=%.2f", skews[i]);
+		bench_report(name, NLOOKUPS, bench_now_ns() - start);
+
+		start = bench_now_ns();
+		for (j = 0; j < NLOOKUPS; j++) {
+			probe.key = keys[j];
+			bench_use(avl_find(&avl, &probe.avl));
+		}
+		snprintf(name, sizeof name, "avl_find zipf s=%.2f", skews[i]);
+		bench_report(name, NLOOKUPS, bench_now_ns() - start);
+
+		free(keys);
+	}
+
+	free(items);
+	return 0;
+}
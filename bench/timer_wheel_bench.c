@@ -0,0 +1,274 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file timer_wheel_bench.c
+ *
+ * \author Eric Mueller
+ *
+ * \brief Benchmark for timer_wheel.h versus keeping timers in an rbtree or a
+ * binary heap, on a few mixes of arming, cancelling and expiry.
+ *
+ * \detail Time is simulated in milliseconds, and moves forward a millisecond
+ * every OPS_PER_MS operations, when each implementation collects what has
+ * expired. The heap can't remove an arbitrary element, so it does what heap
+ * based timer code usually does: cancelled and re-armed timers leave their
+ * old entries behind, and those are skipped when they reach the top.
+ */
+
+#include "bench.h"
+#include "binary_heap.h"
+#include "rbtree.h"
+#include "timer_wheel.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MAX_CONNS (1UL << 20)
+#define NOPS (1UL << 22)
+#define OPS_PER_MS (1000UL)
+
+/* bits of the heap keys used to tell apart the arms of a conn */
+#define GEN_BITS (20)
+
+struct conn {
+	unsigned long id;
+	bool armed;
+
+	/* for the wheel */
+	struct timer_wheel_timer timer;
+
+	/* for the tree */
+	struct rb_node node;
+	uint64_t expires;
+
+	/* for the heap: key of the conn's live heap entry */
+	unsigned long heap_key;
+	unsigned long gen;
+};
+
+/* ===== the implementations ===== */
+
+static struct timer_wheel wheel;
+static struct rb_head *tree;
+static struct binary_heap heap;
+
+static long conn_cmp(const struct conn *lhs, const struct conn *rhs)
+{
+	if (lhs->expires != rhs->expires)
+		return lhs->expires < rhs->expires ? -1 : 1;
+	return (long)lhs->id - (long)rhs->id;
+}
+
+static void wheel_arm(struct conn *c, uint64_t when)
+{
+	timer_wheel_arm(&wheel, &c->timer, when);
+}
+
+static void wheel_cancel(struct conn *c)
+{
+	timer_wheel_cancel(&wheel, &c->timer);
+}
+
+static unsigned long wheel_expire(uint64_t now)
+{
+	TIMER_WHEEL_LIST(expired);
+	struct timer_wheel_timer *t;
+	unsigned long n = 0;
+
+	timer_wheel_advance(&wheel, now, &expired);
+	while ((t = list_pop_front(&expired))) {
+		container_of(t, struct conn, timer)->armed = false;
+		n++;
+	}
+	return n;
+}
+
+static void tree_arm(struct conn *c, uint64_t when)
+{
+	if (c->armed)
+		rb_erase(tree, c);
+	c->expires = when;
+	rb_insert(tree, c);
+}
+
+static void tree_cancel(struct conn *c)
+{
+	rb_erase(tree, c);
+}
+
+static unsigned long tree_expire(uint64_t now)
+{
+	struct conn *c;
+	unsigned long n = 0;
+
+	while ((c = rb_first(tree)) && c->expires <= now) {
+		rb_erase(tree, c);
+		c->armed = false;
+		n++;
+	}
+	return n;
+}
+
+static void heap_arm(struct conn *c, uint64_t when)
+{
+	c->heap_key = when << GEN_BITS | (++c->gen & ((1UL << GEN_BITS) - 1));
+	if (!binary_heap_insert(&heap, c->heap_key, c))
+		exit(1);
+}
+
+static void heap_cancel(struct conn *c)
+{
+	c->heap_key = 0;
+}
+
+static unsigned long heap_expire(uint64_t now)
+{
+	unsigned long key, n = 0;
+	const void *val;
+
+	while (heap.end && BINARY_HEAP_PEEK(&heap).key >> GEN_BITS <= now) {
+		struct conn *c;
+
+		binary_heap_pop(&heap, &key, &val);
+		c = (struct conn *)val;
+		if (c->heap_key != key)
+			continue;
+		c->heap_key = 0;
+		c->armed = false;
+		n++;
+	}
+	return n;
+}
+
+struct impl {
+	const char *name;
+	void (*arm)(struct conn *c, uint64_t when);
+	void (*cancel)(struct conn *c);
+	unsigned long (*expire)(uint64_t now);
+};
+
+static const struct impl impls[] = {
+	{"timer_wheel", wheel_arm, wheel_cancel, wheel_expire},
+	{"rbtree", tree_arm, tree_cancel, tree_expire},
+	{"binary_heap", heap_arm, heap_cancel, heap_expire},
+};
+
+/* ===== the mixes ===== */
+
+enum action {
+	/* re-arm the timer every time the conn is touched */
+	REARM,
+	/* arm it if it isn't armed, cancel it if it is */
+	TOGGLE,
+	/* arm it if it isn't armed, and let it fire */
+	ARM_ONLY
+};
+
+struct mix {
+	const char *name;
+	unsigned long nconns;
+	enum action action;
+	uint64_t min_timeout;
+	uint64_t max_timeout;
+};
+
+static const struct mix mixes[] = {
+	/* idle timeouts, pushed back on every bit of traffic */
+	{"keepalive", MAX_CONNS, REARM, 30000, 31000},
+	/* request timeouts, mostly cancelled by a reply */
+	{"request", MAX_CONNS / 16, TOGGLE, 100, 1000},
+	/* every timer fires */
+	{"expire", MAX_CONNS, ARM_ONLY, 1, 1000},
+};
+
+static uint64_t rng_state;
+
+static uint64_t next_rand(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return rng_state;
+}
+
+static uint64_t timeout(const struct mix *m)
+{
+	return m->min_timeout
+		+ next_rand() % (m->max_timeout - m->min_timeout + 1);
+}
+
+static void run(const struct impl *impl, const struct mix *m,
+		struct conn *conns)
+{
+	RB_TREE(t, conn_cmp, struct conn, node);
+	unsigned long i, fired = 0;
+	uint64_t now = 0, start;
+	char name[96];
+
+	tree = &t;
+	if (!timer_wheel_init(&wheel, 1, 8, 4, now)
+	    || !binary_heap_init(&heap, 1024))
+		exit(1);
+	for (i = 0; i < m->nconns; i++) {
+		conns[i].id = i;
+		conns[i].armed = false;
+		conns[i].heap_key = 0;
+		conns[i].gen = 0;
+		timer_wheel_timer_init(&conns[i].timer);
+	}
+	rng_state = 88172645463325252ULL;
+
+	start = bench_now_ns();
+	/* every conn starts out with a timer */
+	for (i = 0; i < m->nconns; i++) {
+		impl->arm(&conns[i], now + timeout(m));
+		conns[i].armed = true;
+	}
+	for (i = 0; i < NOPS; i++) {
+		struct conn *c = &conns[next_rand() % m->nconns];
+
+		if (c->armed && m->action == TOGGLE) {
+			impl->cancel(c);
+			c->armed = false;
+		} else if (!c->armed || m->action == REARM) {
+			impl->arm(c, now + timeout(m));
+			c->armed = true;
+		}
+		if ((i + 1) % OPS_PER_MS == 0)
+			fired += impl->expire(++now);
+	}
+	snprintf(name, sizeof name, "%s %s conns=%lu fired=%.1f%%",
+		 impl->name, m->name, m->nconns,
+		 100.0 * fired / (NOPS + m->nconns));
+	bench_report(name, NOPS + m->nconns, bench_now_ns() - start);
+
+	timer_wheel_destroy(&wheel);
+	binary_heap_destroy(&heap);
+}
+
+int main(void)
+{
+	struct conn *conns = malloc(MAX_CONNS * sizeof *conns);
+	unsigned i, j;
+
+	if (!conns)
+		exit(1);
+	for (i = 0; i < sizeof mixes / sizeof mixes[0]; i++)
+		for (j = 0; j < sizeof impls / sizeof impls[0]; j++)
+			run(&impls[j], &mixes[i], conns);
+	free(conns);
+	return 0;
+}
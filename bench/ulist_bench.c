@@ -0,0 +1,106 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file ulist_bench.c
+ *
+ * \author Eric Mueller
+ *
+ * \brief Traversal benchmark for ulist.h versus list.h and flist.h, over
+ * objects scattered across the heap.
+ */
+
+#include "bench.h"
+#include "flist.h"
+#include "list.h"
+#include "ulist.h"
+#include "pcg_variants.h"
+
+#include <stdlib.h>
+
+#define NITEMS (1UL << 22)
+#define NPASSES 4
+
+struct item {
+	unsigned long key;
+	struct list l;
+	struct flist fl;
+};
+
+static unsigned long sum;
+
+static void add_key(void *data)
+{
+	sum += ((struct item *)data)->key;
+}
+
+int main(void)
+{
+	LIST_HEAD(l, struct item, l);
+	FLIST_HEAD(fl, struct item, fl);
+	ULIST(ul);
+	struct item *items = malloc(NITEMS * sizeof *items);
+	unsigned long *order = malloc(NITEMS * sizeof *order);
+	uint64_t start;
+	unsigned long i, p;
+
+	if (!items || !order)
+		return 1;
+
+	/* link the items in a random order, so each step is a jump in memory */
+	pcg32_srandom(42u, 54u);
+	for (i = 0; i < NITEMS; i++) {
+		items[i].key = i;
+		order[i] = i;
+	}
+	bench_shuffle(order, NITEMS);
+	for (i = 0; i < NITEMS; i++) {
+		struct item *it = &items[order[i]];
+		list_push_back(&l, it);
+		flist_push_front(&fl, it);
+		if (!ulist_push_back(&ul, it))
+			return 1;
+	}
+
+	start = bench_now_ns();
+	for (p = 0; p < NPASSES; p++)
+		list_for_each(&l, struct item, it)
+			sum += it->key;
+	bench_report("list_for_each", NPASSES * NITEMS, bench_now_ns() - start);
+
+	start = bench_now_ns();
+	for (p = 0; p < NPASSES; p++)
+		flist_for_each(&fl, add_key);
+	bench_report("flist_for_each", NPASSES * NITEMS, bench_now_ns() - start);
+
+	start = bench_now_ns();
+	for (p = 0; p < NPASSES; p++)
+		ulist_for_each(&ul, struct item, it)
+			sum += it->key;
+	bench_report("ulist_for_each", NPASSES * NITEMS, bench_now_ns() - start);
+
+	/* the pointers alone, which is what a scan over handles looks like */
+	start = bench_now_ns();
+	for (p = 0; p < NPASSES; p++)
+		ulist_for_each(&ul, struct item, it)
+			sum += (uintptr_t)it;
+	bench_report("ulist_for_each (pointers only)", NPASSES * NITEMS,
+		     bench_now_ns() - start);
+
+	bench_use(&sum);
+	ulist_destroy(&ul);
+	free(items);
+	free(order);
+	return 0;
+}
@@ -0,0 +1,93 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file bigmem.h
+ *
+ * \author Eric Mueller
+ *
+ * \brief Header file for allocation options for very large tables.
+ *
+ * \detail A hash table or filter of a few GB that is probed at random
+ * spends most of its time on TLB misses if it sits on 4K pages, since
+ * nearly every probe lands on a page whose translation isn't cached. On a
+ * machine with several NUMA nodes it has a second problem: whichever thread
+ * first touches a page decides which node it lives on, and when one thread
+ * zeroes the whole table, it all ends up on that thread's node.
+ *
+ * The structures that take a struct bigmem_opts (cuckoo_htable.h and
+ * bloom.h) use it to allocate their big arrays. An all zero struct, which
+ * is what their declaration macros give you, means a plain heap allocation
+ * just like before. Anything else gets the memory straight from mmap and:
+ *
+ *   - with hugepages, backs it with huge pages: explicitly reserved ones
+ *     (MAP_HUGETLB) if there are any, transparent ones otherwise.
+ *   - with a policy, places it on NUMA nodes with mbind: interleaved over
+ *     every node, on one node, or on the node of the thread that touches it.
+ *   - with prefault_threads, touches every page up front from that many
+ *     threads, so the cost of faulting in (and zeroing) the pages is paid at
+ *     allocation and spread over several cores, instead of being paid by the
+ *     first probes.
+ *
+ * Placement is best effort: on a kernel or machine without NUMA support, the
+ * policy is ignored.
+ */
+
+#ifndef STRUCT_BIGMEM_H
+#define STRUCT_BIGMEM_H 1
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/** where to put the pages of an allocation */
+enum bigmem_policy {
+	/** wherever the kernel's default policy puts them */
+	BIGMEM_POLICY_DEFAULT = 0,
+	/** on the node of the thread that first touches each page */
+	BIGMEM_POLICY_LOCAL,
+	/** spread round robin over every node */
+	BIGMEM_POLICY_INTERLEAVE,
+	/** all on node 'node' */
+	BIGMEM_POLICY_BIND
+};
+
+/** allocation options. zero initialize for a plain heap allocation */
+struct bigmem_opts {
+	bool hugepages;
+	enum bigmem_policy policy;
+	/** node for BIGMEM_POLICY_BIND */
+	unsigned node;
+	/** threads to fault the memory in with, 0 to leave it to first use */
+	unsigned prefault_threads;
+};
+
+/**
+ * \brief Allocate zeroed memory, aligned to at least a cacheline.
+ *
+ * \param size  Bytes to allocate.
+ * \param opts  How to allocate it. NULL is the same as all zeros.
+ * \return The memory, or NULL on failure.
+ */
+extern void *bigmem_alloc(size_t size, const struct bigmem_opts *opts);
+
+/**
+ * \brief Free memory from bigmem_alloc.
+ *
+ * \param mem   The memory. May be NULL.
+ * \param size  The size it was allocated with.
+ * \param opts  The options it was allocated with.
+ */
+extern void bigmem_free(void *mem, size_t size, const struct bigmem_opts *opts);
+
+#endif /* STRUCT_BIGMEM_H */
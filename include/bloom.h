@@ -62,6 +62,8 @@
 #ifndef STRUCT_BLOOM_H
 #define STRUCT_BLOOM_H 1
 
+#include "bigmem.h"
+
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
@@ -88,6 +90,9 @@ struct bloom {
 
         /** number of bits we actually use in the bits array */
 	unsigned long nbits;
+
+        /** how to allocate the bits array, see bigmem.h. set before init */
+	struct bigmem_opts mem;
 };
 
 /*! lower bound on allowable false positive probability parameter */
@@ -107,7 +112,8 @@ struct bloom {
 			.bsize = 0,				\
 			.nhash = 0,				\
 			.p = (prob),				\
-			.nbits = 0};
+			.nbits = 0,				\
+			.mem = {0}};
 
 /**
  * \brief Declare a bloom filter.
@@ -0,0 +1,233 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file clock_cache.h
+ *
+ * \author Eric Mueller
+ *
+ * \brief Header file for a thread safe cache with CLOCK eviction.
+ *
+ * \detail A cache maps 64 bit keys to values, each with a 'charge' (its size
+ * in bytes, or 1 to count entries), and evicts entries when the total charge
+ * goes over a capacity. It is split into shards like shard_htable.h, each
+ * holding a swiss_htable from keys to entries and a list of its entries
+ * arranged as a ring for the CLOCK algorithm.
+ *
+ * CLOCK approximates LRU without reordering anything on a hit: a hit just
+ * sets the entry's referenced bit, which is why lookups only need a shared
+ * (read) lock. To make room, a hand sweeps around the ring clearing
+ * referenced bits, and evicts the first entry whose bit was already clear,
+ * i.e. that wasn't used since the hand last went by. New entries go just
+ * behind the hand, so they get a full sweep before they can be evicted.
+ *
+ * Values handed out by the cache are reference counted so that one thread
+ * can't have a value evicted (and freed) out from under another.
+ * clock_cache_lookup returns a handle that pins the entry, and
+ * clock_cache_release drops it. The eviction callback is called once for
+ * each value, when it has left the cache and the last handle on it has been
+ * released, and never with a shard lock held.
+ *
+ * To use a cache, declare a struct clock_cache and call clock_cache_init,
+ * ex:
+ *
+ *     struct clock_cache pages;
+ *     clock_cache_init(&pages, 16, 64 << 20, free_page, NULL);
+ *
+ * When finished, release every handle and call clock_cache_destroy, which
+ * must not race with anything.
+ */
+
+#ifndef STRUCT_CLOCK_CACHE_H
+#define STRUCT_CLOCK_CACHE_H 1
+
+#include "list.h"
+#include "swiss_htable.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* this definition isn't portable but it's good enough for now */
+#define CLOCK_CACHE_CACHELINE (64)
+
+/** maximum number of shards */
+#define CLOCK_CACHE_MAX_SHARDS (256U)
+
+/**
+ * \brief Called when a value leaves the cache for good.
+ *
+ * \param key      The value's key.
+ * \param val      The value.
+ * \param private  The private argument given to clock_cache_init.
+ */
+typedef void (*clock_cache_evict_t)(uint64_t key, const void *val,
+				    void *private);
+
+/** an entry in the cache, and a handle on it. don't touch the members */
+struct clock_cache_entry {
+	struct list link;
+	uint64_t key;
+	const void *val;
+	size_t charge;
+
+	/* handles, plus one while the entry is in the cache */
+	unsigned long refs;
+
+	/* set on every hit, cleared by the clock hand */
+	bool referenced;
+};
+
+/** a shard. don't touch the members */
+struct clock_cache_shard {
+	pthread_rwlock_t lock;
+
+	/* keys to struct clock_cache_entry *'s */
+	struct swiss_head table;
+
+	/* all entries, in the order the hand visits them */
+	struct list_head ring;
+
+	/* next entry to look at, or NULL to start at the front of the ring */
+	struct clock_cache_entry *hand;
+
+	size_t used;
+	size_t capacity;
+
+	unsigned long stat_hits;
+	unsigned long stat_misses;
+	unsigned long stat_inserts;
+	unsigned long stat_evictions;
+} __attribute__((aligned(CLOCK_CACHE_CACHELINE)));
+
+/** cache. don't touch the members, use the api */
+struct clock_cache {
+	/** 1 << shard_bits shards */
+	struct clock_cache_shard *shards;
+	unsigned shard_bits;
+
+	/** seed for the hash that picks a key's shard */
+	uint64_t seed;
+
+	clock_cache_evict_t evict;
+	void *private;
+};
+
+/** counters, summed over all shards */
+struct clock_cache_stats {
+	/** lookups that found their key */
+	unsigned long hits;
+
+	/** lookups that didn't */
+	unsigned long misses;
+
+	/** successful calls to clock_cache_insert */
+	unsigned long inserts;
+
+	/** entries pushed out by the clock hand to make room */
+	unsigned long evictions;
+
+	/** number of entries in the cache */
+	unsigned long entries;
+
+	/** sum of the charges of the entries in the cache */
+	size_t used;
+};
+
+/**
+ * \brief Initialize a cache.
+ *
+ * \param c         The cache to initialize.
+ * \param nshards   Number of shards, rounded up to a power of two and down to
+ *                  CLOCK_CACHE_MAX_SHARDS. Each shard gets an equal part of
+ *                  the capacity and evicts on its own, so with small
+ *                  capacities use fewer shards.
+ * \param capacity  Maximum total charge of the entries in the cache.
+ * \param evict     Called on each value when it leaves the cache, or NULL.
+ * \param private   Passed to evict.
+ * \return true on success or false if allocation failed.
+ */
+extern bool clock_cache_init(struct clock_cache *c, unsigned nshards,
+			     size_t capacity, clock_cache_evict_t evict,
+			     void *private);
+
+/**
+ * \brief Remove every entry from a cache, calling the eviction callback on
+ * each, and free all memory associated with it. No handles may be held.
+ */
+extern void clock_cache_destroy(struct clock_cache *c);
+
+/**
+ * \brief Insert a value into a cache, evicting other entries if the cache is
+ * full.
+ *
+ * \param c       The cache.
+ * \param key     The key to insert.
+ * \param val     The value to insert.
+ * \param charge  The value's share of the cache's capacity.
+ * \return true on success, or false if allocation failed or the charge is
+ * more than a shard can hold, in which case val isn't inserted and the
+ * eviction callback is not called on it. If the key was already in the
+ * cache, its old value is replaced (and evicted), even if the insert fails.
+ * \detail Entries that have handles on them are never evicted, so the cache
+ * can go over its capacity while many entries are pinned.
+ */
+extern bool clock_cache_insert(struct clock_cache *c, uint64_t key,
+			       const void *val, size_t charge);
+
+/**
+ * \brief Look up a key, and pin its entry.
+ *
+ * \param c    The cache.
+ * \param key  The key to look up.
+ * \return A handle on the key's entry, which must be given back with
+ * clock_cache_release, or NULL if the key isn't in the cache.
+ */
+extern struct clock_cache_entry *clock_cache_lookup(struct clock_cache *c,
+						    uint64_t key);
+
+/**
+ * \brief Release a handle returned by clock_cache_lookup.
+ */
+extern void clock_cache_release(struct clock_cache *c,
+				struct clock_cache_entry *e);
+
+/**
+ * \brief Get the value of a pinned entry.
+ */
+static inline const void *clock_cache_value(const struct clock_cache_entry *e)
+{
+	return e->val;
+}
+
+/**
+ * \brief Remove a key from a cache.
+ *
+ * \param c    The cache.
+ * \param key  The key to remove.
+ * \return true if the key was in the cache, false if not.
+ * \detail The eviction callback is called on the value once any handles on
+ * it are released.
+ */
+extern bool clock_cache_remove(struct clock_cache *c, uint64_t key);
+
+/**
+ * \brief Get a cache's counters. Operations running concurrently may or may
+ * not be counted.
+ */
+extern void clock_cache_stats(struct clock_cache *c,
+			      struct clock_cache_stats *out);
+
+#endif /* STRUCT_CLOCK_CACHE_H */
@@ -0,0 +1,191 @@
+/*
+ * Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file count_min.h
+ *
+ * \author Eric Mueller
+ *
+ * \brief Header file for a Count-Min sketch.
+ *
+ * \detail A Count-Min sketch estimates how many times each key has been
+ * added to it, in space that doesn't depend on the number of distinct keys.
+ * It is a table of depth rows of width counters. Adding a key bumps one
+ * counter in each row, picked by a hash of the key, and querying a key
+ * returns the smallest of its counters. Estimates are never too low, and with
+ * probability at least 1 - delta they are too high by at most eps times the
+ * total of all counts added, where width = e / eps and depth = ln(1 / delta).
+ *
+ *     http://dimacs.rutgers.edu/~graham/pubs/papers/cmencyc.pdf
+ *
+ * Adds use the 'conservative update': a counter is only raised as far as the
+ * new estimate for the key, so counters shared with other keys grow more
+ * slowly, which makes estimates tighter without breaking the guarantee.
+ *
+ * Each row is a contiguous array of 32 bit counters whose width is a power of
+ * two and a multiple of a cache line, so merging two sketches is a
+ * straight line loop the compiler vectorizes. Counters saturate instead of
+ * wrapping.
+ *
+ * The API follows bloom.h. Declare a sketch with the COUNT_MIN_SKETCH macro,
+ * ex:
+ *
+ *     COUNT_MIN_SKETCH(my_sketch, 0.001, 0.01);
+ *
+ * then call count_min_init to allocate it. Use any combination of
+ * count_min_add and count_min_query, and count_min_union to combine sketches
+ * (e.g. one per shard or per thread) that were set up with
+ * count_min_init_from. When you are done with the sketch, call
+ * count_min_destroy to free all memory associated with it.
+ *
+ * Synchronization is left to the caller.
+ */
+
+#ifndef STRUCT_COUNT_MIN_H
+#define STRUCT_COUNT_MIN_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/** count-min sketch */
+struct count_min {
+	/** depth rows of width counters, one row after another */
+	uint32_t *counters;
+
+	/** seed for the hash function */
+	uint64_t seed;
+
+	/** number of counters per row, a power of two */
+	unsigned long width;
+
+	/** number of rows */
+	unsigned long depth;
+
+	/** sum of all counts added */
+	uint64_t total;
+
+	/** target error, as a fraction of total */
+	double eps;
+
+	/** target probability of missing the error target */
+	double delta;
+};
+
+/*! lower bound on allowable eps */
+#define COUNT_MIN_EPS_MIN (1e-7)
+/*! upper bound on allowable eps */
+#define COUNT_MIN_EPS_MAX (1e-1)
+/*! lower bound on allowable delta */
+#define COUNT_MIN_DELTA_MIN (1e-9)
+/*! upper bound on allowable delta */
+#define COUNT_MIN_DELTA_MAX (5e-1)
+
+/**
+ * \brief Initialize an already allocated sketch. See COUNT_MIN_SKETCH.
+ */
+#define COUNT_MIN_SKETCH_INITIALIZER(_eps, _delta) (struct count_min) {	\
+			.counters = NULL,				\
+			.seed = 0,					\
+			.width = 0,					\
+			.depth = 0,					\
+			.total = 0,					\
+			.eps = (_eps),					\
+			.delta = (_delta)}
+
+/**
+ * \brief Declare a count-min sketch.
+ * \param name   (token) name of the sketch to declare
+ * \param eps    Target error, as a fraction of the total of all counts. Must
+ * be between COUNT_MIN_EPS_MIN and COUNT_MIN_EPS_MAX.
+ * \param delta  Target probability that an estimate is off by more than eps.
+ * Must be between COUNT_MIN_DELTA_MIN and COUNT_MIN_DELTA_MAX.
+ * \detail This does not initialize the structure. That is done by
+ * count_min_init.
+ */
+#define COUNT_MIN_SKETCH(name, eps, delta)				\
+	struct count_min name = COUNT_MIN_SKETCH_INITIALIZER(eps, delta)
+
+/**
+ * \brief Initialize a sketch.
+ * \param cm  The sketch to initialize.
+ * \return true on success, false on allocation failure.
+ */
+extern bool count_min_init(struct count_min *cm);
+
+/**
+ * \brief Initialize a sketch with the same size and seed as another sketch.
+ * \param cm     The sketch to initialize. Every field is clobbered.
+ * \param other  The sketch to copy the class of.
+ * \return true on success, false on allocation failure.
+ *
+ * \detail In order to take the union of two sketches, they must have the same
+ * seed and the same size.
+ */
+extern bool count_min_init_from(struct count_min *restrict cm,
+				const struct count_min *restrict other);
+
+/**
+ * \brief Determine if two sketches are in the same 'class', i.e. have the
+ * same size and seed. In order to take the union of two sketches, this must
+ * return true.
+ */
+extern bool count_min_same_class(const struct count_min *cm0,
+				 const struct count_min *cm1);
+
+/**
+ * \brief Destroy a sketch.
+ * \param cm  The sketch to destroy.
+ * \detail Frees all memory associated with @cm
+ */
+extern void count_min_destroy(struct count_min *cm);
+
+/**
+ * \brief Add to a key's count.
+ * \param cm     The sketch to add to.
+ * \param key    The key.
+ * \param count  How much to add.
+ */
+extern void count_min_add(struct count_min *cm, uint64_t key, uint32_t count);
+
+/**
+ * \brief Estimate a key's count.
+ * \param cm   The sketch to query.
+ * \param key  The key to query for.
+ * \return An estimate that is at least the key's real count.
+ */
+extern uint32_t count_min_query(const struct count_min *cm, uint64_t key);
+
+/**
+ * \brief Compute the union of two sketches into a third sketch.
+ *
+ * \param into  The new sketch will be put here. This sketch need not be
+ *              initialized, but if it is, it needs to be the same class as
+ *              cm0 and cm1.
+ * \param cm0   One sketch to merge. Unmodified. May be the same as into.
+ * \param cm1   The other sketch to merge. Unmodified.
+ * \return      True on success, false if memory allocation failed or if into,
+ *              cm0, and cm1 are not the same class.
+ *
+ * \detail Counters are summed, so estimates from into are at least the sum of
+ * a key's counts in cm0 and cm1. Merging sketches built with the
+ * conservative update gives estimates at least as tight as a single sketch
+ * that saw every count without it.
+ */
+extern bool count_min_union(struct count_min *into,
+			    const struct count_min *cm0,
+			    const struct count_min *cm1);
+
+#endif /* STRUCT_COUNT_MIN_H */
@@ -27,44 +27,70 @@
  * then call cuckoo_htable_init to do the initial memory allocations. At that
  * point the full hash table api can be used. When finished with the table,
  * call cuckoo_htable_destroy to free all memory associated with the table.
+ * A table can also live in a file that outlives the process, see
+ * cuckoo_htable_create_file.
  *
  * ** TODO DISCUSS API COMPLEXITY **
  *
  * Synchronization is left to the caller.
  *
  * IMPORTANT NOTE: Because of the collision resolution algorithm used by this
- * hash table, it can not handle multiple insertions of the same key.
+ * hash table, it can not handle multiple insertions of the same key. Use
+ * the multimap functions (cuckoo_htable_multi_insert and friends) to keep
+ * several values per key.
  */
 
 #ifndef STRUCT_CUCKOO_HTABLE_H
 #define STRUCT_CUCKOO_HTABLE_H
 
+#include "bigmem.h"
+
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 /*
  * number of arrays and hash functions to use (this is a trait specific to
- * cuckoo hashing).
+ * cuckoo hashing). cuckoo_htable_init uses CUCKOO_HTABLE_NTABLES, and
+ * cuckoo_htable_init_ntables takes anything from CUCKOO_HTABLE_MIN_TABLES to
+ * CUCKOO_HTABLE_MAX_TABLES.
  */
 #define CUCKOO_HTABLE_NTABLES (2U)
+#define CUCKOO_HTABLE_MIN_TABLES (2U)
+#define CUCKOO_HTABLE_MAX_TABLES (4U)
 
 /* note -- you should not declare one of these yourself */
 struct cuckoo_tables {
         /* number of elements in each of the arrays in tables */
         unsigned long table_buckets;
 
+        /* number of arrays in use, i.e. nests each key has */
+        unsigned ntables;
+
         /* buckets where key-value pairs are stored */
-        struct cuckoo_bucket *tables[CUCKOO_HTABLE_NTABLES];
+        struct cuckoo_bucket *tables[CUCKOO_HTABLE_MAX_TABLES];
+
+        /* a byte per bucket, saying which of its slots are in use */
+        uint8_t *meta[CUCKOO_HTABLE_MAX_TABLES];
 
         /*
-         * seeds for the hash function. We need CUCKOO_HTABLE_NTABLES
-         * independent hash functions, but it is sufficient to use
-         * CUCKOO_HTABLE_NTABLES seeds for the same function, as long
-         * as we have good random seeds.
+         * seeds for the hash function. We need ntables independent hash
+         * functions, but it is sufficient to use ntables seeds for the
+         * same function, as long as we have good random seeds.
          */
-        uint64_t seeds[CUCKOO_HTABLE_NTABLES];
+        uint64_t seeds[CUCKOO_HTABLE_MAX_TABLES];
+
+        /*
+         * for a table kept in a file, the mapping of the whole file, which
+         * the arrays above point into. NULL otherwise.
+         */
+        void *map;
+        size_t map_size;
 };
 
+/* private state of a table kept in a file, see cuckoo_htable_create_file */
+struct cuckoo_file;
+
 struct cuckoo_head {
         /* number of key-value pairs currently contained in the table */
         unsigned long nentries;
@@ -75,11 +101,37 @@ struct cuckoo_head {
         /* the actual table */
         struct cuckoo_tables tables;
 
+        /*
+         * how to allocate the arrays, see bigmem.h. Zeroed by
+         * CUCKOO_HASH_TABLE; set it before cuckoo_htable_init and leave it
+         * alone afterwards.
+         */
+        struct bigmem_opts mem;
+
+        /* the file the table is kept in, or NULL for a table in memory */
+        struct cuckoo_file *file;
+
+        /*
+         * threads to move the keys with when the table grows, shrinks or
+         * is rehashed. 0 or 1 does it all on the calling thread. Tables
+         * too small to be worth it are always done on one thread.
+         */
+        unsigned resize_threads;
+
+        /*
+         * the table never shrinks on its own below this many buckets per
+         * array. cuckoo_htable_init sets it to the size it allocates; raise
+         * it afterwards to keep a table from shrinking at all.
+         */
+        unsigned long min_buckets;
+
         /*
          * some statistics to keep tabs on how many major internal
          * ops have occurred.
          *     - resizes keeps track of the number of times the table
          *       has been resized. Does not count resizes that failed.
+         *     - shrinks keeps track of how many of those resizes were
+         *       the table shrinking after removals.
          *     - rehashes keeps track of the number of times the table
          *       has needed to be rehashed. Note that if a rehash fails,
          *       this will not be incremented -- this is just the number of
@@ -90,6 +142,7 @@ struct cuckoo_head {
          *       that a single rehash has needed to restart.
          */
         unsigned long stat_resizes;
+        unsigned long stat_shrinks;
         unsigned long stat_rehashes;
         unsigned long stat_rehash_fails;
         unsigned long stat_rehash_fails_max;
@@ -106,8 +159,17 @@ struct cuckoo_head {
                 .capacity = 0,                          \
                 .tables = {                             \
                         .table_buckets = 0,             \
-                        .tables = {0}},                 \
+                        .ntables = 0,                   \
+                        .tables = {0},                  \
+                        .meta = {0},                    \
+                        .map = NULL,                    \
+                        .map_size = 0},                 \
+                .mem = {0},                             \
+                .file = NULL,                           \
+                .resize_threads = 0,                    \
+                .min_buckets = 0,                       \
                 .stat_resizes = 0,                      \
+                .stat_shrinks = 0,                      \
                 .stat_rehashes = 0,                     \
                 .stat_rehash_fails = 0,                 \
                 .stat_rehash_fails_max = 0};
@@ -120,10 +182,32 @@ struct cuckoo_head {
  * \return true on success or false if table allocation failed.
  */
 bool cuckoo_htable_init(struct cuckoo_head *head, unsigned long capacity);
+
+/**
+ * \brief Initialize a hash table with a given number of hash functions.
+ *
+ * \param head      Pointer to the hash table to initialize.
+ * \param capacity  How many insertions to allocate space for (upper bound).
+ * \param ntables   Number of arrays and hash functions, from
+ *                  CUCKOO_HTABLE_MIN_TABLES to CUCKOO_HTABLE_MAX_TABLES.
+ * \return true on success or false if table allocation failed or ntables is
+ *         out of range.
+ *
+ * \detail Every key can live in one bucket of each array, so lookups and
+ * removals probe ntables buckets (all at once, so the cache misses overlap),
+ * and in exchange the table can be filled much fuller before it has to grow:
+ * about 93% of its slots with 2 arrays, 97% with 3 and 98% with 4. Use 3 or
+ * 4 when memory matters more than a cache miss per lookup.
+ */
+bool cuckoo_htable_init_ntables(struct cuckoo_head *head,
+                                unsigned long capacity, unsigned ntables);
  
 /**
  * \brief Deallocate any memory that was allocated by the hash table.
  * \param head  Pointer to the hash table to deallocate.
+ *
+ * \detail A table in a file is checkpointed and detached from, and the file
+ * is left for cuckoo_htable_open_file.
  */
 void cuckoo_htable_destroy(struct cuckoo_head *head);
 
@@ -132,9 +216,7 @@ void cuckoo_htable_destroy(struct cuckoo_head *head);
  *
  * \param head  Pointer to the hash table to insert into.
  * \param key   Key to insert.
- * \param value Value to insert along with the key. MUST be aligned on at least
- *              a 4 byte boundary, otherwise an assertion will trip and your
- *              program will crash
+ * \param value Value to insert along with the key.
  * \return true if the insertion succeeded, false if the table is full. Note
  *         that if the inserted key already exists, insert will return true
  *         without modifying the table.
@@ -144,6 +226,41 @@ void cuckoo_htable_destroy(struct cuckoo_head *head);
 bool cuckoo_htable_insert(struct cuckoo_head *head, uint64_t key,
                           void const *value);
 
+/**
+ * \brief Insert an element into a table, or replace the value of a key that
+ * is already in it.
+ *
+ * \param head  Pointer to the hash table to insert into.
+ * \param key   Key to insert.
+ * \param value Value to insert along with the key.
+ * \param old   If the key was already in the table, its old value is put
+ *              here. Not modified otherwise. May be NULL.
+ * \return true if the insertion succeeded, false if the table is full.
+ *
+ * \detail The key is hashed and its buckets are looked up once, for both the
+ * search and the insertion, so this is much cheaper than a remove followed
+ * by an insert.
+ */
+bool cuckoo_htable_upsert(struct cuckoo_head *head, uint64_t key,
+                          void const *value, void const **old);
+
+/**
+ * \brief Get the value corresponding to a key, inserting the key with a given
+ * value if it isn't in the table.
+ *
+ * \param head  Pointer to the hash table.
+ * \param key   Key to look up or insert.
+ * \param value Value to insert if the key isn't found.
+ * \param out   The key's value is put here: the one already in the table, or
+ *              value if it was just inserted.
+ * \return true on success, false if the key wasn't found and the table is
+ *         full, in which case out is not modified.
+ *
+ * \detail Like cuckoo_htable_upsert, this looks up the key's buckets once.
+ */
+bool cuckoo_htable_get_or_insert(struct cuckoo_head *head, uint64_t key,
+                                 void const *value, void const **out);
+
 /**
  * \brief Query the existence of an element in a table.
  *
@@ -160,6 +277,12 @@ bool cuckoo_htable_exists(struct cuckoo_head const *head, uint64_t key);
  * \param key   Key to remove.
  *
  * \return The value that was removed.
+ *
+ * \detail When removals leave the table less than an eighth full, it
+ * shrinks to a size it fills a quarter to a half of, though never below
+ * head->min_buckets. The gap between that and the load at which it grows
+ * keeps a table that goes back and forth around one size from being
+ * resized over and over.
  */
 const void *cuckoo_htable_remove(struct cuckoo_head *head, uint64_t key);
 
@@ -187,4 +310,195 @@ bool cuckoo_htable_get(struct cuckoo_head const *head,
  */
 bool cuckoo_htable_resize(struct cuckoo_head *head, bool grow);
 
+/*
+ * The same operations with plain 64 bit integer values in place of
+ * pointers, so small values (counters, ids...) can be kept in the table
+ * itself instead of being allocated for the table to point to, and a lookup
+ * doesn't have to follow a pointer to get at them. Both kinds of values live
+ * in the same slots, so a table should be used with one api or the other.
+ */
+
+/** \brief cuckoo_htable_insert with an integer value. */
+bool cuckoo_htable_insert_u64(struct cuckoo_head *head, uint64_t key,
+                              uint64_t value);
+
+/** \brief cuckoo_htable_upsert with integer values. old may be NULL. */
+bool cuckoo_htable_upsert_u64(struct cuckoo_head *head, uint64_t key,
+                              uint64_t value, uint64_t *old);
+
+/** \brief cuckoo_htable_get_or_insert with integer values. */
+bool cuckoo_htable_get_or_insert_u64(struct cuckoo_head *head, uint64_t key,
+                                     uint64_t value, uint64_t *out);
+
+/**
+ * \brief Remove an element from the table.
+ *
+ * \param head  Pointer to hash table to remove from.
+ * \param key   Key to remove.
+ * \param out   The value that was removed is put here.
+ * \return true if the key was found and removed, false if not.
+ */
+bool cuckoo_htable_remove_u64(struct cuckoo_head *head, uint64_t key,
+                              uint64_t *out);
+
+/** \brief cuckoo_htable_get with an integer value. */
+bool cuckoo_htable_get_u64(struct cuckoo_head const *head, uint64_t key,
+                           uint64_t *out);
+
+/*
+ * A table can also be used as a multimap, where a key has any number of
+ * values. Each key still has a single slot, so looking a key up costs the
+ * same as in a plain table. A key with one value keeps it in the slot; a
+ * key with more has them in a separately allocated block the slot points
+ * to, which is one more cache miss for those keys only.
+ *
+ * A multimap must only be used through the functions below, other than
+ * cuckoo_htable_init, cuckoo_htable_exists and cuckoo_htable_resize, and
+ * can't be kept in a file. Values are at most CUCKOO_HTABLE_MULTI_MAX, since
+ * a bit of each slot says which kind of slot it is. nentries counts keys,
+ * not values, and the values of a key are in no particular order.
+ */
+
+/** largest value a multimap can hold */
+#define CUCKOO_HTABLE_MULTI_MAX (UINT64_MAX >> 1)
+
+/** iterator over the values of one key of a multimap */
+struct cuckoo_multi_iter {
+        const uint64_t *vals;
+        uint64_t single;
+        unsigned long count;
+        unsigned long pos;
+};
+
+/**
+ * \brief Add a value to a key of a multimap, adding the key if it isn't in
+ * the table yet.
+ *
+ * \param head   The multimap.
+ * \param key    The key.
+ * \param value  The value. The same value can be added to a key any number
+ *               of times.
+ * \return true on success, false if the value is larger than
+ *         CUCKOO_HTABLE_MULTI_MAX or memory allocation failed.
+ */
+bool cuckoo_htable_multi_insert(struct cuckoo_head *head, uint64_t key,
+                                uint64_t value);
+
+/**
+ * \brief Get the values of a key of a multimap.
+ *
+ * \param head  The multimap.
+ * \param key   The key.
+ * \param out   Up to max values are put here.
+ * \param max   Size of out.
+ * \return The number of values the key has, which may be more than max, or
+ *         0 if it isn't in the table.
+ */
+unsigned long cuckoo_htable_get_all(struct cuckoo_head const *head,
+                                    uint64_t key, uint64_t *out,
+                                    unsigned long max);
+
+/** \brief Get any one value of a key of a multimap. */
+bool cuckoo_htable_multi_get(struct cuckoo_head const *head, uint64_t key,
+                             uint64_t *out);
+
+/**
+ * \brief Remove one copy of a value from a key of a multimap. The key goes
+ * when its last value does.
+ *
+ * \return true if the key had the value, false if not.
+ */
+bool cuckoo_htable_multi_remove(struct cuckoo_head *head, uint64_t key,
+                                uint64_t value);
+
+/**
+ * \brief Remove a key and all its values from a multimap.
+ *
+ * \return The number of values the key had, 0 if it wasn't in the table.
+ */
+unsigned long cuckoo_htable_multi_remove_all(struct cuckoo_head *head,
+                                             uint64_t key);
+
+/**
+ * \brief Start iterating over the values of a key of a multimap. The
+ * iterator is good until that key is next changed.
+ */
+void cuckoo_htable_multi_iter_init(struct cuckoo_head const *head,
+                                   uint64_t key,
+                                   struct cuckoo_multi_iter *iter);
+
+/**
+ * \brief Get the next value from an iterator.
+ *
+ * \return true if there was one, false if all values have been returned.
+ */
+bool cuckoo_htable_multi_iter_next(struct cuckoo_multi_iter *iter,
+                                   uint64_t *out);
+
+/** \brief Free the value blocks of a multimap, then destroy it. */
+void cuckoo_htable_multi_destroy(struct cuckoo_head *head);
+
+/*
+ * A table can also be kept in a file instead of in memory, so that a process
+ * can pick up where a previous one left off without rebuilding the table.
+ * The file is mapped into memory and the table is used in place, so every
+ * operation works the same on it, but only the integer value api makes
+ * sense for it: a pointer means nothing to the next process, while an
+ * offset into some other file does.
+ *
+ * The file has a header with a magic number, a format version and the
+ * table's geometry and hash seeds, followed by the arrays. It is in the
+ * byte order of the machine that wrote it. While a process has the table
+ * open, the file is locked with flock so a second one can't attach to it.
+ *
+ * Changes reach the file through the page cache, so if the process dies,
+ * nothing is lost. Only cuckoo_htable_checkpoint (and
+ * cuckoo_htable_destroy) make them durable against the machine going down,
+ * and changes made since the last checkpoint may have been written back
+ * only in part at that point. When the table grows, shrinks or has to be
+ * rehashed it is rebuilt in a new file next to the old one, which is
+ * checkpointed and then renamed over the old one.
+ *
+ * bigmem options don't apply to a table in a file.
+ */
+
+/**
+ * \brief Create a table in a file, replacing anything already there.
+ *
+ * \param head      Pointer to the hash table to initialize.
+ * \param path      The file to keep the table in.
+ * \param capacity  How many insertions to allocate space for (upper bound).
+ * \param ntables   Number of arrays and hash functions, as for
+ *                  cuckoo_htable_init_ntables.
+ * \return true on success, false if the file can't be created, locked or
+ *         mapped, or ntables is out of range.
+ */
+bool cuckoo_htable_create_file(struct cuckoo_head *head, const char *path,
+                               unsigned long capacity, unsigned ntables);
+
+/**
+ * \brief Attach to a table made by cuckoo_htable_create_file.
+ *
+ * \param head  Pointer to the hash table to initialize.
+ * \param path  The file the table is kept in.
+ * \return true on success, false if the file can't be opened, locked or
+ *         mapped, or doesn't hold a table in a format this version reads.
+ *
+ * \detail This takes constant time if the last process to use the table
+ * closed it with cuckoo_htable_destroy. If it didn't, the number of entries
+ * in the header may be stale, and it is recounted from the occupancy bytes,
+ * which means reading one byte per bucket.
+ */
+bool cuckoo_htable_open_file(struct cuckoo_head *head, const char *path);
+
+/**
+ * \brief Write all changes to a table in a file out to disk, and wait for
+ * them to get there.
+ *
+ * \param head  The table.
+ * \return true on success, false if msync fails or the table isn't in a
+ *         file.
+ */
+bool cuckoo_htable_checkpoint(struct cuckoo_head *head);
+
 #endif /* STRUCT_CUCKOO_HTABLE_H */
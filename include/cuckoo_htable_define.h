@@ -0,0 +1,358 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file cuckoo_htable_define.h
+ *
+ * \author Eric Mueller
+ *
+ * \brief Generator for cuckoo hash tables specialized to a key type, value
+ * type, hash function and equality function at compile time.
+ *
+ * \detail cuckoo_htable.h is one compiled table for every use, with 64 bit
+ * keys, a fixed hash, and every operation an out of line call. This header
+ * instead expands, in the file that uses it, a table with its own types and
+ * functions, all static inline, so the compiler can inline the hash and the
+ * comparison into each lookup and keys and values of any type are stored
+ * by value. For example
+ *
+ *   static inline uint64_t pt_hash(struct point p, uint64_t seed) {...}
+ *   static inline bool pt_eq(struct point a, struct point b) {...}
+ *
+ *   CUCKOO_HTABLE_DEFINE(pt_table, struct point, double, pt_hash, pt_eq)
+ *
+ * defines struct pt_table and pt_table_init, pt_table_destroy,
+ * pt_table_get, pt_table_lookup, pt_table_insert, pt_table_upsert and
+ * pt_table_remove, which work like their cuckoo_htable.h counterparts.
+ *
+ * hash_fn(key, seed) returns a uint64_t and must give independent hashes for
+ * different seeds; eq_fn(a, b) is true when two keys are equal. Either can be
+ * a function or a macro.
+ *
+ * The generated tables are kept simple so they stay small enough to inline:
+ * two arrays of 4 slot buckets, a power of two buckets each so a hash is
+ * masked rather than divided, growth by doubling at 90% load, a random walk
+ * to make room rather than a path search, and no shrinking, multimap, file
+ * or threading options. Use cuckoo_htable.h for those.
+ *
+ * Synchronization is left to the caller.
+ */
+
+#ifndef STRUCT_CUCKOO_HTABLE_DEFINE_H
+#define STRUCT_CUCKOO_HTABLE_DEFINE_H 1
+
+#include "bigmem.h"
+#include "util.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* slots per bucket, and the bits of a full bucket's byte */
+#define CUCKOO_DEFINE_SLOTS (4UL)
+#define CUCKOO_DEFINE_FULL ((1U << CUCKOO_DEFINE_SLOTS) - 1)
+
+/* longest random walk before the table is rebuilt bigger */
+#define CUCKOO_DEFINE_MAX_KICKS (128UL)
+
+/* load in percent at which the table grows */
+#define CUCKOO_DEFINE_MAX_LOAD (90UL)
+
+/**
+ * \brief Define a cuckoo hash table type and its functions.
+ *
+ * \param name     (token) Name of the table struct, and prefix of its
+ *                 functions.
+ * \param key_t    (type) Key type.
+ * \param val_t    (type) Value type.
+ * \param hash_fn  (function) uint64_t hash_fn(key_t key, uint64_t seed).
+ * \param eq_fn    (function) bool eq_fn(key_t a, key_t b).
+ */
+#define CUCKOO_HTABLE_DEFINE(name, key_t, val_t, hash_fn, eq_fn)	\
+									\
+struct name##_bucket {							\
+	key_t keys[CUCKOO_DEFINE_SLOTS];				\
+	val_t vals[CUCKOO_DEFINE_SLOTS];				\
+};									\
+									\
+struct name {								\
+	/* number of key-value pairs in the table */			\
+	unsigned long nentries;						\
+	/* number of slots in the table */				\
+	unsigned long capacity;						\
+	/* buckets per array, minus one. the count is a power of 2 */	\
+	unsigned long mask;						\
+	struct name##_bucket *buckets[2];				\
+	/* a byte per bucket, bit i set if slot i is in use */		\
+	uint8_t *meta[2];						\
+	uint64_t seeds[2];						\
+	/* state for picking keys to evict */				\
+	uint64_t rng;							\
+};									\
+									\
+/* where a key is, or would go */					\
+struct name##_pos {							\
+	unsigned long t;						\
+	unsigned long b;						\
+	unsigned long s;						\
+};									\
+									\
+static inline unsigned long name##_index(const struct name *h,		\
+					 unsigned long t, key_t key)	\
+{									\
+	return (unsigned long)hash_fn(key, h->seeds[t]) & h->mask;	\
+}									\
+									\
+/* find a key. false if it isn't in the table */			\
+static inline bool name##_find(const struct name *h, key_t key,		\
+			       struct name##_pos *pos)			\
+{									\
+	unsigned long t, s;						\
+									\
+	for (t = 0; t < 2; t++) {					\
+		unsigned long b = name##_index(h, t, key);		\
+		unsigned m = h->meta[t][b];				\
+									\
+		for (s = 0; s < CUCKOO_DEFINE_SLOTS; s++) {		\
+			if ((m >> s & 1)				\
+			    && eq_fn(h->buckets[t][b].keys[s], key)) {	\
+				pos->t = t;				\
+				pos->b = b;				\
+				pos->s = s;				\
+				return true;				\
+			}						\
+		}							\
+	}								\
+	return false;							\
+}									\
+									\
+static inline bool name##_alloc(struct name *h, unsigned long nbuckets)	\
+{									\
+	unsigned long t;						\
+									\
+	for (t = 0; t < 2; t++) {					\
+		h->seeds[t] = pcg64_random();				\
+		h->buckets[t] = bigmem_alloc(nbuckets			\
+					     * sizeof(struct name##_bucket), \
+					     NULL);			\
+		h->meta[t] = bigmem_alloc(nbuckets, NULL);		\
+	}								\
+	h->rng = pcg64_random() | 1;					\
+	h->mask = nbuckets - 1;						\
+	h->capacity = 2 * nbuckets * CUCKOO_DEFINE_SLOTS;		\
+	h->nentries = 0;						\
+	return h->buckets[0] && h->buckets[1] && h->meta[0] && h->meta[1]; \
+}									\
+									\
+static inline void name##_free(struct name *h)				\
+{									\
+	unsigned long nbuckets = h->mask + 1;				\
+	unsigned long t;						\
+									\
+	for (t = 0; t < 2; t++) {					\
+		bigmem_free(h->buckets[t],				\
+			    nbuckets * sizeof(struct name##_bucket), NULL); \
+		bigmem_free(h->meta[t], nbuckets, NULL);		\
+		h->buckets[t] = NULL;					\
+		h->meta[t] = NULL;					\
+	}								\
+}									\
+									\
+/*									\
+ * put a key that isn't in the table into it, evicting keys along a random \
+ * walk if both its buckets are full. If the walk gets too long, every swap \
+ * is undone and false is returned, leaving the table as it was.	\
+ */									\
+static inline bool name##_place(struct name *h, key_t key, val_t val)	\
+{									\
+	struct name##_pos path[CUCKOO_DEFINE_MAX_KICKS];		\
+	unsigned long t, b, s, k;					\
+	key_t tk;							\
+	val_t tv;							\
+									\
+	for (k = 0; k < CUCKOO_DEFINE_MAX_KICKS; k++) {			\
+		for (t = 0; t < 2; t++) {				\
+			unsigned empty;					\
+									\
+			b = name##_index(h, t, key);			\
+			empty = ~h->meta[t][b] & CUCKOO_DEFINE_FULL;	\
+			if (empty) {					\
+				s = __builtin_ctz(empty);		\
+				h->buckets[t][b].keys[s] = key;		\
+				h->buckets[t][b].vals[s] = val;		\
+				h->meta[t][b] |= 1U << s;		\
+				h->nentries++;				\
+				return true;				\
+			}						\
+		}							\
+									\
+		h->rng ^= h->rng << 13;					\
+		h->rng ^= h->rng >> 7;					\
+		h->rng ^= h->rng << 17;					\
+		t = h->rng & 1;						\
+		s = (h->rng >> 1) % CUCKOO_DEFINE_SLOTS;		\
+		b = name##_index(h, t, key);				\
+		path[k].t = t;						\
+		path[k].b = b;						\
+		path[k].s = s;						\
+		tk = h->buckets[t][b].keys[s];				\
+		tv = h->buckets[t][b].vals[s];				\
+		h->buckets[t][b].keys[s] = key;				\
+		h->buckets[t][b].vals[s] = val;				\
+		key = tk;						\
+		val = tv;						\
+	}								\
+									\
+	while (k-- > 0) {						\
+		struct name##_bucket *bkt = &h->buckets[path[k].t][path[k].b]; \
+									\
+		tk = bkt->keys[path[k].s];				\
+		tv = bkt->vals[path[k].s];				\
+		bkt->keys[path[k].s] = key;				\
+		bkt->vals[path[k].s] = val;				\
+		key = tk;						\
+		val = tv;						\
+	}								\
+	return false;							\
+}									\
+									\
+/*									\
+ * move everything into new arrays of nbuckets buckets with new seeds, plus \
+ * one more key that isn't in the table yet, doubling the size until it fits. \
+ */									\
+static inline bool name##_rebuild(struct name *h, unsigned long nbuckets, \
+				  key_t key, val_t val)			\
+{									\
+	struct name grown;						\
+	unsigned long t, b, s;						\
+									\
+	for (;;) {							\
+		if (!name##_alloc(&grown, nbuckets)) {			\
+			name##_free(&grown);				\
+			return false;					\
+		}							\
+		for (t = 0; t < 2; t++)					\
+			for (b = 0; b <= h->mask; b++)			\
+				for (s = 0; s < CUCKOO_DEFINE_SLOTS; s++) \
+					if ((h->meta[t][b] >> s & 1)	\
+					    && !name##_place(&grown,	\
+						h->buckets[t][b].keys[s], \
+						h->buckets[t][b].vals[s])) \
+						goto retry;		\
+		if (name##_place(&grown, key, val))			\
+			break;						\
+retry:									\
+		name##_free(&grown);					\
+		nbuckets *= 2;						\
+	}								\
+	name##_free(h);							\
+	*h = grown;							\
+	return true;							\
+}									\
+									\
+/* allocate a table for at least capacity keys */			\
+static inline bool name##_init(struct name *h, unsigned long capacity)	\
+{									\
+	unsigned long nbuckets = 1;					\
+									\
+	while (2 * nbuckets * CUCKOO_DEFINE_SLOTS < capacity)		\
+		nbuckets *= 2;						\
+	if (!seed_rng())						\
+		return false;						\
+	if (!name##_alloc(h, nbuckets)) {				\
+		name##_free(h);						\
+		return false;						\
+	}								\
+	return true;							\
+}									\
+									\
+static inline void name##_destroy(struct name *h)			\
+{									\
+	name##_free(h);							\
+	h->nentries = 0;						\
+	h->capacity = 0;						\
+}									\
+									\
+/* a pointer to the value of a key, or NULL if it isn't in the table */	\
+static inline val_t *name##_lookup(const struct name *h, key_t key)	\
+{									\
+	struct name##_pos p;						\
+									\
+	if (!name##_find(h, key, &p))					\
+		return NULL;						\
+	return &h->buckets[p.t][p.b].vals[p.s];				\
+}									\
+									\
+static inline bool name##_get(const struct name *h, key_t key, val_t *out) \
+{									\
+	val_t *v = name##_lookup(h, key);				\
+									\
+	if (!v)								\
+		return false;						\
+	*out = *v;							\
+	return true;							\
+}									\
+									\
+/*									\
+ * add a key that isn't in the table. false only if the table had to grow \
+ * and couldn't.							\
+ */									\
+static inline bool name##_add(struct name *h, key_t key, val_t val)	\
+{									\
+	/* not capacity / 100 * max, which is 0 for small tables */	\
+	if (h->nentries * 100 >= h->capacity * CUCKOO_DEFINE_MAX_LOAD)	\
+		return name##_rebuild(h, 2 * (h->mask + 1), key, val);	\
+	if (name##_place(h, key, val))					\
+		return true;						\
+	return name##_rebuild(h, 2 * (h->mask + 1), key, val);		\
+}									\
+									\
+/*									\
+ * insert a key, or replace its value if it's already there. false only if \
+ * the table had to grow and couldn't.					\
+ */									\
+static inline bool name##_upsert(struct name *h, key_t key, val_t val)	\
+{									\
+	struct name##_pos p;						\
+									\
+	if (name##_find(h, key, &p)) {					\
+		h->buckets[p.t][p.b].vals[p.s] = val;			\
+		return true;						\
+	}								\
+	return name##_add(h, key, val);					\
+}									\
+									\
+/* insert a key that isn't in the table yet. no-op if it is */		\
+static inline bool name##_insert(struct name *h, key_t key, val_t val)	\
+{									\
+	struct name##_pos p;						\
+									\
+	if (name##_find(h, key, &p))					\
+		return true;						\
+	return name##_add(h, key, val);					\
+}									\
+									\
+static inline bool name##_remove(struct name *h, key_t key, val_t *out)	\
+{									\
+	struct name##_pos p;						\
+									\
+	if (!name##_find(h, key, &p))					\
+		return false;						\
+	if (out)							\
+		*out = h->buckets[p.t][p.b].vals[p.s];			\
+	h->meta[p.t][p.b] &= ~(1U << p.s);				\
+	h->nentries--;							\
+	return true;							\
+}
+
+#endif /* STRUCT_CUCKOO_HTABLE_DEFINE_H */
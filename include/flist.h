@@ -38,7 +38,9 @@
  *     FLIST_HEAD(foo_list);
  *
  * Then use any combination of flist_push_front, flist_pop_front,
- * flist_insert_after, flist_splice, flist_for_each, and flist_for_each_range.
+ * flist_insert_after, flist_splice, flist_for_each, flist_for_each_range,
+ * flist_for_each_prefetch, flist_for_each_batch, flist_sort, and
+ * flist_merge.
  *
  * This should go without saying, but the list does no memory allocation.
  *
@@ -61,6 +63,9 @@ struct flist_head {
 	const unsigned long offset;
 };
 
+/** should return < 0 if lhs < rhs, 0 if lhs == rhs, and > 0 if lhs > rhs */
+typedef long (*flist_cmp_t)(void *lhs, void *rhs);
+
 /**
  * Declares a new flist head.
  *
@@ -137,6 +142,45 @@ extern void flist_for_each(struct flist_head *hd, void (*f)(void *data));
 extern void flist_for_each_range(struct flist_head *hd, void (*f)(void *data),
 				 void *first,void *last);
 
+/**
+ * Call a function on batches of elements in a list, in order. Each element
+ * is prefetched as the batch is gathered, so f finds them in cache. See
+ * list_for_each_batch in list.h.
+ *
+ * \param hd       Pointer to the head of the list.
+ * \param buf      Room for k element pointers.
+ * \param k        Maximum number of elements per batch.
+ * \param f        Called with each batch, an array of n <= k pointers to the
+ *                 enclosing structs. May free any of them.
+ * \param private  Passed to f.
+ */
+extern void flist_for_each_batch(struct flist_head *hd, void **buf, size_t k,
+				 void (*f)(void **batch, size_t n,
+					   void *private),
+				 void *private);
+
+/**
+ * Sort a list with a stable, non-recursive merge sort that only relinks
+ * elements (so it allocates nothing). O(n log n), or O(n) if the list is
+ * already sorted or reverse sorted.
+ *
+ * \param hd   Pointer to the head of the list.
+ * \param cmp  Comparison function, called on the enclosing structs.
+ */
+extern void flist_sort(struct flist_head *hd, flist_cmp_t cmp);
+
+/**
+ * Merge a sorted list into another sorted list. The head of the merged list
+ * is invalidated like with flist_splice.
+ *
+ * \param hd      Pointer to the list to merge into.
+ * \param mergee  Pointer to the list to merge. Equal elements from hd come
+ *                first.
+ * \param cmp     Comparison function both lists are sorted by.
+ */
+extern void flist_merge(struct flist_head *hd, struct flist_head *mergee,
+			flist_cmp_t cmp);
+
 /**
  * Get the first element in a list from the list head.
  * 
@@ -161,4 +205,59 @@ static inline void *flist_next(struct flist_head *hd, void *elem)
 	return e->next ? (void*)((uintptr_t)e->next - hd->offset) : NULL;
 }
 
+/* prefetch an element's list node, and its start in case that's elsewhere */
+static inline void flist_prefetch(struct flist_head *hd, void *elem)
+{
+	__builtin_prefetch((char *)elem + hd->offset);
+	__builtin_prefetch(elem);
+}
+
+/**
+ * Prefetch the elements from elem to distance elements after it, and return
+ * the last one. A distance of 0 is taken as 1. A helper for
+ * flist_for_each_prefetch.
+ */
+static inline void *flist_prefetch_ahead(struct flist_head *hd, void *elem,
+					 unsigned long distance)
+{
+	if (!distance)
+		distance = 1;
+	for (; elem && distance > 0; distance--) {
+		flist_prefetch(hd, elem);
+		elem = flist_next(hd, elem);
+	}
+	if (elem)
+		flist_prefetch(hd, elem);
+	return elem;
+}
+
+/**
+ * Loop over the elements in a list, prefetching the element distance links
+ * ahead so the loop body finds its element in cache. See
+ * list_for_each_prefetch in list.h.
+ *
+ * \param hd         Pointer to the head of the list.
+ * \param type       (token) Type of the enclosing struct (not a pointer type).
+ * \param iter_name  (token) Name of the iterator to declare (use this in
+ *                   your loop). The macro declares a variable of type
+ *                   @type * with this name. Don't declare one yourself.
+ * \param distance   How many links ahead to prefetch, at least 1.
+ * \detail           It is safe to free iter_name within this loop, but not
+ *                   other elements.
+ */
+#define flist_for_each_prefetch(hd, type, iter_name, distance)		\
+	for (type *iter_name = (type*)flist_first(hd),			\
+	     *___foreach_next = iter_name				\
+		     ? (type*)flist_next(hd, iter_name)			\
+		     : NULL,						\
+	     *___foreach_ahead = (type*)flist_prefetch_ahead(hd,	\
+			iter_name, (distance));				\
+	     iter_name;							\
+	     iter_name = ___foreach_next,				\
+	     ___foreach_next = iter_name				\
+		     ? (type*)flist_next(hd, iter_name)			\
+		     : NULL,						\
+	     ___foreach_ahead = (type*)flist_prefetch_ahead(hd,		\
+			___foreach_ahead, 1))
+
 #endif /* STRUCT_FLIST_H */
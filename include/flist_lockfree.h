@@ -0,0 +1,198 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file flist_lockfree.h
+ *
+ * \author Eric Mueller
+ *
+ * \brief Header file for a lock-free stack and a lock-free multi-producer
+ * single-consumer queue built out of struct flist nodes.
+ *
+ * \detail Both structures are intrusive in exactly the same way as
+ * struct flist_head, so an object that already has a struct flist member
+ * can be handed between threads without any memory allocation, ex:
+ *
+ *     struct foo {
+ *               .
+ *             struct flist link;
+ *               .
+ *     };
+ *
+ *     FLIST_STACK(free_foos, struct foo, link);
+ *     FLIST_MPSC(foo_queue, struct foo, link);
+ *
+ * The stack is a Treiber stack. Any number of threads may call
+ * flist_stack_push and flist_stack_pop concurrently. To avoid the ABA
+ * problem the top-of-stack pointer carries a 16 bit generation counter in
+ * its (otherwise unused) upper bits, which is bumped by every pop. A pop
+ * will read the next pointer of a node that another thread may have popped
+ * concurrently, so memory for nodes must not be returned to the operating
+ * system while the stack is in use (recycling the objects, which is the
+ * point of this structure, is fine).
+ *
+ * The queue is Dmitry Vyukov's intrusive MPSC queue. Any number of threads
+ * may call flist_mpsc_push concurrently, but only one thread at a time may
+ * call flist_mpsc_pop. Push is wait-free (one atomic exchange). Pop may
+ * return NULL while a producer is half-way through a push even though the
+ * queue is not empty; the element will be visible on a subsequent pop.
+ *
+ * Neither structure keeps a length, as doing so would put another contended
+ * atomic on every operation.
+ */
+
+#ifndef STRUCT_FLIST_LOCKFREE_H
+#define STRUCT_FLIST_LOCKFREE_H 1
+
+#include "flist.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* this definition isn't portable but it's good enough for now */
+#define FLIST_LF_CACHELINE (64)
+
+/** lock-free LIFO stack of struct flist nodes */
+struct flist_stack {
+	/** tagged pointer to the top node. use the api, don't touch this */
+	uintptr_t top;
+
+	/** offset of the struct flist member in the enclosing struct */
+	unsigned long offset;
+};
+
+/** lock-free multi-producer single-consumer FIFO of struct flist nodes */
+struct flist_mpsc {
+	/** most recently pushed node. written by producers */
+	struct flist *head __attribute__((aligned(FLIST_LF_CACHELINE)));
+
+	/** next node to pop. owned by the consumer */
+	struct flist *tail __attribute__((aligned(FLIST_LF_CACHELINE)));
+
+	/** dummy node that keeps the queue from ever being truly empty */
+	struct flist stub;
+
+	/** offset of the struct flist member in the enclosing struct */
+	unsigned long offset;
+};
+
+/**
+ * \brief Initialize an already allocated stack. See FLIST_STACK.
+ */
+#define FLIST_STACK_INITIALIZER(type, member) (struct flist_stack) {	\
+		.top = 0,						\
+		.offset = offsetof(type, member)}
+
+/**
+ * \brief Declare a new lock-free stack.
+ *
+ * \param name    (token) The name of the new stack.
+ * \param type    The type of the enclosing struct.
+ * \param member  The name of the struct flist member in the struct
+ *                declaration.
+ */
+#define FLIST_STACK(name, type, member)					\
+	struct flist_stack name = FLIST_STACK_INITIALIZER(type, member)
+
+/**
+ * \brief Declare a new lock-free mpsc queue.
+ *
+ * \param name    (token) The name of the new queue.
+ * \param type    The type of the enclosing struct.
+ * \param member  The name of the struct flist member in the struct
+ *                declaration.
+ *
+ * \detail The queue points into itself, so a queue declared with this macro
+ * must never be copied. Use flist_mpsc_init for dynamically allocated queues.
+ */
+#define FLIST_MPSC(name, type, member)					\
+	struct flist_mpsc name = {					\
+		.head = &name.stub,					\
+		.tail = &name.stub,					\
+		.stub = {NULL},						\
+		.offset = offsetof(type, member)}
+
+/**
+ * \brief Push an element onto a stack. Safe to call from any thread.
+ *
+ * \param s     The stack to push onto.
+ * \param elem  The element to push.
+ */
+extern void flist_stack_push(struct flist_stack *s, void *elem);
+
+/**
+ * \brief Pop the top element off of a stack. Safe to call from any thread.
+ *
+ * \param s  The stack to pop from.
+ * \return The element that was on top of the stack, or NULL if the stack was
+ * empty.
+ */
+extern void *flist_stack_pop(struct flist_stack *s);
+
+/**
+ * \brief Atomically take every element off of a stack.
+ *
+ * \param s     The stack to empty.
+ * \param into  The elements are pushed onto the front of this list in pop
+ *              order, so the bottom of the stack ends up first. Must have the
+ *              same offset as the stack.
+ *
+ * \detail This is a single atomic exchange regardless of the stack depth,
+ * which makes it the cheap way for a consumer to drain a stack that many
+ * threads are pushing onto.
+ */
+extern void flist_stack_pop_all(struct flist_stack *s,
+				struct flist_head *into);
+
+/**
+ * \brief Determine if a stack is (momentarily) empty.
+ */
+extern bool flist_stack_empty(const struct flist_stack *s);
+
+/**
+ * \brief Initialize a queue that was not declared with FLIST_MPSC.
+ *
+ * \param q       The queue to initialize.
+ * \param offset  Offset of the struct flist member in the enclosing struct,
+ *                i.e. offsetof(type, member).
+ */
+extern void flist_mpsc_init(struct flist_mpsc *q, unsigned long offset);
+
+/**
+ * \brief Push an element onto the back of a queue. Safe to call from any
+ * thread.
+ *
+ * \param q     The queue to push onto.
+ * \param elem  The element to push.
+ */
+extern void flist_mpsc_push(struct flist_mpsc *q, void *elem);
+
+/**
+ * \brief Pop the element at the front of a queue. Must only be called by the
+ * one consumer thread.
+ *
+ * \param q  The queue to pop from.
+ * \return The element at the front of the queue, or NULL if the queue is
+ * empty or a push is in progress.
+ */
+extern void *flist_mpsc_pop(struct flist_mpsc *q);
+
+/**
+ * \brief Determine if a queue is (momentarily) empty. Must only be called by
+ * the consumer thread.
+ */
+extern bool flist_mpsc_empty(const struct flist_mpsc *q);
+
+#endif /* STRUCT_FLIST_LOCKFREE_H */
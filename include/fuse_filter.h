@@ -0,0 +1,168 @@
+/*
+ * Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file fuse_filter.h
+ *
+ * \author Eric Mueller
+ *
+ * \brief Header file for a binary fuse filter
+ *
+ * \detail A binary fuse filter answers the same question as a bloom filter
+ * (is this key in the set, with some false positives) for a set of keys that
+ * is known up front and never changes.
+ *
+ *     https://arxiv.org/abs/2201.01174
+ *
+ * Each key hashes to three positions in an array of fingerprints, and the
+ * array is built so that the three fingerprints XOR to the key's own
+ * fingerprint. A query is one hash and exactly three memory accesses. With
+ * 8 bit fingerprints the false positive probability is 1/256 at about 9 bits
+ * per key, where a bloom filter needs about 11.5 bits and 8 probes; with 16
+ * bit fingerprints it is 1/65536 at about 18 bits per key.
+ *
+ * The three positions fall in three consecutive 'segments' of the array,
+ * which makes the array cheap to build: keys are peeled off one at a time,
+ * each time taking one whose position is used by no other remaining key,
+ * then fingerprints are filled in in the opposite order.
+ *
+ * pros:
+ *   - size: close to the minimum possible for the false positive rate.
+ *   - speed: queries never touch more than three cache lines.
+ *
+ * cons:
+ *   - keys can't be added or removed once the filter is built.
+ *   - building needs about 24 bytes per key of temporary memory.
+ *
+ * To use a filter, declare one with the FUSE_FILTER macro, ex:
+ *
+ *     FUSE_FILTER(my_filter, 8);
+ *
+ * then call fuse_filter_build with all the keys, and then fuse_filter_query.
+ * A filter can be written out with fuse_filter_serialize and read back with
+ * fuse_filter_deserialize. When you are done with the filter, call
+ * fuse_filter_destroy to free all memory associated with it.
+ *
+ * Synchronization is left to the caller.
+ */
+
+#ifndef STRUCT_FUSE_FILTER_H
+#define STRUCT_FUSE_FILTER_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/** binary fuse filter */
+struct fuse_filter {
+	/** array_length fingerprints, each bits wide */
+	void *fingerprints;
+
+	/** seed for the hash function */
+	uint64_t seed;
+
+	/** number of fingerprints in a segment, a power of two */
+	uint32_t segment_length;
+
+	/** number of segments the first position can fall in */
+	uint32_t segment_count;
+
+	/** total number of fingerprints */
+	uint32_t array_length;
+
+	/** fingerprint size in bits, 8 or 16 */
+	unsigned bits;
+};
+
+/*! the largest number of keys a filter can be built from */
+#define FUSE_FILTER_MAX_KEYS (UINT32_MAX / 2)
+
+/**
+ * \brief Initialize an already allocated fuse filter. See FUSE_FILTER.
+ */
+#define FUSE_FILTER_INITIALIZER(fp_bits) (struct fuse_filter) {	\
+			.fingerprints = NULL,				\
+			.seed = 0,					\
+			.segment_length = 0,				\
+			.segment_count = 0,				\
+			.array_length = 0,				\
+			.bits = (fp_bits)}
+
+/**
+ * \brief Declare a fuse filter.
+ * \param name     (token) name of the filter to declare
+ * \param fp_bits  Fingerprint size, 8 or 16. The false positive probability
+ * is 2^-fp_bits.
+ * \detail This does not initialize the structure. That is done by
+ * fuse_filter_build.
+ */
+#define FUSE_FILTER(name, fp_bits)					\
+	struct fuse_filter name = FUSE_FILTER_INITIALIZER(fp_bits)
+
+/**
+ * \brief Build a filter from a set of keys.
+ * \param f     The filter to build. Must not already be built.
+ * \param keys  The keys. Repeated keys are fine. Not modified.
+ * \param n     Number of keys, at most FUSE_FILTER_MAX_KEYS.
+ * \return true on success, false if allocation failed or the parameters were
+ * invalid.
+ */
+extern bool fuse_filter_build(struct fuse_filter *f, const uint64_t *keys,
+			      size_t n);
+
+/**
+ * \brief Destroy a filter.
+ * \param f  The filter to destroy.
+ * \detail Frees all memory associated with @f
+ */
+extern void fuse_filter_destroy(struct fuse_filter *f);
+
+/**
+ * \brief Query a filter for the existence of a key.
+ * \param f    The filter to query.
+ * \param key  The key to query for.
+ * \return true if the key probably was one of the keys the filter was built
+ * from, false if it definitely was not.
+ */
+extern bool fuse_filter_query(const struct fuse_filter *f, uint64_t key);
+
+/**
+ * \brief Get the size of a filter's serialized form.
+ * \param f  The filter.
+ * \return The number of bytes fuse_filter_serialize will write.
+ */
+extern size_t fuse_filter_serialized_size(const struct fuse_filter *f);
+
+/**
+ * \brief Serialize a filter.
+ * \param f    The filter to serialize.
+ * \param buf  Where to write the filter, fuse_filter_serialized_size bytes.
+ * \detail The format is a fixed little endian header followed by the
+ * fingerprints, also little endian, so it can be read back on any machine.
+ */
+extern void fuse_filter_serialize(const struct fuse_filter *f, void *buf);
+
+/**
+ * \brief Read a filter written by fuse_filter_serialize.
+ * \param f    The filter to read into. Must not already be built.
+ * \param buf  The serialized filter.
+ * \param len  Length of buf, in bytes.
+ * \return true on success, false if allocation failed or buf doesn't hold a
+ * valid filter.
+ */
+extern bool fuse_filter_deserialize(struct fuse_filter *f, const void *buf,
+				    size_t len);
+
+#endif /* STRUCT_FUSE_FILTER_H */
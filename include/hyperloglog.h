@@ -0,0 +1,194 @@
+/*
+ * Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file hyperloglog.h
+ *
+ * \author Eric Mueller
+ *
+ * \brief Header file for a HyperLogLog cardinality estimator.
+ *
+ * \detail A HyperLogLog estimates the number of distinct keys inserted into
+ * it, with a relative standard error of about 1.04 / sqrt(2^p), using 6 * 2^p
+ * bits no matter how many keys there are. The top p bits of a hash of each
+ * key pick one of 2^p registers, which keeps the longest run of leading
+ * zeros seen in the rest of the hash.
+ *
+ * Like HyperLogLog++
+ *
+ *     http://research.google.com/pubs/pub40671.html
+ *
+ * the sketch starts out 'sparse', as a list of (register, value) pairs at a
+ * higher precision of 25 bits, which is both smaller and much more accurate
+ * while there are few keys. It switches to the 'dense' array of registers
+ * once the list would be bigger than that. Dense registers are packed 6 bits
+ * each.
+ *
+ * Instead of HyperLogLog++'s empirical bias correction tables, the dense
+ * estimate uses Ertl's improved estimator, which is unbiased over the whole
+ * range without tables
+ *
+ *     https://arxiv.org/abs/1702.01284
+ *
+ * The API follows bloom.h. Declare a sketch with the HYPERLOGLOG macro, ex:
+ *
+ *     HYPERLOGLOG(my_sketch, 14);
+ *
+ * then call hyperloglog_init to allocate it. Use any combination of
+ * hyperloglog_insert and hyperloglog_count, and hyperloglog_union to combine
+ * sketches (e.g. one per shard) that were set up with hyperloglog_init_from.
+ * When you are done with the sketch, call hyperloglog_destroy to free all
+ * memory associated with it.
+ *
+ * Synchronization is left to the caller.
+ */
+
+#ifndef STRUCT_HYPERLOGLOG_H
+#define STRUCT_HYPERLOGLOG_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/** hyperloglog sketch */
+struct hyperloglog {
+	/** 2^p packed 6 bit registers, or NULL while the sketch is sparse */
+	uint8_t *regs;
+
+	/**
+	 * sparse entries, or NULL once the sketch is dense. Each is a 25 bit
+	 * register index above a 6 bit value.
+	 */
+	uint32_t *sparse;
+
+	/** number of entries in sparse */
+	size_t nsparse;
+
+	/** number of entries sparse has room for */
+	size_t sparse_cap;
+
+	/** seed for the hash function */
+	uint64_t seed;
+
+	/** log2 of the number of dense registers */
+	unsigned p;
+};
+
+/*! lower bound on allowable precision */
+#define HYPERLOGLOG_P_MIN (4)
+/*! upper bound on allowable precision */
+#define HYPERLOGLOG_P_MAX (18)
+/*! convenience macro for a reasonable default precision (0.8% error, 12KB) */
+#define HYPERLOGLOG_P_DEFAULT (14)
+
+/**
+ * \brief Initialize an already allocated sketch. See HYPERLOGLOG.
+ */
+#define HYPERLOGLOG_INITIALIZER(precision) (struct hyperloglog) {	\
+			.regs = NULL,					\
+			.sparse = NULL,					\
+			.nsparse = 0,					\
+			.sparse_cap = 0,				\
+			.seed = 0,					\
+			.p = (precision)}
+
+/**
+ * \brief Declare a hyperloglog sketch.
+ * \param name       (token) name of the sketch to declare
+ * \param precision  log2 of the number of registers. Must be between
+ * HYPERLOGLOG_P_MIN and HYPERLOGLOG_P_MAX. HYPERLOGLOG_P_DEFAULT is a good
+ * choice if you aren't sure.
+ * \detail This does not initialize the structure. That is done by
+ * hyperloglog_init.
+ */
+#define HYPERLOGLOG(name, precision)					\
+	struct hyperloglog name = HYPERLOGLOG_INITIALIZER(precision)
+
+/**
+ * \brief Initialize a sketch.
+ * \param h  The sketch to initialize.
+ * \return true on success, false on allocation failure.
+ */
+extern bool hyperloglog_init(struct hyperloglog *h);
+
+/**
+ * \brief Initialize an empty sketch with the same precision and seed as
+ * another sketch.
+ * \param h      The sketch to initialize. Every field is clobbered.
+ * \param other  The sketch to copy the class of.
+ * \return true on success, false on allocation failure.
+ *
+ * \detail In order to take the union of two sketches, they must have the same
+ * seed and the same precision.
+ */
+extern bool hyperloglog_init_from(struct hyperloglog *restrict h,
+				  const struct hyperloglog *restrict other);
+
+/**
+ * \brief Determine if two sketches are in the same 'class', i.e. have the
+ * same precision and seed. In order to take the union of two sketches, this
+ * must return true.
+ */
+extern bool hyperloglog_same_class(const struct hyperloglog *h0,
+				   const struct hyperloglog *h1);
+
+/**
+ * \brief Destroy a sketch.
+ * \param h  The sketch to destroy.
+ * \detail Frees all memory associated with @h
+ */
+extern void hyperloglog_destroy(struct hyperloglog *h);
+
+/**
+ * \brief Insert a key into a sketch.
+ * \param h    The sketch to insert into.
+ * \param key  The key to insert.
+ * \return true on success, false if the sketch needed to grow and memory
+ * allocation failed, in which case the key may not have been counted.
+ */
+extern bool hyperloglog_insert(struct hyperloglog *h, uint64_t key);
+
+/**
+ * \brief Estimate the number of distinct keys inserted into a sketch.
+ * \param h  The sketch.
+ * \return The estimate.
+ * \detail This isn't const because it tidies up the sparse list.
+ */
+extern double hyperloglog_count(struct hyperloglog *h);
+
+/**
+ * \brief Compute the union of two sketches into a third sketch.
+ *
+ * \param into  The new sketch will be put here. This sketch need not be
+ *              initialized, but if it is, it needs to be the same class as
+ *              h0 and h1.
+ * \param h0    One sketch to merge. Unmodified. May be the same as into.
+ * \param h1    The other sketch to merge. Unmodified. May be the same as
+ *              into.
+ * \return      True on success, false if memory allocation failed or if into,
+ *              h0, and h1 are not the same class.
+ *
+ * \detail The union estimates the number of keys that were inserted into
+ * either h0 or h1, with the same error bounds as one sketch they had all
+ * been inserted into. The two estimates are usually equal, but not always:
+ * when a sketch switches from its sparse list to dense registers depends
+ * on the order its keys came in, and the estimates of the two forms differ
+ * slightly.
+ */
+extern bool hyperloglog_union(struct hyperloglog *into,
+			      const struct hyperloglog *h0,
+			      const struct hyperloglog *h1);
+
+#endif /* STRUCT_HYPERLOGLOG_H */
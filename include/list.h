@@ -39,7 +39,8 @@
  *
  * Then use any combination of list_insert_before, list_insert_after,
  * list_delete, list_push_front, list_push_back, list_pop_front, list_pop_back,
- * list_splice, list_for_each, list_for_each_range, and list_revers.
+ * list_splice, list_for_each, list_for_each_range, list_for_each_prefetch,
+ * list_for_each_batch, list_revers, list_sort, and list_merge.
  *
  * This should go without saying, but the list does no memory allocation.
  *
@@ -68,6 +69,9 @@ struct list_head {
 	unsigned long offset;
 };
 
+/** should return < 0 if lhs < rhs, 0 if lhs == rhs, and > 0 if lhs > rhs */
+typedef long (*list_cmp_t)(void *lhs, void *rhs);
+
 /**
  * \brief Create and initialize a new empty list_head.
  * 
@@ -176,6 +180,52 @@ extern void list_splice(struct list_head *hd, void *after,
  */
 extern void list_reverse(struct list_head *hd);
 
+/**
+ * \brief Sort a list.
+ *
+ * \param hd   Pointer to the head of the list to sort.
+ * \param cmp  Comparison function, called on the enclosing structs.
+ *
+ * \detail This is a bottom-up merge sort done entirely by relinking the
+ * elements, so it is O(n log n), stable (equal elements keep their order),
+ * allocates nothing, and uses O(log n) stack. It merges the runs already in
+ * the list, so sorted and reverse sorted lists take O(n).
+ */
+extern void list_sort(struct list_head *hd, list_cmp_t cmp);
+
+/**
+ * \brief Merge a sorted list into another sorted list.
+ * \warning Mergee is empty after this function is called.
+ *
+ * \param hd      Pointer to the head of the list to merge into.
+ * \param mergee  Pointer to the head of the list to merge. Equal elements
+ *                from hd come before those from mergee.
+ * \param cmp     Comparison function both lists are sorted by.
+ */
+extern void list_merge(struct list_head *hd, struct list_head *mergee,
+		       list_cmp_t cmp);
+
+/**
+ * \brief Call a function on batches of elements in a list, in order.
+ *
+ * \param hd       Pointer to the head of the list.
+ * \param buf      Room for k element pointers.
+ * \param k        Maximum number of elements per batch.
+ * \param f        Called with each batch, an array of n <= k pointers to the
+ *                 enclosing structs. May unlink and free any of them.
+ * \param private  Passed to f.
+ *
+ * \detail Each element is prefetched as it's gathered, so f finds the whole
+ * batch in cache and can work on it without stalling, amortize a lock or a
+ * call across k elements, or prefetch what the elements point to. Gathering
+ * is still one dependent load per element, and isn't overlapped with f; when
+ * the per element work is heavy list_for_each_prefetch is faster.
+ */
+extern void list_for_each_batch(struct list_head *hd, void **buf, size_t k,
+				void (*f)(void **batch, size_t n,
+					  void *private),
+				void *private);
+
 /**
  * Get the first element in a list.
  *
@@ -276,5 +326,65 @@ static inline void *list_prev(const struct list_head *hd, const void *elem)
 		     ? (type*)list_next(list, iter_name)	\
 		     : NULL)
 
+/* prefetch an element's list node, and its start in case that's elsewhere */
+static inline void list_prefetch(const struct list_head *hd, const void *elem)
+{
+	__builtin_prefetch((const char *)elem + hd->offset);
+	__builtin_prefetch(elem);
+}
+
+/**
+ * Prefetch the elements from elem to distance elements after it, and return
+ * the last one. A distance of 0 is taken as 1. A helper for
+ * list_for_each_prefetch.
+ */
+static inline void *list_prefetch_ahead(const struct list_head *hd,
+					void *elem, unsigned long distance)
+{
+	if (!distance)
+		distance = 1;
+	for (; elem && distance > 0; distance--) {
+		list_prefetch(hd, elem);
+		elem = list_next(hd, elem);
+	}
+	if (elem)
+		list_prefetch(hd, elem);
+	return elem;
+}
+
+/**
+ * \brief Execute a function on each element in the list, prefetching the
+ * element distance links ahead.
+ * \note The function is applied to the container, not the list node itself.
+ *
+ * \param list       Pointer to the list to iterate over.
+ * \param type       Type of the enclosing struct. Should be a struct type, not
+ *                   a pointer type.
+ * \param iter_name  (token) name of the iterator variable to declare. The
+ *                   macro decalres a variable of type @type * with this name.
+ *                   Don't decalre one yourself.
+ * \param distance   How many links ahead to prefetch, at least 1. Enough to
+ *                   cover memory latency with the work done on each element,
+ *                   usually 4 to 16.
+ * \detail           A second cursor runs distance elements ahead of
+ *                   iter_name, prefetching as it goes, so the loop body finds
+ *                   its element already in cache. It is safe to use
+ *                   functions like free on iter_name within this loop, but
+ *                   not on other elements.
+ */
+#define list_for_each_prefetch(list, type, iter_name, distance)	\
+	for (type *iter_name = (type*)list_first(list),			\
+	     *___foreach_next = iter_name				\
+		     ? (type*)list_next(list, iter_name)		\
+		     : NULL,						\
+	     *___foreach_ahead = (type*)list_prefetch_ahead(list,	\
+			iter_name, (distance));				\
+	     iter_name;							\
+	     iter_name = ___foreach_next,				\
+	     ___foreach_next = iter_name				\
+		     ? (type*)list_next(list, iter_name)		\
+		     : NULL,						\
+	     ___foreach_ahead = (type*)list_prefetch_ahead(list,	\
+			___foreach_ahead, 1))
 
 #endif /* STRUCT_LIST_H */
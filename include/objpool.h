@@ -0,0 +1,164 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file objpool.h
+ *
+ * \author Eric Mueller
+ *
+ * \brief Header file for a fixed-size object pool (a.k.a. freelist).
+ *
+ * \detail An object pool hands out objects of one size, carved out of large
+ * cache-line aligned slabs, in O(1). It is a slab allocator with a magazine
+ * layer as described here
+ *
+ *     https://www.usenix.org/legacy/event/usenix01/full_papers/bonwick/bonwick.pdf
+ *
+ * Every thread that uses a pool gets its own pair of 'magazines' (small
+ * arrays of free objects). Allocation and freeing only touch the calling
+ * thread's magazines, and the shared pool lock is taken only once per
+ * OBJPOOL_MAG_SIZE operations to swap a full magazine for an empty one (or
+ * vice versa) with the pool's depot. Objects may be freed by a different
+ * thread than the one that allocated them.
+ *
+ * To use a pool, declare a struct objpool and call objpool_init with the
+ * size of the objects it should hand out, ex:
+ *
+ *     struct objpool node_pool;
+ *     objpool_init(&node_pool, sizeof(struct foo), OBJPOOL_CACHELINE, 0);
+ *
+ * Then use any combination of objpool_alloc, objpool_free,
+ * objpool_alloc_bulk and objpool_free_bulk. Memory is only returned to the
+ * system by objpool_destroy, which must not race with any other pool call.
+ *
+ * If the pool is created with OBJPOOL_POISON and the library is built
+ * without NDEBUG, freed objects are filled with a poison pattern that is
+ * checked (with an assertion) when the object is next handed out, catching
+ * writes after free.
+ */
+
+#ifndef STRUCT_OBJPOOL_H
+#define STRUCT_OBJPOOL_H 1
+
+#include "list.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* this definition isn't portable but it's good enough for now */
+#define OBJPOOL_CACHELINE (64)
+
+/** number of objects per magazine. chosen so a magazine is 512 bytes */
+#define OBJPOOL_MAG_SIZE (62)
+
+/** poison freed objects (only when built without NDEBUG) */
+#define OBJPOOL_POISON (0x1U)
+
+/** object pool. don't touch the members, use the api */
+struct objpool {
+	/** protects everything below except the constant parameters */
+	pthread_mutex_t lock;
+
+	/** key for each thread's struct objpool_cache */
+	pthread_key_t key;
+
+	/** size of each object, rounded up to a multiple of align */
+	size_t objsize;
+
+	/** alignment of each object */
+	size_t align;
+
+	/** number of objects carved from each slab */
+	size_t slab_objs;
+
+	/** OBJPOOL_* flags */
+	unsigned flags;
+
+	/** depot of full magazines */
+	struct objpool_mag *full;
+
+	/** depot of empty magazines */
+	struct objpool_mag *empty;
+
+	/** all slabs, linked through their headers */
+	struct objpool_slab *slabs;
+
+	/** next never-used object in the newest slab, and how many are left */
+	char *slab_cur;
+	size_t slab_left;
+
+	/** every thread's cache, so destroy can find them */
+	struct list_head caches;
+
+	/** number of slabs allocated */
+	unsigned long stat_slabs;
+
+	/** number of times a thread went to the depot */
+	unsigned long stat_depot_trips;
+};
+
+/**
+ * \brief Initialize an object pool.
+ *
+ * \param pool     The pool to initialize.
+ * \param objsize  Size of each object. Must be nonzero.
+ * \param align    Alignment of each object. Must be a power of two, or zero
+ *                 for the alignment of a pointer. OBJPOOL_CACHELINE keeps
+ *                 objects from sharing cache lines.
+ * \param flags    Zero or OBJPOOL_POISON.
+ * \return true on success, false on failure (out of thread keys).
+ */
+extern bool objpool_init(struct objpool *pool, size_t objsize, size_t align,
+			 unsigned flags);
+
+/**
+ * \brief Free all memory associated with a pool, including objects that
+ * are still allocated.
+ */
+extern void objpool_destroy(struct objpool *pool);
+
+/**
+ * \brief Allocate an object.
+ * \return The object, or NULL on allocation failure. The contents are
+ * undefined.
+ */
+extern void *objpool_alloc(struct objpool *pool);
+
+/**
+ * \brief Return an object to a pool.
+ * \param pool  The pool the object came from.
+ * \param obj   The object to free. May be NULL.
+ */
+extern void objpool_free(struct objpool *pool, void *obj);
+
+/**
+ * \brief Allocate several objects at once.
+ * \param pool  The pool to allocate from.
+ * \param objs  Where to put the objects.
+ * \param n     Number of objects to allocate.
+ * \return The number of objects allocated. Only less than n on allocation
+ * failure.
+ */
+extern size_t objpool_alloc_bulk(struct objpool *pool, void **objs, size_t n);
+
+/**
+ * \brief Free several objects at once.
+ * \param pool  The pool the objects came from.
+ * \param objs  The objects to free.
+ * \param n     Number of objects in objs.
+ */
+extern void objpool_free_bulk(struct objpool *pool, void **objs, size_t n);
+
+#endif /* STRUCT_OBJPOOL_H */
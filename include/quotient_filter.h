@@ -0,0 +1,214 @@
+/*
+ * Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file quotient_filter.h
+ *
+ * \author Eric Mueller
+ *
+ * \brief Header file for a quotient filter
+ *
+ * \detail A quotient filter is an approximate set, like a bloom filter, that
+ * also supports deletes, counts, resizing and merging.
+ *
+ *     http://vldb.org/pvldb/vol5/p1627_michaelabender_vldb2012.pdf
+ *
+ * Each key is reduced to a (q + r) bit fingerprint. The top q bits (the
+ * quotient) pick one of 2^q slots, and the bottom r bits (the remainder) are
+ * stored in the table, as close after that slot as possible, like linear
+ * probing. Remainders with the same quotient are kept together in a sorted
+ * 'run', and runs are kept in order of quotient, so three bits of metadata
+ * per slot are enough to work out every stored remainder's quotient. Two
+ * keys only collide if their whole fingerprints are equal, so the false
+ * positive probability is about 2^-r at full load.
+ *
+ * Because the table holds the whole fingerprint, in sorted order:
+ *   - it can be doubled without the original keys, by moving one bit from
+ *     each remainder to its quotient (which doubles the false positive
+ *     probability);
+ *   - two filters with the same fingerprint size can be merged in one
+ *     sequential pass over each;
+ *   - lookups touch one short stretch of memory, which suits slow or paged
+ *     storage much better than a bloom filter's scattered probes.
+ *
+ * A key inserted more than once is stored once per insert, so
+ * quotient_filter_count reports (an upper bound on) how many times it was
+ * inserted, and quotient_filter_remove takes away one copy at a time.
+ *
+ * To use the filter, declare one with the QUOTIENT_FILTER macro, ex:
+ *
+ *     QUOTIENT_FILTER(my_filter, 16, 10);
+ *
+ * then call quotient_filter_init to allocate it. Use any combination of
+ * quotient_filter_insert, quotient_filter_query, quotient_filter_count and
+ * quotient_filter_remove. The filter doubles itself when it gets full. When
+ * you are done with the filter, call quotient_filter_destroy to free all
+ * memory associated with it.
+ *
+ * Synchronization is left to the caller.
+ */
+
+#ifndef STRUCT_QUOTIENT_FILTER_H
+#define STRUCT_QUOTIENT_FILTER_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/** quotient filter */
+struct quotient_filter {
+	/** 2^qbits slots, packed rbits + 3 bits each */
+	uint64_t *table;
+
+	/** seed for the hash function */
+	uint64_t seed;
+
+	/** number of remainders stored in the table */
+	uint64_t nentries;
+
+	/** number of quotient bits */
+	unsigned qbits;
+
+	/** number of remainder bits */
+	unsigned rbits;
+};
+
+/*! bounds on the number of quotient bits */
+#define QUOTIENT_FILTER_Q_MIN (1)
+#define QUOTIENT_FILTER_Q_MAX (40)
+
+/*! bounds on the number of remainder bits */
+#define QUOTIENT_FILTER_R_MIN (1)
+#define QUOTIENT_FILTER_R_MAX (60)
+
+/**
+ * \brief Initialize an already allocated quotient filter. See QUOTIENT_FILTER.
+ */
+#define QUOTIENT_FILTER_INITIALIZER(q, r) (struct quotient_filter) {	\
+			.table = NULL,					\
+			.seed = 0,					\
+			.nentries = 0,					\
+			.qbits = (q),					\
+			.rbits = (r)}
+
+/**
+ * \brief Declare a quotient filter.
+ * \param name  (token) name of the filter to declare
+ * \param q     log2 of the initial number of slots.
+ * \param r     Remainder bits. The false positive probability is about 2^-r,
+ *              and goes up by a factor of two every time the filter doubles.
+ *              q + r must be at most 64.
+ * \detail This does not initialize the structure. That is done by
+ * quotient_filter_init.
+ */
+#define QUOTIENT_FILTER(name, q, r)					\
+	struct quotient_filter name = QUOTIENT_FILTER_INITIALIZER(q, r)
+
+/**
+ * \brief Initialize a quotient filter.
+ * \param qf  The filter to initialize.
+ * \return true on success, false on allocation failure or invalid sizes.
+ */
+extern bool quotient_filter_init(struct quotient_filter *qf);
+
+/**
+ * \brief Initialize an empty quotient filter with the same sizes and seed as
+ * another filter.
+ * \param qf     The filter to initialize. Every field is clobbered.
+ * \param other  The filter to copy the class of.
+ * \return true on success, false on allocation failure.
+ */
+extern bool quotient_filter_init_from(struct quotient_filter *restrict qf,
+				      const struct quotient_filter *restrict
+				      other);
+
+/**
+ * \brief Determine if two filters can be merged, i.e. if they have the same
+ * seed and the same fingerprint size. Their table sizes may differ.
+ */
+extern bool quotient_filter_same_class(const struct quotient_filter *qf0,
+				       const struct quotient_filter *qf1);
+
+/**
+ * \brief Destroy a quotient filter.
+ * \param qf  The filter to destroy.
+ * \detail Frees all memory associated with @qf
+ */
+extern void quotient_filter_destroy(struct quotient_filter *qf);
+
+/**
+ * \brief Insert a key into the filter.
+ * \param qf   The filter to insert into.
+ * \param key  The key to insert.
+ * \return true on success, false if the filter needed to grow and couldn't,
+ * because allocation failed or there are no remainder bits left to give up.
+ */
+extern bool quotient_filter_insert(struct quotient_filter *qf, uint64_t key);
+
+/**
+ * \brief Query the filter for the existence of a key.
+ * \param qf   The filter to query.
+ * \param key  The key to query for.
+ * \return true if the key probably exists, false if it definitely does not.
+ */
+extern bool quotient_filter_query(const struct quotient_filter *qf,
+				  uint64_t key);
+
+/**
+ * \brief Count how many times a key has been inserted (and not removed).
+ * \param qf   The filter to query.
+ * \param key  The key to count.
+ * \return The count, which may be too high (never too low) because of keys
+ * with the same fingerprint.
+ */
+extern unsigned long quotient_filter_count(const struct quotient_filter *qf,
+					   uint64_t key);
+
+/**
+ * \brief Remove one copy of a key from the filter.
+ * \param qf   The filter to remove from.
+ * \param key  The key to remove. This must have been inserted, or a key with
+ *             the same fingerprint will be removed instead.
+ * \return true if a copy of the key's fingerprint was found and removed.
+ */
+extern bool quotient_filter_remove(struct quotient_filter *qf, uint64_t key);
+
+/**
+ * \brief Double the number of slots in a filter, taking one bit from every
+ * remainder.
+ * \param qf  The filter to resize.
+ * \return true on success, false if allocation failed or the remainders only
+ * have one bit left.
+ */
+extern bool quotient_filter_resize(struct quotient_filter *qf);
+
+/**
+ * \brief Merge two filters into a new one.
+ *
+ * \param into  The merged filter is put here. Any filter that was here is
+ *              destroyed first. May be the same as qf0 or qf1.
+ * \param qf0   One filter to merge. Unmodified unless it is into.
+ * \param qf1   The other filter to merge. Unmodified unless it is into.
+ * \return      True on success, false if memory allocation failed or if qf0
+ *              and qf1 are not the same class.
+ *
+ * \detail Counts add. The merged filter has the same fingerprint size as the
+ * inputs, and enough slots to hold both.
+ */
+extern bool quotient_filter_merge(struct quotient_filter *into,
+				  const struct quotient_filter *qf0,
+				  const struct quotient_filter *qf1);
+
+#endif /* STRUCT_QUOTIENT_FILTER_H */
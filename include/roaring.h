@@ -0,0 +1,248 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file roaring.h
+ *
+ * \author Eric Mueller
+ *
+ * \brief Header file for a compressed bitmap (set of 32 bit integers).
+ *
+ * \detail This is a roaring bitmap as described here
+ *
+ *     http://arxiv.org/abs/1402.6407
+ *     http://arxiv.org/abs/1603.06549
+ *
+ * The 32 bit key space is split into 2^16 chunks keyed on the high 16 bits
+ * of each integer. Each non-empty chunk gets a 'container' holding the low 16
+ * bits of its members in whichever of three representations is smallest:
+ *
+ *   - array: a sorted array of uint16_t, used for sparse chunks (at most
+ *     4096 members, i.e. at most 8 KiB).
+ *   - bitmap: a flat 2^16 bit bitmap (always 8 KiB), used for dense chunks.
+ *   - run: a sorted array of [start, start + length] runs, used for chunks
+ *     made of long consecutive ranges. Run containers are only created by
+ *     roaring_add_range and roaring_run_optimize.
+ *
+ * Set operations between bitmap containers work a word at a time and use
+ * AVX2 when the library is compiled with it enabled (i.e. -mavx2 or
+ * -march=native).
+ *
+ * To use a bitmap, declare one with the ROARING_BITMAP macro, ex:
+ *
+ *     ROARING_BITMAP(ids);
+ *
+ * Then use any combination of roaring_add, roaring_remove, roaring_contains,
+ * the set operations, and the roaring_iter_* api. When finished, call
+ * roaring_destroy to free all memory associated with the bitmap.
+ *
+ * roaring_add_radix and roaring_insert_bloom let a bitmap be built from the
+ * keys of a radix tree and let a bitmap be used to fill a bloom filter, so an
+ * exact filter can be kept next to an approximate one.
+ *
+ * Synchronization is left to the caller.
+ */
+
+#ifndef STRUCT_ROARING_H
+#define STRUCT_ROARING_H 1
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct bloom;
+struct radix_head;
+
+/** compressed bitmap */
+struct roaring {
+	/** high 16 bits of each container, sorted */
+	uint16_t *keys;
+
+	/** containers, parallel to keys. opaque */
+	struct roaring_container *containers;
+
+	/** number of containers in use */
+	unsigned long ncontainers;
+
+	/** number of containers allocated */
+	unsigned long alloc;
+};
+
+/** iterator over the members of a bitmap, in increasing order */
+struct roaring_iter {
+	const struct roaring *r;
+
+	/** index of the current container */
+	unsigned long ci;
+
+	/** position within the container, meaning depends on the type */
+	uint32_t pos;
+
+	/** offset within the current run, for run containers */
+	uint32_t off;
+};
+
+/**
+ * \brief Initialize an already allocated bitmap. See ROARING_BITMAP.
+ */
+#define ROARING_INITIALIZER (struct roaring) {	\
+		.keys = NULL,			\
+		.containers = NULL,		\
+		.ncontainers = 0,		\
+		.alloc = 0}
+
+/**
+ * \brief Declare an empty bitmap.
+ * \param name  (token) name of the bitmap to declare.
+ */
+#define ROARING_BITMAP(name) struct roaring name = ROARING_INITIALIZER
+
+/**
+ * \brief Free all memory associated with a bitmap. The bitmap is left empty
+ * and may be reused.
+ */
+extern void roaring_destroy(struct roaring *r);
+
+/**
+ * \brief Add an integer to a bitmap.
+ * \return false on allocation failure, true otherwise (including if x was
+ * already present).
+ */
+extern bool roaring_add(struct roaring *r, uint32_t x);
+
+/**
+ * \brief Add every integer in [lo, hi) to a bitmap.
+ * \param r   The bitmap to add to.
+ * \param lo  First integer to add.
+ * \param hi  One past the last integer to add. May be up to 2^32.
+ * \return false on allocation failure.
+ */
+extern bool roaring_add_range(struct roaring *r, uint64_t lo, uint64_t hi);
+
+/**
+ * \brief Remove an integer from a bitmap.
+ * \return 1 if x was removed, 0 if it wasn't present, or -1 on allocation
+ * failure (splitting up a run container), in which case x is still there.
+ */
+extern int roaring_remove(struct roaring *r, uint32_t x);
+
+/**
+ * \brief Determine if an integer is in a bitmap.
+ */
+extern bool roaring_contains(const struct roaring *r, uint32_t x);
+
+/**
+ * \brief Get the number of integers in a bitmap.
+ */
+extern uint64_t roaring_cardinality(const struct roaring *r);
+
+/**
+ * \brief Get the number of integers in a bitmap that are <= x.
+ */
+extern uint64_t roaring_rank(const struct roaring *r, uint32_t x);
+
+/**
+ * \brief Find the ith smallest integer in a bitmap (0 indexed).
+ * \param r    The bitmap to search.
+ * \param i    Rank of the integer to find.
+ * \param out  Where to put the integer if it exists.
+ * \return true if the bitmap has more than i elements, false otherwise, in
+ * which case out is not modified.
+ */
+extern bool roaring_select(const struct roaring *r, uint64_t i,
+			   uint32_t *out);
+
+/**
+ * \brief Determine if two bitmaps contain exactly the same integers.
+ */
+extern bool roaring_equals(const struct roaring *a, const struct roaring *b);
+
+/**
+ * \brief Compute the union of two bitmaps.
+ * \param into  Where to put the result. Any previous contents are destroyed.
+ *              May be the same as a or b.
+ * \param a     One bitmap to merge.
+ * \param b     The other bitmap to merge.
+ * \return false on allocation failure, in which case into is unmodified.
+ */
+extern bool roaring_union(struct roaring *into, const struct roaring *a,
+			  const struct roaring *b);
+
+/**
+ * \brief Compute the intersection of two bitmaps. See roaring_union.
+ */
+extern bool roaring_intersection(struct roaring *into,
+				 const struct roaring *a,
+				 const struct roaring *b);
+
+/**
+ * \brief Compute the difference a - b of two bitmaps. See roaring_union.
+ */
+extern bool roaring_difference(struct roaring *into, const struct roaring *a,
+			       const struct roaring *b);
+
+/**
+ * \brief Convert each container to a run container if that is smaller.
+ * \return false on allocation failure. The bitmap is still valid.
+ *
+ * \detail Worth calling once after building a bitmap with long runs of
+ * consecutive integers, as roaring_add never creates run containers.
+ */
+extern bool roaring_run_optimize(struct roaring *r);
+
+/**
+ * \brief Add the keys of every entry in a radix tree to a bitmap.
+ * \param r     The bitmap to add to.
+ * \param head  The tree to read keys from. Keys above UINT32_MAX are skipped.
+ * \return false on allocation failure.
+ */
+extern bool roaring_add_radix(struct roaring *r, struct radix_head *head);
+
+/**
+ * \brief Insert every integer in a bitmap into a bloom filter as a key.
+ * \param r   The bitmap to read.
+ * \param bf  An initialized bloom filter.
+ */
+extern void roaring_insert_bloom(const struct roaring *r, struct bloom *bf);
+
+/**
+ * \brief Start iterating over a bitmap.
+ * \param it  The iterator to initialize.
+ * \param r   The bitmap to iterate over. Must not be modified while the
+ *            iterator is in use.
+ */
+extern void roaring_iter_init(struct roaring_iter *it, const struct roaring *r);
+
+/**
+ * \brief Get the next integer from an iterator.
+ * \param it   The iterator.
+ * \param out  The integer is put here.
+ * \return false if the iteration is finished.
+ */
+extern bool roaring_iter_next(struct roaring_iter *it, uint32_t *out);
+
+/**
+ * Loop over every integer in a bitmap in increasing order.
+ *
+ * \param bitmap    Pointer to the bitmap.
+ * \param it        (token) name of a struct roaring_iter to declare.
+ * \param val_name  (token) name of a uint32_t loop variable to declare.
+ */
+#define roaring_for_each(bitmap, it, val_name)				\
+	for (struct roaring_iter it = {(bitmap), 0, 0, 0};		\
+	     it.r; it.r = NULL)						\
+		for (uint32_t val_name;					\
+		     roaring_iter_next(&it, &val_name); )
+
+#endif /* STRUCT_ROARING_H */
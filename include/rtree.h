@@ -0,0 +1,210 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file rtree.h
+ *
+ * \author Eric Mueller
+ *
+ * \brief Header file for an R*-tree, a spatial index of 2D rectangles.
+ *
+ * \detail An R-tree is a balanced tree in which every node holds up to
+ * RTREE_MAX_ENTRIES entries, each of which is a rectangle and either a
+ * pointer to a child node (whose entries the rectangle bounds) or, at the
+ * leaves, a pointer to user data. It answers 'which rectangles overlap this
+ * window' and 'which rectangles are closest to this point' by only
+ * descending into nodes whose bounding rectangle is relevant.
+ *
+ * This is the R*-tree variant described here
+ *
+ *     http://dbs.mathematik.uni-marburg.de/publications/myPapers/1990/BKSS90.pdf
+ *
+ * which picks subtrees and splits to minimize overlap, area, and perimeter,
+ * and the first time a node at a given level overflows during an insertion,
+ * reinserts the 30% of its entries farthest from its center instead of
+ * splitting it.
+ *
+ * A tree can also be built in one go from an array of rectangles with
+ * rtree_bulk_load, which uses Sort-Tile-Recursive packing
+ *
+ *     http://www.dtic.mil/dtic/tr/fulltext/u2/a324493.pdf
+ *
+ * and is much faster than inserting one at a time, and gives a better tree.
+ *
+ * The coordinates of each node are stored as four separate arrays (all the
+ * min x's, then all the min y's, ...) so a node's entries can be tested
+ * against a window a few at a time with SIMD instructions. This is done with
+ * AVX when the library is compiled with it enabled (i.e. -mavx or
+ * -march=native).
+ *
+ * Coordinates are doubles, or floats if the library and its users are
+ * compiled with RTREE_COORD_FLOAT defined.
+ *
+ * To use a tree, declare one with the RTREE macro, ex:
+ *
+ *     RTREE(tiles);
+ *
+ * Then use any combination of rtree_insert, rtree_delete, rtree_search and
+ * rtree_nearest. When finished, call rtree_destroy to free all memory
+ * associated with the tree. The tree never touches the data pointers.
+ *
+ * Synchronization is left to the caller. rtree_search and rtree_nearest don't
+ * modify the tree, so they may run concurrently with each other.
+ */
+
+#ifndef STRUCT_RTREE_H
+#define STRUCT_RTREE_H 1
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef RTREE_COORD_FLOAT
+typedef float rtree_coord_t;
+#else
+typedef double rtree_coord_t;
+#endif
+
+/** maximum number of entries in a node */
+#define RTREE_MAX_ENTRIES (16)
+
+/** minimum number of entries in every node except the root (40%) */
+#define RTREE_MIN_ENTRIES (6)
+
+/** an axis aligned rectangle. a point has min == max */
+struct rtree_rect {
+	rtree_coord_t minx;
+	rtree_coord_t miny;
+	rtree_coord_t maxx;
+	rtree_coord_t maxy;
+};
+
+/** r*-tree. don't touch the members, use the api */
+struct rtree {
+	/** root node. opaque */
+	struct rtree_node *root;
+
+	/** number of data items in the tree */
+	size_t nitems;
+
+	/** spare nodes, so inserts can't fail halfway through */
+	struct rtree_node *pool;
+	size_t npool;
+};
+
+/**
+ * \brief Called for each item that matches a search.
+ *
+ * \param data     The item's data pointer.
+ * \param rect     The item's rectangle.
+ * \param private  Whatever was passed to rtree_search.
+ * \return false to stop the search, true to keep going.
+ */
+typedef bool (*rtree_visit_t)(void *data, const struct rtree_rect *rect,
+			      void *private);
+
+/**
+ * \brief Initialize an already allocated tree. See RTREE.
+ */
+#define RTREE_INITIALIZER (struct rtree) {	\
+		.root = NULL,			\
+		.nitems = 0,			\
+		.pool = NULL,			\
+		.npool = 0}
+
+/**
+ * \brief Declare an empty tree.
+ * \param name  (token) name of the tree to declare.
+ */
+#define RTREE(name) struct rtree name = RTREE_INITIALIZER
+
+/**
+ * \brief Free all memory associated with a tree. The tree is left empty and
+ * may be reused.
+ */
+extern void rtree_destroy(struct rtree *t);
+
+/**
+ * \brief Insert an item into a tree.
+ *
+ * \param t     The tree.
+ * \param rect  The item's rectangle. minx <= maxx and miny <= maxy.
+ * \param data  The item's data pointer. Need not be unique.
+ * \return false on allocation failure, in which case the tree is unmodified.
+ */
+extern bool rtree_insert(struct rtree *t, const struct rtree_rect *rect,
+			 void *data);
+
+/**
+ * \brief Remove an item from a tree.
+ *
+ * \param t     The tree.
+ * \param rect  The rectangle the item was inserted with.
+ * \param data  The item's data pointer.
+ * \return true if a matching item was found and removed, false otherwise.
+ */
+extern bool rtree_delete(struct rtree *t, const struct rtree_rect *rect,
+			 void *data);
+
+/**
+ * \brief Find every item whose rectangle overlaps a window (edges count).
+ *
+ * \param t        The tree.
+ * \param window   The window to search.
+ * \param f        Called for each match, in no particular order. May be NULL
+ *                 to just count matches.
+ * \param private  Passed to f.
+ * \return The number of matches passed to f, including the one that stopped
+ * the search if f returned false.
+ */
+extern size_t rtree_search(const struct rtree *t,
+			   const struct rtree_rect *window,
+			   rtree_visit_t f, void *private);
+
+/**
+ * \brief Find the k items closest to a point.
+ *
+ * \param t      The tree.
+ * \param x      x coordinate of the point.
+ * \param y      y coordinate of the point.
+ * \param k      Number of items to find.
+ * \param out    Where to put the data pointers of the items found, closest
+ *               first. Must have room for k.
+ * \param dists  If not NULL, where to put the distance from the point to each
+ *               item's rectangle (zero if the point is inside it).
+ * \return The number of items found (less than k only if the tree has fewer
+ * than k items), or -1 on allocation failure.
+ */
+extern long rtree_nearest(const struct rtree *t, rtree_coord_t x,
+			  rtree_coord_t y, size_t k, void **out,
+			  rtree_coord_t *dists);
+
+/**
+ * \brief Build a tree from arrays of rectangles and data pointers.
+ *
+ * \param t      The tree. Must be empty.
+ * \param rects  The items' rectangles.
+ * \param data   The items' data pointers, parallel to rects.
+ * \param n      Number of items.
+ * \return false on allocation failure or if the tree was not empty, in which
+ * case the tree is unmodified.
+ */
+extern bool rtree_bulk_load(struct rtree *t, const struct rtree_rect *rects,
+			    void *const *data, size_t n);
+
+/**
+ * \brief Get the number of levels in a tree (0 if empty, 1 if just a leaf).
+ */
+extern unsigned rtree_height(const struct rtree *t);
+
+#endif /* STRUCT_RTREE_H */
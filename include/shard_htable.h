@@ -0,0 +1,159 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file shard_htable.h
+ *
+ * \author Eric Mueller
+ *
+ * \brief Header file for a thread safe hash table split into shards.
+ *
+ * \detail A sharded table is a power of two number of independent
+ * swiss_htable's, each behind its own reader-writer lock. The top bits of a
+ * hash of the key pick the shard, so operations on different shards never
+ * contend, and each shard grows (or rehashes) on its own, holding only its
+ * own lock while it does. Each shard is padded out to its own cache lines so
+ * threads working on neighboring shards don't bounce a line between them.
+ *
+ * The batch functions take an array of keys, group them by shard, and take
+ * each shard's lock once per group instead of once per key.
+ *
+ * To use a table, declare a struct shard_htable and call shard_htable_init,
+ * ex:
+ *
+ *     struct shard_htable sessions;
+ *     shard_htable_init(&sessions, 64, 100000);
+ *
+ * then use the same API as swiss_htable.h from any number of threads. When
+ * finished, call shard_htable_destroy, which must not race with anything.
+ */
+
+#ifndef STRUCT_SHARD_HTABLE_H
+#define STRUCT_SHARD_HTABLE_H 1
+
+#include "swiss_htable.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* this definition isn't portable but it's good enough for now */
+#define SHARD_HTABLE_CACHELINE (64)
+
+/** maximum number of shards */
+#define SHARD_HTABLE_MAX_SHARDS (256U)
+
+/** a shard. don't touch the members */
+struct shard_htable_shard {
+	pthread_rwlock_t lock;
+	struct swiss_head table;
+} __attribute__((aligned(SHARD_HTABLE_CACHELINE)));
+
+/** sharded hash table. don't touch the members, use the api */
+struct shard_htable {
+	/** 1 << shard_bits shards */
+	struct shard_htable_shard *shards;
+	unsigned shard_bits;
+
+	/** seed for the hash that picks a key's shard */
+	uint64_t seed;
+};
+
+/**
+ * \brief Initialize a sharded hash table.
+ *
+ * \param t         The table to initialize.
+ * \param nshards   Number of shards, rounded up to a power of two and down to
+ *                  SHARD_HTABLE_MAX_SHARDS. A few times the number of threads
+ *                  that will use the table is plenty.
+ * \param capacity  How many insertions to allocate space for, in total.
+ * \return true on success or false if allocation failed.
+ */
+extern bool shard_htable_init(struct shard_htable *t, unsigned nshards,
+			      unsigned long capacity);
+
+/**
+ * \brief Free all memory associated with a table.
+ */
+extern void shard_htable_destroy(struct shard_htable *t);
+
+/**
+ * \brief Insert a key-value pair. See swiss_htable_insert.
+ */
+extern bool shard_htable_insert(struct shard_htable *t, uint64_t key,
+				const void *val);
+
+/**
+ * \brief Query the existence of a key. See swiss_htable_exists.
+ */
+extern bool shard_htable_exists(struct shard_htable *t, uint64_t key);
+
+/**
+ * \brief Remove a key. See swiss_htable_remove.
+ */
+extern const void *shard_htable_remove(struct shard_htable *t, uint64_t key);
+
+/**
+ * \brief Get the value for a key. See swiss_htable_get.
+ */
+extern bool shard_htable_get(struct shard_htable *t, uint64_t key,
+			     const void **out);
+
+/**
+ * \brief Get the number of entries in a table. Entries inserted or removed
+ * concurrently may or may not be counted.
+ */
+extern unsigned long shard_htable_count(struct shard_htable *t);
+
+/**
+ * \brief Insert many key-value pairs.
+ *
+ * \param t     The table.
+ * \param keys  Keys to insert.
+ * \param vals  Values to insert, parallel to keys.
+ * \param n     Number of keys.
+ * \return The number of keys that were inserted or already present (less
+ * than n only if allocation failed).
+ */
+extern size_t shard_htable_insert_batch(struct shard_htable *t,
+					const uint64_t *keys,
+					const void *const *vals, size_t n);
+
+/**
+ * \brief Get the values for many keys.
+ *
+ * \param t     The table.
+ * \param keys  Keys to look up.
+ * \param out   Where to put the value of each key, parallel to keys. Entries
+ *              for keys that aren't found are not modified.
+ * \param n     Number of keys.
+ * \return The number of keys found.
+ */
+extern size_t shard_htable_get_batch(struct shard_htable *t,
+				     const uint64_t *keys, const void **out,
+				     size_t n);
+
+/**
+ * \brief Remove many keys.
+ *
+ * \param t     The table.
+ * \param keys  Keys to remove.
+ * \param n     Number of keys.
+ * \return The number of keys that were found and removed.
+ */
+extern size_t shard_htable_remove_batch(struct shard_htable *t,
+					const uint64_t *keys, size_t n);
+
+#endif /* STRUCT_SHARD_HTABLE_H */
@@ -0,0 +1,187 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file splay_tree.h
+ *
+ * \author Eric Mueller
+ *
+ * \brief Header file for a splay tree.
+ *
+ * \detail A splay tree is a self-adjusting binary search tree: every access
+ * moves the accessed element to the root with a sequence of rotations (a
+ * 'splay'), roughly halving the depth of every node on the way. There is no
+ * balance information at all, so a single operation can be O(n), but any
+ * sequence of m operations costs O(m log n). More interestingly, frequently
+ * accessed elements stay near the root, so on skewed workloads (caches,
+ * sessions, ...) lookups of hot elements are much cheaper than the O(log n)
+ * descent of a balanced tree. They are described in full here
+ *
+ *     http://www.cs.cmu.edu/~sleator/papers/self-adjusting.pdf
+ *
+ * This implementation splays top-down, so nodes only need two child
+ * pointers and no parent pointer.
+ *
+ * Like rbtree.h, this is meant to be used as a structure member and not a
+ * container. If you want your struct foo to be organized in a splay tree, add
+ * a field of type struct splay_node to your struct declaration, ex:
+ *
+ *   struct foo {
+ *             .
+ *             .
+ *           struct splay_node splay_link;
+ *             .
+ *             .
+ *   };
+ *
+ * Then declare a splay tree with the SPLAY_TREE macro, ex:
+ *
+ *     SPLAY_TREE(foo_tree, cmp_op, struct foo, splay_link);
+ *
+ * The tree can then be modified with splay_insert and splay_delete, queried
+ * with splay_find, and traversed in order with splay_first, splay_last,
+ * splay_next, splay_prev and the splay_for_each macro.
+ *
+ * Note that every one of these, including the 'read only' ones, restructures
+ * the tree. So a tree that is shared between threads needs an exclusive lock
+ * even for lookups, and the tree must not be modified during a traversal
+ * (other than by the traversal itself).
+ *
+ * None of these functions allocate memory.
+ */
+
+#ifndef STRUCT_SPLAY_TREE_H
+#define STRUCT_SPLAY_TREE_H 1
+
+#include <stddef.h>
+
+struct splay_node {
+	struct splay_node *chld[2];
+};
+
+/** should return < 0 if lhs < rhs, 0 if lhs == rhs, and > 0 if lhs > rhs */
+typedef long (*splay_cmp_t)(void *lhs, void *rhs);
+
+struct splay_head {
+	struct splay_node *root;
+	const size_t offset;
+	/* offset of splay_nodes in enclosing structs */
+	splay_cmp_t cmp;
+	size_t nnodes;
+	/* number of nodes in the tree */
+};
+
+/**
+ * \brief Declare a splay tree head.
+ *
+ * \param name       (token) The name of the struct splay_head to declare.
+ * \param lt         (function pointer) The comparison operator for the tree.
+ *                   This function should return < 0 when lhs < rhs, 0 when
+ *                   lhs == rhs, and > 0 when lhs > rhs.
+ * \param container  (type) Type of the enclosing structure.
+ * \param member     (token) name of the struct splay_node member in
+ *                   container.
+ */
+#define SPLAY_TREE(name, lt, container, member)				\
+	struct splay_head name = {					\
+		.root = NULL,						\
+		.offset = offsetof(container, member),			\
+		.cmp = (splay_cmp_t)lt,					\
+		.nnodes = 0};
+
+/**
+ * \brief Insert an element into a tree.
+ *
+ * \param hd   Head of the tree.
+ * \param new  Element to insert.
+ * \return NULL if new was inserted, or the element already in the tree that
+ * matches new, in which case new was not inserted.
+ */
+extern void *splay_insert(struct splay_head *hd, void *new);
+
+/**
+ * \brief Remove an element from a tree.
+ *
+ * \param hd      Head of the tree.
+ * \param victim  Element to remove. Must be in the tree.
+ */
+extern void splay_delete(struct splay_head *hd, void *victim);
+
+/**
+ * \brief Look for an element in a tree, and move it to the root if found.
+ *
+ * \param hd      Head of the tree.
+ * \param findee  Element matching the element to find.
+ * \return Element matching findee, or NULL if no such element exists.
+ */
+extern void *splay_find(struct splay_head *hd, void *findee);
+
+/**
+ * \brief Get the in order first element in a tree.
+ *
+ * \param hd  Head of the tree.
+ * \return The first element in the tree, or NULL if the tree is empty.
+ */
+extern void *splay_first(struct splay_head *hd);
+
+/**
+ * \brief Get the in order last element in a tree.
+ *
+ * \param hd  Head of the tree.
+ * \return The last element in the tree, or NULL if the tree is empty.
+ */
+extern void *splay_last(struct splay_head *hd);
+
+/**
+ * \brief Get the in order next element in a tree.
+ *
+ * \param hd     Head of the tree containing start.
+ * \param start  The element to start at.
+ * \return The element immediately after start, or NULL if start is last.
+ */
+extern void *splay_next(struct splay_head *hd, void *start);
+
+/**
+ * \brief Get the in order previous element in a tree.
+ *
+ * \param hd     Head of the tree containing start.
+ * \param start  The element to start at.
+ * \return The element immediately before start, or NULL if start is first.
+ */
+extern void *splay_prev(struct splay_head *hd, void *start);
+
+/**
+ * \brief Remove every element from a tree, applying a function to each.
+ *
+ * \param hd  Head of the tree. It is empty afterwards.
+ * \param f   Function to apply to each element, in no particular order. It
+ *            may free the element. May be NULL.
+ */
+extern void splay_clear(struct splay_head *hd, void (*f)(void *));
+
+/**
+ * Loop over the elements in a tree in order.
+ *
+ * \param head       Head of the tree to iterate over.
+ * \param type       (token) Type of the iterator to declare (type of the
+ *                   enclosing struct, not a pointer type).
+ * \param iter_name  (token) Name of the iterator to declare (use this in
+ *                   your loop). The macro declares a variable of type @type
+ *                   with this name. Don't declare one yourself.
+ */
+#define splay_for_each(head, type, iter_name)				\
+	for (type *iter_name = (type*)splay_first(head); iter_name;	\
+	     iter_name = (type*)splay_next(head, iter_name))
+
+#endif /* STRUCT_SPLAY_TREE_H */
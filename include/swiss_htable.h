@@ -0,0 +1,188 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file swiss_htable.h
+ *
+ * \author Eric Mueller
+ *
+ * \brief Header file for an open addressing hash table with SIMD probing.
+ *
+ * \detail This is a 'SwissTable', the design of Abseil's flat_hash_map
+ *
+ *     https://abseil.io/about/design/swisstables
+ *
+ * Next to the array of key-value slots is an array of one byte control
+ * words, one per slot, saying whether the slot is empty, deleted (a
+ * tombstone), or full, and for full slots holding 7 bits of the key's hash
+ * (H2). The rest of the hash (H1) picks where to start probing. A probe
+ * loads 16 control bytes at a time and compares all of them against H2 with
+ * one SSE2 instruction, so only slots whose H2 matches (1 in 128 of the
+ * others, on average) have their keys compared. Lookups almost always touch
+ * one line of control bytes and one slot.
+ *
+ * The table holds up to 7/8 of its slots. When it is full and more than a
+ * few of its slots are tombstones, it is rehashed in place to clear them
+ * instead of being doubled.
+ *
+ * The API is the same shape as cuckoo_htable.h. To create a table use the
+ * SWISS_HASH_TABLE macro, ex:
+ *
+ *     SWISS_HASH_TABLE(my_table);
+ *
+ * then call swiss_htable_init to do the initial allocations. When finished,
+ * call swiss_htable_destroy to free all memory associated with the table.
+ * Unlike the cuckoo table, values may be any pointer (including NULL) and
+ * inserts only fail if memory allocation does.
+ *
+ * Synchronization is left to the caller.
+ */
+
+#ifndef STRUCT_SWISS_HTABLE_H
+#define STRUCT_SWISS_HTABLE_H 1
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** number of control bytes probed at once */
+#define SWISS_HTABLE_GROUP (16U)
+
+struct swiss_slot {
+	uint64_t key;
+	const void *val;
+};
+
+struct swiss_head {
+	/* number of key-value pairs currently contained in the table */
+	unsigned long nentries;
+
+	/* maximum number of key-value pairs the table holds before growing */
+	unsigned long capacity;
+
+	/* number of slots (a power of two) minus one */
+	unsigned long mask;
+
+	/* number of empty slots that can be filled before the next rehash */
+	unsigned long growth_left;
+
+	/*
+	 * control bytes, mask + SWISS_HTABLE_GROUP of them. The last
+	 * SWISS_HTABLE_GROUP - 1 copy the first ones, so a group can be loaded
+	 * from any position without wrapping around.
+	 */
+	int8_t *ctrl;
+
+	/* key-value pairs, mask + 1 of them */
+	struct swiss_slot *slots;
+
+	/* seed for the hash function */
+	uint64_t seed;
+
+	/*
+	 * some statistics
+	 *     - resizes is the number of times the table has been resized.
+	 *     - rehashes is the number of times the table has been rehashed
+	 *       in place to clear out tombstones.
+	 */
+	unsigned long stat_resizes;
+	unsigned long stat_rehashes;
+};
+
+/**
+ * \brief Declare a hash table head.
+ *
+ * \param name  (token) The name of the hash table to declare.
+ */
+#define SWISS_HASH_TABLE(name)				\
+	struct swiss_head name = {			\
+		.nentries = 0,				\
+		.capacity = 0,				\
+		.mask = 0,				\
+		.growth_left = 0,			\
+		.ctrl = NULL,				\
+		.slots = NULL,				\
+		.seed = 0,				\
+		.stat_resizes = 0,			\
+		.stat_rehashes = 0}
+
+/**
+ * \brief Initialize a hash table of a given size.
+ *
+ * \param head      Pointer to the hash table to initialize.
+ * \param capacity  How many insertions to allocate space for.
+ * \return true on success or false if table allocation failed.
+ */
+bool swiss_htable_init(struct swiss_head *head, unsigned long capacity);
+
+/**
+ * \brief Deallocate any memory that was allocated by the hash table.
+ * \param head  Pointer to the hash table to deallocate.
+ */
+void swiss_htable_destroy(struct swiss_head *head);
+
+/**
+ * \brief Insert an element into a table.
+ *
+ * \param head  Pointer to the hash table to insert into.
+ * \param key   Key to insert.
+ * \param value Value to insert along with the key.
+ * \return true if the insertion succeeded, false if the table needed to grow
+ *         and memory allocation failed. If the key already exists, insert
+ *         returns true without modifying the table.
+ */
+bool swiss_htable_insert(struct swiss_head *head, uint64_t key,
+			 void const *value);
+
+/**
+ * \brief Query the existence of an element in a table.
+ *
+ * \param head  Pointer to the hash table to search.
+ * \param key   Key to look up.
+ * \return true if the object exists, false if not.
+ */
+bool swiss_htable_exists(struct swiss_head const *head, uint64_t key);
+
+/**
+ * \brief Remove an element from the table.
+ *
+ * \param head  Pointer to hash table to remove from.
+ * \param key   Key to remove.
+ * \return The value that was removed, or NULL if the key wasn't found.
+ */
+const void *swiss_htable_remove(struct swiss_head *head, uint64_t key);
+
+/**
+ * \brief Get the value corresponding to a key, if such a key exists.
+ *
+ * \param head  Pointer to the hash table to search.
+ * \param key   Key to search for.
+ * \param out   If a value is found, it is put here.
+ * \return true if a value corresponding to the given key was found, false if
+ *         it was not found.
+ */
+bool swiss_htable_get(struct swiss_head const *head, uint64_t key,
+		      void const **out);
+
+/**
+ * \brief Resize a hash table.
+ * \param head  The hash table to resize.
+ * \param grow  True if the table should grow, false to shrink.
+ * \return true if the resize is successful, false if memory allocation
+ * fails or if the table can not be shrunk.
+ * \detail If the table is set to grow, its size is doubled. If it is set to
+ * shrink, its size is halved, but only if it is at most a quarter full.
+ */
+bool swiss_htable_resize(struct swiss_head *head, bool grow);
+
+#endif /* STRUCT_SWISS_HTABLE_H */
@@ -0,0 +1,206 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file timer_wheel.h
+ *
+ * \author Eric Mueller
+ *
+ * \brief Header file for a hierarchical timing wheel.
+ *
+ * \detail A timing wheel keeps timers in buckets ('slots') by the tick they
+ * expire on, so arming and cancelling a timer is O(1), instead of the
+ * O(log n) of keeping them sorted in a heap or a tree. It is the right thing
+ * when most timers are cancelled or re-armed before they fire, like
+ * connection timeouts.
+ *
+ *     http://www.cs.columbia.edu/~nahum/w6998/papers/sosp87-timing-wheels.pdf
+ *
+ * Time is in whatever units the caller likes (nanoseconds, milliseconds...),
+ * and is divided into ticks of 'granularity' units each. Timers are only
+ * resolved to a tick: a timer never fires early, but can fire up to a tick
+ * late, or later if timer_wheel_advance isn't called often enough.
+ *
+ * The wheel has several levels of 2^slot_bits slots each. Level 0 has a slot
+ * per tick, level 1 a slot per 2^slot_bits ticks, and so on, so the levels
+ * together cover 2^(slot_bits * levels) ticks. Timers that expire further out
+ * than that are parked in the last slot of the top level and looked at again
+ * each time it comes around. When a higher level slot comes due, its timers
+ * are redistributed ('cascaded') to the levels below, so a timer is moved at
+ * most once per level, and only if it hasn't been cancelled by then.
+ *
+ * Timers are structure members, like list.h, so the wheel does no
+ * allocation per timer. Add a struct timer_wheel_timer to your struct, ex:
+ *
+ *     struct conn {
+ *               .
+ *             struct timer_wheel_timer timeout;
+ *               .
+ *     };
+ *
+ * set it up with timer_wheel_timer_init, and then use timer_wheel_arm and
+ * timer_wheel_cancel on it. Expired timers are collected in batches: call
+ * timer_wheel_advance with the current time and a list declared with
+ * TIMER_WHEEL_LIST, and it moves every timer that is due onto the list, in
+ * order of expiry tick, for you to pop off and handle.
+ *
+ *     TIMER_WHEEL_LIST(expired);
+ *     struct timer_wheel_timer *t;
+ *
+ *     timer_wheel_advance(&wheel, now, &expired);
+ *     while ((t = list_pop_front(&expired)))
+ *             close_conn(container_of(t, struct conn, timeout));
+ *
+ * Synchronization is left to the caller.
+ */
+
+#ifndef STRUCT_TIMER_WHEEL_H
+#define STRUCT_TIMER_WHEEL_H 1
+
+#include "list.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** bounds on the number of bits of slots per level */
+#define TIMER_WHEEL_SLOT_BITS_MIN (1U)
+#define TIMER_WHEEL_SLOT_BITS_MAX (16U)
+
+/** maximum number of levels */
+#define TIMER_WHEEL_MAX_LEVELS (8U)
+
+/** a timer. don't touch the members */
+struct timer_wheel_timer {
+	struct list link;
+
+	/* slot the timer is in, or NULL if it isn't armed */
+	struct list_head *slot;
+
+	/* tick the timer expires on */
+	uint64_t expires;
+};
+
+/** timing wheel. don't touch the members, use the api */
+struct timer_wheel {
+	/** levels << slot_bits slots, level 0 first */
+	struct list_head *slots;
+
+	/** timers armed for ticks that have already been processed */
+	struct list_head due;
+
+	/** a bit per slot, set if the slot has timers in it */
+	uint64_t *nonempty;
+
+	/** units of time per tick */
+	uint64_t granularity;
+
+	/** the next tick to process. every tick before it has been */
+	uint64_t now;
+
+	/** number of armed timers */
+	unsigned long count;
+
+	unsigned slot_bits;
+	unsigned levels;
+};
+
+/**
+ * \brief Declare a list for timer_wheel_advance to put expired timers on.
+ */
+#define TIMER_WHEEL_LIST(name)					\
+	LIST_HEAD(name, struct timer_wheel_timer, link)
+
+/**
+ * \brief Initialize a timing wheel.
+ *
+ * \param w            The wheel to initialize.
+ * \param granularity  Units of time per tick. Must be nonzero.
+ * \param slot_bits    log2 of the number of slots per level, between
+ *                     TIMER_WHEEL_SLOT_BITS_MIN and TIMER_WHEEL_SLOT_BITS_MAX.
+ *                     8 is a good default.
+ * \param levels       Number of levels, at most TIMER_WHEEL_MAX_LEVELS, and
+ *                     slot_bits * levels must be less than 64. Use enough
+ *                     that most timers fit in 2^(slot_bits * levels) ticks.
+ * \param now          The current time.
+ * \return true on success, false if allocation failed or the parameters are
+ * out of range.
+ */
+extern bool timer_wheel_init(struct timer_wheel *w, uint64_t granularity,
+			     unsigned slot_bits, unsigned levels, uint64_t now);
+
+/**
+ * \brief Free all memory associated with a wheel. Timers still armed are
+ * left as they are, and must not be used with the wheel again.
+ */
+extern void timer_wheel_destroy(struct timer_wheel *w);
+
+/**
+ * \brief Initialize a timer, which starts out not armed.
+ */
+static inline void timer_wheel_timer_init(struct timer_wheel_timer *t)
+{
+	t->slot = NULL;
+	t->expires = 0;
+}
+
+/**
+ * \brief Determine if a timer is armed.
+ */
+static inline bool timer_wheel_pending(const struct timer_wheel_timer *t)
+{
+	return t->slot;
+}
+
+/**
+ * \brief Arm a timer, or move it if it is already armed.
+ *
+ * \param w        The wheel.
+ * \param t        The timer.
+ * \param expires  The time to fire the timer at. Times that have already
+ *                 passed fire on the next call to timer_wheel_advance.
+ * \note O(1) complexity.
+ */
+extern void timer_wheel_arm(struct timer_wheel *w, struct timer_wheel_timer *t,
+			    uint64_t expires);
+
+/**
+ * \brief Cancel a timer.
+ *
+ * \param w  The wheel.
+ * \param t  The timer.
+ * \return true if the timer was armed, false if not.
+ * \note O(1) complexity.
+ */
+extern bool timer_wheel_cancel(struct timer_wheel *w,
+			       struct timer_wheel_timer *t);
+
+/**
+ * \brief Advance the wheel, collecting the timers that have expired.
+ *
+ * \param w        The wheel.
+ * \param now      The current time. Times earlier than the last call are
+ *                 ignored.
+ * \param expired  A list declared with TIMER_WHEEL_LIST. Every timer that is
+ *                 due is disarmed and put on the end of this list, in order
+ *                 of the tick it expires on (timers on the same tick are in
+ *                 no particular order).
+ * \return The number of timers put on the list.
+ * \detail This takes time proportional to the number of timers that expire
+ * or are cascaded, plus the number of times level 0 wraps around; ticks
+ * with no timers are skipped over.
+ */
+extern unsigned long timer_wheel_advance(struct timer_wheel *w, uint64_t now,
+					 struct list_head *expired);
+
+#endif /* STRUCT_TIMER_WHEEL_H */
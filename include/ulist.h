@@ -0,0 +1,207 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file ulist.h
+ *
+ * \author Eric Mueller
+ *
+ * \brief Header file for an unrolled list of pointers.
+ *
+ * \detail An unrolled list is a doubly linked list of blocks, each of which
+ * holds an array of up to ULIST_BLOCK_ITEMS pointers. Unlike list.h and
+ * flist.h it is not intrusive: it stores pointers to your data, not links
+ * inside it, so an object can be in any number of them.
+ *
+ * Walking a struct list takes a dependent load (and usually a cache miss) per
+ * element, because the address of the next element isn't known until the
+ * current one has been fetched. Walking an unrolled list reads pointers
+ * sequentially out of cache-line aligned blocks, so the hardware prefetcher
+ * keeps up, and the addresses of the next several elements are known ahead
+ * of time, so fetching the elements themselves overlaps too.
+ *
+ * Pointers can be added and removed at both ends in O(1). The list keeps one
+ * empty block around so pushing and popping back and forth over a block
+ * boundary doesn't call malloc and free each time.
+ *
+ * To use a list, declare one with the ULIST macro, ex:
+ *
+ *     ULIST(handles);
+ *
+ * Then use any combination of ulist_push_back, ulist_push_front,
+ * ulist_pop_back, ulist_pop_front, ulist_first, ulist_last, ulist_for_each
+ * and ulist_for_each_reverse. When finished, call ulist_destroy to free the
+ * blocks (the list never touches the pointers it holds).
+ *
+ * Synchronization is left to the caller.
+ */
+
+#ifndef STRUCT_ULIST_H
+#define STRUCT_ULIST_H 1
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* this definition isn't portable but it's good enough for now */
+#define ULIST_CACHELINE (64)
+
+/** size of each block in bytes, a multiple of ULIST_CACHELINE */
+#define ULIST_BLOCK_SIZE (512)
+
+/** number of pointers in each block */
+#define ULIST_BLOCK_ITEMS ((ULIST_BLOCK_SIZE - 2 * sizeof(void *)	\
+			    - 2 * sizeof(unsigned)) / sizeof(void *))
+
+/** a block of an unrolled list. The used pointers are items[begin, end) */
+struct ulist_block {
+	struct ulist_block *next;
+	struct ulist_block *prev;
+	unsigned begin;
+	unsigned end;
+	void *items[ULIST_BLOCK_ITEMS];
+};
+
+/** unrolled list. don't touch the members, use the api */
+struct ulist {
+	struct ulist_block *first;
+	struct ulist_block *last;
+
+	/** number of pointers in the list */
+	size_t length;
+
+	/** an empty block to use before calling malloc, or NULL */
+	struct ulist_block *spare;
+};
+
+/**
+ * \brief Initialize an already allocated list. See ULIST.
+ */
+#define ULIST_INITIALIZER (struct ulist) {	\
+		.first = NULL,			\
+		.last = NULL,			\
+		.length = 0,			\
+		.spare = NULL}
+
+/**
+ * \brief Declare an empty list.
+ * \param name  (token) name of the list to declare.
+ */
+#define ULIST(name) struct ulist name = ULIST_INITIALIZER
+
+/**
+ * \brief Free all memory associated with a list. The list is left empty and
+ * may be reused.
+ */
+extern void ulist_destroy(struct ulist *ul);
+
+/**
+ * \brief Add a pointer to the end of a list.
+ *
+ * \param ul    The list.
+ * \param data  The pointer to add. May be NULL, but then ulist_pop_back and
+ *              ulist_pop_front can't distinguish it from an empty list.
+ * \return false on allocation failure, in which case the list is unmodified.
+ */
+extern bool ulist_push_back(struct ulist *ul, void *data);
+
+/**
+ * \brief Add a pointer to the front of a list. See ulist_push_back.
+ */
+extern bool ulist_push_front(struct ulist *ul, void *data);
+
+/**
+ * \brief Remove and return the last pointer in a list.
+ * \return The pointer, or NULL if the list was empty.
+ */
+extern void *ulist_pop_back(struct ulist *ul);
+
+/**
+ * \brief Remove and return the first pointer in a list.
+ * \return The pointer, or NULL if the list was empty.
+ */
+extern void *ulist_pop_front(struct ulist *ul);
+
+/**
+ * Get the first pointer in a list.
+ *
+ * \param ul  The list.
+ * \return The first pointer, or NULL if the list is empty.
+ */
+static inline void *ulist_first(const struct ulist *ul)
+{
+	return ul->first ? ul->first->items[ul->first->begin] : NULL;
+}
+
+/**
+ * Get the last pointer in a list.
+ *
+ * \param ul  The list.
+ * \return The last pointer, or NULL if the list is empty.
+ */
+static inline void *ulist_last(const struct ulist *ul)
+{
+	return ul->last ? ul->last->items[ul->last->end - 1] : NULL;
+}
+
+/*
+ * The iteration macros below are three nested loops: over blocks, a loop that
+ * runs once per block to hold the index, and over the block's pointers. So
+ * that break works as expected, the innermost loop sets ___ustop before each
+ * iteration and clears it when it finishes a block normally; if the body
+ * breaks out, ___ustop is left set and the outer loop stops too.
+ */
+
+/**
+ * Loop over the pointers in a list from first to last.
+ *
+ * \param ul         Pointer to the list.
+ * \param type       (token) Type the pointers point to (not a pointer type).
+ * \param iter_name  (token) Name of the iterator to declare (use this in
+ *                   your loop). The macro declares a variable of type
+ *                   @type * with this name. Don't declare one yourself.
+ * \detail           Pointers may be pushed onto the back of the list while
+ *                   iterating, and will be visited. Don't pop anything.
+ */
+#define ulist_for_each(ul, type, iter_name)				\
+	for (struct ulist_block *___ub = (ul)->first, *___ustop = NULL;	\
+	     ___ub;							\
+	     ___ub = ___ustop ? NULL : ___ub->next)			\
+		for (unsigned ___ui = ___ub->begin; ___ui != ~0U;	\
+		     ___ui = ~0U)					\
+			for (type *iter_name;				\
+			     (___ustop = ___ub, ___ui < ___ub->end)	\
+				     ? (iter_name = (type *)		\
+					___ub->items[___ui], true)	\
+				     : (___ustop = NULL, false);	\
+			     ___ui++)
+
+/**
+ * Loop over the pointers in a list from last to first. See ulist_for_each.
+ * \detail Pointers may be pushed onto the front of the list while iterating,
+ * and will be visited. Don't pop anything.
+ */
+#define ulist_for_each_reverse(ul, type, iter_name)			\
+	for (struct ulist_block *___ub = (ul)->last, *___ustop = NULL;	\
+	     ___ub;							\
+	     ___ub = ___ustop ? NULL : ___ub->prev)			\
+		for (unsigned ___ui = ___ub->end; ___ui != ~0U;	\
+		     ___ui = ~0U)					\
+			for (type *iter_name;				\
+			     (___ustop = ___ub, ___ui > ___ub->begin)	\
+				     ? (iter_name = (type *)		\
+					___ub->items[___ui - 1], true)	\
+				     : (___ustop = NULL, false);	\
+			     ___ui--)
+
+#endif /* STRUCT_ULIST_H */
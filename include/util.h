@@ -55,8 +55,11 @@ static inline bool seed_rng()
 		return fallback_seed_rng();
 	}
 
-	if (read(fd, &seeds, sizeof(seeds)) < (int)sizeof(seeds))
+	if (read(fd, &seeds, sizeof(seeds)) < (int)sizeof(seeds)) {
+		close(fd);
 		return fallback_seed_rng();
+	}
+	close(fd);
 
 	pcg64_srandom(seeds[0], seeds[1]);
 	pcg32_srandom(pcg64_random(), pcg64_random());
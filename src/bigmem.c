@@ -0,0 +1,225 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file bigmem.c
+ *
+ * \author Eric Mueller
+ *
+ * \brief Implementation of the allocation options in bigmem.h.
+ *
+ * \detail mbind is called through syscall rather than libnuma, so the
+ * library doesn't pick up a dependency for one system call.
+ */
+
+#define _GNU_SOURCE
+#include "bigmem.h"
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/* this definition isn't portable but it's good enough for now */
+#define CACHELINE (64)
+
+/* likewise, the default huge page size on x86-64 */
+#define HUGE_PAGE (2UL << 20)
+
+/* most nodes we know how to name in a node mask */
+#define MAX_NODES (1024U)
+#define BITS_PER_LONG (8 * sizeof(unsigned long))
+
+static bool is_plain(const struct bigmem_opts *opts)
+{
+	return !opts || (!opts->hugepages
+			 && opts->policy == BIGMEM_POLICY_DEFAULT
+			 && !opts->prefault_threads);
+}
+
+static size_t page_size(void)
+{
+	return sysconf(_SC_PAGESIZE);
+}
+
+/* mappings are whole pages, and huge page mappings whole huge pages */
+static size_t mapped_size(size_t size, const struct bigmem_opts *opts)
+{
+	size_t unit = opts->hugepages ? HUGE_PAGE : page_size();
+
+	return (size + unit - 1) / unit * unit;
+}
+
+static void set_node(unsigned long *mask, unsigned node)
+{
+	mask[node / BITS_PER_LONG] |= 1UL << (node % BITS_PER_LONG);
+}
+
+/*
+ * set the bit of every online node in mask, from a list like "0-3,8". false
+ * if there's no such list, i.e. the kernel has no NUMA support.
+ */
+static bool online_nodes(unsigned long *mask)
+{
+	FILE *f = fopen("/sys/devices/system/node/online", "r");
+	unsigned lo, hi;
+	int c;
+
+	if (!f)
+		return false;
+	while (fscanf(f, "%u", &lo) == 1) {
+		hi = lo;
+		c = fgetc(f);
+		if (c == '-') {
+			if (fscanf(f, "%u", &hi) != 1)
+				break;
+			c = fgetc(f);
+		}
+		for (; lo <= hi && lo < MAX_NODES; lo++)
+			set_node(mask, lo);
+		if (c != ',')
+			break;
+	}
+	fclose(f);
+	return true;
+}
+
+/* set the NUMA policy of a mapping. best effort, see bigmem.h */
+static void place(void *mem, size_t size, const struct bigmem_opts *opts)
+{
+	unsigned long mask[MAX_NODES / BITS_PER_LONG] = {0};
+	int mode;
+
+	switch (opts->policy) {
+	case BIGMEM_POLICY_LOCAL:
+		syscall(SYS_mbind, mem, size, MPOL_LOCAL, NULL, 0, 0);
+		return;
+	case BIGMEM_POLICY_INTERLEAVE:
+		if (!online_nodes(mask))
+			return;
+		mode = MPOL_INTERLEAVE;
+		break;
+	case BIGMEM_POLICY_BIND:
+		if (opts->node >= MAX_NODES)
+			return;
+		set_node(mask, opts->node);
+		mode = MPOL_BIND;
+		break;
+	default:
+		return;
+	}
+	/* the kernel wants one more than the number of bits in the mask */
+	syscall(SYS_mbind, mem, size, mode, mask, MAX_NODES + 1, 0);
+}
+
+struct prefault_range {
+	volatile char *start;
+	volatile char *end;
+	size_t step;
+};
+
+static void *prefault_range(void *arg)
+{
+	struct prefault_range *r = arg;
+	volatile char *p;
+
+	for (p = r->start; p < r->end; p += r->step)
+		*p = 0;
+	return NULL;
+}
+
+/* write a byte to every page of a mapping, from nthreads threads */
+static void prefault(char *mem, size_t size, unsigned nthreads)
+{
+	size_t page = page_size();
+	size_t chunk = (size / page + nthreads - 1) / nthreads * page;
+	struct prefault_range *ranges = calloc(nthreads, sizeof *ranges);
+	pthread_t *threads = calloc(nthreads, sizeof *threads);
+	bool *started = calloc(nthreads, sizeof *started);
+	unsigned i;
+
+	if (!ranges || !threads || !started) {
+		struct prefault_range all = {mem, mem + size, page};
+
+		prefault_range(&all);
+		goto out;
+	}
+
+	for (i = 0; i < nthreads; i++) {
+		ranges[i].start = mem + (i * chunk < size ? i * chunk : size);
+		ranges[i].end = mem + ((i + 1) * chunk < size
+				       ? (i + 1) * chunk : size);
+		ranges[i].step = page;
+	}
+	/* the calling thread does the first range, and any that didn't start */
+	for (i = 1; i < nthreads; i++)
+		started[i] = !pthread_create(&threads[i], NULL, prefault_range,
+					     &ranges[i]);
+	for (i = 0; i < nthreads; i++)
+		if (!started[i])
+			prefault_range(&ranges[i]);
+	for (i = 1; i < nthreads; i++)
+		if (started[i])
+			pthread_join(threads[i], NULL);
+out:
+	free(ranges);
+	free(threads);
+	free(started);
+}
+
+void *bigmem_alloc(size_t size, const struct bigmem_opts *opts)
+{
+	void *mem = MAP_FAILED;
+
+	if (is_plain(opts)) {
+		if (posix_memalign(&mem, CACHELINE, size))
+			return NULL;
+		memset(mem, 0, size);
+		return mem;
+	}
+
+	size = mapped_size(size, opts);
+	if (opts->hugepages)
+		mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (mem == MAP_FAILED) {
+		/* no reserved huge pages, fall back to transparent ones */
+		mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (mem == MAP_FAILED)
+			return NULL;
+		if (opts->hugepages)
+			madvise(mem, size, MADV_HUGEPAGE);
+	}
+
+	/* fresh anonymous memory is already zero, it only has to be placed */
+	place(mem, size, opts);
+	if (opts->prefault_threads)
+		prefault(mem, size, opts->prefault_threads);
+	return mem;
+}
+
+void bigmem_free(void *mem, size_t size, const struct bigmem_opts *opts)
+{
+	if (!mem)
+		return;
+	if (is_plain(opts))
+		free(mem);
+	else
+		munmap(mem, mapped_size(size, opts));
+}
@@ -82,17 +82,16 @@ bool bloom_same_class(const struct bloom *bf0, const struct bloom *bf1)
 static bool bloom_init_arrays(struct bloom *bf)
 {
 	/* try to alocate both arrays */
-	bf->bits = malloc(sizeof *bf->bits * bf->bsize);
+	bf->bits = bigmem_alloc(sizeof *bf->bits * bf->bsize, &bf->mem);
 	if (!bf->bits)
 		return false;
 
 	bf->seeds = malloc(sizeof *bf->seeds * bf->nhash);
 	if (!bf->seeds) {
-		free(bf->bits);
+		bigmem_free(bf->bits, sizeof *bf->bits * bf->bsize, &bf->mem);
 		bf->bits = NULL;
 		return false;
 	}
-	memset(bf->bits, 0, sizeof *bf->bits * bf->bsize);
 	return true;
 }
 
@@ -164,6 +163,7 @@ bool bloom_init_from(struct bloom *restrict bf,
 	bf->nhash = other->nhash;
 	bf->p = other->p;
 	bf->nbits = other->nbits;
+	bf->mem = other->mem;
 
 	if (!bloom_init_arrays(bf))
 		return false;
@@ -174,7 +174,7 @@ bool bloom_init_from(struct bloom *restrict bf,
 
 void bloom_destroy(struct bloom *bf)
 {
-	free(bf->bits);
+	bigmem_free(bf->bits, sizeof *bf->bits * bf->bsize, &bf->mem);
 	free(bf->seeds);
 	bf->bits = NULL;
 	bf->seeds = NULL;
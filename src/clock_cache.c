@@ -0,0 +1,289 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file clock_cache.c
+ *
+ * \author Eric Mueller
+ *
+ * \brief Implementation of a sharded cache with CLOCK eviction.
+ *
+ * \detail Lookups hold a shard's lock for reading, so the only things they
+ * write are the referenced bit, the entry's reference count and the hit
+ * counters, all with atomics. Everything that changes the table or the ring
+ * holds the lock for writing. Entries that leave the cache are collected on
+ * a local list and only released after the lock is dropped, so eviction
+ * callbacks never run under it.
+ */
+
+#include "clock_cache.h"
+#include "util.h"
+#include "fasthash.h"
+#ifdef _POSIX_C_SOURCE
+  #undef _POSIX_C_SOURCE
+#endif
+#define _POSIX_C_SOURCE 200112L
+#include <stdlib.h>
+
+static inline struct clock_cache_shard *shard_of(struct clock_cache *c,
+						 uint64_t key)
+{
+	unsigned long i = 0;
+
+	if (c->shard_bits)
+		i = fasthash64_key(key, c->seed) >> (64 - c->shard_bits);
+	return &c->shards[i];
+}
+
+/* drop a reference, and get rid of the entry if it was the last one */
+static void unref(struct clock_cache *c, struct clock_cache_entry *e)
+{
+	if (__atomic_sub_fetch(&e->refs, 1, __ATOMIC_ACQ_REL))
+		return;
+	if (c->evict)
+		c->evict(e->key, e->val, c->private);
+	free(e);
+}
+
+/*
+ * take an entry out of a shard's table and ring and put it on dead, which
+ * holds the cache's reference on it. the shard must be write locked.
+ */
+static void detach(struct clock_cache_shard *s, struct clock_cache_entry *e,
+		   struct list_head *dead)
+{
+	swiss_htable_remove(&s->table, e->key);
+	if (s->hand == e)
+		s->hand = list_next(&s->ring, e);
+	list_delete(&s->ring, e);
+	s->used -= e->charge;
+	list_push_back(dead, e);
+}
+
+/*
+ * sweep the hand until there's room for charge more, or until every entry
+ * has been passed twice, at which point all of them are pinned.
+ */
+static void make_room(struct clock_cache_shard *s, size_t charge,
+		      struct list_head *dead)
+{
+	size_t steps = 2 * s->ring.length;
+
+	while (s->used + charge > s->capacity && steps-- > 0) {
+		struct clock_cache_entry *e = s->hand ? s->hand
+			: list_first(&s->ring);
+
+		s->hand = list_next(&s->ring, e);
+		if (__atomic_load_n(&e->referenced, __ATOMIC_RELAXED)) {
+			__atomic_store_n(&e->referenced, false,
+					 __ATOMIC_RELAXED);
+			continue;
+		}
+		/* lookups can't add references while we hold the lock */
+		if (__atomic_load_n(&e->refs, __ATOMIC_RELAXED) > 1)
+			continue;
+
+		detach(s, e, dead);
+		s->stat_evictions++;
+	}
+}
+
+static void release_dead(struct clock_cache *c, struct list_head *dead)
+{
+	struct clock_cache_entry *e;
+
+	while ((e = list_pop_front(dead)))
+		unref(c, e);
+}
+
+bool clock_cache_init(struct clock_cache *c, unsigned nshards,
+		      size_t capacity, clock_cache_evict_t evict,
+		      void *private)
+{
+	unsigned i, bits = 0;
+	void *mem;
+
+	while ((1U << bits) < nshards && (1U << bits) < CLOCK_CACHE_MAX_SHARDS)
+		bits++;
+	nshards = 1U << bits;
+
+	if (!seed_rng())
+		return false;
+	if (posix_memalign(&mem, CLOCK_CACHE_CACHELINE,
+			   nshards * sizeof *c->shards))
+		return false;
+	c->shards = mem;
+	c->shard_bits = bits;
+	c->seed = pcg64_random();
+	c->evict = evict;
+	c->private = private;
+
+	for (i = 0; i < nshards; i++) {
+		struct clock_cache_shard *s = &c->shards[i];
+		SWISS_HASH_TABLE(empty);
+		LIST_HEAD(ring, struct clock_cache_entry, link);
+
+		s->table = empty;
+		s->ring = ring;
+		s->hand = NULL;
+		s->used = 0;
+		s->capacity = capacity / nshards;
+		s->stat_hits = 0;
+		s->stat_misses = 0;
+		s->stat_inserts = 0;
+		s->stat_evictions = 0;
+		if (pthread_rwlock_init(&s->lock, NULL))
+			goto fail;
+		if (!swiss_htable_init(&s->table, 16)) {
+			pthread_rwlock_destroy(&s->lock);
+			goto fail;
+		}
+	}
+	return true;
+
+fail:
+	while (i-- > 0) {
+		swiss_htable_destroy(&c->shards[i].table);
+		pthread_rwlock_destroy(&c->shards[i].lock);
+	}
+	free(c->shards);
+	c->shards = NULL;
+	return false;
+}
+
+void clock_cache_destroy(struct clock_cache *c)
+{
+	unsigned i;
+
+	if (!c->shards)
+		return;
+	for (i = 0; i < 1U << c->shard_bits; i++) {
+		struct clock_cache_shard *s = &c->shards[i];
+
+		release_dead(c, &s->ring);
+		swiss_htable_destroy(&s->table);
+		pthread_rwlock_destroy(&s->lock);
+	}
+	free(c->shards);
+	c->shards = NULL;
+}
+
+bool clock_cache_insert(struct clock_cache *c, uint64_t key,
+			const void *val, size_t charge)
+{
+	struct clock_cache_shard *s = shard_of(c, key);
+	LIST_HEAD(dead, struct clock_cache_entry, link);
+	struct clock_cache_entry *e;
+	const void *old;
+	bool ret = false;
+
+	if (charge > s->capacity)
+		return false;
+	e = malloc(sizeof *e);
+	if (!e)
+		return false;
+	e->key = key;
+	e->val = val;
+	e->charge = charge;
+	e->refs = 1;
+	e->referenced = false;
+
+	pthread_rwlock_wrlock(&s->lock);
+	if (swiss_htable_get(&s->table, key, &old))
+		detach(s, (struct clock_cache_entry *)old, &dead);
+	make_room(s, charge, &dead);
+	if (swiss_htable_insert(&s->table, key, e)) {
+		/* just behind the hand, so it's the last thing it gets to */
+		list_insert_before(&s->ring, s->hand, e);
+		s->used += charge;
+		s->stat_inserts++;
+		ret = true;
+	}
+	pthread_rwlock_unlock(&s->lock);
+
+	if (!ret)
+		free(e);
+	release_dead(c, &dead);
+	return ret;
+}
+
+struct clock_cache_entry *clock_cache_lookup(struct clock_cache *c,
+					     uint64_t key)
+{
+	struct clock_cache_shard *s = shard_of(c, key);
+	struct clock_cache_entry *e = NULL;
+	const void *found;
+
+	pthread_rwlock_rdlock(&s->lock);
+	if (swiss_htable_get(&s->table, key, &found)) {
+		e = (struct clock_cache_entry *)found;
+		__atomic_add_fetch(&e->refs, 1, __ATOMIC_RELAXED);
+		/* don't dirty the line if the bit is already set */
+		if (!__atomic_load_n(&e->referenced, __ATOMIC_RELAXED))
+			__atomic_store_n(&e->referenced, true,
+					 __ATOMIC_RELAXED);
+		__atomic_add_fetch(&s->stat_hits, 1, __ATOMIC_RELAXED);
+	} else {
+		__atomic_add_fetch(&s->stat_misses, 1, __ATOMIC_RELAXED);
+	}
+	pthread_rwlock_unlock(&s->lock);
+	return e;
+}
+
+void clock_cache_release(struct clock_cache *c, struct clock_cache_entry *e)
+{
+	unref(c, e);
+}
+
+bool clock_cache_remove(struct clock_cache *c, uint64_t key)
+{
+	struct clock_cache_shard *s = shard_of(c, key);
+	LIST_HEAD(dead, struct clock_cache_entry, link);
+	const void *found;
+	bool ret;
+
+	pthread_rwlock_wrlock(&s->lock);
+	ret = swiss_htable_get(&s->table, key, &found);
+	if (ret)
+		detach(s, (struct clock_cache_entry *)found, &dead);
+	pthread_rwlock_unlock(&s->lock);
+
+	release_dead(c, &dead);
+	return ret;
+}
+
+void clock_cache_stats(struct clock_cache *c, struct clock_cache_stats *out)
+{
+	unsigned i;
+
+	out->hits = 0;
+	out->misses = 0;
+	out->inserts = 0;
+	out->evictions = 0;
+	out->entries = 0;
+	out->used = 0;
+	for (i = 0; i < 1U << c->shard_bits; i++) {
+		struct clock_cache_shard *s = &c->shards[i];
+
+		pthread_rwlock_rdlock(&s->lock);
+		out->hits += __atomic_load_n(&s->stat_hits, __ATOMIC_RELAXED);
+		out->misses += __atomic_load_n(&s->stat_misses,
+					       __ATOMIC_RELAXED);
+		out->inserts += s->stat_inserts;
+		out->evictions += s->stat_evictions;
+		out->entries += s->ring.length;
+		out->used += s->used;
+		pthread_rwlock_unlock(&s->lock);
+	}
+}
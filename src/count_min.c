@@ -0,0 +1,189 @@
+/*
+ * Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \author Eric Mueller
+ *
+ * \file count_min.c
+ *
+ * \brief Implementation of a Count-Min sketch.
+ */
+
+#include "count_min.h"
+#include "fasthash.h"
+#include "util.h"
+#ifdef _POSIX_C_SOURCE
+  #undef _POSIX_C_SOURCE
+#endif
+#define _POSIX_C_SOURCE 200112L
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+
+/* this definition isn't portable but it's good enough for now */
+#define CACHELINE (64)
+
+/* rows are at least a cache line wide */
+#define MIN_WIDTH (CACHELINE / sizeof(uint32_t))
+
+/*
+ * the row i counter for a hash. Rather than hashing the key once per row, the
+ * rows use h1 + i * h2 from the two halves of one hash, which is as good for
+ * this purpose (Kirsch and Mitzenmacher, "Less Hashing, Same Performance").
+ */
+static inline unsigned long row_index(const struct count_min *cm, uint64_t h,
+				      unsigned long i)
+{
+	uint32_t h1 = h, h2 = h >> 32;
+
+	return i * cm->width + ((h1 + i * h2) & (cm->width - 1));
+}
+
+static bool count_min_init_counters(struct count_min *cm)
+{
+	void *mem;
+	size_t size = cm->width * cm->depth * sizeof *cm->counters;
+
+	if (posix_memalign(&mem, CACHELINE, size))
+		return false;
+	cm->counters = mem;
+	memset(cm->counters, 0, size);
+	cm->total = 0;
+	return true;
+}
+
+bool count_min_init(struct count_min *cm)
+{
+	double eps = cm->eps, delta = cm->delta;
+	unsigned long width = MIN_WIDTH;
+
+	if (!seed_rng())
+		return false;
+
+	if (eps < COUNT_MIN_EPS_MIN)
+		eps = COUNT_MIN_EPS_MIN;
+	else if (eps > COUNT_MIN_EPS_MAX)
+		eps = COUNT_MIN_EPS_MAX;
+	if (delta < COUNT_MIN_DELTA_MIN)
+		delta = COUNT_MIN_DELTA_MIN;
+	else if (delta > COUNT_MIN_DELTA_MAX)
+		delta = COUNT_MIN_DELTA_MAX;
+	cm->eps = eps;
+	cm->delta = delta;
+
+	while (width < M_E / eps)
+		width *= 2;
+	cm->width = width;
+	cm->depth = ceil(log(1 / delta));
+	cm->seed = pcg64_random();
+	return count_min_init_counters(cm);
+}
+
+bool count_min_init_from(struct count_min *restrict cm,
+			 const struct count_min *restrict other)
+{
+	cm->seed = other->seed;
+	cm->width = other->width;
+	cm->depth = other->depth;
+	cm->eps = other->eps;
+	cm->delta = other->delta;
+	return count_min_init_counters(cm);
+}
+
+bool count_min_same_class(const struct count_min *cm0,
+			  const struct count_min *cm1)
+{
+	return cm0->seed == cm1->seed && cm0->width == cm1->width
+		&& cm0->depth == cm1->depth;
+}
+
+void count_min_destroy(struct count_min *cm)
+{
+	free(cm->counters);
+	cm->counters = NULL;
+}
+
+void count_min_add(struct count_min *cm, uint64_t key, uint32_t count)
+{
+	uint64_t h = fasthash64_key(key, cm->seed);
+	uint32_t est = UINT32_MAX;
+	unsigned long i;
+
+	for (i = 0; i < cm->depth; i++) {
+		uint32_t c = cm->counters[row_index(cm, h, i)];
+
+		if (c < est)
+			est = c;
+	}
+
+	/* saturate rather than wrap */
+	est = est + count < est ? UINT32_MAX : est + count;
+	for (i = 0; i < cm->depth; i++) {
+		uint32_t *c = &cm->counters[row_index(cm, h, i)];
+
+		if (*c < est)
+			*c = est;
+	}
+	cm->total += count;
+}
+
+uint32_t count_min_query(const struct count_min *cm, uint64_t key)
+{
+	uint64_t h = fasthash64_key(key, cm->seed);
+	uint32_t est = UINT32_MAX;
+	unsigned long i;
+
+	for (i = 0; i < cm->depth; i++) {
+		uint32_t c = cm->counters[row_index(cm, h, i)];
+
+		if (c < est)
+			est = c;
+	}
+	return est;
+}
+
+bool count_min_union(struct count_min *into, const struct count_min *cm0,
+		     const struct count_min *cm1)
+{
+	unsigned long i, n = cm0->width * cm0->depth;
+	uint32_t *out;
+	const uint32_t *a, *b;
+	bool need_free = false;
+
+	/* we allow into to be uninitialized, if it is unique */
+	if (into != cm0 && !into->counters) {
+		need_free = true;
+		if (!count_min_init_from(into, cm0))
+			return false;
+	}
+	if (!count_min_same_class(into, cm0)
+	    || !count_min_same_class(into, cm1)) {
+		if (need_free)
+			count_min_destroy(into);
+		return false;
+	}
+
+	out = into->counters;
+	a = cm0->counters;
+	b = cm1->counters;
+	for (i = 0; i < n; i++) {
+		uint32_t sum = a[i] + b[i];
+
+		/* saturating add, without a branch so this vectorizes */
+		out[i] = sum | -(uint32_t)(sum < a[i]);
+	}
+	into->total = cm0->total + cm1->total;
+	return true;
+}
@@ -47,17 +47,22 @@
  *     http://research.microsoft.com/pubs/73856/stash-full.9-30.pdf
  */
 
+#define _GNU_SOURCE
 #include "cuckoo_htable.h"
 #include "util.h"
 #include "fasthash.h"
-#ifdef _POSIX_C_SOURCE
-  #undef _POSIX_C_SOURCE
-#endif
-#define _POSIX_C_SOURCE 200112L
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <assert.h>
 #include <math.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 /* hash function wrapper */
 static uint64_t cuckoo_hash(uint64_t key, uint64_t seed)
@@ -71,187 +76,146 @@ static uint64_t cuckoo_rand64()
         return pcg64_random();
 }
 
-/**
- * \brief iterate through all the "nests" (buckets) in which a given key
- * could live.
- * \param tables       Pointer to a struct cuckoo_tables
- * \param bucket_name  (token) name of the bucket loop variable to declare --
- *                     this is the identifier to use within the loop
- * \param key          The key whose nests we're iterating over.
- *
- * \note This macro is a double loop, you won't be able to get out of it
- * with a break, you'll need a goto (which I don't think is ever needed
- * in this code).
- *
- * \detail In essence, this is the core of the cuckoo table-walking
- * algorithm. For the ith array in the abstract "table", we get the bucket
- * indexed by the hash seeded with the ith seed.
- *
- * implementation: The outer loop does the actual work (i.e. looping over
- * the tables), and the inner loop just exists so that we have a space to
- * assign the bucket. The '__j' variable exists to make the inner loop
- * run just once. I know this macro is disgusting, but it makes the later
- * code so much prettier later because this loop is so so common.
- */ 
-#define for_each_nest(__tables, bucket_name, __key)                     \
-        for (unsigned long __i = 0, __j = 0;                            \
-             __i < CUCKOO_HTABLE_NTABLES;                               \
-             __i++, __j = 0)                                            \
-                for (struct cuckoo_bucket *bucket_name =                \
-                             &(__tables)->tables[__i][cuckoo_hash(__key,\
-                                             (__tables)->seeds[__i])    \
-                                           % (__tables)->table_buckets];\
-                     __j < 1; __j++)
-
-#define for_each_bucket(__tables, bucket_name)                          \
-        for (unsigned long __i = 0;                                     \
-             __i < CUCKOO_HTABLE_NTABLES;                               \
-             __i++)                                                     \
-                for (unsigned long __j = 0, __k = 0;                    \
-                     __j < (__tables)->table_buckets;                   \
-                     __j++, __k = 0)                                    \
-                        for (struct cuckoo_bucket *bucket_name =        \
-                                     &(__tables)->tables[__i][__j];     \
-                             __k < 1;                                   \
-                             __k++)
-
-
 /* ======= bucket struct and methods ======= */
 
-#define TAG_OCCUPIED ((uintptr_t)0x1)
-#define TAG_INVALID ((uintptr_t)0x2)
-#define TAG_WIDTH (TAG_OCCUPIED | TAG_INVALID)
-
 /* this definition isn't portable but it's good enough for now */
 #define CACHELINE (64)
 
 /* how many keys/values can we fit in a cacheline? */
-#define BUCKET_SIZE (CACHELINE/(sizeof(uint64_t)+sizeof(void*)))
+#define BUCKET_SIZE (CACHELINE/(2*sizeof(uint64_t)))
 
 struct cuckoo_bucket {
         uint64_t keys[BUCKET_SIZE];
+        uint64_t vals[BUCKET_SIZE];
+};
 
-        /*
-         * the lowest bit of each pointer in this array is set high to
-         * denote an occupied kv-pair, low to denote an unoccupied pair.
-         * The other option is to store NULL pointers to denote empty
-         * buckets, but that prevents us from actually storing NULL pointers,
-         * which is a somewhat arbitrary limitation we want to avoid.
-         * We could also keep an integer counter variable, but that
-         * takes a lot of space over all buckets and screws over our memory
-         * alignment.
-         */
-        union {
-                const void *ptrs[BUCKET_SIZE];
-                uintptr_t tags[BUCKET_SIZE];
-        } vals;
+/*
+ * Which slots of a bucket are in use isn't kept in the bucket itself, but in
+ * a byte per bucket in an array next to it. The low BUCKET_SIZE bits of the
+ * byte are set for the occupied slots, and the next BUCKET_SIZE bits for
+ * slots whose key is in the wrong place during a rehash (see do_rehash).
+ *
+ * We used to steal the low bits of the value pointers for this, which meant
+ * values had to be aligned pointers. With the bits somewhere else, a value
+ * is any 64 bit integer, so small values can be stored inline instead of
+ * being allocated just to have something to point to. The occupancy bytes of
+ * 64 buckets fit in one cacheline, so they mostly stay in cache even when the
+ * buckets themselves don't, and finding an empty slot is one bit operation.
+ *
+ * A "nest" is a bucket together with its byte.
+ */
+#define META_OCCUPIED(i) (1U << (i))
+#define META_INVALID(i) (1U << (BUCKET_SIZE + (i)))
+#define META_FULL ((1U << BUCKET_SIZE) - 1)
+
+struct nest {
+        struct cuckoo_bucket *bkt;
+        uint8_t *meta;
 };
 
+/* the nest at index i of array t */
+static struct nest nest_at(const struct cuckoo_tables *tables, unsigned long t,
+                           unsigned long i)
+{
+        return (struct nest){&tables->tables[t][i], &tables->meta[t][i]};
+}
+
+/* the nest a key hashes to in array t */
+static struct nest nest_of(const struct cuckoo_tables *tables, unsigned long t,
+                           uint64_t key)
+{
+        return nest_at(tables, t, cuckoo_hash(key, tables->seeds[t])
+                                  % tables->table_buckets);
+}
+
+#define for_each_nest(__tables, nest_name)                              \
+        for (unsigned long __i = 0;                                     \
+             __i < (__tables)->ntables;                                 \
+             __i++)                                                     \
+                for (unsigned long __j = 0, __k = 0;                    \
+                     __j < (__tables)->table_buckets;                   \
+                     __j++, __k = 0)                                    \
+                        for (struct nest nest_name =                    \
+                                     nest_at((__tables), __i, __j);     \
+                             __k < 1;                                   \
+                             __k++)
+
+
 /* ====== setters/getters for fields within each bucket ====== */
 
-/* set a value at index i in a bucket */
-static void set_val(struct cuckoo_bucket *bkt, const void *val, unsigned long i)
+/* set a value at index i in a bucket, marking the slot occupied */
+static void set_val(struct nest n, uint64_t val, unsigned long i)
 {
-        assert(!((uintptr_t)val & TAG_WIDTH));
-        bkt->vals.ptrs[i] = val;
-        bkt->vals.tags[i] |= TAG_OCCUPIED;
+        n.bkt->vals[i] = val;
+        *n.meta |= META_OCCUPIED(i);
 }
 
 /* retrieve a value at index i from a bucket */
-static const void *get_val(const struct cuckoo_bucket *bkt,
-                                  unsigned long i)
+static uint64_t get_val(struct nest n, unsigned long i)
 {
-        return (const void*)(bkt->vals.tags[i] & ~TAG_WIDTH);
+        return n.bkt->vals[i];
 }
 
 /* remove a value at index i from a bucket */
-static const void *remove_val(struct cuckoo_bucket *bkt, unsigned long i)
+static uint64_t remove_val(struct nest n, unsigned long i)
 {
-        const void *val = get_val(bkt, i);
-        bkt->vals.tags[i] = 0;
-        return val;
+        *n.meta &= ~(META_OCCUPIED(i) | META_INVALID(i));
+        return get_val(n, i);
 }
 
 /* get a key at index i from a bucket */
-static uint64_t get_key(const struct cuckoo_bucket *bkt, unsigned long i)
+static uint64_t get_key(struct nest n, unsigned long i)
 {
-        return bkt->keys[i];
+        return n.bkt->keys[i];
 }
 
 /* set a key at index i in a bucket */
-static void set_key(struct cuckoo_bucket *bkt, uint64_t key, unsigned long i)
+static void set_key(struct nest n, uint64_t key, unsigned long i)
 {
-        bkt->keys[i] = key;
+        n.bkt->keys[i] = key;
 }
 
-/* check if the ith slot in a bucket has a given tag */
-static bool slot_has_tag(const struct cuckoo_bucket *bkt, unsigned long i,
-                         uintptr_t tag)
+/* is the ith slot of a bucket occupied? */
+static bool slot_occupied(struct nest n, unsigned long i)
 {
-        return bkt->vals.tags[i] & tag;
+        return *n.meta & META_OCCUPIED(i);
 }
 
-/* set a tag at index i in a bucket */
-static void set_tag(struct cuckoo_bucket *bkt, unsigned long i, uintptr_t tag)
+/* is the ith slot of a bucket occupied by a key waiting to be rehashed? */
+static bool slot_invalid(struct nest n, unsigned long i)
 {
-        bkt->vals.tags[i] |= tag;
+        return *n.meta & META_INVALID(i);
 }
 
 /* ===== helper functions that operate on individual buckets ===== */
 
-/*
- * \brief insert a key-value pair into a bucket.
- * 
- * \param bkt         Bucket to insert into.
- * \param caller_key  Pointer to key in caller's stack frame.
- * \param caller_val  Pointer to value in caller's stack frame.
- *
- * \detail Looks through a bucket for an empty slot and inserts the given
- * key-value pair in that empty slot (slot gets marked with TAG_OCCUPIED).
- * If an empty slot can not be found, the k-v pair in the last slot of the
- * bucket is evicted & written to caller_key and caller_val.
- * 
- * \return True if the insertion succeeded without having to kick anything
- * out, false if the last value had to be kicked out.
- */
-static bool bucket_insert(struct cuckoo_bucket *bkt,
-                          uint64_t *caller_key,
-                          const void **caller_val)
+#define REHASH_EVICTED_INVALID (0L)
+#define REHASH_EVICTED_VALID (1L)
+#define REHASH_FOUND_SLOT (2L)
+
+/* index of an empty slot in a bucket, or BUCKET_SIZE if it's full */
+static unsigned long bucket_find_empty(struct nest n)
+{
+        unsigned empty = ~*n.meta & META_FULL;
+
+        return empty ? (unsigned long)__builtin_ctz(empty) : BUCKET_SIZE;
+}
+
+/* index of a key in a bucket, or BUCKET_SIZE if it isn't there */
+static unsigned long bucket_find(struct nest n, uint64_t key)
 {
         unsigned long i;
-        uint64_t key = *caller_key;
-        const void *val = *caller_val;
-        bool did_evict = false;
 
-        /* find the first empty slot */
         for (i = 0; i < BUCKET_SIZE; i++)
-                if (!slot_has_tag(bkt, i, TAG_OCCUPIED))
+                if (slot_occupied(n, i) && get_key(n, i) == key)
                         break;
-
-        /* bucket was full, kick out the last kv-pair */
-        if (i == BUCKET_SIZE) {
-                i = pcg32_random() % BUCKET_SIZE;
-                *caller_key = get_key(bkt, i);
-                *caller_val = get_val(bkt, i);
-                did_evict = true;
-        }
-
-        /* insert new kv-pair */
-        set_val(bkt, val, i);
-        set_key(bkt, key, i);
-
-        return !did_evict;
+        return i;
 }
 
-
-#define REHASH_EVICTED_INVALID (0L)
-#define REHASH_EVICTED_VALID (1L)
-#define REHASH_FOUND_SLOT (2L)
-
 /*
  * \brief bucket insertion procedure for use during rehashing.
  *
- * \param bkt         Bucket t/o insert into.
+ * \param n           Nest to insert into.
  * \param caller_key  Pointer to key in caller's stack frame.
  * \param caller_val  Pointer to value in caller's stack frame.
  *
@@ -263,24 +227,22 @@ static bool bucket_insert(struct cuckoo_bucket *bkt,
  * REHASH_EVICTED_INVALID if the evicted k-v pair was invalid, or
  * REHASH_EVICTED_VALID if the evicted k-v pair was valid.
  */ 
-static long bucket_insert_rehash(struct cuckoo_bucket *bkt,
+static long bucket_insert_rehash(struct nest n,
                                  uint64_t *caller_key,
-                                 const void **caller_val)
+                                 uint64_t *caller_val)
 {
         unsigned long i;
         uint64_t key = *caller_key;
-        const void *val = *caller_val;
+        uint64_t val = *caller_val;
         long ret = REHASH_FOUND_SLOT;
 
         /* try to find an empty slot */
-        for (i = 0; i < BUCKET_SIZE; i++)
-                if (!slot_has_tag(bkt, i, TAG_OCCUPIED))
-                        break;
+        i = bucket_find_empty(n);
 
         /* if we couldn't find an empty slot, look for an invalid slot */
         if (i == BUCKET_SIZE)
                 for (i = 0; i < BUCKET_SIZE; i++)
-                        if (slot_has_tag(bkt, i, TAG_INVALID))
+                        if (slot_invalid(n, i))
                                 break;
 
         /* we got to the end */
@@ -288,158 +250,481 @@ static long bucket_insert_rehash(struct cuckoo_bucket *bkt,
                 i = pcg32_random() % BUCKET_SIZE;
 
         /* if the slot in question has something in it, kick it out */
-        if (slot_has_tag(bkt, i, TAG_OCCUPIED)) {
-                ret = slot_has_tag(bkt, i, TAG_INVALID) ?
+        if (slot_occupied(n, i)) {
+                ret = slot_invalid(n, i) ?
                         REHASH_EVICTED_INVALID : REHASH_EVICTED_VALID;
 
-                *caller_key = get_key(bkt, i);
-                *caller_val = get_val(bkt, i);
+                *caller_key = get_key(n, i);
+                *caller_val = remove_val(n, i);
         }
 
         /* insert new kv-pair */
-        set_val(bkt, val, i);
-        set_key(bkt, key, i);
+        set_val(n, val, i);
+        set_key(n, key, i);
 
         return ret;
 }
 
-/* search through a bucket for a key */
-static bool bucket_contains(const struct cuckoo_bucket *bkt,
-                                   uint64_t key)
+/* ===== helper functions that operate on all of a key's nests ===== */
+
+/*
+ * hash a key once per array to find every bucket it could live in, and
+ * prefetch them all, so the cache misses overlap instead of being taken one
+ * after another as the nests are searched.
+ */
+static void get_nests(const struct cuckoo_tables *tables, uint64_t key,
+                      struct nest nests[CUCKOO_HTABLE_MAX_TABLES])
 {
-        unsigned long i = 0;
+        unsigned long i;
 
-        /* walk through the bucket and look for the key */
-        for (i = 0; i < BUCKET_SIZE; i++) {
-                if (slot_has_tag(bkt, i, TAG_OCCUPIED)
-                    && get_key(bkt, i) == key)
-                        return true;
+        for (i = 0; i < tables->ntables; i++) {
+                nests[i] = nest_of(tables, i, key);
+                __builtin_prefetch(nests[i].meta);
+                __builtin_prefetch(nests[i].bkt);
         }
-
-        return false;
 }
 
 /*
- * look through a bucket for a key and remove the corresponding value.
- * returns false if the key was not found
+ * look for a key in its nests. returns the index of the nest it's in, with
+ * its slot in *slot, or -1 if it isn't in the table.
  */
-static bool try_bucket_remove(struct cuckoo_bucket *bkt, uint64_t key, const void **out)
+static long find_in_nests(const struct cuckoo_tables *tables,
+                          const struct nest nests[CUCKOO_HTABLE_MAX_TABLES],
+                          uint64_t key, unsigned long *slot)
 {
         unsigned long i;
 
-        /*
-         * look for the key. If we get to an empty slot, we didn't find it,
-         * so bail.
-         */
-        for (i = 0; i < BUCKET_SIZE; i++) {
-                if (slot_has_tag(bkt, i, TAG_OCCUPIED)
-                    && get_key(bkt, i) == key) {
-                        *out = get_val(bkt, i);
-                        remove_val(bkt, i);
-                        break;
-                }
+        for (i = 0; i < tables->ntables; i++) {
+                *slot = bucket_find(nests[i], key);
+                if (*slot != BUCKET_SIZE)
+                        return i;
         }
+        return -1;
+}
+
+
+/* ======= initialization and destruction methods ======= */
+
+/* ======= tables kept in files ======= */
+
+#define FILE_MAGIC "CUCKOOHT"
+#define FILE_VERSION (1U)
+
+/* the header gets a page to itself, and the arrays start after it */
+#define FILE_HEADER_SIZE (4096UL)
+
+struct file_header {
+        char magic[8];
+        uint32_t version;
+        /* sizeof(struct cuckoo_bucket), as a sanity check */
+        uint32_t bucket_bytes;
+        uint32_t ntables;
+        /* nonzero if the last process to use the table closed it */
+        uint32_t clean;
+        uint64_t table_buckets;
+        uint64_t nentries;
+        uint64_t min_buckets;
+        uint64_t seeds[CUCKOO_HTABLE_MAX_TABLES];
+};
 
-        /* if we didn't get to the end, we removed something */
-        return i != BUCKET_SIZE;
+struct cuckoo_file {
+        /* the table's file, and the one it is being rebuilt into, or -1 */
+        int fd;
+        int new_fd;
+        char *path;
+        char *new_path;
+};
+
+static struct file_header *header_of(const struct cuckoo_tables *tables)
+{
+        return tables->map;
 }
 
-/*
- * look for a key and get the corresponding value if the key is found.
- * returns false if the key was not found
- */
-static bool try_bucket_get(const struct cuckoo_bucket *bkt,
-                           uint64_t key, const void **val)
+/* bytes in a file holding a table of the given geometry */
+static size_t file_size(unsigned long entries, unsigned ntables)
 {
+        size_t page = sysconf(_SC_PAGESIZE);
+        size_t size = FILE_HEADER_SIZE
+                + ntables * entries * (sizeof(struct cuckoo_bucket) + 1);
+
+        return (size + page - 1) / page * page;
+}
+
+/* point the arrays of tables into map: all the buckets, then all the bytes */
+static void map_arrays(struct cuckoo_tables *tables, char *map,
+                       unsigned long entries, unsigned ntables)
+{
+        size_t bytes = entries * sizeof(struct cuckoo_bucket);
+        uint8_t *meta = (uint8_t *)map + FILE_HEADER_SIZE + ntables * bytes;
         unsigned long i;
 
-        for (i = 0; i < BUCKET_SIZE; i++) {
-                if (slot_has_tag(bkt, i, TAG_OCCUPIED)
-                    && get_key(bkt, i) == key ) {
-                        *val = get_val(bkt, i);
-                        return true;
-                }
+        for (i = 0; i < ntables; i++) {
+                tables->tables[i] = (struct cuckoo_bucket *)
+                        (map + FILE_HEADER_SIZE + i * bytes);
+                tables->meta[i] = meta + i * entries;
         }
+        tables->table_buckets = entries;
+        tables->ntables = ntables;
+}
+
+/* open and lock a file, returning the fd or -1 */
+static int lock_file(const char *path, int flags)
+{
+        int fd = open(path, O_RDWR | flags, 0644);
+
+        if (fd < 0)
+                return -1;
+        if (flock(fd, LOCK_EX | LOCK_NB)) {
+                close(fd);
+                return -1;
+        }
+        return fd;
+}
+
+/* write everything but the magic number and version to the header */
+static void store_header(const struct cuckoo_head *head,
+                         const struct cuckoo_tables *tables)
+{
+        struct file_header *hdr = header_of(tables);
+
+        hdr->bucket_bytes = sizeof(struct cuckoo_bucket);
+        hdr->ntables = tables->ntables;
+        hdr->table_buckets = tables->table_buckets;
+        hdr->nentries = head->nentries;
+        hdr->min_buckets = head->min_buckets;
+        memcpy(hdr->seeds, tables->seeds, sizeof hdr->seeds);
+}
+
+/*
+ * size an empty file for a table and map it. The new part of a file reads as
+ * zeros, which is an empty table, so nothing has to be written.
+ */
+static bool map_new_file(struct cuckoo_tables *tables, int fd,
+                         unsigned long entries, unsigned ntables)
+{
+        size_t size = file_size(entries, ntables);
+        struct file_header *hdr;
+        void *map;
+
+        if (ftruncate(fd, size))
+                return false;
+        map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED)
+                return false;
+
+        map_arrays(tables, map, entries, ntables);
+        tables->map = map;
+        tables->map_size = size;
+        hdr = header_of(tables);
+        memcpy(hdr->magic, FILE_MAGIC, sizeof hdr->magic);
+        hdr->version = FILE_VERSION;
+        return true;
+}
+
+/*
+ * map a file for a new table. A table being created goes in the file itself,
+ * one being resized in a new file next to it (see file_replace).
+ */
+static bool file_alloc_table(struct cuckoo_file *file,
+                             struct cuckoo_tables *tables,
+                             unsigned long entries, unsigned ntables,
+                             bool resizing)
+{
+        if (!resizing)
+                return map_new_file(tables, file->fd, entries, ntables);
+
+        file->new_fd = lock_file(file->new_path, O_CREAT | O_TRUNC);
+        if (file->new_fd < 0)
+                return false;
+        if (map_new_file(tables, file->new_fd, entries, ntables))
+                return true;
 
+        unlink(file->new_path);
+        close(file->new_fd);
+        file->new_fd = -1;
         return false;
 }
 
+/* drop a table that was being rebuilt in a new file */
+static void file_abort(struct cuckoo_file *file)
+{
+        unlink(file->new_path);
+        close(file->new_fd);
+        file->new_fd = -1;
+}
+
+/*
+ * make a rebuilt table the table: get it to disk, then rename its file over
+ * the old one, so the path always holds one whole table or the other.
+ */
+static bool file_replace(struct cuckoo_head *head,
+                         struct cuckoo_tables *new_tables)
+{
+        struct cuckoo_file *file = head->file;
 
+        store_header(head, new_tables);
+        if (msync(new_tables->map, new_tables->map_size, MS_SYNC)
+            || rename(file->new_path, file->path))
+                return false;
 
-/* ======= initialization and destruction methods ======= */
+        close(file->fd);
+        file->fd = file->new_fd;
+        file->new_fd = -1;
+        return true;
+}
+
+static void file_close(struct cuckoo_file *file)
+{
+        if (file->fd >= 0)
+                close(file->fd);
+        free(file->path);
+        free(file->new_path);
+        free(file);
+}
 
-/* aligned, zeroed allocation */
-static void *alligned_zalloc(size_t allignment, size_t size)
+static struct cuckoo_file *file_open(const char *path, int flags)
 {
-        void *mem = NULL;
-        posix_memalign(&mem, allignment, size);
-        if (mem)
-                memset(mem, 0, size);
-        return mem;
+        struct cuckoo_file *file = calloc(1, sizeof *file);
+
+        if (!file)
+                return NULL;
+        file->new_fd = -1;
+        file->path = strdup(path);
+        if (!file->path || asprintf(&file->new_path, "%s.resize", path) < 0) {
+                file->new_path = NULL;
+                file->fd = -1;
+                file_close(file);
+                return NULL;
+        }
+        file->fd = lock_file(path, flags);
+        if (file->fd < 0) {
+                file_close(file);
+                return NULL;
+        }
+        return file;
 }
 
+/* count the entries of a table from its occupancy bytes */
+static unsigned long count_entries(const struct cuckoo_tables *tables)
+{
+        unsigned long count = 0;
+
+        for_each_nest(tables, b)
+                count += __builtin_popcount(*b.meta & META_FULL);
+        return count;
+}
+
+/* ======= initialization and destruction methods ======= */
+
 /* allocate all arrays for a cuckoo hash table and initialize seeds */ 
-static bool alloc_table(struct cuckoo_tables *tables, unsigned long entries)
+static bool alloc_table(struct cuckoo_head *head, struct cuckoo_tables *tables,
+                        unsigned long entries, unsigned ntables)
 {
+        const struct bigmem_opts *mem = &head->mem;
         unsigned long i;
 
-        for (i = 0; i < CUCKOO_HTABLE_NTABLES; i++) {
+        for (i = 0; i < ntables; i++)
                 tables->seeds[i] = cuckoo_rand64();
-                tables->tables[i] = alligned_zalloc(CACHELINE,
-                                       entries*sizeof(struct cuckoo_bucket));
-                if (!tables->tables[i])
+        if (head->file)
+                return file_alloc_table(head->file, tables, entries, ntables,
+                                        head->tables.map != NULL);
+
+        tables->map = NULL;
+        tables->map_size = 0;
+        for (i = 0; i < ntables; i++) {
+                tables->tables[i] = bigmem_alloc(
+                                entries*sizeof(struct cuckoo_bucket), mem);
+                tables->meta[i] = bigmem_alloc(entries*sizeof(uint8_t), mem);
+                if (!tables->tables[i] || !tables->meta[i])
                         goto failed_alloc;
         }
         tables->table_buckets = entries;
+        tables->ntables = ntables;
         return true;
 
 failed_alloc:
-        while (i-- > 0)
-                free(tables->tables[i]);
+        do {
+                bigmem_free(tables->tables[i],
+                            entries*sizeof(struct cuckoo_bucket), mem);
+                bigmem_free(tables->meta[i], entries*sizeof(uint8_t), mem);
+        } while (i-- > 0);
         return false;
 }
 
 /* free all memory in a table */
-static void free_table(struct cuckoo_tables *tables)
+static void free_table(const struct cuckoo_head *head,
+                       struct cuckoo_tables *tables)
 {
+        unsigned long entries = tables->table_buckets;
         unsigned long i;
 
-        for (i = 0; i < CUCKOO_HTABLE_NTABLES; i++) {
-                free(tables->tables[i]);
+        if (tables->map)
+                munmap(tables->map, tables->map_size);
+        for (i = 0; i < tables->ntables; i++) {
+                if (!tables->map) {
+                        bigmem_free(tables->tables[i],
+                                    entries*sizeof(struct cuckoo_bucket),
+                                    &head->mem);
+                        bigmem_free(tables->meta[i], entries*sizeof(uint8_t),
+                                    &head->mem);
+                }
                 tables->tables[i] = NULL;
+                tables->meta[i] = NULL;
         }
+        tables->map = NULL;
+        tables->map_size = 0;
 }
 
 /* init rng, get rands, allocate memory, initialize members of head */ 
-bool cuckoo_htable_init(struct cuckoo_head *head,
-                        unsigned long capacity)
+bool cuckoo_htable_init_ntables(struct cuckoo_head *head,
+                                unsigned long capacity, unsigned ntables)
 {
         unsigned long nr_tables;
+
+        if (ntables < CUCKOO_HTABLE_MIN_TABLES
+            || ntables > CUCKOO_HTABLE_MAX_TABLES)
+                return false;
         if (!seed_rng())
                 return false;
 
-        nr_tables = div_round_up_ul(capacity, CUCKOO_HTABLE_NTABLES);
-        if (!alloc_table(&head->tables, nr_tables))
+        nr_tables = div_round_up_ul(capacity, ntables);
+        if (!alloc_table(head, &head->tables, nr_tables, ntables))
                 return false;
 
-        head->capacity = capacity;
+        head->capacity = nr_tables * ntables * BUCKET_SIZE;
+        head->min_buckets = nr_tables;
         return true;
 }
 
+bool cuckoo_htable_init(struct cuckoo_head *head,
+                        unsigned long capacity)
+{
+        return cuckoo_htable_init_ntables(head, capacity,
+                                          CUCKOO_HTABLE_NTABLES);
+}
+
 /* free all memory, zero out all the members of head */ 
 void cuckoo_htable_destroy(struct cuckoo_head *head)
 {
-        free_table(&head->tables);
+        if (head->file) {
+                cuckoo_htable_checkpoint(head);
+                header_of(&head->tables)->clean = 1;
+                msync(head->tables.map, FILE_HEADER_SIZE, MS_SYNC);
+        }
+        free_table(head, &head->tables);
+        if (head->file) {
+                file_close(head->file);
+                head->file = NULL;
+        }
         head->nentries = 0;
         head->capacity = 0;
 }
 
+bool cuckoo_htable_create_file(struct cuckoo_head *head, const char *path,
+                               unsigned long capacity, unsigned ntables)
+{
+        head->tables.map = NULL;
+        head->file = file_open(path, O_CREAT | O_TRUNC);
+        if (!head->file)
+                return false;
+        if (!cuckoo_htable_init_ntables(head, capacity, ntables)) {
+                unlink(path);
+                file_close(head->file);
+                head->file = NULL;
+                return false;
+        }
+        store_header(head, &head->tables);
+        return true;
+}
+
+/* check that a header describes a table this code can use in a file */
+static bool header_ok(const struct file_header *hdr, size_t size)
+{
+        return !memcmp(hdr->magic, FILE_MAGIC, sizeof hdr->magic)
+                && hdr->version == FILE_VERSION
+                && hdr->bucket_bytes == sizeof(struct cuckoo_bucket)
+                && hdr->ntables >= CUCKOO_HTABLE_MIN_TABLES
+                && hdr->ntables <= CUCKOO_HTABLE_MAX_TABLES
+                && hdr->table_buckets
+                && hdr->min_buckets <= hdr->table_buckets
+                && file_size(hdr->table_buckets, hdr->ntables) == size;
+}
+
+bool cuckoo_htable_open_file(struct cuckoo_head *head, const char *path)
+{
+        struct cuckoo_tables *tables = &head->tables;
+        struct file_header *hdr;
+        struct stat st;
+        void *map;
+
+        if (!seed_rng())
+                return false;
+        head->file = file_open(path, 0);
+        if (!head->file)
+                return false;
+        if (fstat(head->file->fd, &st)
+            || (size_t)st.st_size < FILE_HEADER_SIZE)
+                goto failed_open;
+        map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   head->file->fd, 0);
+        if (map == MAP_FAILED)
+                goto failed_open;
+        hdr = map;
+        if (!header_ok(hdr, st.st_size)) {
+                munmap(map, st.st_size);
+                goto failed_open;
+        }
+
+        map_arrays(tables, map, hdr->table_buckets, hdr->ntables);
+        memcpy(tables->seeds, hdr->seeds, sizeof tables->seeds);
+        tables->map = map;
+        tables->map_size = st.st_size;
+        head->nentries = hdr->clean ? hdr->nentries : count_entries(tables);
+        head->capacity = tables->table_buckets * tables->ntables * BUCKET_SIZE;
+        head->min_buckets = hdr->min_buckets;
+
+        /*
+         * the flag has to be on disk before anything else changes, or a
+         * crash could leave a modified file that still claims to be clean.
+         */
+        hdr->clean = 0;
+        if (msync(map, FILE_HEADER_SIZE, MS_SYNC)) {
+                tables->map = NULL;
+                munmap(map, st.st_size);
+                goto failed_open;
+        }
+        return true;
+
+failed_open:
+        file_close(head->file);
+        head->file = NULL;
+        return false;
+}
+
+bool cuckoo_htable_checkpoint(struct cuckoo_head *head)
+{
+        if (!head->file)
+                return false;
+        store_header(head, &head->tables);
+        return !msync(head->tables.map, head->tables.map_size, MS_SYNC);
+}
+
 
 
 /* ======= insertion, deletion, and query methods ======= */
 
 #define MAX_INSERT_TRIES_MULTIPLIER (4UL)
 
+/*
+ * how full the table gets before it grows, indexed by the number of arrays.
+ * The more nests each key has, the more paths there are to look at. The
+ * capped path search starts failing at about 94.5% with 2 arrays, 98.4% with
+ * 3 and 98.9% with 4, so the table grows a little before that.
+ */
+static const unsigned long max_load_percent[CUCKOO_HTABLE_MAX_TABLES + 1] = {
+        [2] = 93, [3] = 97, [4] = 98
+};
+
 /*
  * max number of tries to insert given the number of entries in a table.
  * TODO: this is wrong-ish but close enough for now.
@@ -452,48 +737,159 @@ static unsigned long max_insert_tries(unsigned long entries)
 /* returns true if a table needs to be resized */
 static bool needs_resize(const struct cuckoo_head *head)
 {
-        /* this value imples half of the buckets are full */
-        unsigned long threshold = CUCKOO_HTABLE_NTABLES
-                                * (BUCKET_SIZE - 1)
-                                * head->tables.table_buckets;
+        unsigned long ntables = head->tables.ntables;
+        unsigned long slots = ntables
+                            * BUCKET_SIZE
+                            * head->tables.table_buckets;
 
-        return head->nentries >= threshold;
+        /* not slots / 100 * pct, which is 0 for small tables */
+        return head->nentries * 100 >= slots * max_load_percent[ntables];
 }
 
 /*
- * The work of insertion is done here. return true if we successfully inserted
+ * a table shrinks when removals leave it less than this full, in percent,
+ * to a size it fills between 2 and 4 times as much. That leaves a wide gap
+ * between the loads that make it shrink and grow again.
  */
-static bool do_insert(struct cuckoo_tables *tables, uint64_t *key,
-                      void const **val, unsigned long max_tries)
+#define MIN_LOAD_PERCENT (12UL)
+
+/* how many buckets per array the table should shrink to, or 0 for none */
+static unsigned long shrink_target(const struct cuckoo_head *head)
 {
-        unsigned long i, which_array;
+        unsigned long per_bucket = head->tables.ntables * BUCKET_SIZE;
+        unsigned long buckets = head->tables.table_buckets;
+
+        if (head->nentries * 100 >= head->capacity * MIN_LOAD_PERCENT
+            || buckets / 2 < head->min_buckets || buckets < 2)
+                return 0;
+
+        /* halve until the next halving would be more than half full */
+        do {
+                buckets /= 2;
+        } while (buckets / 2 >= head->min_buckets && buckets >= 2
+                 && head->nentries < buckets / 2 * per_bucket / 2);
+        return buckets;
+}
 
-        /*
-         * idea: keep looping until bucket_insert succeeds. Each time its
-         * called, the key and value arguments get reassigned with a
-         * new key/value, which we then try to insert on the next iteration.
-         *
-         * this is the "cuckoo" part of cuckoo hashing -- kicking out old
-         * values when we find fully occupied buckets.
-         */
-        for (i = 0, which_array = 0; i < max_tries; i++, which_array++) {
-                uint64_t hash;
-                struct cuckoo_bucket *b;
+/* ===== breadth-first search for a cuckoo path ===== */
+
+/* most keys moved to make room for one insertion */
+#define BFS_MAX_DEPTH (5UL)
+
+/* most buckets looked at by one search */
+#define BFS_MAX_NODES (512UL)
+
+/*
+ * a bucket reached by the search, in array table. Its parent is the bucket
+ * holding the key that would move into it, in slot from_slot.
+ */
+struct bfs_node {
+        struct nest nest;
+        unsigned long table;
+        long parent;
+        unsigned long from_slot;
+        unsigned long depth;
+};
 
-                which_array %= CUCKOO_HTABLE_NTABLES;
+/* is a bucket on the path from queue[i] back to its root? */
+static bool on_path(const struct bfs_node *queue, long i,
+                    const struct cuckoo_bucket *bkt)
+{
+        for (; i >= 0; i = queue[i].parent)
+                if (queue[i].nest.bkt == bkt)
+                        return true;
+        return false;
+}
 
-                hash = cuckoo_hash(*key, tables->seeds[which_array]);
-                hash %= tables->table_buckets;
+/*
+ * move every key on the path to queue[i] one bucket along, into slot dst of
+ * queue[i] first, then store the new key where the first one moved out of.
+ */
+static void shift_path(const struct bfs_node *queue, long i, unsigned long dst,
+                       uint64_t key, uint64_t val)
+{
+        for (; queue[i].parent >= 0; i = queue[i].parent) {
+                const struct bfs_node *n = &queue[i];
+                struct nest p = queue[n->parent].nest;
+
+                set_val(n->nest, get_val(p, n->from_slot), dst);
+                set_key(n->nest, get_key(p, n->from_slot), dst);
+                dst = n->from_slot;
+        }
+        set_val(queue[i].nest, val, dst);
+        set_key(queue[i].nest, key, dst);
+}
 
-                b = &tables->tables[which_array][hash];
-                if (bucket_insert(b, key, val))
+/*
+ * The work of insertion is done here. return true if we successfully
+ * inserted.
+ *
+ * This is the "cuckoo" part of cuckoo hashing: if the key's nests are full,
+ * something in them has to be kicked out to one of its other nests, which
+ * may kick something else out, and so on. Rather than kicking out keys at
+ * random until one lands in an empty slot, we search breadth first from the
+ * key's nests, through the other nests of the keys in each full bucket, for
+ * the nearest bucket with an empty slot, like MemC3 and libcuckoo do:
+ *
+ *     https://www.cs.cmu.edu/~dga/papers/memc3-nsdi2013.pdf
+ *
+ * Nothing moves until a free slot is found, and then only the keys on the
+ * path to it, so a failed search leaves the table as it was.
+ */
+static bool do_insert(struct cuckoo_tables *tables, uint64_t key, uint64_t val)
+{
+        struct bfs_node queue[BFS_MAX_NODES];
+        struct nest nests[CUCKOO_HTABLE_MAX_TABLES];
+        unsigned long head = 0, tail = 0, i, j, slot;
+
+        get_nests(tables, key, nests);
+        for (i = 0; i < tables->ntables; i++) {
+                slot = bucket_find_empty(nests[i]);
+                if (slot != BUCKET_SIZE) {
+                        set_val(nests[i], val, slot);
+                        set_key(nests[i], key, slot);
                         return true;
+                }
+                queue[tail++] = (struct bfs_node){nests[i], i, -1, 0, 0};
+        }
+
+        for (; head < tail; head++) {
+                const struct bfs_node *n = &queue[head];
+
+                if (n->depth == BFS_MAX_DEPTH)
+                        break;
+
+                for (i = 0; i < BUCKET_SIZE; i++) {
+                        uint64_t k = get_key(n->nest, i);
+
+                        for (j = 0; j < tables->ntables; j++) {
+                                struct nest b;
+
+                                if (j == n->table)
+                                        continue;
+                                b = nest_of(tables, j, k);
+                                if (on_path(queue, head, b.bkt))
+                                        continue;
+                                if (tail == BFS_MAX_NODES)
+                                        return false;
+
+                                queue[tail] = (struct bfs_node){
+                                        b, j, head, i, n->depth + 1};
+                                slot = bucket_find_empty(b);
+                                if (slot != BUCKET_SIZE) {
+                                        shift_path(queue, tail, slot,
+                                                   key, val);
+                                        return true;
+                                }
+                                tail++;
+                        }
+                }
         }
         return false;
 }
 
 static bool do_insert_rehash(struct cuckoo_tables *tables, uint64_t *key,
-                             void const **val, unsigned long max_tries)
+                             uint64_t *val, unsigned long max_tries)
 {
         unsigned long i, which_array;
 
@@ -506,17 +902,11 @@ static bool do_insert_rehash(struct cuckoo_tables *tables, uint64_t *key,
          * inserting a new value from scratch that was in the wrong place.
          */
         for (i = 0, which_array = 0; i < max_tries; which_array++) {
-                uint64_t hash;
-                struct cuckoo_bucket *bucket;
                 long ret;
 
-                which_array %= CUCKOO_HTABLE_NTABLES;
-
-                hash = cuckoo_hash(*key, tables->seeds[which_array]);
-                hash %= tables->table_buckets;
-
-                bucket = &tables->tables[which_array][hash];
-                ret = bucket_insert_rehash(bucket, key, val);
+                which_array %= tables->ntables;
+                ret = bucket_insert_rehash(nest_of(tables, which_array, *key),
+                                           key, val);
 
                 if (ret == REHASH_FOUND_SLOT)
                         return true;
@@ -531,46 +921,222 @@ static bool do_insert_rehash(struct cuckoo_tables *tables, uint64_t *key,
         return false;
 }
 
+/* ===== filling a new table from several threads ===== */
+
+/* tables with fewer buckets than this are always refilled on one thread */
+#define PARALLEL_MIN_BUCKETS (1UL << 14)
+
+/* one thread's share of the work of moving a table into a new one */
+struct fill_work {
+        const struct cuckoo_tables *old;
+        struct cuckoo_tables *new;
+
+        /* range of buckets to move, counting across all the old arrays */
+        unsigned long begin;
+        unsigned long end;
+
+        /* keys that didn't find an empty slot in any of their nests */
+        uint64_t *keys;
+        uint64_t *vals;
+        unsigned long nleft;
+        unsigned long left_cap;
+        bool failed;
+};
+
+/*
+ * claim an empty slot in a nest other threads may be claiming slots in too,
+ * returning its index or BUCKET_SIZE if the nest is full. Only the occupancy
+ * byte is shared, the key and value of a claimed slot are the claimer's.
+ */
+static unsigned long claim_slot(struct nest n)
+{
+        uint8_t m = __atomic_load_n(n.meta, __ATOMIC_RELAXED);
+        unsigned long slot;
+
+        while ((m & META_FULL) != META_FULL) {
+                slot = __builtin_ctz(~m & META_FULL);
+                if (__atomic_compare_exchange_n(n.meta, &m,
+                                                m | META_OCCUPIED(slot), true,
+                                                __ATOMIC_RELAXED,
+                                                __ATOMIC_RELAXED))
+                        return slot;
+        }
+        return BUCKET_SIZE;
+}
+
+static bool push_leftover(struct fill_work *w, uint64_t key, uint64_t val)
+{
+        if (w->nleft == w->left_cap) {
+                unsigned long cap = w->left_cap ? w->left_cap * 2 : 64;
+                uint64_t *keys = realloc(w->keys, cap * sizeof *keys);
+                uint64_t *vals;
+
+                if (!keys)
+                        return false;
+                w->keys = keys;
+                vals = realloc(w->vals, cap * sizeof *vals);
+                if (!vals)
+                        return false;
+                w->vals = vals;
+                w->left_cap = cap;
+        }
+        w->keys[w->nleft] = key;
+        w->vals[w->nleft] = val;
+        w->nleft++;
+        return true;
+}
+
+/*
+ * move the keys of a range of old buckets into empty slots of their nests in
+ * the new table. Moving keys around to make room would mean locking whole
+ * cuckoo paths, so keys whose nests are all full are left for later.
+ */
+static void *fill_range(void *arg)
+{
+        struct fill_work *w = arg;
+        unsigned long tb = w->old->table_buckets;
+        struct nest nests[CUCKOO_HTABLE_MAX_TABLES];
+        unsigned long b, i, t, slot;
+
+        for (b = w->begin; b < w->end && !w->failed; b++) {
+                struct nest n = nest_at(w->old, b / tb, b % tb);
+
+                for (i = 0; i < BUCKET_SIZE; i++) {
+                        uint64_t key, val;
+
+                        if (!slot_occupied(n, i))
+                                continue;
+                        key = get_key(n, i);
+                        val = get_val(n, i);
+                        get_nests(w->new, key, nests);
+                        for (t = 0; t < w->new->ntables; t++) {
+                                slot = claim_slot(nests[t]);
+                                if (slot != BUCKET_SIZE)
+                                        break;
+                        }
+                        if (t < w->new->ntables) {
+                                nests[t].bkt->keys[slot] = key;
+                                nests[t].bkt->vals[slot] = val;
+                        } else if (!push_leftover(w, key, val)) {
+                                w->failed = true;
+                                break;
+                        }
+                }
+        }
+        return NULL;
+}
+
+/* move every key of old into new, on this thread */
+static bool serial_fill(const struct cuckoo_tables *old,
+                        struct cuckoo_tables *new)
+{
+        for_each_nest(old, b) {
+                unsigned long i;
+                for (i = 0; i < BUCKET_SIZE; i++) {
+                        if (!slot_occupied(b, i))
+                                continue;
+
+                        if (!do_insert(new, get_key(b, i), get_val(b, i)))
+                                return false;
+                }
+        }
+        return true;
+}
+
+/*
+ * move every key of old into new from nthreads threads. Each takes a share
+ * of the old buckets and puts keys straight into empty slots, then the few
+ * keys that didn't find one are inserted the usual way on this thread.
+ */
+static bool parallel_fill(const struct cuckoo_tables *old,
+                          struct cuckoo_tables *new, unsigned nthreads)
+{
+        unsigned long total = old->ntables * old->table_buckets;
+        unsigned long chunk = div_round_up_ul(total, nthreads);
+        struct fill_work *work = calloc(nthreads, sizeof *work);
+        pthread_t *threads = calloc(nthreads, sizeof *threads);
+        bool *started = calloc(nthreads, sizeof *started);
+        bool ok = true;
+        unsigned long i, j;
+
+        /* the threads are only there to go faster, so do without them */
+        if (!work || !threads || !started) {
+                ok = serial_fill(old, new);
+                goto out;
+        }
+
+        for (i = 0; i < nthreads; i++) {
+                work[i].old = old;
+                work[i].new = new;
+                work[i].begin = i * chunk < total ? i * chunk : total;
+                work[i].end = (i + 1) * chunk < total ? (i + 1) * chunk
+                                                      : total;
+        }
+        /* this thread does the first share, and any that didn't start */
+        for (i = 1; i < nthreads; i++)
+                started[i] = !pthread_create(&threads[i], NULL, fill_range,
+                                             &work[i]);
+        for (i = 0; i < nthreads; i++)
+                if (!started[i])
+                        fill_range(&work[i]);
+        for (i = 1; i < nthreads; i++)
+                if (started[i])
+                        pthread_join(threads[i], NULL);
+
+        for (i = 0; ok && i < nthreads; i++) {
+                ok = !work[i].failed;
+                for (j = 0; ok && j < work[i].nleft; j++)
+                        ok = do_insert(new, work[i].keys[j], work[i].vals[j]);
+        }
+
+        for (i = 0; i < nthreads; i++) {
+                free(work[i].keys);
+                free(work[i].vals);
+        }
+out:
+        free(work);
+        free(threads);
+        free(started);
+        return ok;
+}
+
 /**
  * \brief Resize a table.
  * \param head       The hash table to resize.
  * \param new_size   The number of buckets to allocate for each of the
- *                   CUCKOO_HTABLE_NTABLES arrays.
+ *                   arrays.
  * \return true on success, false otherwise.
  */ 
 static bool do_resize(struct cuckoo_head *head, unsigned long new_size)
 {
-        unsigned long tries = max_insert_tries(head->nentries);
         struct cuckoo_tables new_tables;
 
-        if (!alloc_table(&new_tables, new_size))
+        if (!alloc_table(head, &new_tables, new_size, head->tables.ntables))
                 return false;
 
         /* insert everything into the new table */
-        for_each_bucket(&head->tables, b) {
-                unsigned long i;
-                for (i = 0; i < BUCKET_SIZE; i++) {
-                        uint64_t key;
-                        const void *val;
-
-                        if (!slot_has_tag(b, i, TAG_OCCUPIED))
-                                continue;
-
-                        key = get_key(b, i);
-                        val = get_val(b, i);
-                        if (!do_insert(&new_tables, &key, &val, tries))
-                                goto failed_insert;
-                }
+        if (head->resize_threads > 1
+            && head->tables.table_buckets >= PARALLEL_MIN_BUCKETS) {
+                if (!parallel_fill(&head->tables, &new_tables,
+                                   head->resize_threads))
+                        goto failed_insert;
+        } else if (!serial_fill(&head->tables, &new_tables)) {
+                goto failed_insert;
         }
 
+        if (head->file && !file_replace(head, &new_tables))
+                goto failed_insert;
+
         /* free the old table and assign the new one */
-        free_table(&head->tables);
+        free_table(head, &head->tables);
         head->tables = new_tables;
-        head->capacity = new_size * CUCKOO_HTABLE_NTABLES * BUCKET_SIZE;
+        head->capacity = new_size * new_tables.ntables * BUCKET_SIZE;
         return true;
 
 failed_insert:
-        free_table(&new_tables);
+        free_table(head, &new_tables);
+        if (head->file)
+                file_abort(head->file);
         return false;
 }
 
@@ -583,38 +1149,37 @@ failed_insert:
  * \detail Rehashing is implemented in place. First every occupied slot in
  * the table is marked as invalid, meaning that the key is not in the slot
  * that corresponds to its hash. Then every key in an invalid slot is
- * evicted, rehashed, and reinserted.
+ * evicted, rehashed, and reinserted. Not for a table in a file, which a
+ * crash partway through would leave with keys it can't find.
  */ 
 static unsigned long do_rehash(struct cuckoo_tables *tables, unsigned long tries)
 {
         unsigned long i;
-        const void *val;
-        uint64_t key;
+        uint64_t key, val;
         bool has_orphan = false;
         unsigned long retries = 0;
 
 again:
         /* re-seed the hash functions */
-        for (i = 0; i < CUCKOO_HTABLE_NTABLES; i++)
+        for (i = 0; i < tables->ntables; i++)
                 tables->seeds[i] = cuckoo_rand64();
 
         /* mark everything as invalid */
-        for_each_bucket(tables, b)
-                for (i = 0; i < BUCKET_SIZE; i++)
-                        if (slot_has_tag(b, i, TAG_OCCUPIED))
-                                set_tag(b, i, TAG_INVALID);
+        for_each_nest(tables, b)
+                *b.meta |= (*b.meta & META_FULL) << BUCKET_SIZE;
 
         /* reinsert an outstanding k-v pair if we have one */
         if (has_orphan) {
                 /* this should never fail */
-                assert(do_insert_rehash(tables, &key, &val, tries));
+                bool ok = do_insert_rehash(tables, &key, &val, tries);
+                assert(ok);
+                (void)ok;
                 has_orphan = false;
         }
 
-        for_each_bucket(tables, b)
+        for_each_nest(tables, b)
                 for (i = 0; i < BUCKET_SIZE; i++) {
-                        if (!slot_has_tag(b, i, TAG_INVALID)
-                            || !slot_has_tag(b, i, TAG_OCCUPIED))
+                        if (!slot_invalid(b, i))
                                 continue;
 
                         key = get_key(b, i);
@@ -631,23 +1196,15 @@ again:
 }
 
 /*
- * inset a key-value pair into the table. Because of the evicting nature
- * of the cuckoo insertion algorithm, our insertion helpers take
- * pointers to keys/values so they can return key/values that they evict.
- * they need something to point to, so we keep the "anchor" key and value
- * in this function's stack frame.
- */ 
-bool cuckoo_htable_insert(struct cuckoo_head *head, uint64_t key,
-                          void const *val)
+ * insert a key-value pair that isn't in the table, given the key's nests
+ * (which are recomputed if the table has to grow).
+ */
+static bool insert_new(struct cuckoo_head *head, uint64_t key, uint64_t val,
+                       struct nest nests[CUCKOO_HTABLE_MAX_TABLES])
 {
         unsigned long fails = 0;
-        uint64_t key_anchor = key;
-        const void *val_anchor = val;
         unsigned long tries = max_insert_tries(head->nentries);
-
-        /* if it exists, yay */
-        if (cuckoo_htable_exists(head, key))
-                return true;
+        unsigned long i, slot;
 
         /* do we need to resize the table? */
         if (needs_resize(head)) {
@@ -655,27 +1212,87 @@ bool cuckoo_htable_insert(struct cuckoo_head *head, uint64_t key,
                         head->stat_resizes++;
                 else
                         return false;
+                get_nests(&head->tables, key, nests);
         }
 
         head->nentries++;
-        if (!do_insert(&head->tables, &key_anchor, &val_anchor, tries)) {
-                /*
-                 * rehashing is done in an infinite loop, but assuming the
-                 * random number generator doesn't suck and we're not trying to
-                 * insert into an overfull table, it should always succeed after
-                 * just a few tries.
-                 */
-                head->stat_rehashes++;
+
+        /* take an empty slot in any nest before searching for a path */
+        for (i = 0; i < head->tables.ntables; i++) {
+                slot = bucket_find_empty(nests[i]);
+                if (slot != BUCKET_SIZE) {
+                        set_val(nests[i], val, slot);
+                        set_key(nests[i], key, slot);
+                        return true;
+                }
+        }
+
+        if (do_insert(&head->tables, key, val))
+                return true;
+
+        /*
+         * the search only fails when the table is nearly full, or the hash
+         * functions are unlucky. Rehashing a nearly full table can take
+         * forever, so grow it instead.
+         */
+        if (head->nentries > head->capacity / 4 * 3) {
+                if (!do_resize(head, head->tables.table_buckets*2)) {
+                        head->nentries--;
+                        return false;
+                }
+                head->stat_resizes++;
+                if (do_insert(&head->tables, key, val))
+                        return true;
+        }
+
+        /*
+         * rehashing is done in an infinite loop, but assuming the random
+         * number generator doesn't suck and we're not trying to insert into
+         * an overfull table, it should always succeed after just a few tries.
+         */
+        head->stat_rehashes++;
+
+        /*
+         * a table in a file is rebuilt with new seeds in a new file, like a
+         * resize, never rehashed in place. If the process died halfway
+         * through that, the file would have the old seeds and keys moved by
+         * the new ones.
+         */
+        if (head->file) {
                 for (;;) {
-                        fails += do_rehash(&head->tables, tries);
+                        if (!do_resize(head, head->tables.table_buckets)) {
+                                head->nentries--;
+                                return false;
+                        }
 
-                        if (do_insert(&head->tables, &key_anchor, &val_anchor, tries))
+                        if (do_insert(&head->tables, key, val))
                                 break;
 
                         fails++;
                 }
+                goto out;
         }
 
+        /*
+         * with threads to spare, rebuilding the table with new seeds in
+         * parallel beats moving everything around in place on this one.
+         */
+        if (head->resize_threads > 1
+            && head->tables.table_buckets >= PARALLEL_MIN_BUCKETS
+            && do_resize(head, head->tables.table_buckets)
+            && do_insert(&head->tables, key, val))
+                return true;
+
+        for (;;) {
+                fails += do_rehash(&head->tables, tries);
+
+                if (do_insert(&head->tables, key, val))
+                        break;
+
+                fails++;
+        }
+
+out:
         /* fix up stats */
         head->stat_rehash_fails += fails;
         if (fails > head->stat_rehash_fails_max)
@@ -684,36 +1301,181 @@ bool cuckoo_htable_insert(struct cuckoo_head *head, uint64_t key,
         return true;
 }
 
+bool cuckoo_htable_insert_u64(struct cuckoo_head *head, uint64_t key,
+                              uint64_t val)
+{
+        struct nest nests[CUCKOO_HTABLE_MAX_TABLES];
+        unsigned long slot;
+
+        get_nests(&head->tables, key, nests);
+
+        /* if it exists, yay */
+        if (find_in_nests(&head->tables, nests, key, &slot) >= 0)
+                return true;
+
+        return insert_new(head, key, val, nests);
+}
+
+/* upsert, with *found set if the key was already there */
+static bool upsert(struct cuckoo_head *head, uint64_t key, uint64_t val,
+                   uint64_t *old, bool *found)
+{
+        struct nest nests[CUCKOO_HTABLE_MAX_TABLES];
+        unsigned long slot;
+        long i;
+
+        get_nests(&head->tables, key, nests);
+        i = find_in_nests(&head->tables, nests, key, &slot);
+        *found = i >= 0;
+        if (*found) {
+                *old = get_val(nests[i], slot);
+                set_val(nests[i], val, slot);
+                return true;
+        }
+
+        return insert_new(head, key, val, nests);
+}
+
+bool cuckoo_htable_upsert_u64(struct cuckoo_head *head, uint64_t key,
+                              uint64_t val, uint64_t *old)
+{
+        uint64_t o;
+        bool found;
+
+        if (!upsert(head, key, val, &o, &found))
+                return false;
+        if (found && old)
+                *old = o;
+        return true;
+}
+
+bool cuckoo_htable_get_or_insert_u64(struct cuckoo_head *head, uint64_t key,
+                                     uint64_t val, uint64_t *out)
+{
+        struct nest nests[CUCKOO_HTABLE_MAX_TABLES];
+        unsigned long slot;
+        long i;
+
+        get_nests(&head->tables, key, nests);
+        i = find_in_nests(&head->tables, nests, key, &slot);
+        if (i >= 0) {
+                *out = get_val(nests[i], slot);
+                return true;
+        }
+
+        if (!insert_new(head, key, val, nests))
+                return false;
+        *out = val;
+        return true;
+}
+
 bool cuckoo_htable_exists(struct cuckoo_head const *head, uint64_t key)
 {
-        for_each_nest(&head->tables, b, key)
-                if(bucket_contains(b, key))
-                        return true;
+        struct nest nests[CUCKOO_HTABLE_MAX_TABLES];
+        unsigned long slot;
 
-        return false;
+        get_nests(&head->tables, key, nests);
+        return find_in_nests(&head->tables, nests, key, &slot) >= 0;
 }
 
-const void *cuckoo_htable_remove(struct cuckoo_head *head, uint64_t key)
+bool cuckoo_htable_remove_u64(struct cuckoo_head *head, uint64_t key,
+                              uint64_t *out)
 {
-        const void *ret = NULL;
+        struct nest nests[CUCKOO_HTABLE_MAX_TABLES];
+        unsigned long slot, target;
+        long i;
 
-        for_each_nest(&head->tables, b, key)
-                if (try_bucket_remove(b, key, &ret)) {
-                        head->nentries--;
-                        return ret;
-                }
+        get_nests(&head->tables, key, nests);
+        i = find_in_nests(&head->tables, nests, key, &slot);
+        if (i < 0)
+                return false;
 
-        return ret;
+        head->nentries--;
+        *out = remove_val(nests[i], slot);
+
+        /* a failed shrink leaves the table as it was, which is fine */
+        target = shrink_target(head);
+        if (target && do_resize(head, target)) {
+                head->stat_resizes++;
+                head->stat_shrinks++;
+        }
+        return true;
+}
+
+bool cuckoo_htable_get_u64(struct cuckoo_head const *head, uint64_t key,
+                           uint64_t *out)
+{
+        struct nest nests[CUCKOO_HTABLE_MAX_TABLES];
+        unsigned long slot;
+        long i;
+
+        get_nests(&head->tables, key, nests);
+        i = find_in_nests(&head->tables, nests, key, &slot);
+        if (i < 0)
+                return false;
+
+        *out = get_val(nests[i], slot);
+        return true;
+}
+
+/* ===== the pointer api, on top of the u64 one ===== */
+
+static uint64_t from_ptr(const void *p)
+{
+        return (uintptr_t)p;
+}
+
+static const void *to_ptr(uint64_t v)
+{
+        return (const void *)(uintptr_t)v;
+}
+
+bool cuckoo_htable_insert(struct cuckoo_head *head, uint64_t key,
+                          void const *val)
+{
+        return cuckoo_htable_insert_u64(head, key, from_ptr(val));
+}
+
+bool cuckoo_htable_upsert(struct cuckoo_head *head, uint64_t key,
+                          void const *val, void const **old)
+{
+        uint64_t o;
+        bool found;
+
+        if (!upsert(head, key, from_ptr(val), &o, &found))
+                return false;
+        if (found && old)
+                *old = to_ptr(o);
+        return true;
+}
+
+bool cuckoo_htable_get_or_insert(struct cuckoo_head *head, uint64_t key,
+                                 void const *val, void const **out)
+{
+        uint64_t o;
+
+        if (!cuckoo_htable_get_or_insert_u64(head, key, from_ptr(val), &o))
+                return false;
+        *out = to_ptr(o);
+        return true;
+}
+
+const void *cuckoo_htable_remove(struct cuckoo_head *head, uint64_t key)
+{
+        uint64_t o;
+
+        return cuckoo_htable_remove_u64(head, key, &o) ? to_ptr(o) : NULL;
 }
 
 bool cuckoo_htable_get(struct cuckoo_head const *head,
                        uint64_t key, void const **out)
 {
-        for_each_nest(&head->tables, b, key)
-                if (try_bucket_get(b, key, out))
-                        return true;
+        uint64_t o;
 
-        return false;
+        if (!cuckoo_htable_get_u64(head, key, &o))
+                return false;
+        *out = to_ptr(o);
+        return true;
 }
 
 bool cuckoo_htable_resize(struct cuckoo_head *head, bool grow)
@@ -725,3 +1487,210 @@ bool cuckoo_htable_resize(struct cuckoo_head *head, bool grow)
         else
                 return false;
 }
+
+/* ===== multimaps ===== */
+
+/*
+ * A key of a multimap has one slot like any other key, so lookups cost the
+ * same and the cuckoo moves don't care. A key with one value keeps it in
+ * the slot, shifted left with the low bit set. A key with more has a pointer
+ * to a block of them there instead, which is at least 2 byte aligned, so its
+ * low bit is clear. Since the tag is in the value itself, it moves along
+ * with it whenever the table moves keys around.
+ */
+#define MULTI_BLOCK_MIN (4UL)
+
+struct multi_block {
+        unsigned long count;
+        unsigned long cap;
+        uint64_t vals[];
+};
+
+static bool multi_inline(uint64_t v)
+{
+        return v & 1;
+}
+
+static uint64_t multi_to_inline(uint64_t value)
+{
+        return value << 1 | 1;
+}
+
+static uint64_t multi_from_inline(uint64_t v)
+{
+        return v >> 1;
+}
+
+static struct multi_block *multi_block(uint64_t v)
+{
+        return (struct multi_block *)(uintptr_t)v;
+}
+
+/* the value slot of a key, or NULL if it isn't in the table */
+static uint64_t *find_val(const struct cuckoo_head *head, uint64_t key)
+{
+        struct nest nests[CUCKOO_HTABLE_MAX_TABLES];
+        unsigned long slot;
+        long i;
+
+        get_nests(&head->tables, key, nests);
+        i = find_in_nests(&head->tables, nests, key, &slot);
+        return i < 0 ? NULL : &nests[i].bkt->vals[slot];
+}
+
+bool cuckoo_htable_multi_insert(struct cuckoo_head *head, uint64_t key,
+                                uint64_t value)
+{
+        struct nest nests[CUCKOO_HTABLE_MAX_TABLES];
+        struct multi_block *b;
+        unsigned long slot;
+        uint64_t *v;
+        long i;
+
+        if (value > CUCKOO_HTABLE_MULTI_MAX)
+                return false;
+
+        get_nests(&head->tables, key, nests);
+        i = find_in_nests(&head->tables, nests, key, &slot);
+        if (i < 0)
+                return insert_new(head, key, multi_to_inline(value), nests);
+        v = &nests[i].bkt->vals[slot];
+
+        /* a second value moves both out to a block */
+        if (multi_inline(*v)) {
+                b = malloc(sizeof *b + MULTI_BLOCK_MIN * sizeof b->vals[0]);
+                if (!b)
+                        return false;
+                b->count = 1;
+                b->cap = MULTI_BLOCK_MIN;
+                b->vals[0] = multi_from_inline(*v);
+                *v = (uintptr_t)b;
+        }
+
+        b = multi_block(*v);
+        if (b->count == b->cap) {
+                b = realloc(b, sizeof *b + 2 * b->cap * sizeof b->vals[0]);
+                if (!b)
+                        return false;
+                b->cap *= 2;
+                *v = (uintptr_t)b;
+        }
+        b->vals[b->count++] = value;
+        return true;
+}
+
+unsigned long cuckoo_htable_get_all(struct cuckoo_head const *head,
+                                    uint64_t key, uint64_t *out,
+                                    unsigned long max)
+{
+        const uint64_t *v = find_val(head, key);
+        const struct multi_block *b;
+        unsigned long i;
+
+        if (!v)
+                return 0;
+        if (multi_inline(*v)) {
+                if (max)
+                        out[0] = multi_from_inline(*v);
+                return 1;
+        }
+
+        b = multi_block(*v);
+        for (i = 0; i < b->count && i < max; i++)
+                out[i] = b->vals[i];
+        return b->count;
+}
+
+bool cuckoo_htable_multi_get(struct cuckoo_head const *head, uint64_t key,
+                             uint64_t *out)
+{
+        return cuckoo_htable_get_all(head, key, out, 1) != 0;
+}
+
+bool cuckoo_htable_multi_remove(struct cuckoo_head *head, uint64_t key,
+                                uint64_t value)
+{
+        uint64_t *v = find_val(head, key);
+        struct multi_block *b;
+        unsigned long i;
+        uint64_t o;
+
+        if (!v)
+                return false;
+        if (multi_inline(*v)) {
+                if (multi_from_inline(*v) != value)
+                        return false;
+                return cuckoo_htable_remove_u64(head, key, &o);
+        }
+
+        b = multi_block(*v);
+        for (i = 0; i < b->count; i++)
+                if (b->vals[i] == value)
+                        break;
+        if (i == b->count)
+                return false;
+
+        /* order isn't kept, so fill the hole with the last value */
+        b->vals[i] = b->vals[--b->count];
+        if (b->count == 1) {
+                *v = multi_to_inline(b->vals[0]);
+                free(b);
+        }
+        return true;
+}
+
+unsigned long cuckoo_htable_multi_remove_all(struct cuckoo_head *head,
+                                             uint64_t key)
+{
+        unsigned long count = 1;
+        uint64_t o;
+
+        if (!cuckoo_htable_remove_u64(head, key, &o))
+                return 0;
+        if (!multi_inline(o)) {
+                count = multi_block(o)->count;
+                free(multi_block(o));
+        }
+        return count;
+}
+
+void cuckoo_htable_multi_iter_init(struct cuckoo_head const *head,
+                                   uint64_t key,
+                                   struct cuckoo_multi_iter *iter)
+{
+        const uint64_t *v = find_val(head, key);
+
+        iter->pos = 0;
+        iter->vals = NULL;
+        if (!v) {
+                iter->count = 0;
+        } else if (multi_inline(*v)) {
+                iter->count = 1;
+                iter->single = multi_from_inline(*v);
+        } else {
+                iter->count = multi_block(*v)->count;
+                iter->vals = multi_block(*v)->vals;
+        }
+}
+
+bool cuckoo_htable_multi_iter_next(struct cuckoo_multi_iter *iter,
+                                   uint64_t *out)
+{
+        if (iter->pos == iter->count)
+                return false;
+        *out = iter->vals ? iter->vals[iter->pos] : iter->single;
+        iter->pos++;
+        return true;
+}
+
+void cuckoo_htable_multi_destroy(struct cuckoo_head *head)
+{
+        unsigned long i;
+
+        for_each_nest(&head->tables, b)
+                for (i = 0; i < BUCKET_SIZE; i++)
+                        if (slot_occupied(b, i)
+                            && !multi_inline(get_val(b, i)))
+                                free(multi_block(get_val(b, i)));
+        cuckoo_htable_destroy(head);
+}
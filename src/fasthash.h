@@ -29,7 +29,7 @@
 #include <stdint.h>
 #include <stdio.h>
 
-#define __fasthash_mix(h) ((h) ^= (h) > 23,			\
+#define __fasthash_mix(h) ((h) ^= (h) >> 23,			\
 			   (h) *= 0x2127599bf4325c37ULL,	\
 			   (h) ^= (h) >> 47);
 
@@ -23,6 +23,7 @@
 
 #include "flist.h"
 #include <assert.h>
+#include <limits.h>
 #include <stdbool.h>
 
 static inline void *node_to_data(struct flist_head *hd, struct flist *n)
@@ -144,3 +145,114 @@ void flist_for_each_range(struct flist_head *hd, void (*f)(void *data),
 	}
 }
 
+void flist_for_each_batch(struct flist_head *hd, void **buf, size_t k,
+			  void (*f)(void **batch, size_t n, void *private),
+			  void *private)
+{
+	struct flist *n = hd->first;
+	size_t i;
+
+	assert(k > 0);
+
+	while (n) {
+		/* read every next pointer before f can free its element */
+		for (i = 0; n && i < k; i++, n = n->next) {
+			buf[i] = node_to_data(hd, n);
+			__builtin_prefetch(buf[i]);
+		}
+		f(buf, i, private);
+	}
+}
+
+/* merge two sorted null terminated chains */
+static struct flist *merge_chains(struct flist_head *hd, flist_cmp_t cmp,
+				  struct flist *a, struct flist *b)
+{
+	struct flist head;
+	struct flist *tail = &head;
+
+	while (a && b) {
+		/* <= keeps the sort stable: a's elements came first */
+		if (cmp(node_to_data(hd, a), node_to_data(hd, b)) <= 0) {
+			tail->next = a;
+			a = a->next;
+		} else {
+			tail->next = b;
+			b = b->next;
+		}
+		tail = tail->next;
+	}
+	tail->next = a ? a : b;
+	return head.next;
+}
+
+/* see take_run in list.c */
+static struct flist *take_run(struct flist_head *hd, flist_cmp_t cmp,
+			      struct flist **rest)
+{
+	struct flist *first = *rest, *last = first, *n = first->next, *next;
+
+	if (n && cmp(node_to_data(hd, first), node_to_data(hd, n)) > 0) {
+		first->next = NULL;
+		do {
+			next = n->next;
+			n->next = first;
+			first = n;
+			n = next;
+		} while (n && cmp(node_to_data(hd, first),
+				  node_to_data(hd, n)) > 0);
+		*rest = n;
+		return first;
+	}
+
+	while (n && cmp(node_to_data(hd, last), node_to_data(hd, n)) <= 0) {
+		last = n;
+		n = n->next;
+	}
+	last->next = NULL;
+	*rest = n;
+	return first;
+}
+
+void flist_sort(struct flist_head *hd, flist_cmp_t cmp)
+{
+	/* see list_sort in list.c */
+	struct flist *pending[sizeof(size_t) * CHAR_BIT + 1] = {NULL};
+	struct flist *n = hd->first, *chain;
+	size_t i, max = 0;
+
+	if (hd->length < 2)
+		return;
+
+	while (n) {
+		chain = take_run(hd, cmp, &n);
+		for (i = 0; pending[i]; i++) {
+			chain = merge_chains(hd, cmp, pending[i], chain);
+			pending[i] = NULL;
+		}
+		pending[i] = chain;
+		if (i > max)
+			max = i;
+	}
+
+	chain = NULL;
+	for (i = 0; i <= max; i++)
+		if (pending[i])
+			chain = merge_chains(hd, cmp, pending[i], chain);
+	hd->first = chain;
+}
+
+void flist_merge(struct flist_head *hd, struct flist_head *mergee,
+		 flist_cmp_t cmp)
+{
+	assert(hd->offset == mergee->offset);
+
+	if (is_empty(mergee))
+		return;
+
+	hd->first = merge_chains(hd, cmp, hd->first, mergee->first);
+	hd->length += mergee->length;
+
+	mergee->first = NULL;
+	mergee->length = 0;
+}
@@ -0,0 +1,204 @@
+/*
+ * Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file flist_lockfree.c
+ *
+ * \author Eric Mueller
+ *
+ * \brief Implementation of a Treiber stack and a Vyukov mpsc queue on top
+ * of struct flist.
+ *
+ * \detail The queue algorithm is described here
+ *
+ *     http://www.1024cores.net/home/lock-free-algorithms/queues/intrusive-mpsc-node-based-queue
+ */
+
+#include "flist_lockfree.h"
+#include <assert.h>
+
+static inline void *node_to_data(unsigned long offset, struct flist *n)
+{
+	return (void *)((uintptr_t)n - offset);
+}
+
+static inline struct flist *data_to_node(unsigned long offset, void *d)
+{
+	return (struct flist *)((uintptr_t)d + offset);
+}
+
+/* ======= stack ======= */
+
+/*
+ * The top of the stack is a pointer in the low TAG_SHIFT bits and a
+ * generation counter in the remaining high bits. Every x86-64 and aarch64
+ * userspace address fits in 48 bits.
+ */
+#define TAG_SHIFT (48)
+#define PTR_MASK ((UINT64_C(1) << TAG_SHIFT) - 1)
+#define TAG_ONE (UINT64_C(1) << TAG_SHIFT)
+
+#define GET_PTR(t) ((struct flist *)(uintptr_t)((uint64_t)(t) & PTR_MASK))
+#define GET_TAG(t) ((uint64_t)(t) & ~PTR_MASK)
+#define MAKE_TOP(p, tag) ((uintptr_t)((uint64_t)(uintptr_t)(p) | (tag)))
+
+void flist_stack_push(struct flist_stack *s, void *elem)
+{
+	struct flist *n = data_to_node(s->offset, elem);
+	uintptr_t old = __atomic_load_n(&s->top, __ATOMIC_RELAXED);
+	uintptr_t new;
+
+	assert(((uint64_t)(uintptr_t)n & ~PTR_MASK) == 0);
+
+	/*
+	 * the tag is left alone on push: a push can only be fooled by a top
+	 * that was popped and pushed back, and the pop bumps the tag.
+	 */
+	do {
+		n->next = GET_PTR(old);
+		new = MAKE_TOP(n, GET_TAG(old));
+	} while (!__atomic_compare_exchange_n(&s->top, &old, new, true,
+					      __ATOMIC_RELEASE,
+					      __ATOMIC_RELAXED));
+}
+
+void *flist_stack_pop(struct flist_stack *s)
+{
+	uintptr_t old = __atomic_load_n(&s->top, __ATOMIC_ACQUIRE);
+	uintptr_t new;
+	struct flist *n;
+
+	do {
+		n = GET_PTR(old);
+		if (!n)
+			return NULL;
+
+		/*
+		 * n may be popped by someone else before we get here, in which
+		 * case next is garbage -- but then the tag will have moved and
+		 * the cas below fails.
+		 */
+		new = MAKE_TOP(__atomic_load_n(&n->next, __ATOMIC_RELAXED),
+			       GET_TAG(old + TAG_ONE));
+	} while (!__atomic_compare_exchange_n(&s->top, &old, new, true,
+					      __ATOMIC_ACQUIRE,
+					      __ATOMIC_ACQUIRE));
+
+	return node_to_data(s->offset, n);
+}
+
+void flist_stack_pop_all(struct flist_stack *s, struct flist_head *into)
+{
+	uintptr_t old = __atomic_load_n(&s->top, __ATOMIC_ACQUIRE);
+	struct flist *i;
+
+	assert(into->offset == s->offset);
+
+	while (!__atomic_compare_exchange_n(&s->top, &old,
+					    MAKE_TOP(NULL,
+						     GET_TAG(old + TAG_ONE)),
+					    true, __ATOMIC_ACQUIRE,
+					    __ATOMIC_ACQUIRE))
+		;
+
+	/* the detached chain is private now, move it over one at a time */
+	for (i = GET_PTR(old); i; ) {
+		struct flist *next = i->next;
+		flist_push_front(into, node_to_data(s->offset, i));
+		i = next;
+	}
+}
+
+bool flist_stack_empty(const struct flist_stack *s)
+{
+	return GET_PTR(__atomic_load_n(&s->top, __ATOMIC_RELAXED)) == NULL;
+}
+
+/* ======= mpsc queue ======= */
+
+void flist_mpsc_init(struct flist_mpsc *q, unsigned long offset)
+{
+	q->stub.next = NULL;
+	q->head = &q->stub;
+	q->tail = &q->stub;
+	q->offset = offset;
+}
+
+static void mpsc_push_node(struct flist_mpsc *q, struct flist *n)
+{
+	struct flist *prev;
+
+	__atomic_store_n(&n->next, NULL, __ATOMIC_RELAXED);
+	prev = __atomic_exchange_n(&q->head, n, __ATOMIC_ACQ_REL);
+
+	/*
+	 * between the exchange and this store the queue is 'broken': the
+	 * consumer can see prev but not n. pop handles this by returning NULL.
+	 */
+	__atomic_store_n(&prev->next, n, __ATOMIC_RELEASE);
+}
+
+void flist_mpsc_push(struct flist_mpsc *q, void *elem)
+{
+	mpsc_push_node(q, data_to_node(q->offset, elem));
+}
+
+void *flist_mpsc_pop(struct flist_mpsc *q)
+{
+	struct flist *tail = q->tail;
+	struct flist *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+	struct flist *head;
+
+	/* skip over the stub if it's at the front */
+	if (tail == &q->stub) {
+		if (!next)
+			return NULL;
+		q->tail = next;
+		tail = next;
+		next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+	}
+
+	if (next) {
+		q->tail = next;
+		return node_to_data(q->offset, tail);
+	}
+
+	/* tail looks like the last node. if it isn't, a push is in flight */
+	head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+	if (tail != head)
+		return NULL;
+
+	/*
+	 * tail really is the last node. we can't hand it out while it's the
+	 * only node (producers link onto it), so put the stub behind it.
+	 */
+	mpsc_push_node(q, &q->stub);
+
+	next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+	if (next) {
+		q->tail = next;
+		return node_to_data(q->offset, tail);
+	}
+	return NULL;
+}
+
+bool flist_mpsc_empty(const struct flist_mpsc *q)
+{
+	struct flist *tail = q->tail;
+
+	return tail == &q->stub
+		&& !__atomic_load_n(&tail->next, __ATOMIC_ACQUIRE)
+		&& __atomic_load_n(&q->head, __ATOMIC_ACQUIRE) == tail;
+}
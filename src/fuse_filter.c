@@ -0,0 +1,403 @@
+/*
+ * Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \author Eric Mueller
+ *
+ * \file fuse_filter.c
+ *
+ * \brief Implementation of a binary fuse filter.
+ *
+ * \detail This follows the reference implementation from the paper,
+ *
+ *     https://github.com/FastFilter/xor_singleheader
+ *
+ * For each position, construction keeps the number of remaining keys that
+ * use it and the XOR of their hashes, so when a position has exactly one key
+ * its hash is right there. The low two bits of the count also hold the XOR
+ * of which of its three positions (0, 1 or 2) each key is using this one as,
+ * which tells us the same thing about the last key.
+ */
+
+#include "fuse_filter.h"
+#include "fasthash.h"
+#include "util.h"
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+
+/* give up on building after this many seeds fail */
+#define MAX_ATTEMPTS (100)
+
+#define MAX_SEGMENT_LENGTH (1U << 18)
+
+#define MAGIC (0x45535546U) /* "FUSE" */
+#define HEADER_SIZE (24U)
+
+static inline uint64_t mulhi(uint64_t a, uint64_t b)
+{
+	return ((__uint128_t)a * b) >> 64;
+}
+
+/*
+ * the i'th position for a hash. The first is in [0, segment_count) segments
+ * and each of the others is in the segment after the one before.
+ */
+static inline uint32_t position(const struct fuse_filter *f, uint64_t hash,
+				unsigned i)
+{
+	uint32_t h = mulhi(hash, (uint64_t)f->segment_count
+			   * f->segment_length);
+
+	h += i * f->segment_length;
+	return h ^ (((hash & ((1ULL << 36) - 1)) >> (36 - 18 * i))
+		    & (f->segment_length - 1));
+}
+
+static inline uint16_t fingerprint(uint64_t hash)
+{
+	return hash ^ hash >> 32;
+}
+
+static bool set_sizes(struct fuse_filter *f, size_t n)
+{
+	uint32_t capacity = 0;
+	long segments;
+
+	if ((f->bits != 8 && f->bits != 16) || n > FUSE_FILTER_MAX_KEYS)
+		return false;
+
+	/* sizes recommended by the paper for three positions */
+	f->segment_length = 4;
+	if (n > 1) {
+		double factor = fmax(1.125, 0.875 + 0.25 * log(1e6) / log(n));
+
+		f->segment_length = 1U << (int)floor(log(n) / log(3.33) + 2.25);
+		capacity = lround(n * factor);
+	}
+	if (f->segment_length > MAX_SEGMENT_LENGTH)
+		f->segment_length = MAX_SEGMENT_LENGTH;
+
+	segments = div_round_up_ul(capacity, f->segment_length);
+	f->segment_count = segments > 2 ? segments - 2 : 1;
+	f->array_length = (f->segment_count + 2) * f->segment_length;
+	return true;
+}
+
+static int cmp_key(const void *lhs, const void *rhs)
+{
+	uint64_t a = *(const uint64_t *)lhs, b = *(const uint64_t *)rhs;
+
+	return (a > b) - (a < b);
+}
+
+/* sort, and remove repeats. returns the new length */
+static size_t dedup(uint64_t *keys, size_t n)
+{
+	size_t i, j = 0;
+
+	qsort(keys, n, sizeof *keys, cmp_key);
+	for (i = 0; i < n; i++)
+		if (!j || keys[j - 1] != keys[i])
+			keys[j++] = keys[i];
+	return j;
+}
+
+static inline void fp_set(struct fuse_filter *f, uint32_t i, uint16_t fp)
+{
+	if (f->bits == 8)
+		((uint8_t *)f->fingerprints)[i] = fp;
+	else
+		((uint16_t *)f->fingerprints)[i] = fp;
+}
+
+static inline uint16_t fp_get(const struct fuse_filter *f, uint32_t i)
+{
+	if (f->bits == 8)
+		return ((const uint8_t *)f->fingerprints)[i];
+	return ((const uint16_t *)f->fingerprints)[i];
+}
+
+bool fuse_filter_build(struct fuse_filter *f, const uint64_t *keys, size_t n)
+{
+	uint64_t *order = NULL, *xhash = NULL, *copy = NULL;
+	uint32_t *alone = NULL, *start = NULL;
+	uint8_t *count = NULL, *which = NULL;
+	uint32_t block_bits = 1, block, len;
+	unsigned attempt;
+	size_t i, stacked = 0;
+	bool ok = false;
+
+	if (!set_sizes(f, n) || !seed_rng())
+		return false;
+	len = f->array_length;
+
+	while ((1U << block_bits) < f->segment_count)
+		block_bits++;
+	block = 1U << block_bits;
+
+	f->fingerprints = calloc(len, f->bits / 8);
+	order = calloc(n + 1, sizeof *order);
+	which = malloc(n + 1);
+	alone = malloc(len * sizeof *alone);
+	count = calloc(len, 1);
+	xhash = calloc(len, sizeof *xhash);
+	start = malloc(block * sizeof *start);
+	if (!f->fingerprints || !order || !which || !alone || !count || !xhash
+	    || !start)
+		goto out;
+
+	for (attempt = 0; attempt < MAX_ATTEMPTS; attempt++) {
+		size_t repeats = 0, nalone = 0;
+		bool error = false;
+
+		f->seed = pcg64_random();
+		memset(order, 0, n * sizeof *order);
+		memset(count, 0, len);
+		memset(xhash, 0, len * sizeof *xhash);
+
+		/*
+		 * roughly sort the hashes by their first segment, so the
+		 * positions below are visited more or less in order.
+		 */
+		order[n] = 1;
+		for (i = 0; i < block; i++)
+			start[i] = ((uint64_t)i * n) >> block_bits;
+		for (i = 0; i < n; i++) {
+			uint64_t hash = fasthash64_key(keys[i], f->seed);
+			uint32_t b = hash >> (64 - block_bits);
+
+			while (order[start[b]])
+				b = (b + 1) & (block - 1);
+			order[start[b]++] = hash;
+		}
+
+		for (i = 0; i < n; i++) {
+			uint64_t hash = order[i];
+			uint32_t h[3];
+			unsigned k;
+
+			for (k = 0; k < 3; k++) {
+				h[k] = position(f, hash, k);
+				count[h[k]] += 4;
+				count[h[k]] ^= k;
+				xhash[h[k]] ^= hash;
+			}
+
+			/* a repeated key cancels itself out of some position */
+			if ((xhash[h[0]] & xhash[h[1]] & xhash[h[2]]) == 0
+			    && ((xhash[h[0]] == 0 && count[h[0]] == 8)
+				|| (xhash[h[1]] == 0 && count[h[1]] == 8)
+				|| (xhash[h[2]] == 0 && count[h[2]] == 8))) {
+				repeats++;
+				for (k = 0; k < 3; k++) {
+					count[h[k]] -= 4;
+					count[h[k]] ^= k;
+					xhash[h[k]] ^= hash;
+				}
+			}
+			/* a count overflowed */
+			for (k = 0; k < 3; k++)
+				error |= count[h[k]] < 4;
+		}
+		if (error)
+			continue;
+
+		/* peel */
+		for (i = 0; i < len; i++) {
+			alone[nalone] = i;
+			nalone += (count[i] >> 2) == 1;
+		}
+		stacked = 0;
+		while (nalone > 0) {
+			uint32_t idx = alone[--nalone], h[5];
+			unsigned found, k;
+			uint64_t hash;
+
+			if ((count[idx] >> 2) != 1)
+				continue;
+			hash = xhash[idx];
+			for (k = 0; k < 3; k++)
+				h[k] = position(f, hash, k);
+			h[3] = h[0];
+			h[4] = h[1];
+			found = count[idx] & 3;
+			which[stacked] = found;
+			order[stacked++] = hash;
+
+			for (k = 1; k <= 2; k++) {
+				uint32_t other = h[found + k];
+
+				alone[nalone] = other;
+				nalone += (count[other] >> 2) == 2;
+				count[other] -= 4;
+				count[other] ^= (found + k) % 3;
+				xhash[other] ^= hash;
+			}
+		}
+		if (stacked + repeats == n) {
+			ok = true;
+			break;
+		}
+
+		/* get the repeats out of the way for the next attempt */
+		if (repeats && !copy) {
+			copy = malloc(n * sizeof *copy);
+			if (!copy)
+				goto out;
+			memcpy(copy, keys, n * sizeof *copy);
+			n = dedup(copy, n);
+			keys = copy;
+		}
+	}
+	if (!ok)
+		goto out;
+
+	/* fill in fingerprints in the opposite order keys were peeled */
+	for (i = stacked; i-- > 0;) {
+		uint64_t hash = order[i];
+		unsigned found = which[i];
+		uint32_t h[5];
+		unsigned k;
+
+		for (k = 0; k < 3; k++)
+			h[k] = position(f, hash, k);
+		h[3] = h[0];
+		h[4] = h[1];
+		fp_set(f, h[found], fingerprint(hash) ^ fp_get(f, h[found + 1])
+		       ^ fp_get(f, h[found + 2]));
+	}
+
+out:
+	if (!ok) {
+		free(f->fingerprints);
+		f->fingerprints = NULL;
+	}
+	free(order);
+	free(which);
+	free(alone);
+	free(count);
+	free(xhash);
+	free(start);
+	free(copy);
+	return ok;
+}
+
+void fuse_filter_destroy(struct fuse_filter *f)
+{
+	free(f->fingerprints);
+	f->fingerprints = NULL;
+}
+
+bool fuse_filter_query(const struct fuse_filter *f, uint64_t key)
+{
+	uint64_t hash = fasthash64_key(key, f->seed);
+	uint32_t h0 = position(f, hash, 0);
+	uint32_t h1 = position(f, hash, 1);
+	uint32_t h2 = position(f, hash, 2);
+
+	if (f->bits == 8) {
+		const uint8_t *fp = f->fingerprints;
+
+		return (uint8_t)(fingerprint(hash) ^ fp[h0] ^ fp[h1] ^ fp[h2])
+			== 0;
+	} else {
+		const uint16_t *fp = f->fingerprints;
+
+		return (uint16_t)(fingerprint(hash) ^ fp[h0] ^ fp[h1] ^ fp[h2])
+			== 0;
+	}
+}
+
+/* ===== serialization ===== */
+
+static void put_le(uint8_t *p, uint64_t v, unsigned bytes)
+{
+	unsigned i;
+
+	for (i = 0; i < bytes; i++)
+		p[i] = v >> (8 * i);
+}
+
+static uint64_t get_le(const uint8_t *p, unsigned bytes)
+{
+	uint64_t v = 0;
+	unsigned i;
+
+	for (i = 0; i < bytes; i++)
+		v |= (uint64_t)p[i] << (8 * i);
+	return v;
+}
+
+/*
+ * header:
+ *     0   magic
+ *     4   fingerprint bits
+ *     8   seed
+ *     16  segment length
+ *     20  segment count
+ */
+size_t fuse_filter_serialized_size(const struct fuse_filter *f)
+{
+	return HEADER_SIZE + (size_t)f->array_length * (f->bits / 8);
+}
+
+void fuse_filter_serialize(const struct fuse_filter *f, void *buf)
+{
+	uint8_t *p = buf;
+	uint32_t i;
+
+	put_le(p, MAGIC, 4);
+	put_le(p + 4, f->bits, 4);
+	put_le(p + 8, f->seed, 8);
+	put_le(p + 16, f->segment_length, 4);
+	put_le(p + 20, f->segment_count, 4);
+	p += HEADER_SIZE;
+	for (i = 0; i < f->array_length; i++)
+		put_le(p + i * (f->bits / 8), fp_get(f, i), f->bits / 8);
+}
+
+bool fuse_filter_deserialize(struct fuse_filter *f, const void *buf,
+			     size_t len)
+{
+	const uint8_t *p = buf;
+	uint64_t length;
+	uint32_t i;
+
+	if (len < HEADER_SIZE || get_le(p, 4) != MAGIC)
+		return false;
+	f->bits = get_le(p + 4, 4);
+	f->seed = get_le(p + 8, 8);
+	f->segment_length = get_le(p + 16, 4);
+	f->segment_count = get_le(p + 20, 4);
+
+	if ((f->bits != 8 && f->bits != 16) || f->segment_length == 0
+	    || f->segment_length > MAX_SEGMENT_LENGTH
+	    || (f->segment_length & (f->segment_length - 1))
+	    || f->segment_count == 0)
+		return false;
+	length = ((uint64_t)f->segment_count + 2) * f->segment_length;
+	if (length > UINT32_MAX || len != HEADER_SIZE + length * (f->bits / 8))
+		return false;
+	f->array_length = length;
+
+	f->fingerprints = malloc(length * (f->bits / 8));
+	if (!f->fingerprints)
+		return false;
+	p += HEADER_SIZE;
+	for (i = 0; i < f->array_length; i++)
+		fp_set(f, i, get_le(p + i * (f->bits / 8), f->bits / 8));
+	return true;
+}
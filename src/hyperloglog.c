@@ -0,0 +1,391 @@
+/*
+ * Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \author Eric Mueller
+ *
+ * \file hyperloglog.c
+ *
+ * \brief Implementation of a HyperLogLog with a sparse representation.
+ *
+ * \detail A register's value is one more than the number of leading zeros
+ * in the hash bits after its index, so 0 means the register is unused.
+ *
+ * A sparse entry's index is the top SP bits of the hash and its value is
+ * computed from the bits after those. That's enough to recover the dense
+ * register it would have set: the dense index is the top p bits of the sparse
+ * index, and the dense value comes from the rest of the sparse index bits if
+ * any of them are set, or else from the sparse value.
+ */
+
+#include "hyperloglog.h"
+#include "fasthash.h"
+#include "util.h"
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+
+/* precision of the sparse representation */
+#define SP (25U)
+
+#define SPARSE_MIN_CAP (16U)
+
+#define ENTRY(idx, val) ((uint32_t)(idx) << 6 | (val))
+#define ENTRY_IDX(e) ((e) >> 6)
+#define ENTRY_VAL(e) ((e) & 63U)
+
+/* one spare byte so a register can always be read as two bytes */
+static inline size_t dense_size(unsigned p)
+{
+	return (6UL << p) / 8 + 1;
+}
+
+static inline unsigned get_reg(const uint8_t *regs, unsigned long i)
+{
+	unsigned long bit = 6 * i;
+	unsigned v = regs[bit / 8] | (unsigned)regs[bit / 8 + 1] << 8;
+
+	return (v >> bit % 8) & 63U;
+}
+
+static inline void set_reg(uint8_t *regs, unsigned long i, unsigned val)
+{
+	unsigned long bit = 6 * i;
+	unsigned v = regs[bit / 8] | (unsigned)regs[bit / 8 + 1] << 8;
+
+	v = (v & ~(63U << bit % 8)) | val << bit % 8;
+	regs[bit / 8] = v;
+	regs[bit / 8 + 1] = v >> 8;
+}
+
+static inline void max_reg(uint8_t *regs, unsigned long i, unsigned val)
+{
+	if (get_reg(regs, i) < val)
+		set_reg(regs, i, val);
+}
+
+/* value for the bits of a hash after the top p */
+static inline unsigned value_of(uint64_t hash, unsigned p)
+{
+	uint64_t rest = hash << p;
+
+	return rest ? (unsigned)__builtin_clzll(rest) + 1 : 64 - p + 1;
+}
+
+/* set the dense register for a sparse entry */
+static void add_entry_dense(struct hyperloglog *h, uint32_t e)
+{
+	uint32_t idx = ENTRY_IDX(e);
+	uint32_t low = idx & ((1U << (SP - h->p)) - 1);
+	unsigned val;
+
+	if (low)
+		val = __builtin_clz(low) - (32 - (SP - h->p)) + 1;
+	else
+		val = SP - h->p + ENTRY_VAL(e);
+	max_reg(h->regs, idx >> (SP - h->p), val);
+}
+
+static int cmp_entry(const void *lhs, const void *rhs)
+{
+	uint32_t a = *(const uint32_t *)lhs, b = *(const uint32_t *)rhs;
+
+	return (a > b) - (a < b);
+}
+
+/* sort the sparse list and keep only the biggest value for each index */
+static void compact(struct hyperloglog *h)
+{
+	size_t i, n = 0;
+
+	qsort(h->sparse, h->nsparse, sizeof *h->sparse, cmp_entry);
+	for (i = 0; i < h->nsparse; i++) {
+		if (n && ENTRY_IDX(h->sparse[n - 1]) == ENTRY_IDX(h->sparse[i]))
+			n--;
+		h->sparse[n++] = h->sparse[i];
+	}
+	h->nsparse = n;
+}
+
+static bool to_dense(struct hyperloglog *h)
+{
+	size_t i;
+
+	h->regs = calloc(1, dense_size(h->p));
+	if (!h->regs)
+		return false;
+	for (i = 0; i < h->nsparse; i++)
+		add_entry_dense(h, h->sparse[i]);
+	free(h->sparse);
+	h->sparse = NULL;
+	h->nsparse = 0;
+	h->sparse_cap = 0;
+	return true;
+}
+
+static bool add_entry(struct hyperloglog *h, uint32_t e)
+{
+	if (h->regs) {
+		add_entry_dense(h, e);
+		return true;
+	}
+
+	if (h->nsparse == h->sparse_cap) {
+		uint32_t *sparse;
+
+		compact(h);
+		if (h->nsparse < h->sparse_cap / 2)
+			goto add;
+		if (2 * h->sparse_cap * sizeof *h->sparse > dense_size(h->p)) {
+			if (!to_dense(h))
+				return false;
+			add_entry_dense(h, e);
+			return true;
+		}
+		sparse = realloc(h->sparse, 2 * h->sparse_cap * sizeof *sparse);
+		if (!sparse)
+			return false;
+		h->sparse = sparse;
+		h->sparse_cap *= 2;
+	}
+add:
+	h->sparse[h->nsparse++] = e;
+	return true;
+}
+
+static bool hyperloglog_init_storage(struct hyperloglog *h)
+{
+	h->nsparse = 0;
+	if (SPARSE_MIN_CAP * sizeof *h->sparse >= dense_size(h->p)) {
+		/* too small to bother */
+		h->sparse = NULL;
+		h->sparse_cap = 0;
+		h->regs = calloc(1, dense_size(h->p));
+		return h->regs;
+	}
+	h->regs = NULL;
+	h->sparse_cap = SPARSE_MIN_CAP;
+	h->sparse = malloc(h->sparse_cap * sizeof *h->sparse);
+	return h->sparse;
+}
+
+bool hyperloglog_init(struct hyperloglog *h)
+{
+	if (!seed_rng())
+		return false;
+	if (h->p < HYPERLOGLOG_P_MIN)
+		h->p = HYPERLOGLOG_P_MIN;
+	else if (h->p > HYPERLOGLOG_P_MAX)
+		h->p = HYPERLOGLOG_P_MAX;
+	h->seed = pcg64_random();
+	return hyperloglog_init_storage(h);
+}
+
+bool hyperloglog_init_from(struct hyperloglog *restrict h,
+			   const struct hyperloglog *restrict other)
+{
+	h->p = other->p;
+	h->seed = other->seed;
+	return hyperloglog_init_storage(h);
+}
+
+bool hyperloglog_same_class(const struct hyperloglog *h0,
+			    const struct hyperloglog *h1)
+{
+	return h0->p == h1->p && h0->seed == h1->seed;
+}
+
+void hyperloglog_destroy(struct hyperloglog *h)
+{
+	free(h->regs);
+	free(h->sparse);
+	h->regs = NULL;
+	h->sparse = NULL;
+	h->nsparse = 0;
+	h->sparse_cap = 0;
+}
+
+bool hyperloglog_insert(struct hyperloglog *h, uint64_t key)
+{
+	uint64_t hash = fasthash64_key(key, h->seed);
+
+	if (h->regs) {
+		max_reg(h->regs, hash >> (64 - h->p), value_of(hash, h->p));
+		return true;
+	}
+	return add_entry(h, ENTRY(hash >> (64 - SP), value_of(hash, SP)));
+}
+
+/* the series from Ertl's paper, section 4 */
+static double sigma(double x)
+{
+	double y = 1, z = x, prev;
+
+	if (x == 1)
+		return INFINITY;
+	do {
+		x *= x;
+		prev = z;
+		z += x * y;
+		y += y;
+	} while (z != prev);
+	return z;
+}
+
+static double tau(double x)
+{
+	double y = 1, z = 1 - x, prev;
+
+	if (x == 0 || x == 1)
+		return 0;
+	do {
+		x = sqrt(x);
+		prev = z;
+		y *= 0.5;
+		z -= (1 - x) * (1 - x) * y;
+	} while (z != prev);
+	return z / 3;
+}
+
+double hyperloglog_count(struct hyperloglog *h)
+{
+	unsigned long hist[64] = {0};
+	unsigned long i, m = 1UL << h->p;
+	unsigned q = 64 - h->p;
+	double z;
+	int k;
+
+	if (!h->regs) {
+		/* linear counting over the sparse registers */
+		double ms = 1UL << SP;
+
+		compact(h);
+		return ms * log(ms / (ms - h->nsparse));
+	}
+
+	for (i = 0; i < m; i++)
+		hist[get_reg(h->regs, i)]++;
+
+	z = m * tau(1 - (double)hist[q + 1] / m);
+	for (k = q; k >= 1; k--)
+		z = 0.5 * (z + hist[k]);
+	z += m * sigma((double)hist[0] / m);
+	return m / (2 * M_LN2) * m / z;
+}
+
+/* the longest a sparse list gets before add_entry makes the sketch dense */
+static size_t sparse_max_cap(unsigned p)
+{
+	size_t cap = SPARSE_MIN_CAP;
+
+	while (2 * cap * sizeof(uint32_t) <= dense_size(p))
+		cap *= 2;
+	return cap;
+}
+
+/*
+ * merge h's sparse list into into's. The result goes dense only if its
+ * distinct entries don't fit in the longest sparse list, rather than on the
+ * length of the two lists before duplicates are dropped.
+ */
+static bool union_sparse(struct hyperloglog *into, const struct hyperloglog *h)
+{
+	size_t n = into->nsparse + h->nsparse, cap = into->sparse_cap;
+	size_t max = sparse_max_cap(into->p);
+	uint32_t *sparse;
+
+	while (cap < n)
+		cap *= 2;
+	if (cap > into->sparse_cap) {
+		sparse = realloc(into->sparse, cap * sizeof *sparse);
+		if (!sparse)
+			return false;
+		into->sparse = sparse;
+		into->sparse_cap = cap;
+	}
+	memcpy(into->sparse + into->nsparse, h->sparse,
+	       h->nsparse * sizeof *h->sparse);
+	into->nsparse = n;
+	compact(into);
+
+	if (into->nsparse > max)
+		return to_dense(into);
+	if (into->sparse_cap > max) {
+		/* shrinking, so failure just means keeping the bigger list */
+		sparse = realloc(into->sparse, max * sizeof *sparse);
+		if (sparse) {
+			into->sparse = sparse;
+			into->sparse_cap = max;
+		}
+	}
+	return true;
+}
+
+/* make into a copy of h */
+static bool copy(struct hyperloglog *into, const struct hyperloglog *h)
+{
+	hyperloglog_destroy(into);
+	if (h->regs) {
+		into->regs = malloc(dense_size(h->p));
+		if (!into->regs)
+			return false;
+		memcpy(into->regs, h->regs, dense_size(h->p));
+	} else {
+		into->sparse = malloc(h->sparse_cap * sizeof *h->sparse);
+		if (!into->sparse)
+			return false;
+		memcpy(into->sparse, h->sparse, h->nsparse * sizeof *h->sparse);
+		into->nsparse = h->nsparse;
+		into->sparse_cap = h->sparse_cap;
+	}
+	return true;
+}
+
+bool hyperloglog_union(struct hyperloglog *into, const struct hyperloglog *h0,
+		       const struct hyperloglog *h1)
+{
+	unsigned long i;
+
+	if (into == h1) {
+		h1 = h0;
+		h0 = into;
+	}
+	if (!hyperloglog_same_class(h0, h1))
+		return false;
+	if (into != h0) {
+		if ((into->regs || into->sparse)
+		    && !hyperloglog_same_class(into, h0))
+			return false;
+		into->p = h0->p;
+		into->seed = h0->seed;
+		if (!copy(into, h0))
+			return false;
+	}
+	if (into == h1)
+		return true;
+
+	if (h1->regs) {
+		if (!into->regs && !to_dense(into))
+			return false;
+		for (i = 0; i < 1UL << into->p; i++)
+			max_reg(into->regs, i, get_reg(h1->regs, i));
+	} else if (into->regs) {
+		for (i = 0; i < h1->nsparse; i++)
+			add_entry_dense(into, h1->sparse[i]);
+	} else if (!union_sparse(into, h1)) {
+		return false;
+	}
+	return true;
+}
@@ -21,6 +21,7 @@
 
 #include "list.h"
 #include <assert.h>
+#include <limits.h>
 #include <stdbool.h>
 
 static inline void *node_to_data(struct list_head *hd, struct list *n)
@@ -163,6 +164,10 @@ void list_splice(struct list_head *hd, void *after,
 
 	assert(hd->offset == splicee->offset);
 
+	/* splicing onto the end, or into an empty list */
+	if (l_after == hd->last)
+		hd->last = splicee->last;
+
 	if (after) {
 		list_link(splicee->last, l_after->next);
 		list_link(l_after, splicee->first);
@@ -193,3 +198,142 @@ void list_reverse(struct list_head *hd)
 	hd->first = hd->last;
 	hd->last = first;
 }
+
+void list_for_each_batch(struct list_head *hd, void **buf, size_t k,
+			 void (*f)(void **batch, size_t n, void *private),
+			 void *private)
+{
+	struct list *n = hd->first;
+	size_t i;
+
+	assert(k > 0);
+
+	while (n) {
+		/* read every next pointer before f can free its element */
+		for (i = 0; n && i < k; i++, n = n->next) {
+			buf[i] = node_to_data(hd, n);
+			__builtin_prefetch(buf[i]);
+		}
+		f(buf, i, private);
+	}
+}
+
+/*
+ * merge two null terminated chains linked through next only. prev pointers
+ * are left garbage and fixed up by relink_prev once everything is merged.
+ */
+static struct list *merge_chains(struct list_head *hd, list_cmp_t cmp,
+				 struct list *a, struct list *b)
+{
+	struct list head;
+	struct list *tail = &head;
+
+	while (a && b) {
+		/* <= keeps the sort stable: a's elements came first */
+		if (cmp(node_to_data(hd, a), node_to_data(hd, b)) <= 0) {
+			tail->next = a;
+			a = a->next;
+		} else {
+			tail->next = b;
+			b = b->next;
+		}
+		tail = tail->next;
+	}
+	tail->next = a ? a : b;
+	return head.next;
+}
+
+/*
+ * cut the longest run off the front of the chain *rest that is either
+ * ascending or strictly descending, reversing it if it's descending, and
+ * advance *rest past it. Strict descent means reversing can't reorder equal
+ * elements. Sorted and reverse sorted input are then one run each.
+ */
+static struct list *take_run(struct list_head *hd, list_cmp_t cmp,
+			     struct list **rest)
+{
+	struct list *first = *rest, *last = first, *n = first->next, *next;
+
+	if (n && cmp(node_to_data(hd, first), node_to_data(hd, n)) > 0) {
+		first->next = NULL;
+		do {
+			next = n->next;
+			n->next = first;
+			first = n;
+			n = next;
+		} while (n && cmp(node_to_data(hd, first),
+				  node_to_data(hd, n)) > 0);
+		*rest = n;
+		return first;
+	}
+
+	while (n && cmp(node_to_data(hd, last), node_to_data(hd, n)) <= 0) {
+		last = n;
+		n = n->next;
+	}
+	last->next = NULL;
+	*rest = n;
+	return first;
+}
+
+static void relink_prev(struct list_head *hd, struct list *chain)
+{
+	struct list *prev = NULL;
+
+	hd->first = chain;
+	for (; chain; chain = chain->next) {
+		chain->prev = prev;
+		prev = chain;
+	}
+	hd->last = prev;
+}
+
+void list_sort(struct list_head *hd, list_cmp_t cmp)
+{
+	/*
+	 * pending[i] is NULL or a sorted chain of 2^i runs, and holds elements
+	 * that came before those in pending[i - 1]. Each run is added like
+	 * incrementing a binary counter, merging equal sized chains as it
+	 * carries, so merges stay roughly balanced.
+	 */
+	struct list *pending[sizeof(size_t) * CHAR_BIT + 1] = {NULL};
+	struct list *n = hd->first, *chain;
+	size_t i, max = 0;
+
+	if (hd->length < 2)
+		return;
+
+	while (n) {
+		chain = take_run(hd, cmp, &n);
+		for (i = 0; pending[i]; i++) {
+			chain = merge_chains(hd, cmp, pending[i], chain);
+			pending[i] = NULL;
+		}
+		pending[i] = chain;
+		if (i > max)
+			max = i;
+	}
+
+	chain = NULL;
+	for (i = 0; i <= max; i++)
+		if (pending[i])
+			chain = merge_chains(hd, cmp, pending[i], chain);
+	relink_prev(hd, chain);
+}
+
+void list_merge(struct list_head *hd, struct list_head *mergee,
+		list_cmp_t cmp)
+{
+	assert(hd->offset == mergee->offset);
+
+	if (is_empty(mergee))
+		return;
+
+	/* the chains are already null terminated at their last elements */
+	relink_prev(hd, merge_chains(hd, cmp, hd->first, mergee->first));
+	hd->length += mergee->length;
+
+	mergee->first = NULL;
+	mergee->last = NULL;
+	mergee->length = 0;
+}
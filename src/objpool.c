@@ -0,0 +1,414 @@
+/*
+ * Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file objpool.c
+ *
+ * \author Eric Mueller
+ *
+ * \brief Implementation of a fixed-size object pool with per-thread
+ * magazines.
+ */
+
+#include "objpool.h"
+#ifdef _POSIX_C_SOURCE
+  #undef _POSIX_C_SOURCE
+#endif
+#define _POSIX_C_SOURCE 200112L
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* target size of each slab. slabs always hold at least one magazine's worth */
+#define SLAB_BYTES (64 * 1024)
+
+#define POISON_FREE (0x6b)
+
+struct objpool_mag {
+	struct objpool_mag *next;
+	unsigned long count;
+	void *objs[OBJPOOL_MAG_SIZE];
+};
+
+/* lives at the start of every slab */
+struct objpool_slab {
+	struct objpool_slab *next;
+};
+
+/* per-thread state */
+struct objpool_cache {
+	struct objpool *pool;
+
+	/* we alloc from and free to loaded. previous is a spare */
+	struct objpool_mag *loaded;
+	struct objpool_mag *previous;
+
+	/* link in pool->caches */
+	struct list link;
+};
+
+/* ======= poisoning ======= */
+
+static inline bool poisoning(const struct objpool *pool)
+{
+#ifndef NDEBUG
+	return pool->flags & OBJPOOL_POISON;
+#else
+	(void)pool;
+	return false;
+#endif
+}
+
+static void poison(const struct objpool *pool, void *obj)
+{
+	if (poisoning(pool))
+		memset(obj, POISON_FREE, pool->objsize);
+}
+
+static void check_poison(const struct objpool *pool, const void *obj)
+{
+	const unsigned char *p = obj;
+	size_t i;
+
+	if (!poisoning(pool))
+		return;
+	for (i = 0; i < pool->objsize; i++)
+		assert(p[i] == POISON_FREE && "objpool: write after free");
+	(void)p;
+}
+
+/* ======= magazine helpers ======= */
+
+static void mag_push_list(struct objpool_mag **list, struct objpool_mag *m)
+{
+	m->next = *list;
+	*list = m;
+}
+
+static struct objpool_mag *mag_pop_list(struct objpool_mag **list)
+{
+	struct objpool_mag *m = *list;
+	if (m)
+		*list = m->next;
+	return m;
+}
+
+static void mag_free_list(struct objpool_mag *m)
+{
+	while (m) {
+		struct objpool_mag *next = m->next;
+		free(m);
+		m = next;
+	}
+}
+
+/* ======= slab layer. all called with the pool lock held ======= */
+
+static size_t slab_header_size(const struct objpool *pool)
+{
+	size_t hdr = sizeof(struct objpool_slab);
+	return (hdr + pool->align - 1) & ~(pool->align - 1);
+}
+
+static bool new_slab(struct objpool *pool)
+{
+	size_t hdr = slab_header_size(pool);
+	struct objpool_slab *slab = NULL;
+	size_t align = pool->align > OBJPOOL_CACHELINE ? pool->align
+						       : OBJPOOL_CACHELINE;
+
+	if (posix_memalign((void **)&slab, align,
+			   hdr + pool->slab_objs * pool->objsize))
+		return false;
+
+	slab->next = pool->slabs;
+	pool->slabs = slab;
+	pool->slab_cur = (char *)slab + hdr;
+	pool->slab_left = pool->slab_objs;
+	pool->stat_slabs++;
+	return true;
+}
+
+/* fill a magazine with never-used objects, returns the number added */
+static unsigned long carve(struct objpool *pool, struct objpool_mag *m)
+{
+	unsigned long added = 0;
+
+	while (m->count < OBJPOOL_MAG_SIZE) {
+		void *obj;
+
+		if (!pool->slab_left && !new_slab(pool))
+			break;
+
+		obj = pool->slab_cur;
+		pool->slab_cur += pool->objsize;
+		pool->slab_left--;
+
+		poison(pool, obj);
+		m->objs[m->count++] = obj;
+		added++;
+	}
+	return added;
+}
+
+/* ======= per-thread caches ======= */
+
+static void release_mag(struct objpool *pool, struct objpool_mag *m)
+{
+	if (!m)
+		return;
+	if (m->count)
+		mag_push_list(&pool->full, m);
+	else
+		mag_push_list(&pool->empty, m);
+}
+
+/* thread exit: give our magazines back to the depot */
+static void cache_dtor(void *arg)
+{
+	struct objpool_cache *tc = arg;
+	struct objpool *pool = tc->pool;
+
+	pthread_mutex_lock(&pool->lock);
+	release_mag(pool, tc->loaded);
+	release_mag(pool, tc->previous);
+	list_delete(&pool->caches, tc);
+	pthread_mutex_unlock(&pool->lock);
+	free(tc);
+}
+
+static struct objpool_cache *get_cache(struct objpool *pool)
+{
+	struct objpool_cache *tc = pthread_getspecific(pool->key);
+
+	if (tc)
+		return tc;
+
+	tc = calloc(1, sizeof *tc);
+	if (!tc)
+		return NULL;
+	tc->pool = pool;
+	tc->loaded = calloc(1, sizeof *tc->loaded);
+	tc->previous = calloc(1, sizeof *tc->previous);
+	if (!tc->loaded || !tc->previous
+	    || pthread_setspecific(pool->key, tc)) {
+		free(tc->loaded);
+		free(tc->previous);
+		free(tc);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	list_push_back(&pool->caches, tc);
+	pthread_mutex_unlock(&pool->lock);
+	return tc;
+}
+
+static inline void swap_mags(struct objpool_cache *tc)
+{
+	struct objpool_mag *tmp = tc->loaded;
+	tc->loaded = tc->previous;
+	tc->previous = tmp;
+}
+
+/* ======= public api ======= */
+
+bool objpool_init(struct objpool *pool, size_t objsize, size_t align,
+		  unsigned flags)
+{
+	assert(objsize);
+	assert((align & (align - 1)) == 0);
+
+	if (align < sizeof(void *))
+		align = sizeof(void *);
+
+	memset(pool, 0, sizeof *pool);
+	pool->align = align;
+	pool->objsize = (objsize + align - 1) & ~(align - 1);
+	pool->slab_objs = SLAB_BYTES / pool->objsize;
+	if (pool->slab_objs < OBJPOOL_MAG_SIZE)
+		pool->slab_objs = OBJPOOL_MAG_SIZE;
+	pool->flags = flags;
+	pool->caches = (struct list_head){
+		.first = NULL,
+		.last = NULL,
+		.length = 0,
+		.offset = offsetof(struct objpool_cache, link)};
+
+	if (pthread_key_create(&pool->key, cache_dtor))
+		return false;
+	if (pthread_mutex_init(&pool->lock, NULL)) {
+		pthread_key_delete(pool->key);
+		return false;
+	}
+	return true;
+}
+
+void objpool_destroy(struct objpool *pool)
+{
+	struct objpool_slab *slab;
+
+	/* deleting the key means exiting threads won't run cache_dtor */
+	pthread_key_delete(pool->key);
+
+	list_for_each(&pool->caches, struct objpool_cache, tc) {
+		free(tc->loaded);
+		free(tc->previous);
+		free(tc);
+	}
+
+	mag_free_list(pool->full);
+	mag_free_list(pool->empty);
+
+	while ((slab = pool->slabs)) {
+		pool->slabs = slab->next;
+		free(slab);
+	}
+
+	pthread_mutex_destroy(&pool->lock);
+	pool->full = NULL;
+	pool->empty = NULL;
+	pool->slab_cur = NULL;
+	pool->slab_left = 0;
+}
+
+/*
+ * both of tc's magazines are empty: trade the spare for a full one from the
+ * depot, or fill it from the slabs if the depot has none.
+ */
+static void refill(struct objpool *pool, struct objpool_cache *tc)
+{
+	struct objpool_mag *m;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->stat_depot_trips++;
+	m = mag_pop_list(&pool->full);
+	if (m) {
+		mag_push_list(&pool->empty, tc->previous);
+		tc->previous = tc->loaded;
+		tc->loaded = m;
+	} else {
+		carve(pool, tc->previous);
+		swap_mags(tc);
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
+
+static void *cache_alloc(struct objpool *pool, struct objpool_cache *tc)
+{
+	void *obj;
+
+	if (!tc->loaded->count) {
+		if (tc->previous->count)
+			swap_mags(tc);
+		else
+			refill(pool, tc);
+		if (!tc->loaded->count)
+			return NULL;
+	}
+
+	obj = tc->loaded->objs[--tc->loaded->count];
+	check_poison(pool, obj);
+	return obj;
+}
+
+/*
+ * both of tc's magazines are full: trade the spare for an empty one. returns
+ * false if no empty magazine could be found or allocated.
+ */
+static bool drain(struct objpool *pool, struct objpool_cache *tc)
+{
+	struct objpool_mag *m;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->stat_depot_trips++;
+	m = mag_pop_list(&pool->empty);
+	pthread_mutex_unlock(&pool->lock);
+
+	if (!m && !(m = calloc(1, sizeof *m)))
+		return false;
+	m->count = 0;
+
+	pthread_mutex_lock(&pool->lock);
+	mag_push_list(&pool->full, tc->previous);
+	pthread_mutex_unlock(&pool->lock);
+
+	tc->previous = tc->loaded;
+	tc->loaded = m;
+	return true;
+}
+
+static bool cache_free(struct objpool *pool, struct objpool_cache *tc,
+		       void *obj)
+{
+	if (tc->loaded->count == OBJPOOL_MAG_SIZE) {
+		if (tc->previous->count < OBJPOOL_MAG_SIZE)
+			swap_mags(tc);
+		else if (!drain(pool, tc))
+			return false;
+	}
+
+	poison(pool, obj);
+	tc->loaded->objs[tc->loaded->count++] = obj;
+	return true;
+}
+
+void *objpool_alloc(struct objpool *pool)
+{
+	struct objpool_cache *tc = get_cache(pool);
+	return tc ? cache_alloc(pool, tc) : NULL;
+}
+
+/*
+ * if we can't get a magazine to free into, the object is leaked back into the
+ * pool's memory (it'll be freed by objpool_destroy). this only happens when
+ * malloc is failing.
+ */
+void objpool_free(struct objpool *pool, void *obj)
+{
+	struct objpool_cache *tc;
+
+	if (!obj)
+		return;
+	tc = get_cache(pool);
+	if (tc)
+		cache_free(pool, tc, obj);
+}
+
+size_t objpool_alloc_bulk(struct objpool *pool, void **objs, size_t n)
+{
+	struct objpool_cache *tc = get_cache(pool);
+	size_t i;
+
+	if (!tc)
+		return 0;
+	for (i = 0; i < n; i++)
+		if (!(objs[i] = cache_alloc(pool, tc)))
+			break;
+	return i;
+}
+
+void objpool_free_bulk(struct objpool *pool, void **objs, size_t n)
+{
+	struct objpool_cache *tc = get_cache(pool);
+	size_t i;
+
+	if (!tc)
+		return;
+	for (i = 0; i < n; i++)
+		if (objs[i] && !cache_free(pool, tc, objs[i]))
+			break;
+}
@@ -0,0 +1,509 @@
+/*
+ * Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \author Eric Mueller
+ *
+ * \file quotient_filter.c
+ *
+ * \brief Implementation of a quotient filter.
+ *
+ * \detail Terminology: a 'run' is all the remainders with one quotient, and a
+ * 'cluster' is a sequence of runs with no empty slot in between, whose first
+ * run is in its canonical slot (the slot its quotient names). The metadata
+ * bits of a slot are
+ *
+ *     occupied      some key has this slot's index as its quotient. This
+ *                   belongs to the slot, not to the remainder in it.
+ *     continuation  the remainder here is not the first of its run.
+ *     shifted       the remainder here is not in its canonical slot.
+ *
+ * so a remainder's quotient can be found by walking back to the start of its
+ * cluster, then forward counting runs against occupied slots. The table is
+ * circular and is never completely full, so there's always an empty slot to
+ * stop at.
+ */
+
+#include "quotient_filter.h"
+#include "fasthash.h"
+#include "util.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* the table doubles when it is this full (out of 8) */
+#define MAX_LOAD_8THS (7U)
+
+#define OCCUPIED (1U)
+#define CONTINUATION (2U)
+#define SHIFTED (4U)
+#define META (7U)
+
+static inline uint64_t nslots(const struct quotient_filter *qf)
+{
+	return 1ULL << qf->qbits;
+}
+
+static inline uint64_t incr(const struct quotient_filter *qf, uint64_t i)
+{
+	return (i + 1) & (nslots(qf) - 1);
+}
+
+static inline uint64_t decr(const struct quotient_filter *qf, uint64_t i)
+{
+	return (i - 1) & (nslots(qf) - 1);
+}
+
+static inline uint64_t fingerprint(const struct quotient_filter *qf,
+				   uint64_t key)
+{
+	return fasthash64_key(key, qf->seed) >> (64 - qf->qbits - qf->rbits);
+}
+
+/* ===== packed slots ===== */
+
+static inline uint64_t get_slot(const struct quotient_filter *qf, uint64_t i)
+{
+	unsigned width = qf->rbits + 3;
+	uint64_t bit = i * width, mask = (1ULL << width) - 1;
+	unsigned off = bit % 64;
+	uint64_t v = qf->table[bit / 64] >> off;
+
+	if (off + width > 64)
+		v |= qf->table[bit / 64 + 1] << (64 - off);
+	return v & mask;
+}
+
+static inline void set_slot(struct quotient_filter *qf, uint64_t i,
+			    uint64_t v)
+{
+	unsigned width = qf->rbits + 3;
+	uint64_t bit = i * width, mask = (1ULL << width) - 1;
+	unsigned off = bit % 64;
+	uint64_t *w = &qf->table[bit / 64];
+
+	w[0] = (w[0] & ~(mask << off)) | v << off;
+	if (off + width > 64) {
+		unsigned spill = off + width - 64;
+
+		w[1] = (w[1] & ~((1ULL << spill) - 1)) | v >> (64 - off);
+	}
+}
+
+static inline bool is_empty(uint64_t slot)
+{
+	return (slot & META) == 0;
+}
+
+static inline bool is_run_start(uint64_t slot)
+{
+	return !(slot & CONTINUATION) && (slot & (OCCUPIED | SHIFTED));
+}
+
+static inline bool is_cluster_start(uint64_t slot)
+{
+	return (slot & OCCUPIED) && !(slot & (CONTINUATION | SHIFTED));
+}
+
+static inline uint64_t slot_rem(uint64_t slot)
+{
+	return slot >> 3;
+}
+
+/* ===== finding things ===== */
+
+/* index of the first remainder in the run for quotient fq */
+static uint64_t find_run(const struct quotient_filter *qf, uint64_t fq)
+{
+	uint64_t b = fq, s;
+
+	/* back to the start of the cluster */
+	while (get_slot(qf, b) & SHIFTED)
+		b = decr(qf, b);
+
+	/* forward, skipping one run per occupied slot until we get to fq */
+	s = b;
+	while (b != fq) {
+		do {
+			s = incr(qf, s);
+		} while (get_slot(qf, s) & CONTINUATION);
+		do {
+			b = incr(qf, b);
+		} while (!(get_slot(qf, b) & OCCUPIED));
+	}
+	return s;
+}
+
+/* ===== insert ===== */
+
+/* put elt at s, shifting the rest of the cluster right by one slot */
+static void shift_in(struct quotient_filter *qf, uint64_t s, uint64_t elt)
+{
+	uint64_t prev, curr = elt;
+	bool empty;
+
+	do {
+		prev = get_slot(qf, s);
+		empty = is_empty(prev);
+		if (!empty) {
+			/* the occupied bit stays with the slot */
+			prev |= SHIFTED;
+			if (prev & OCCUPIED) {
+				curr |= OCCUPIED;
+				prev &= ~(uint64_t)OCCUPIED;
+			}
+		}
+		set_slot(qf, s, curr);
+		curr = prev;
+		s = incr(qf, s);
+	} while (!empty);
+}
+
+/* insert a fingerprint, assuming there's room */
+static void insert_fp(struct quotient_filter *qf, uint64_t fp)
+{
+	uint64_t fq = fp >> qf->rbits;
+	uint64_t fr = fp & ((1ULL << qf->rbits) - 1);
+	uint64_t canon = get_slot(qf, fq);
+	uint64_t entry = fr << 3;
+	uint64_t start, s;
+
+	qf->nentries++;
+	if (is_empty(canon)) {
+		set_slot(qf, fq, entry | OCCUPIED);
+		return;
+	}
+	if (!(canon & OCCUPIED))
+		set_slot(qf, fq, canon | OCCUPIED);
+
+	start = find_run(qf, fq);
+	s = start;
+	if (canon & OCCUPIED) {
+		/* find the spot in the run, after any equal remainders */
+		do {
+			if (slot_rem(get_slot(qf, s)) > fr)
+				break;
+			s = incr(qf, s);
+		} while (get_slot(qf, s) & CONTINUATION);
+
+		if (s == start)
+			set_slot(qf, start, get_slot(qf, start) | CONTINUATION);
+		else
+			entry |= CONTINUATION;
+	}
+	if (s != fq)
+		entry |= SHIFTED;
+	shift_in(qf, s, entry);
+}
+
+/* ===== remove ===== */
+
+/*
+ * remove the remainder at s, whose quotient is quot, shifting the rest of
+ * the cluster left. Remainders that land back in their canonical slot are no
+ * longer shifted.
+ */
+static void shift_out(struct quotient_filter *qf, uint64_t s, uint64_t quot)
+{
+	uint64_t curr = get_slot(qf, s), next, sp = incr(qf, s), orig = s;
+
+	for (;;) {
+		bool curr_occupied = curr & OCCUPIED;
+
+		next = get_slot(qf, sp);
+		if (is_empty(next) || is_cluster_start(next) || sp == orig) {
+			set_slot(qf, s, curr_occupied ? OCCUPIED : 0);
+			return;
+		}
+		if (is_run_start(next)) {
+			do {
+				quot = incr(qf, quot);
+			} while (!(get_slot(qf, quot) & OCCUPIED));
+			if (curr_occupied && quot == s)
+				next &= ~(uint64_t)SHIFTED;
+		}
+		next = curr_occupied ? next | OCCUPIED
+			: next & ~(uint64_t)OCCUPIED;
+		set_slot(qf, s, next);
+		s = sp;
+		sp = incr(qf, sp);
+		curr = get_slot(qf, s);
+	}
+}
+
+/* ===== api ===== */
+
+static bool valid_sizes(unsigned q, unsigned r)
+{
+	return q >= QUOTIENT_FILTER_Q_MIN && q <= QUOTIENT_FILTER_Q_MAX
+		&& r >= QUOTIENT_FILTER_R_MIN && r <= QUOTIENT_FILTER_R_MAX
+		&& q + r <= 64;
+}
+
+static bool quotient_filter_init_table(struct quotient_filter *qf)
+{
+	/* one spare word so a slot can always be read as two words */
+	size_t words = div_round_up_ul(nslots(qf) * (qf->rbits + 3), 64) + 1;
+
+	qf->nentries = 0;
+	qf->table = calloc(words, sizeof *qf->table);
+	return qf->table;
+}
+
+bool quotient_filter_init(struct quotient_filter *qf)
+{
+	if (!valid_sizes(qf->qbits, qf->rbits) || !seed_rng())
+		return false;
+	qf->seed = pcg64_random();
+	return quotient_filter_init_table(qf);
+}
+
+bool quotient_filter_init_from(struct quotient_filter *restrict qf,
+			       const struct quotient_filter *restrict other)
+{
+	qf->qbits = other->qbits;
+	qf->rbits = other->rbits;
+	qf->seed = other->seed;
+	return quotient_filter_init_table(qf);
+}
+
+bool quotient_filter_same_class(const struct quotient_filter *qf0,
+				const struct quotient_filter *qf1)
+{
+	return qf0->seed == qf1->seed
+		&& qf0->qbits + qf0->rbits == qf1->qbits + qf1->rbits;
+}
+
+void quotient_filter_destroy(struct quotient_filter *qf)
+{
+	free(qf->table);
+	qf->table = NULL;
+	qf->nentries = 0;
+}
+
+bool quotient_filter_insert(struct quotient_filter *qf, uint64_t key)
+{
+	uint64_t fp = fingerprint(qf, key);
+
+	if ((qf->nentries + 1) * 8 > nslots(qf) * MAX_LOAD_8THS
+	    && !quotient_filter_resize(qf)) {
+		/* we can keep going until the very last slot */
+		if (qf->nentries + 1 >= nslots(qf))
+			return false;
+	}
+	/* resizing doesn't change fingerprints, just how they're split */
+	insert_fp(qf, fp);
+	return true;
+}
+
+unsigned long quotient_filter_count(const struct quotient_filter *qf,
+				    uint64_t key)
+{
+	uint64_t fp = fingerprint(qf, key);
+	uint64_t fq = fp >> qf->rbits;
+	uint64_t fr = fp & ((1ULL << qf->rbits) - 1);
+	unsigned long count = 0;
+	uint64_t s, rem;
+
+	if (!(get_slot(qf, fq) & OCCUPIED))
+		return 0;
+
+	s = find_run(qf, fq);
+	do {
+		rem = slot_rem(get_slot(qf, s));
+		if (rem > fr)
+			break;
+		count += rem == fr;
+		s = incr(qf, s);
+	} while (get_slot(qf, s) & CONTINUATION);
+	return count;
+}
+
+bool quotient_filter_query(const struct quotient_filter *qf, uint64_t key)
+{
+	return quotient_filter_count(qf, key) > 0;
+}
+
+bool quotient_filter_remove(struct quotient_filter *qf, uint64_t key)
+{
+	uint64_t fp = fingerprint(qf, key);
+	uint64_t fq = fp >> qf->rbits;
+	uint64_t fr = fp & ((1ULL << qf->rbits) - 1);
+	uint64_t canon = get_slot(qf, fq);
+	uint64_t s, rem, kill, next;
+	bool run_start;
+
+	if (!(canon & OCCUPIED))
+		return false;
+
+	s = find_run(qf, fq);
+	do {
+		rem = slot_rem(get_slot(qf, s));
+		if (rem >= fr)
+			break;
+		s = incr(qf, s);
+	} while (get_slot(qf, s) & CONTINUATION);
+	if (rem != fr)
+		return false;
+
+	kill = get_slot(qf, s);
+	run_start = is_run_start(kill);
+
+	/* removing the only remainder in the run */
+	if (run_start && !(get_slot(qf, incr(qf, s)) & CONTINUATION))
+		set_slot(qf, fq, get_slot(qf, fq) & ~(uint64_t)OCCUPIED);
+
+	shift_out(qf, s, fq);
+
+	/* whatever slid into the start of the run now starts it */
+	if (run_start) {
+		next = get_slot(qf, s);
+		if (next & CONTINUATION) {
+			next &= ~(uint64_t)CONTINUATION;
+			if (s == fq)
+				next &= ~(uint64_t)SHIFTED;
+			set_slot(qf, s, next);
+		}
+	}
+	qf->nentries--;
+	return true;
+}
+
+/* ===== iteration in fingerprint order ===== */
+
+/*
+ * Visiting the slots in order from just after an empty one decodes every
+ * remainder's quotient, but starts partway through the quotients. So this
+ * goes around twice: first for the quotients after the empty slot, then for
+ * the ones before it.
+ */
+struct cursor {
+	const struct quotient_filter *qf;
+	uint64_t empty;
+	uint64_t visited;
+	uint64_t quot;
+	unsigned pass;
+};
+
+static void cursor_init(struct cursor *c, const struct quotient_filter *qf)
+{
+	c->qf = qf;
+	c->empty = 0;
+	while (!is_empty(get_slot(qf, c->empty)))
+		c->empty++;
+	c->visited = 0;
+	c->quot = c->empty;
+	c->pass = 0;
+}
+
+static bool cursor_next(struct cursor *c, uint64_t *fp)
+{
+	const struct quotient_filter *qf = c->qf;
+
+	while (c->pass < 2) {
+		while (c->visited < nslots(qf)) {
+			uint64_t pos = (c->empty + 1 + c->visited++)
+				& (nslots(qf) - 1);
+			uint64_t slot = get_slot(qf, pos);
+
+			if (is_empty(slot))
+				continue;
+			if (!(slot & SHIFTED)) {
+				c->quot = pos;
+			} else if (!(slot & CONTINUATION)) {
+				do {
+					c->quot = incr(qf, c->quot);
+				} while (!(get_slot(qf, c->quot) & OCCUPIED));
+			}
+			if ((c->pass == 0) == (c->quot > c->empty)) {
+				*fp = c->quot << qf->rbits | slot_rem(slot);
+				return true;
+			}
+		}
+		c->pass++;
+		c->visited = 0;
+		c->quot = c->empty;
+	}
+	return false;
+}
+
+bool quotient_filter_resize(struct quotient_filter *qf)
+{
+	struct quotient_filter bigger = *qf;
+	struct cursor c;
+	uint64_t fp;
+
+	if (qf->rbits <= QUOTIENT_FILTER_R_MIN
+	    || qf->qbits >= QUOTIENT_FILTER_Q_MAX)
+		return false;
+	bigger.qbits++;
+	bigger.rbits--;
+	if (!quotient_filter_init_table(&bigger))
+		return false;
+
+	/* the fingerprints are the same, they just split differently */
+	cursor_init(&c, qf);
+	while (cursor_next(&c, &fp))
+		insert_fp(&bigger, fp);
+
+	quotient_filter_destroy(qf);
+	*qf = bigger;
+	return true;
+}
+
+bool quotient_filter_merge(struct quotient_filter *into,
+			   const struct quotient_filter *qf0,
+			   const struct quotient_filter *qf1)
+{
+	struct quotient_filter out = *qf0;
+	struct cursor c0, c1;
+	uint64_t fp0, fp1;
+	bool more0, more1;
+
+	if (!quotient_filter_same_class(qf0, qf1))
+		return false;
+
+	/* start as big as the bigger one, and grow until both fit */
+	out.qbits = qf0->qbits > qf1->qbits ? qf0->qbits : qf1->qbits;
+	out.rbits = qf0->qbits + qf0->rbits - out.qbits;
+	while ((qf0->nentries + qf1->nentries + 1) * 8
+	       > (1ULL << out.qbits) * MAX_LOAD_8THS) {
+		if (out.rbits <= QUOTIENT_FILTER_R_MIN
+		    || out.qbits >= QUOTIENT_FILTER_Q_MAX)
+			return false;
+		out.qbits++;
+		out.rbits--;
+	}
+	if (!quotient_filter_init_table(&out))
+		return false;
+
+	/* a sorted merge, so every insert goes at the end of its cluster */
+	cursor_init(&c0, qf0);
+	cursor_init(&c1, qf1);
+	more0 = cursor_next(&c0, &fp0);
+	more1 = cursor_next(&c1, &fp1);
+	while (more0 || more1) {
+		if (more0 && (!more1 || fp0 <= fp1)) {
+			insert_fp(&out, fp0);
+			more0 = cursor_next(&c0, &fp0);
+		} else {
+			insert_fp(&out, fp1);
+			more1 = cursor_next(&c1, &fp1);
+		}
+	}
+
+	quotient_filter_destroy(into);
+	*into = out;
+	return true;
+}
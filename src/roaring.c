@@ -0,0 +1,1020 @@
+/*
+ * Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file roaring.c
+ *
+ * \author Eric Mueller
+ *
+ * \brief Implementation of a roaring bitmap.
+ *
+ * \detail Set operations have a fast path for two array containers (a sorted
+ * merge). Every other combination is done by expanding both containers into
+ * 2^16 bit bitmaps, combining those a word at a time, and converting the
+ * result back into the smaller of an array or bitmap container. That keeps
+ * the number of container pairings we need code for small while still doing
+ * the expensive (dense) cases at memory bandwidth.
+ */
+
+#include "roaring.h"
+#include "bloom.h"
+#include "radix_tree.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#define TYPE_ARRAY (0)
+#define TYPE_BITMAP (1)
+#define TYPE_RUN (2)
+
+/* max cardinality of an array container. above this a bitmap is smaller */
+#define ARRAY_MAX (4096U)
+
+/* number of 64 bit words in a bitmap container */
+#define BITMAP_WORDS (1024U)
+#define BITMAP_BYTES (BITMAP_WORDS * sizeof(uint64_t))
+
+#define HIGH(x) ((uint16_t)((x) >> 16))
+#define LOW(x) ((uint16_t)((x) & 0xffff))
+
+/* a run of consecutive integers [start, start + len] */
+struct rrun {
+	uint16_t start;
+	uint16_t len;
+};
+
+struct roaring_container {
+	/* one of TYPE_* */
+	uint32_t type;
+
+	/* number of members. up to 2^16, so this doesn't fit in a uint16_t */
+	uint32_t card;
+
+	/* number of elements in array or runs, for array and run containers */
+	uint32_t n;
+
+	/* number of elements allocated in array or runs */
+	uint32_t cap;
+
+	union {
+		uint16_t *array;
+		uint64_t *bitmap;
+		struct rrun *runs;
+	} u;
+};
+
+/* ======= bitmap word helpers ======= */
+
+static inline unsigned popcount64(uint64_t w)
+{
+	return __builtin_popcountll(w);
+}
+
+static inline unsigned ctz64(uint64_t w)
+{
+	return __builtin_ctzll(w);
+}
+
+static inline bool test_bit(const uint64_t *words, uint32_t i)
+{
+	return words[i >> 6] & (UINT64_C(1) << (i & 63));
+}
+
+static inline void set_bit(uint64_t *words, uint32_t i)
+{
+	words[i >> 6] |= UINT64_C(1) << (i & 63);
+}
+
+static inline void clear_bit(uint64_t *words, uint32_t i)
+{
+	words[i >> 6] &= ~(UINT64_C(1) << (i & 63));
+}
+
+/* set bits [lo, hi] (inclusive) */
+static void set_bit_range(uint64_t *words, uint32_t lo, uint32_t hi)
+{
+	uint32_t lw = lo >> 6, hw = hi >> 6;
+	uint64_t lmask = ~UINT64_C(0) << (lo & 63);
+	uint64_t hmask = ~UINT64_C(0) >> (63 - (hi & 63));
+	uint32_t i;
+
+	if (lw == hw) {
+		words[lw] |= lmask & hmask;
+		return;
+	}
+	words[lw] |= lmask;
+	for (i = lw + 1; i < hw; i++)
+		words[i] = ~UINT64_C(0);
+	words[hw] |= hmask;
+}
+
+/* first bit >= pos that is set (or clear), or 2^16 if there is none */
+static uint32_t next_bit(const uint64_t *words, uint32_t pos, bool set)
+{
+	while (pos < 65536) {
+		uint64_t w = set ? words[pos >> 6] : ~words[pos >> 6];
+
+		w &= ~UINT64_C(0) << (pos & 63);
+		if (w)
+			return (pos & ~63U) + ctz64(w);
+		pos = (pos & ~63U) + 64;
+	}
+	return 65536;
+}
+
+static uint32_t bitmap_card(const uint64_t *words)
+{
+	uint32_t card = 0, i;
+
+	for (i = 0; i < BITMAP_WORDS; i++)
+		card += popcount64(words[i]);
+	return card;
+}
+
+#define OP_OR (0)
+#define OP_AND (1)
+#define OP_ANDNOT (2)
+
+/* dst = a op b, a word at a time. returns the cardinality of dst */
+static uint32_t bitmap_op(uint64_t *dst, const uint64_t *a, const uint64_t *b,
+			  int op)
+{
+	uint32_t i = 0;
+
+#ifdef __AVX2__
+	for (; i < BITMAP_WORDS; i += 4) {
+		__m256i va = _mm256_loadu_si256((const __m256i *)&a[i]);
+		__m256i vb = _mm256_loadu_si256((const __m256i *)&b[i]);
+		__m256i vr;
+
+		if (op == OP_OR)
+			vr = _mm256_or_si256(va, vb);
+		else if (op == OP_AND)
+			vr = _mm256_and_si256(va, vb);
+		else
+			vr = _mm256_andnot_si256(vb, va);
+		_mm256_storeu_si256((__m256i *)&dst[i], vr);
+	}
+#else
+	for (; i < BITMAP_WORDS; i++) {
+		if (op == OP_OR)
+			dst[i] = a[i] | b[i];
+		else if (op == OP_AND)
+			dst[i] = a[i] & b[i];
+		else
+			dst[i] = a[i] & ~b[i];
+	}
+#endif
+	return bitmap_card(dst);
+}
+
+/* number of runs of set bits in a bitmap */
+static uint32_t bitmap_nruns(const uint64_t *words)
+{
+	uint32_t nruns = 0, i;
+	uint64_t carry = 0;
+
+	for (i = 0; i < BITMAP_WORDS; i++) {
+		uint64_t w = words[i];
+		/* a run starts at each set bit whose predecessor is clear */
+		nruns += popcount64(w & ~((w << 1) | carry));
+		carry = w >> 63;
+	}
+	return nruns;
+}
+
+/* ======= container methods ======= */
+
+static void c_free(struct roaring_container *c)
+{
+	free(c->u.array);
+	c->u.array = NULL;
+}
+
+static bool c_init_array(struct roaring_container *c, uint32_t cap)
+{
+	c->type = TYPE_ARRAY;
+	c->card = 0;
+	c->n = 0;
+	c->cap = cap;
+	c->u.array = malloc(sizeof *c->u.array * cap);
+	return c->u.array != NULL;
+}
+
+static bool c_copy(struct roaring_container *dst,
+		   const struct roaring_container *src)
+{
+	size_t size;
+
+	*dst = *src;
+	if (src->type == TYPE_BITMAP)
+		size = BITMAP_BYTES;
+	else if (src->type == TYPE_ARRAY)
+		size = sizeof *src->u.array * src->n;
+	else
+		size = sizeof *src->u.runs * src->n;
+
+	dst->cap = src->n;
+	dst->u.array = malloc(size ? size : 1);
+	if (!dst->u.array)
+		return false;
+	memcpy(dst->u.array, src->u.array, size);
+	return true;
+}
+
+/* first index in a sorted array whose value is >= x */
+static uint32_t array_lower_bound(const uint16_t *a, uint32_t n, uint16_t x)
+{
+	uint32_t lo = 0, hi = n;
+
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (a[mid] < x)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* index of the last run whose start is <= x, or -1 if there is none */
+static long run_find(const struct rrun *runs, uint32_t n, uint16_t x)
+{
+	long lo = 0, hi = (long)n - 1, ret = -1;
+
+	while (lo <= hi) {
+		long mid = lo + (hi - lo) / 2;
+		if (runs[mid].start <= x) {
+			ret = mid;
+			lo = mid + 1;
+		} else {
+			hi = mid - 1;
+		}
+	}
+	return ret;
+}
+
+static bool c_contains(const struct roaring_container *c, uint16_t x)
+{
+	uint32_t i;
+	long r;
+
+	switch (c->type) {
+	case TYPE_ARRAY:
+		i = array_lower_bound(c->u.array, c->n, x);
+		return i < c->n && c->u.array[i] == x;
+	case TYPE_BITMAP:
+		return test_bit(c->u.bitmap, x);
+	default:
+		r = run_find(c->u.runs, c->n, x);
+		return r >= 0
+			&& (uint32_t)x - c->u.runs[r].start <= c->u.runs[r].len;
+	}
+}
+
+/* expand any container into a zeroed 2^16 bit bitmap */
+static void c_to_words(const struct roaring_container *c, uint64_t *words)
+{
+	uint32_t i;
+
+	if (c->type == TYPE_BITMAP) {
+		memcpy(words, c->u.bitmap, BITMAP_BYTES);
+		return;
+	}
+
+	memset(words, 0, BITMAP_BYTES);
+	if (c->type == TYPE_ARRAY) {
+		for (i = 0; i < c->n; i++)
+			set_bit(words, c->u.array[i]);
+	} else {
+		for (i = 0; i < c->n; i++)
+			set_bit_range(words, c->u.runs[i].start,
+				      c->u.runs[i].start + c->u.runs[i].len);
+	}
+}
+
+/*
+ * Build a container out of a bitmap with the given cardinality, picking the
+ * smallest representation. Run containers are only considered if allow_runs.
+ * words may become owned by the container, in which case *words_taken is set.
+ */
+static bool c_from_words(struct roaring_container *c, uint64_t *words,
+			 uint32_t card, bool allow_runs, bool *words_taken)
+{
+	uint32_t nruns = allow_runs ? bitmap_nruns(words) : 0;
+	size_t run_size = sizeof(struct rrun) * nruns;
+	size_t other_size = card <= ARRAY_MAX ? sizeof(uint16_t) * card
+					      : BITMAP_BYTES;
+	uint32_t i, j = 0;
+
+	*words_taken = false;
+
+	if (allow_runs && run_size < other_size) {
+		c->type = TYPE_RUN;
+		c->card = card;
+		c->n = 0;
+		c->cap = nruns;
+		c->u.runs = malloc(run_size);
+		if (!c->u.runs)
+			return false;
+
+		for (i = next_bit(words, 0, true); i < 65536;
+		     i = next_bit(words, j, true)) {
+			j = next_bit(words, i, false);
+			c->u.runs[c->n++] = (struct rrun){i, j - 1 - i};
+		}
+		assert(c->n == nruns);
+		return true;
+	}
+
+	if (card > ARRAY_MAX) {
+		c->type = TYPE_BITMAP;
+		c->card = card;
+		c->n = 0;
+		c->cap = 0;
+		c->u.bitmap = words;
+		*words_taken = true;
+		return true;
+	}
+
+	if (!c_init_array(c, card ? card : 1))
+		return false;
+	for (i = 0; i < BITMAP_WORDS; i++) {
+		uint64_t w = words[i];
+		while (w) {
+			c->u.array[j++] = i * 64 + ctz64(w);
+			w &= w - 1;
+		}
+	}
+	c->n = c->card = card;
+	return true;
+}
+
+/* convert a container to the smallest array or bitmap representation */
+static bool c_normalize(struct roaring_container *c, bool allow_runs)
+{
+	uint64_t *words = malloc(BITMAP_BYTES);
+	struct roaring_container tmp;
+	bool taken;
+
+	if (!words)
+		return false;
+	c_to_words(c, words);
+	if (!c_from_words(&tmp, words, c->card, allow_runs, &taken)) {
+		free(words);
+		return false;
+	}
+	if (!taken)
+		free(words);
+	c_free(c);
+	*c = tmp;
+	return true;
+}
+
+/* returns -1 on allocation failure, 0 if x was present, 1 if added */
+static int c_add(struct roaring_container *c, uint16_t x)
+{
+	uint32_t i;
+
+	if (c->type == TYPE_RUN) {
+		if (c_contains(c, x))
+			return 0;
+		if (!c_normalize(c, false))
+			return -1;
+	}
+
+	if (c->type == TYPE_BITMAP) {
+		if (test_bit(c->u.bitmap, x))
+			return 0;
+		set_bit(c->u.bitmap, x);
+		c->card++;
+		return 1;
+	}
+
+	i = array_lower_bound(c->u.array, c->n, x);
+	if (i < c->n && c->u.array[i] == x)
+		return 0;
+
+	if (c->n == ARRAY_MAX) {
+		uint64_t *words = calloc(BITMAP_WORDS, sizeof *words);
+		if (!words)
+			return -1;
+		c_to_words(c, words);
+		c_free(c);
+		c->type = TYPE_BITMAP;
+		c->u.bitmap = words;
+		set_bit(words, x);
+		c->card++;
+		return 1;
+	}
+
+	if (c->n == c->cap) {
+		uint32_t cap = c->cap * 2 > ARRAY_MAX ? ARRAY_MAX : c->cap * 2;
+		uint16_t *a = realloc(c->u.array, sizeof *a * cap);
+		if (!a)
+			return -1;
+		c->u.array = a;
+		c->cap = cap;
+	}
+
+	memmove(&c->u.array[i + 1], &c->u.array[i],
+		sizeof *c->u.array * (c->n - i));
+	c->u.array[i] = x;
+	c->n++;
+	c->card++;
+	return 1;
+}
+
+/* returns -1 on allocation failure, 0 if x was absent, 1 if removed */
+static int c_remove(struct roaring_container *c, uint16_t x)
+{
+	uint32_t i;
+
+	if (!c_contains(c, x))
+		return 0;
+
+	if (c->type == TYPE_RUN && !c_normalize(c, false))
+		return -1;
+
+	if (c->type == TYPE_BITMAP) {
+		clear_bit(c->u.bitmap, x);
+		c->card--;
+		/*
+		 * shrink back to an array once it's cheaper. x is gone either
+		 * way, so if that fails the bitmap just stays a while longer.
+		 */
+		if (c->card <= ARRAY_MAX / 2)
+			c_normalize(c, false);
+		return 1;
+	}
+
+	i = array_lower_bound(c->u.array, c->n, x);
+	memmove(&c->u.array[i], &c->u.array[i + 1],
+		sizeof *c->u.array * (c->n - i - 1));
+	c->n--;
+	c->card--;
+	return 1;
+}
+
+/* number of members <= x */
+static uint32_t c_rank(const struct roaring_container *c, uint16_t x)
+{
+	uint32_t i, ret = 0;
+
+	switch (c->type) {
+	case TYPE_ARRAY:
+		return array_lower_bound(c->u.array, c->n, x)
+			+ (c_contains(c, x) ? 1 : 0);
+	case TYPE_BITMAP:
+		for (i = 0; i < (uint32_t)x >> 6; i++)
+			ret += popcount64(c->u.bitmap[i]);
+		return ret + popcount64(c->u.bitmap[i]
+					& (~UINT64_C(0) >> (63 - (x & 63))));
+	default:
+		for (i = 0; i < c->n && c->u.runs[i].start <= x; i++) {
+			uint32_t end = c->u.runs[i].start + c->u.runs[i].len;
+			ret += (end < x ? end : x) - c->u.runs[i].start + 1;
+		}
+		return ret;
+	}
+}
+
+/* the ith smallest member. i must be < card */
+static uint16_t c_select(const struct roaring_container *c, uint32_t i)
+{
+	uint32_t j;
+
+	assert(i < c->card);
+
+	switch (c->type) {
+	case TYPE_ARRAY:
+		return c->u.array[i];
+	case TYPE_BITMAP:
+		for (j = 0; ; j++) {
+			uint64_t w = c->u.bitmap[j];
+			uint32_t pc = popcount64(w);
+			if (i < pc) {
+				while (i--)
+					w &= w - 1;
+				return j * 64 + ctz64(w);
+			}
+			i -= pc;
+		}
+	default:
+		for (j = 0; ; j++) {
+			if (i <= c->u.runs[j].len)
+				return c->u.runs[j].start + i;
+			i -= c->u.runs[j].len + 1;
+		}
+	}
+}
+
+/*
+ * a op b for two containers. on success the result is written to out, but
+ * its cardinality may be zero (and then out owns no memory).
+ */
+static bool c_op(struct roaring_container *out,
+		 const struct roaring_container *a,
+		 const struct roaring_container *b, int op)
+{
+	uint64_t *wa, *wb;
+	uint32_t card;
+	bool taken;
+	bool ok;
+
+	/* fast path: merge two sorted arrays */
+	if (a->type == TYPE_ARRAY && b->type == TYPE_ARRAY
+	    && (op != OP_OR || a->n + b->n <= ARRAY_MAX)) {
+		uint32_t i = 0, j = 0, k = 0;
+		uint32_t cap = op == OP_OR ? a->n + b->n : a->n;
+
+		if (!c_init_array(out, cap ? cap : 1))
+			return false;
+		while (i < a->n && j < b->n) {
+			uint16_t va = a->u.array[i], vb = b->u.array[j];
+			if (va < vb) {
+				if (op != OP_AND)
+					out->u.array[k++] = va;
+				i++;
+			} else if (vb < va) {
+				if (op == OP_OR)
+					out->u.array[k++] = vb;
+				j++;
+			} else {
+				if (op != OP_ANDNOT)
+					out->u.array[k++] = va;
+				i++;
+				j++;
+			}
+		}
+		if (op != OP_AND)
+			while (i < a->n)
+				out->u.array[k++] = a->u.array[i++];
+		if (op == OP_OR)
+			while (j < b->n)
+				out->u.array[k++] = b->u.array[j++];
+		out->n = out->card = k;
+		if (k == 0)
+			c_free(out);
+		return true;
+	}
+
+	wa = malloc(BITMAP_BYTES);
+	wb = malloc(BITMAP_BYTES);
+	if (!wa || !wb) {
+		free(wa);
+		free(wb);
+		return false;
+	}
+
+	c_to_words(a, wa);
+	c_to_words(b, wb);
+	card = bitmap_op(wa, wa, wb, op);
+	free(wb);
+
+	if (card == 0) {
+		free(wa);
+		out->card = 0;
+		out->u.array = NULL;
+		return true;
+	}
+
+	ok = c_from_words(out, wa, card, false, &taken);
+	if (!taken)
+		free(wa);
+	return ok;
+}
+
+/* ======= top level key array helpers ======= */
+
+/* index of the container with the given high bits, or where it would go */
+static unsigned long key_lower_bound(const struct roaring *r, uint16_t hb)
+{
+	unsigned long lo = 0, hi = r->ncontainers;
+
+	while (lo < hi) {
+		unsigned long mid = lo + (hi - lo) / 2;
+		if (r->keys[mid] < hb)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static struct roaring_container *find_container(const struct roaring *r,
+						uint16_t hb)
+{
+	unsigned long i = key_lower_bound(r, hb);
+
+	if (i < r->ncontainers && r->keys[i] == hb)
+		return &r->containers[i];
+	return NULL;
+}
+
+static bool reserve(struct roaring *r, unsigned long n)
+{
+	unsigned long alloc = r->alloc ? r->alloc : 4;
+	uint16_t *keys;
+	struct roaring_container *cs;
+
+	if (n <= r->alloc)
+		return true;
+	while (alloc < n)
+		alloc *= 2;
+
+	keys = realloc(r->keys, sizeof *keys * alloc);
+	if (!keys)
+		return false;
+	r->keys = keys;
+
+	cs = realloc(r->containers, sizeof *cs * alloc);
+	if (!cs)
+		return false;
+	r->containers = cs;
+
+	r->alloc = alloc;
+	return true;
+}
+
+/* insert an (uninitialized) container for hb at index i */
+static struct roaring_container *insert_container(struct roaring *r,
+						  unsigned long i, uint16_t hb)
+{
+	if (!reserve(r, r->ncontainers + 1))
+		return NULL;
+
+	memmove(&r->keys[i + 1], &r->keys[i],
+		sizeof *r->keys * (r->ncontainers - i));
+	memmove(&r->containers[i + 1], &r->containers[i],
+		sizeof *r->containers * (r->ncontainers - i));
+	r->keys[i] = hb;
+	r->ncontainers++;
+	return &r->containers[i];
+}
+
+static void remove_container(struct roaring *r, unsigned long i)
+{
+	c_free(&r->containers[i]);
+	r->ncontainers--;
+	memmove(&r->keys[i], &r->keys[i + 1],
+		sizeof *r->keys * (r->ncontainers - i));
+	memmove(&r->containers[i], &r->containers[i + 1],
+		sizeof *r->containers * (r->ncontainers - i));
+}
+
+/* append a container to a bitmap being built in order. takes ownership */
+static bool append_container(struct roaring *r, uint16_t hb,
+			     struct roaring_container *c)
+{
+	if (c->card == 0)
+		return true;
+
+	if (!reserve(r, r->ncontainers + 1)) {
+		c_free(c);
+		return false;
+	}
+	r->keys[r->ncontainers] = hb;
+	r->containers[r->ncontainers] = *c;
+	r->ncontainers++;
+	return true;
+}
+
+/* ======= public api ======= */
+
+void roaring_destroy(struct roaring *r)
+{
+	unsigned long i;
+
+	for (i = 0; i < r->ncontainers; i++)
+		c_free(&r->containers[i]);
+	free(r->keys);
+	free(r->containers);
+	*r = ROARING_INITIALIZER;
+}
+
+bool roaring_add(struct roaring *r, uint32_t x)
+{
+	unsigned long i = key_lower_bound(r, HIGH(x));
+	struct roaring_container tmp, *c;
+
+	if (i < r->ncontainers && r->keys[i] == HIGH(x))
+		return c_add(&r->containers[i], LOW(x)) >= 0;
+
+	if (!c_init_array(&tmp, 4))
+		return false;
+	tmp.u.array[0] = LOW(x);
+	tmp.n = tmp.card = 1;
+
+	c = insert_container(r, i, HIGH(x));
+	if (!c) {
+		c_free(&tmp);
+		return false;
+	}
+	*c = tmp;
+	return true;
+}
+
+bool roaring_add_range(struct roaring *r, uint64_t lo, uint64_t hi)
+{
+	uint64_t *words;
+	bool ok = true;
+
+	if (hi > (UINT64_C(1) << 32))
+		hi = UINT64_C(1) << 32;
+	if (lo >= hi)
+		return true;
+
+	words = malloc(BITMAP_BYTES);
+	if (!words)
+		return false;
+
+	while (lo < hi) {
+		uint16_t hb = (uint16_t)(lo >> 16);
+		uint64_t chunk_end = ((lo >> 16) + 1) << 16;
+		uint64_t end = hi < chunk_end ? hi : chunk_end;
+		unsigned long i = key_lower_bound(r, hb);
+		struct roaring_container *c, tmp;
+		bool taken;
+
+		if (i < r->ncontainers && r->keys[i] == hb) {
+			c = &r->containers[i];
+			c_to_words(c, words);
+		} else {
+			c = NULL;
+			memset(words, 0, BITMAP_BYTES);
+		}
+
+		set_bit_range(words, LOW(lo), LOW(end - 1));
+		if (!c_from_words(&tmp, words, bitmap_card(words), true,
+				  &taken)) {
+			ok = false;
+			break;
+		}
+		if (taken)
+			words = NULL;
+
+		if (c)
+			c_free(c);
+		else
+			c = insert_container(r, i, hb);
+		if (!c) {
+			c_free(&tmp);
+			ok = false;
+			break;
+		}
+		*c = tmp;
+
+		if (!words && !(words = malloc(BITMAP_BYTES))) {
+			ok = false;
+			break;
+		}
+		lo = end;
+	}
+
+	free(words);
+	return ok;
+}
+
+int roaring_remove(struct roaring *r, uint32_t x)
+{
+	unsigned long i = key_lower_bound(r, HIGH(x));
+	int ret;
+
+	if (i == r->ncontainers || r->keys[i] != HIGH(x))
+		return 0;
+
+	ret = c_remove(&r->containers[i], LOW(x));
+	if (r->containers[i].card == 0)
+		remove_container(r, i);
+	return ret;
+}
+
+bool roaring_contains(const struct roaring *r, uint32_t x)
+{
+	const struct roaring_container *c = find_container(r, HIGH(x));
+	return c && c_contains(c, LOW(x));
+}
+
+uint64_t roaring_cardinality(const struct roaring *r)
+{
+	uint64_t card = 0;
+	unsigned long i;
+
+	for (i = 0; i < r->ncontainers; i++)
+		card += r->containers[i].card;
+	return card;
+}
+
+uint64_t roaring_rank(const struct roaring *r, uint32_t x)
+{
+	uint64_t rank = 0;
+	unsigned long i;
+
+	for (i = 0; i < r->ncontainers && r->keys[i] < HIGH(x); i++)
+		rank += r->containers[i].card;
+	if (i < r->ncontainers && r->keys[i] == HIGH(x))
+		rank += c_rank(&r->containers[i], LOW(x));
+	return rank;
+}
+
+bool roaring_select(const struct roaring *r, uint64_t i, uint32_t *out)
+{
+	unsigned long j;
+
+	for (j = 0; j < r->ncontainers; j++) {
+		const struct roaring_container *c = &r->containers[j];
+		if (i < c->card) {
+			*out = (uint32_t)r->keys[j] << 16 | c_select(c, i);
+			return true;
+		}
+		i -= c->card;
+	}
+	return false;
+}
+
+bool roaring_equals(const struct roaring *a, const struct roaring *b)
+{
+	struct roaring_iter ia, ib;
+	uint32_t va, vb;
+	unsigned long i;
+
+	if (a->ncontainers != b->ncontainers)
+		return false;
+	for (i = 0; i < a->ncontainers; i++)
+		if (a->keys[i] != b->keys[i]
+		    || a->containers[i].card != b->containers[i].card)
+			return false;
+
+	/* same shape, compare members (representations may differ) */
+	roaring_iter_init(&ia, a);
+	roaring_iter_init(&ib, b);
+	while (roaring_iter_next(&ia, &va)) {
+		roaring_iter_next(&ib, &vb);
+		if (va != vb)
+			return false;
+	}
+	return true;
+}
+
+/* shared driver for union, intersection and difference */
+static bool roaring_op(struct roaring *into, const struct roaring *a,
+		       const struct roaring *b, int op)
+{
+	ROARING_BITMAP(out);
+	unsigned long i = 0, j = 0;
+	struct roaring_container c;
+
+	while (i < a->ncontainers || j < b->ncontainers) {
+		bool have_a = i < a->ncontainers;
+		bool have_b = j < b->ncontainers;
+		uint16_t hb;
+
+		if (have_a && (!have_b || a->keys[i] < b->keys[j])) {
+			/* only in a */
+			hb = a->keys[i];
+			if (op != OP_AND) {
+				if (!c_copy(&c, &a->containers[i])
+				    || !append_container(&out, hb, &c))
+					goto failed;
+			}
+			i++;
+		} else if (have_b && (!have_a || b->keys[j] < a->keys[i])) {
+			/* only in b */
+			hb = b->keys[j];
+			if (op == OP_OR) {
+				if (!c_copy(&c, &b->containers[j])
+				    || !append_container(&out, hb, &c))
+					goto failed;
+			}
+			j++;
+		} else {
+			hb = a->keys[i];
+			if (!c_op(&c, &a->containers[i], &b->containers[j], op)
+			    || !append_container(&out, hb, &c))
+				goto failed;
+			i++;
+			j++;
+		}
+	}
+
+	roaring_destroy(into);
+	*into = out;
+	return true;
+
+failed:
+	roaring_destroy(&out);
+	return false;
+}
+
+bool roaring_union(struct roaring *into, const struct roaring *a,
+		   const struct roaring *b)
+{
+	return roaring_op(into, a, b, OP_OR);
+}
+
+bool roaring_intersection(struct roaring *into, const struct roaring *a,
+			  const struct roaring *b)
+{
+	return roaring_op(into, a, b, OP_AND);
+}
+
+bool roaring_difference(struct roaring *into, const struct roaring *a,
+			const struct roaring *b)
+{
+	return roaring_op(into, a, b, OP_ANDNOT);
+}
+
+bool roaring_run_optimize(struct roaring *r)
+{
+	unsigned long i;
+
+	for (i = 0; i < r->ncontainers; i++)
+		if (!c_normalize(&r->containers[i], true))
+			return false;
+	return true;
+}
+
+bool roaring_add_radix(struct roaring *r, struct radix_head *head)
+{
+	radix_cursor_t cursor = RADIX_CURSOR;
+
+	if (head->nentries == 0)
+		return true;
+
+	radix_cursor_begin(head, &cursor);
+	do {
+		unsigned long key = radix_cursor_key(&cursor);
+
+		if (key > UINT32_MAX || !radix_cursor_has_entry(&cursor))
+			continue;
+		if (!roaring_add(r, key))
+			return false;
+	} while (radix_cursor_next_valid(&cursor));
+
+	return true;
+}
+
+void roaring_insert_bloom(const struct roaring *r, struct bloom *bf)
+{
+	roaring_for_each(r, it, x)
+		bloom_insert(bf, x);
+}
+
+void roaring_iter_init(struct roaring_iter *it, const struct roaring *r)
+{
+	it->r = r;
+	it->ci = 0;
+	it->pos = 0;
+	it->off = 0;
+}
+
+bool roaring_iter_next(struct roaring_iter *it, uint32_t *out)
+{
+	const struct roaring *r = it->r;
+
+	for (; it->ci < r->ncontainers; it->ci++, it->pos = 0, it->off = 0) {
+		const struct roaring_container *c = &r->containers[it->ci];
+		uint32_t hb = (uint32_t)r->keys[it->ci] << 16;
+
+		if (c->type == TYPE_ARRAY) {
+			if (it->pos < c->n) {
+				*out = hb | c->u.array[it->pos++];
+				return true;
+			}
+		} else if (c->type == TYPE_RUN) {
+			if (it->pos < c->n) {
+				*out = hb | (c->u.runs[it->pos].start + it->off);
+				if (it->off++ == c->u.runs[it->pos].len) {
+					it->pos++;
+					it->off = 0;
+				}
+				return true;
+			}
+		} else {
+			/* pos is the next bit to look at */
+			uint32_t bit = next_bit(c->u.bitmap, it->pos, true);
+			if (bit < 65536) {
+				*out = hb | bit;
+				it->pos = bit + 1;
+				return true;
+			}
+		}
+	}
+	return false;
+}
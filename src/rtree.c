@@ -0,0 +1,1013 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file rtree.c
+ *
+ * \author Eric Mueller
+ *
+ * \brief Implementation of an R*-tree.
+ */
+
+#ifdef _POSIX_C_SOURCE
+  #undef _POSIX_C_SOURCE
+#endif
+#define _POSIX_C_SOURCE 200112L
+
+#include "rtree.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __AVX__
+  #include <immintrin.h>
+#endif
+
+/*
+ * Slots per node. Nodes hold up to RTREE_MAX_ENTRIES + 1 entries while
+ * overflowing, and the coordinate arrays are padded out to a multiple of the
+ * widest SIMD vector. Slots past count always hold an empty rectangle (min
+ * = inf, max = -inf), which never overlaps anything, so SIMD loops can run
+ * over whole vectors without masking.
+ */
+#define SLOTS (24)
+
+/* number of entries removed for forced reinsertion (30%) */
+#define REINSERT (5)
+
+/* more than enough: a tree this tall would need 6^32 items */
+#define MAX_HEIGHT (32)
+
+#define NODE_ALIGN (64)
+
+struct rtree_node {
+	rtree_coord_t minx[SLOTS];
+	rtree_coord_t miny[SLOTS];
+	rtree_coord_t maxx[SLOTS];
+	rtree_coord_t maxy[SLOTS];
+
+	/* child nodes, or data pointers at the leaves */
+	void *child[SLOTS];
+
+	unsigned count;
+
+	/* 0 for leaves */
+	unsigned level;
+};
+
+/* an entry outside of a node */
+struct entry {
+	struct rtree_rect r;
+	void *child;
+};
+
+/* ======= rectangle helpers ======= */
+
+static inline rtree_coord_t min_c(rtree_coord_t a, rtree_coord_t b)
+{
+	return a < b ? a : b;
+}
+
+static inline rtree_coord_t max_c(rtree_coord_t a, rtree_coord_t b)
+{
+	return a > b ? a : b;
+}
+
+static inline struct rtree_rect rect_empty(void)
+{
+	return (struct rtree_rect){INFINITY, INFINITY, -INFINITY, -INFINITY};
+}
+
+static inline struct rtree_rect rect_union(const struct rtree_rect *a,
+					   const struct rtree_rect *b)
+{
+	return (struct rtree_rect){min_c(a->minx, b->minx),
+				   min_c(a->miny, b->miny),
+				   max_c(a->maxx, b->maxx),
+				   max_c(a->maxy, b->maxy)};
+}
+
+static inline double rect_area(const struct rtree_rect *r)
+{
+	return (double)(r->maxx - r->minx) * (r->maxy - r->miny);
+}
+
+static inline double rect_margin(const struct rtree_rect *r)
+{
+	return (double)(r->maxx - r->minx) + (r->maxy - r->miny);
+}
+
+static inline double overlap_area(const struct rtree_rect *a,
+				  const struct rtree_rect *b)
+{
+	double w = (double)min_c(a->maxx, b->maxx) - max_c(a->minx, b->minx);
+	double h = (double)min_c(a->maxy, b->maxy) - max_c(a->miny, b->miny);
+	return w > 0 && h > 0 ? w * h : 0;
+}
+
+static inline bool rect_equal(const struct rtree_rect *a,
+			      const struct rtree_rect *b)
+{
+	return a->minx == b->minx && a->miny == b->miny
+		&& a->maxx == b->maxx && a->maxy == b->maxy;
+}
+
+static inline bool rect_contains(const struct rtree_rect *outer,
+				 const struct rtree_rect *inner)
+{
+	return outer->minx <= inner->minx && outer->miny <= inner->miny
+		&& outer->maxx >= inner->maxx && outer->maxy >= inner->maxy;
+}
+
+/* squared distance from a point to the closest point of r */
+static inline double point_dist2(const struct rtree_rect *r, double x,
+				 double y)
+{
+	double dx = x < r->minx ? r->minx - x : x > r->maxx ? x - r->maxx : 0;
+	double dy = y < r->miny ? r->miny - y : y > r->maxy ? y - r->maxy : 0;
+	return dx * dx + dy * dy;
+}
+
+/* ======= node helpers ======= */
+
+static inline struct rtree_rect node_rect(const struct rtree_node *n,
+					  unsigned i)
+{
+	return (struct rtree_rect){n->minx[i], n->miny[i], n->maxx[i],
+				   n->maxy[i]};
+}
+
+static inline void node_set(struct rtree_node *n, unsigned i,
+			    const struct rtree_rect *r, void *child)
+{
+	n->minx[i] = r->minx;
+	n->miny[i] = r->miny;
+	n->maxx[i] = r->maxx;
+	n->maxy[i] = r->maxy;
+	n->child[i] = child;
+}
+
+static inline void node_set_rect(struct rtree_node *n, unsigned i,
+				 const struct rtree_rect *r)
+{
+	node_set(n, i, r, n->child[i]);
+}
+
+static inline void node_append(struct rtree_node *n, const struct entry *e)
+{
+	node_set(n, n->count++, &e->r, e->child);
+}
+
+static inline struct entry node_entry(const struct rtree_node *n, unsigned i)
+{
+	return (struct entry){node_rect(n, i), n->child[i]};
+}
+
+static void node_reset(struct rtree_node *n, unsigned level)
+{
+	struct rtree_rect empty = rect_empty();
+	unsigned i;
+
+	for (i = 0; i < SLOTS; i++)
+		node_set(n, i, &empty, NULL);
+	n->count = 0;
+	n->level = level;
+}
+
+/* remove entry i by moving the last entry into its place */
+static void node_remove(struct rtree_node *n, unsigned i)
+{
+	struct rtree_rect empty = rect_empty();
+	unsigned last = --n->count;
+
+	node_set(n, i, &(struct rtree_rect){n->minx[last], n->miny[last],
+					     n->maxx[last], n->maxy[last]},
+		 n->child[last]);
+	node_set(n, last, &empty, NULL);
+}
+
+static struct rtree_rect node_bbox(const struct rtree_node *n)
+{
+	struct rtree_rect r = rect_empty();
+	unsigned i;
+
+	for (i = 0; i < n->count; i++) {
+		r.minx = min_c(r.minx, n->minx[i]);
+		r.miny = min_c(r.miny, n->miny[i]);
+		r.maxx = max_c(r.maxx, n->maxx[i]);
+		r.maxy = max_c(r.maxy, n->maxy[i]);
+	}
+	return r;
+}
+
+/* bit i of the result is set if entry i overlaps w */
+static uint32_t overlap_mask(const struct rtree_node *n,
+			     const struct rtree_rect *w)
+{
+	uint32_t mask = 0;
+	unsigned i;
+
+#if defined(__AVX__) && !defined(RTREE_COORD_FLOAT)
+	__m256d wminx = _mm256_set1_pd(w->minx);
+	__m256d wminy = _mm256_set1_pd(w->miny);
+	__m256d wmaxx = _mm256_set1_pd(w->maxx);
+	__m256d wmaxy = _mm256_set1_pd(w->maxy);
+
+	for (i = 0; i < n->count; i += 4) {
+		__m256d m = _mm256_and_pd(
+			_mm256_cmp_pd(_mm256_load_pd(&n->minx[i]), wmaxx,
+				      _CMP_LE_OQ),
+			_mm256_cmp_pd(_mm256_load_pd(&n->maxx[i]), wminx,
+				      _CMP_GE_OQ));
+		m = _mm256_and_pd(m, _mm256_cmp_pd(_mm256_load_pd(&n->miny[i]),
+						   wmaxy, _CMP_LE_OQ));
+		m = _mm256_and_pd(m, _mm256_cmp_pd(_mm256_load_pd(&n->maxy[i]),
+						   wminy, _CMP_GE_OQ));
+		mask |= (uint32_t)_mm256_movemask_pd(m) << i;
+	}
+#elif defined(__AVX__)
+	__m256 wminx = _mm256_set1_ps(w->minx);
+	__m256 wminy = _mm256_set1_ps(w->miny);
+	__m256 wmaxx = _mm256_set1_ps(w->maxx);
+	__m256 wmaxy = _mm256_set1_ps(w->maxy);
+
+	for (i = 0; i < n->count; i += 8) {
+		__m256 m = _mm256_and_ps(
+			_mm256_cmp_ps(_mm256_load_ps(&n->minx[i]), wmaxx,
+				      _CMP_LE_OQ),
+			_mm256_cmp_ps(_mm256_load_ps(&n->maxx[i]), wminx,
+				      _CMP_GE_OQ));
+		m = _mm256_and_ps(m, _mm256_cmp_ps(_mm256_load_ps(&n->miny[i]),
+						   wmaxy, _CMP_LE_OQ));
+		m = _mm256_and_ps(m, _mm256_cmp_ps(_mm256_load_ps(&n->maxy[i]),
+						   wminy, _CMP_GE_OQ));
+		mask |= (uint32_t)_mm256_movemask_ps(m) << i;
+	}
+#else
+	/* written so the compiler can vectorize it */
+	for (i = 0; i < n->count; i++)
+		mask |= (uint32_t)((n->minx[i] <= w->maxx)
+				   & (n->maxx[i] >= w->minx)
+				   & (n->miny[i] <= w->maxy)
+				   & (n->maxy[i] >= w->miny)) << i;
+#endif
+	return mask;
+}
+
+/* ======= node pool ======= */
+
+/*
+ * Inserts take nodes from t->pool, which is topped up before anything is
+ * modified, so a failed allocation never leaves an insert half done.
+ */
+static bool pool_grow(struct rtree *t, size_t n)
+{
+	while (n--) {
+		struct rtree_node *node;
+		if (posix_memalign((void **)&node, NODE_ALIGN, sizeof *node))
+			return false;
+		node->child[0] = t->pool;
+		t->pool = node;
+		t->npool++;
+	}
+	return true;
+}
+
+static bool pool_fill(struct rtree *t, size_t n)
+{
+	return t->npool >= n || pool_grow(t, n - t->npool);
+}
+
+static void pool_trim(struct rtree *t, size_t n)
+{
+	while (t->npool > n) {
+		struct rtree_node *node = t->pool;
+		t->pool = node->child[0];
+		t->npool--;
+		free(node);
+	}
+}
+
+static struct rtree_node *pool_get(struct rtree *t, unsigned level)
+{
+	struct rtree_node *node = t->pool;
+
+	t->pool = node->child[0];
+	t->npool--;
+	node_reset(node, level);
+	return node;
+}
+
+static void pool_put(struct rtree *t, struct rtree_node *node)
+{
+	node->child[0] = t->pool;
+	t->pool = node;
+	t->npool++;
+}
+
+/* nodes one insert of a single entry can need: a split at every level + root */
+static size_t insert_reserve(const struct rtree *t)
+{
+	return (t->root ? t->root->level : 0) + 3;
+}
+
+/* ======= insertion ======= */
+
+/*
+ * R* ChooseSubtree. Above the leaves' parents, pick the entry needing the
+ * least area enlargement to include r. For nodes whose children are leaves,
+ * pick the entry whose enlargement adds the least overlap with its siblings.
+ * Ties go to least area enlargement, then least area.
+ */
+static unsigned choose_subtree(const struct rtree_node *n,
+			       const struct rtree_rect *r)
+{
+	double best_overlap = INFINITY, best_enlarge = INFINITY;
+	double best_area = INFINITY;
+	unsigned best = 0, i, j;
+
+	for (i = 0; i < n->count; i++) {
+		struct rtree_rect ri = node_rect(n, i);
+		struct rtree_rect grown = rect_union(&ri, r);
+		double area = rect_area(&ri);
+		double enlarge = rect_area(&grown) - area;
+		double overlap = 0;
+
+		if (n->level == 1) {
+			for (j = 0; j < n->count; j++) {
+				struct rtree_rect rj;
+				if (j == i)
+					continue;
+				rj = node_rect(n, j);
+				overlap += overlap_area(&grown, &rj)
+					- overlap_area(&ri, &rj);
+			}
+		}
+
+		if (overlap < best_overlap
+		    || (overlap == best_overlap
+			&& (enlarge < best_enlarge
+			    || (enlarge == best_enlarge
+				&& area < best_area)))) {
+			best_overlap = overlap;
+			best_enlarge = enlarge;
+			best_area = area;
+			best = i;
+		}
+	}
+	return best;
+}
+
+/* recompute the rectangles on a path from the root after a change below */
+static void fix_path(struct rtree_node **path, unsigned *idx, unsigned depth,
+		     struct rtree_node *bottom)
+{
+	while (depth--) {
+		struct rtree_rect bb = node_bbox(bottom);
+		node_set_rect(path[depth], idx[depth], &bb);
+		bottom = path[depth];
+	}
+}
+
+static int cmp_minx(const void *a, const void *b)
+{
+	rtree_coord_t l = ((const struct entry *)a)->r.minx;
+	rtree_coord_t r = ((const struct entry *)b)->r.minx;
+	return (l > r) - (l < r);
+}
+
+static int cmp_maxx(const void *a, const void *b)
+{
+	rtree_coord_t l = ((const struct entry *)a)->r.maxx;
+	rtree_coord_t r = ((const struct entry *)b)->r.maxx;
+	return (l > r) - (l < r);
+}
+
+static int cmp_miny(const void *a, const void *b)
+{
+	rtree_coord_t l = ((const struct entry *)a)->r.miny;
+	rtree_coord_t r = ((const struct entry *)b)->r.miny;
+	return (l > r) - (l < r);
+}
+
+static int cmp_maxy(const void *a, const void *b)
+{
+	rtree_coord_t l = ((const struct entry *)a)->r.maxy;
+	rtree_coord_t r = ((const struct entry *)b)->r.maxy;
+	return (l > r) - (l < r);
+}
+
+/* [axis][0 for lower edge, 1 for upper edge] */
+static int (*const split_cmps[2][2])(const void *, const void *) = {
+	{cmp_minx, cmp_maxx},
+	{cmp_miny, cmp_maxy},
+};
+
+/*
+ * bounding boxes of the prefixes and suffixes of a sorted run of entries:
+ * lo[k] bounds e[0, k] and hi[k] bounds e[k, n).
+ */
+static void prefix_boxes(const struct entry *e, unsigned n,
+			 struct rtree_rect *lo, struct rtree_rect *hi)
+{
+	unsigned i;
+
+	lo[0] = e[0].r;
+	for (i = 1; i < n; i++)
+		lo[i] = rect_union(&lo[i - 1], &e[i].r);
+	hi[n - 1] = e[n - 1].r;
+	for (i = n - 1; i-- > 0; )
+		hi[i] = rect_union(&hi[i + 1], &e[i].r);
+}
+
+/*
+ * R* split. For each axis, sort the entries by lower and by upper edge and
+ * sum the margins of every legal distribution into two groups; split along
+ * the axis with the least total margin, choosing the distribution with the
+ * least overlap between the groups (then the least total area). n keeps the
+ * first group, and sib gets the second.
+ */
+static void split(struct rtree_node *n, struct rtree_node *sib)
+{
+	struct entry ents[RTREE_MAX_ENTRIES + 1], best_ents[RTREE_MAX_ENTRIES + 1];
+	struct rtree_rect lo[RTREE_MAX_ENTRIES + 1], hi[RTREE_MAX_ENTRIES + 1];
+	const unsigned total = n->count;
+	double best_margin = INFINITY;
+	double best_overlap = INFINITY, best_area = INFINITY;
+	unsigned axis, edge, k, best_axis = 0, best_k = RTREE_MIN_ENTRIES;
+
+	for (k = 0; k < total; k++)
+		ents[k] = node_entry(n, k);
+
+	/* choose split axis */
+	for (axis = 0; axis < 2; axis++) {
+		double margin = 0;
+		for (edge = 0; edge < 2; edge++) {
+			qsort(ents, total, sizeof *ents, split_cmps[axis][edge]);
+			prefix_boxes(ents, total, lo, hi);
+			for (k = RTREE_MIN_ENTRIES;
+			     k <= total - RTREE_MIN_ENTRIES; k++)
+				margin += rect_margin(&lo[k - 1])
+					+ rect_margin(&hi[k]);
+		}
+		if (margin < best_margin) {
+			best_margin = margin;
+			best_axis = axis;
+		}
+	}
+
+	/* choose split index */
+	for (edge = 0; edge < 2; edge++) {
+		qsort(ents, total, sizeof *ents, split_cmps[best_axis][edge]);
+		prefix_boxes(ents, total, lo, hi);
+		for (k = RTREE_MIN_ENTRIES; k <= total - RTREE_MIN_ENTRIES; k++) {
+			double overlap = overlap_area(&lo[k - 1], &hi[k]);
+			double area = rect_area(&lo[k - 1]) + rect_area(&hi[k]);
+			if (overlap < best_overlap
+			    || (overlap == best_overlap && area < best_area)) {
+				best_overlap = overlap;
+				best_area = area;
+				best_k = k;
+				memcpy(best_ents, ents, sizeof ents);
+			}
+		}
+	}
+
+	node_reset(n, n->level);
+	for (k = 0; k < best_k; k++)
+		node_append(n, &best_ents[k]);
+	for (; k < total; k++)
+		node_append(sib, &best_ents[k]);
+}
+
+struct reinsert_dist {
+	double d;
+	unsigned i;
+};
+
+static int cmp_reinsert_dist(const void *a, const void *b)
+{
+	double l = ((const struct reinsert_dist *)a)->d;
+	double r = ((const struct reinsert_dist *)b)->d;
+	return (l > r) - (l < r);
+}
+
+/*
+ * remove the REINSERT entries of n whose centers are farthest from the
+ * center of n, putting them in out closest first (R*'s 'close reinsert').
+ */
+static void pick_reinsert(struct rtree_node *n, struct entry *out)
+{
+	struct reinsert_dist d[RTREE_MAX_ENTRIES + 1];
+	struct rtree_rect bb = node_bbox(n);
+	double cx = ((double)bb.minx + bb.maxx) / 2;
+	double cy = ((double)bb.miny + bb.maxy) / 2;
+	unsigned keep = n->count - REINSERT;
+	struct entry kept[RTREE_MAX_ENTRIES + 1];
+	unsigned i;
+
+	for (i = 0; i < n->count; i++) {
+		double dx = ((double)n->minx[i] + n->maxx[i]) / 2 - cx;
+		double dy = ((double)n->miny[i] + n->maxy[i]) / 2 - cy;
+		d[i] = (struct reinsert_dist){dx * dx + dy * dy, i};
+	}
+	qsort(d, n->count, sizeof *d, cmp_reinsert_dist);
+
+	for (i = 0; i < keep; i++)
+		kept[i] = node_entry(n, d[i].i);
+	for (i = 0; i < REINSERT; i++)
+		out[i] = node_entry(n, d[keep + i].i);
+
+	node_reset(n, n->level);
+	for (i = 0; i < keep; i++)
+		node_append(n, &kept[i]);
+}
+
+/*
+ * insert e into a node at the given level (0 for data, higher to reattach
+ * subtrees). reinserted has a bit set for each level that has already done
+ * a forced reinsertion during this top level operation. the pool must hold
+ * insert_reserve(t) nodes.
+ */
+static void insert_at(struct rtree *t, const struct entry *e, unsigned level,
+		      uint32_t *reinserted)
+{
+	struct rtree_node *path[MAX_HEIGHT];
+	unsigned idx[MAX_HEIGHT];
+	unsigned depth = 0;
+	struct rtree_node *n = t->root;
+
+	while (n->level > level) {
+		unsigned i = choose_subtree(n, &e->r);
+		path[depth] = n;
+		idx[depth++] = i;
+		n = n->child[i];
+	}
+	node_append(n, e);
+
+	while (n->count > RTREE_MAX_ENTRIES) {
+		struct rtree_node *sib, *parent;
+		struct rtree_rect bb;
+
+		/*
+		 * first overflow at this level: reinsert instead of splitting,
+		 * if we can get enough spare nodes for the reinsertions.
+		 */
+		if (depth && !(*reinserted & (1U << n->level))
+		    && pool_grow(t, REINSERT * insert_reserve(t))) {
+			struct entry out[REINSERT];
+			unsigned i, nlevel = n->level;
+
+			*reinserted |= 1U << nlevel;
+			pick_reinsert(n, out);
+			fix_path(path, idx, depth, n);
+			for (i = 0; i < REINSERT; i++)
+				insert_at(t, &out[i], nlevel, reinserted);
+			return;
+		}
+
+		sib = pool_get(t, n->level);
+		split(n, sib);
+
+		if (!depth) {
+			struct rtree_node *root = pool_get(t, n->level + 1);
+			struct entry a = {node_bbox(n), n};
+			struct entry b = {node_bbox(sib), sib};
+			node_append(root, &a);
+			node_append(root, &b);
+			t->root = root;
+			return;
+		}
+
+		parent = path[--depth];
+		bb = node_bbox(n);
+		node_set_rect(parent, idx[depth], &bb);
+		node_append(parent, &(struct entry){node_bbox(sib), sib});
+		n = parent;
+	}
+	fix_path(path, idx, depth, n);
+}
+
+bool rtree_insert(struct rtree *t, const struct rtree_rect *rect, void *data)
+{
+	struct entry e = {*rect, data};
+	uint32_t reinserted = 0;
+
+	if (!pool_fill(t, insert_reserve(t)))
+		return false;
+	if (!t->root)
+		t->root = pool_get(t, 0);
+
+	insert_at(t, &e, 0, &reinserted);
+	t->nitems++;
+	pool_trim(t, insert_reserve(t));
+	return true;
+}
+
+/* ======= deletion ======= */
+
+/* depth first search for the leaf holding (r, data) */
+static bool find_leaf(struct rtree_node *n, const struct rtree_rect *r,
+		      void *data, struct rtree_node **path, unsigned *idx,
+		      unsigned depth, unsigned *leaf_depth)
+{
+	unsigned i;
+
+	path[depth] = n;
+	for (i = 0; i < n->count; i++) {
+		struct rtree_rect ri = node_rect(n, i);
+		idx[depth] = i;
+		if (n->level == 0) {
+			if (n->child[i] == data && rect_equal(&ri, r)) {
+				*leaf_depth = depth;
+				return true;
+			}
+		} else if (rect_contains(&ri, r)
+			   && find_leaf(n->child[i], r, data, path, idx,
+					depth + 1, leaf_depth)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * decide which nodes on the path will be dissolved after the leaf lost an
+ * entry: any non-root node left with fewer than RTREE_MIN_ENTRIES. The root
+ * is never left childless, so the last child of the root stays regardless.
+ * returns the number of entries that will need reinserting.
+ */
+static size_t plan_condense(struct rtree_node **path, unsigned depth,
+			    bool *dissolve)
+{
+	size_t entries = 0;
+	bool lost = true; /* the leaf already lost its entry */
+	unsigned k;
+
+	for (k = depth; k > 0; k--) {
+		unsigned count = path[k]->count - (k == depth ? 0 : lost);
+		unsigned parent_count = path[k - 1]->count;
+		dissolve[k] = count < RTREE_MIN_ENTRIES
+			&& (k - 1 > 0 || parent_count > 1);
+		if (dissolve[k])
+			entries += count;
+		lost = dissolve[k];
+	}
+	return entries;
+}
+
+/* put n and everything under it in the pool */
+static void release_node(struct rtree *t, struct rtree_node *n)
+{
+	unsigned i;
+
+	if (n->level)
+		for (i = 0; i < n->count; i++)
+			release_node(t, n->child[i]);
+	pool_put(t, n);
+}
+
+bool rtree_delete(struct rtree *t, const struct rtree_rect *rect, void *data)
+{
+	struct rtree_node *path[MAX_HEIGHT];
+	unsigned idx[MAX_HEIGHT];
+	bool dissolve[MAX_HEIGHT];
+	struct rtree_node *orphans[MAX_HEIGHT];
+	unsigned depth, norphans = 0, k, i;
+	uint32_t no_reinsert = UINT32_MAX;
+	bool condense = true;
+	size_t need;
+
+	if (!t->root || !find_leaf(t->root, rect, data, path, idx, 0, &depth))
+		return false;
+
+	node_remove(path[depth], idx[depth]);
+	t->nitems--;
+
+	/*
+	 * if we can't get the nodes to reinsert the dissolved nodes' entries,
+	 * just leave the underfull nodes be. The tree is still correct.
+	 */
+	need = plan_condense(path, depth, dissolve);
+	if (need && !pool_fill(t, need * insert_reserve(t)))
+		condense = false;
+
+	for (k = depth; k > 0; k--) {
+		if (condense && dissolve[k]) {
+			node_remove(path[k - 1], idx[k - 1]);
+			orphans[norphans++] = path[k];
+		} else {
+			struct rtree_rect bb = node_bbox(path[k]);
+			node_set_rect(path[k - 1], idx[k - 1], &bb);
+		}
+	}
+
+	for (k = 0; k < norphans; k++) {
+		for (i = 0; i < orphans[k]->count; i++) {
+			struct entry e = node_entry(orphans[k], i);
+			insert_at(t, &e, orphans[k]->level, &no_reinsert);
+		}
+		pool_put(t, orphans[k]);
+	}
+
+	/* shrink the tree while the root has a single child */
+	while (t->root->level > 0 && t->root->count == 1) {
+		struct rtree_node *old = t->root;
+		t->root = old->child[0];
+		pool_put(t, old);
+	}
+	if (!t->nitems) {
+		release_node(t, t->root);
+		t->root = NULL;
+	}
+
+	pool_trim(t, insert_reserve(t));
+	return true;
+}
+
+/* ======= queries ======= */
+
+static bool search_node(const struct rtree_node *n,
+			const struct rtree_rect *w, rtree_visit_t f,
+			void *private, size_t *found)
+{
+	uint32_t mask = overlap_mask(n, w);
+
+	while (mask) {
+		unsigned i = __builtin_ctz(mask);
+		mask &= mask - 1;
+		if (n->level) {
+			if (!search_node(n->child[i], w, f, private, found))
+				return false;
+		} else {
+			struct rtree_rect r = node_rect(n, i);
+			(*found)++;
+			if (f && !f(n->child[i], &r, private))
+				return false;
+		}
+	}
+	return true;
+}
+
+size_t rtree_search(const struct rtree *t, const struct rtree_rect *window,
+		    rtree_visit_t f, void *private)
+{
+	size_t found = 0;
+
+	if (t->root)
+		search_node(t->root, window, f, private, &found);
+	return found;
+}
+
+/* best first search queue entry. node is a node if level >= 0, else data */
+struct knn_item {
+	double d2;
+	void *p;
+	long level;
+};
+
+struct knn_heap {
+	struct knn_item *items;
+	size_t n;
+	size_t alloc;
+};
+
+static bool knn_push(struct knn_heap *h, double d2, void *p, long level)
+{
+	size_t i;
+
+	if (h->n == h->alloc) {
+		size_t alloc = h->alloc ? h->alloc * 2 : 64;
+		struct knn_item *items = realloc(h->items,
+						 alloc * sizeof *items);
+		if (!items)
+			return false;
+		h->items = items;
+		h->alloc = alloc;
+	}
+
+	/* sift up */
+	for (i = h->n++; i > 0 && h->items[(i - 1) / 2].d2 > d2;
+	     i = (i - 1) / 2)
+		h->items[i] = h->items[(i - 1) / 2];
+	h->items[i] = (struct knn_item){d2, p, level};
+	return true;
+}
+
+static struct knn_item knn_pop(struct knn_heap *h)
+{
+	struct knn_item top = h->items[0];
+	struct knn_item last = h->items[--h->n];
+	size_t i = 0, c;
+
+	/* sift down */
+	while ((c = 2 * i + 1) < h->n) {
+		if (c + 1 < h->n && h->items[c + 1].d2 < h->items[c].d2)
+			c++;
+		if (h->items[c].d2 >= last.d2)
+			break;
+		h->items[i] = h->items[c];
+		i = c;
+	}
+	if (h->n)
+		h->items[i] = last;
+	return top;
+}
+
+long rtree_nearest(const struct rtree *t, rtree_coord_t x, rtree_coord_t y,
+		   size_t k, void **out, rtree_coord_t *dists)
+{
+	struct knn_heap h = {NULL, 0, 0};
+	size_t found = 0;
+	unsigned i;
+
+	if (!t->root || !k)
+		return 0;
+	if (!knn_push(&h, 0, t->root, t->root->level))
+		return -1;
+
+	/*
+	 * pop things closest first. a data item popped is closer than
+	 * everything not yet popped, since a node's distance bounds the
+	 * distances of everything under it.
+	 */
+	while (h.n && found < k) {
+		struct knn_item it = knn_pop(&h);
+		const struct rtree_node *n = it.p;
+
+		if (it.level < 0) {
+			if (dists)
+				dists[found] = sqrt(it.d2);
+			out[found++] = it.p;
+			continue;
+		}
+
+		for (i = 0; i < n->count; i++) {
+			struct rtree_rect r = node_rect(n, i);
+			if (!knn_push(&h, point_dist2(&r, x, y), n->child[i],
+				      n->level ? (long)n->level - 1 : -1)) {
+				free(h.items);
+				return -1;
+			}
+		}
+	}
+
+	free(h.items);
+	return found;
+}
+
+unsigned rtree_height(const struct rtree *t)
+{
+	return t->root ? t->root->level + 1 : 0;
+}
+
+/* ======= bulk loading ======= */
+
+static int cmp_center_x(const void *a, const void *b)
+{
+	const struct rtree_rect *l = &((const struct entry *)a)->r;
+	const struct rtree_rect *r = &((const struct entry *)b)->r;
+	double lc = (double)l->minx + l->maxx, rc = (double)r->minx + r->maxx;
+	return (lc > rc) - (lc < rc);
+}
+
+static int cmp_center_y(const void *a, const void *b)
+{
+	const struct rtree_rect *l = &((const struct entry *)a)->r;
+	const struct rtree_rect *r = &((const struct entry *)b)->r;
+	double lc = (double)l->miny + l->maxy, rc = (double)r->miny + r->maxy;
+	return (lc > rc) - (lc < rc);
+}
+
+static size_t div_up(size_t x, size_t d)
+{
+	return (x + d - 1) / d;
+}
+
+/* sqrt(ceil(count / M)) slices of whole nodes */
+static size_t str_slice_size(size_t count)
+{
+	size_t nodes = div_up(count, RTREE_MAX_ENTRIES);
+	size_t s = (size_t)ceil(sqrt((double)nodes));
+	return s * RTREE_MAX_ENTRIES;
+}
+
+/* number of nodes STR packs count entries into, for one level */
+static size_t str_level_nodes(size_t count)
+{
+	size_t slice = str_slice_size(count), s, nodes = 0;
+
+	if (count <= RTREE_MAX_ENTRIES)
+		return 1;
+	for (s = 0; s < count; s += slice)
+		nodes += div_up(count - s < slice ? count - s : slice,
+				RTREE_MAX_ENTRIES);
+	return nodes;
+}
+
+/*
+ * pack one level: sort by x, cut into vertical slices, sort each slice by y
+ * and cut it into nodes. Each slice's entries are spread evenly over its
+ * nodes so no node ends up nearly empty. Returns the number of nodes, whose
+ * entries are written to next.
+ */
+static size_t str_pack(struct rtree *t, struct entry *ents, size_t count,
+		       unsigned level, struct entry *next)
+{
+	size_t slice = str_slice_size(count), s, produced = 0;
+
+	qsort(ents, count, sizeof *ents, cmp_center_x);
+	for (s = 0; s < count; s += slice) {
+		size_t len = count - s < slice ? count - s : slice;
+		size_t nodes = div_up(len, RTREE_MAX_ENTRIES), j, e = s;
+
+		qsort(ents + s, len, sizeof *ents, cmp_center_y);
+		for (j = 0; j < nodes; j++) {
+			struct rtree_node *n = pool_get(t, level);
+			size_t take = len / nodes + (j < len % nodes);
+			while (take--)
+				node_append(n, &ents[e++]);
+			next[produced++] = (struct entry){node_bbox(n), n};
+		}
+	}
+	return produced;
+}
+
+bool rtree_bulk_load(struct rtree *t, const struct rtree_rect *rects,
+		     void *const *data, size_t n)
+{
+	struct entry *ents, *next, *tmp;
+	size_t count, total = 0, i;
+	unsigned level = 0;
+
+	if (t->root)
+		return false;
+	if (!n)
+		return true;
+
+	count = n;
+	do {
+		count = str_level_nodes(count);
+		total += count;
+	} while (count > 1);
+
+	ents = malloc(n * sizeof *ents);
+	next = malloc(div_up(n, RTREE_MAX_ENTRIES) * 2 * sizeof *next);
+	if (!ents || !next || !pool_fill(t, total)) {
+		free(ents);
+		free(next);
+		pool_trim(t, 0);
+		return false;
+	}
+
+	for (i = 0; i < n; i++)
+		ents[i] = (struct entry){rects[i], data[i]};
+
+	for (count = n; ; level++) {
+		count = str_pack(t, ents, count, level, next);
+		tmp = ents;
+		ents = next;
+		next = tmp;
+		if (count == 1)
+			break;
+	}
+
+	t->root = ents[0].child;
+	t->nitems = n;
+	free(ents);
+	free(next);
+	pool_trim(t, insert_reserve(t));
+	return true;
+}
+
+/* ======= destruction ======= */
+
+static void free_node(struct rtree_node *n)
+{
+	unsigned i;
+
+	if (n->level)
+		for (i = 0; i < n->count; i++)
+			free_node(n->child[i]);
+	free(n);
+}
+
+void rtree_destroy(struct rtree *t)
+{
+	if (t->root)
+		free_node(t->root);
+	t->root = NULL;
+	t->nitems = 0;
+	pool_trim(t, 0);
+}
@@ -0,0 +1,266 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file shard_htable.c
+ *
+ * \author Eric Mueller
+ *
+ * \brief Implementation of a hash table split into independently locked
+ * shards.
+ */
+
+#include "shard_htable.h"
+#include "util.h"
+#include "fasthash.h"
+#ifdef _POSIX_C_SOURCE
+  #undef _POSIX_C_SOURCE
+#endif
+#define _POSIX_C_SOURCE 200112L
+#include <stdlib.h>
+
+/* number of keys the batch functions group at a time */
+#define BATCH (256U)
+
+static inline struct shard_htable_shard *shard_of(struct shard_htable *t,
+						  uint64_t key)
+{
+	unsigned long i = 0;
+
+	if (t->shard_bits)
+		i = fasthash64_key(key, t->seed) >> (64 - t->shard_bits);
+	return &t->shards[i];
+}
+
+bool shard_htable_init(struct shard_htable *t, unsigned nshards,
+		       unsigned long capacity)
+{
+	unsigned long per_shard;
+	unsigned i, bits = 0;
+	void *mem;
+
+	while ((1U << bits) < nshards && (1U << bits) < SHARD_HTABLE_MAX_SHARDS)
+		bits++;
+	nshards = 1U << bits;
+
+	if (!seed_rng())
+		return false;
+	if (posix_memalign(&mem, SHARD_HTABLE_CACHELINE,
+			   nshards * sizeof *t->shards))
+		return false;
+	t->shards = mem;
+	t->shard_bits = bits;
+	t->seed = pcg64_random();
+
+	/* leave some slack, since keys won't spread perfectly evenly */
+	per_shard = div_round_up_ul(capacity, nshards);
+	per_shard += per_shard / 8;
+
+	for (i = 0; i < nshards; i++) {
+		struct shard_htable_shard *s = &t->shards[i];
+
+		SWISS_HASH_TABLE(empty);
+		s->table = empty;
+		if (pthread_rwlock_init(&s->lock, NULL))
+			goto fail;
+		if (!swiss_htable_init(&s->table, per_shard)) {
+			pthread_rwlock_destroy(&s->lock);
+			goto fail;
+		}
+	}
+	return true;
+
+fail:
+	while (i-- > 0) {
+		swiss_htable_destroy(&t->shards[i].table);
+		pthread_rwlock_destroy(&t->shards[i].lock);
+	}
+	free(t->shards);
+	t->shards = NULL;
+	return false;
+}
+
+void shard_htable_destroy(struct shard_htable *t)
+{
+	unsigned i;
+
+	if (!t->shards)
+		return;
+	for (i = 0; i < 1U << t->shard_bits; i++) {
+		swiss_htable_destroy(&t->shards[i].table);
+		pthread_rwlock_destroy(&t->shards[i].lock);
+	}
+	free(t->shards);
+	t->shards = NULL;
+}
+
+bool shard_htable_insert(struct shard_htable *t, uint64_t key,
+			 const void *val)
+{
+	struct shard_htable_shard *s = shard_of(t, key);
+	bool ret;
+
+	pthread_rwlock_wrlock(&s->lock);
+	ret = swiss_htable_insert(&s->table, key, val);
+	pthread_rwlock_unlock(&s->lock);
+	return ret;
+}
+
+bool shard_htable_exists(struct shard_htable *t, uint64_t key)
+{
+	struct shard_htable_shard *s = shard_of(t, key);
+	bool ret;
+
+	pthread_rwlock_rdlock(&s->lock);
+	ret = swiss_htable_exists(&s->table, key);
+	pthread_rwlock_unlock(&s->lock);
+	return ret;
+}
+
+const void *shard_htable_remove(struct shard_htable *t, uint64_t key)
+{
+	struct shard_htable_shard *s = shard_of(t, key);
+	const void *ret;
+
+	pthread_rwlock_wrlock(&s->lock);
+	ret = swiss_htable_remove(&s->table, key);
+	pthread_rwlock_unlock(&s->lock);
+	return ret;
+}
+
+bool shard_htable_get(struct shard_htable *t, uint64_t key,
+		      const void **out)
+{
+	struct shard_htable_shard *s = shard_of(t, key);
+	bool ret;
+
+	pthread_rwlock_rdlock(&s->lock);
+	ret = swiss_htable_get(&s->table, key, out);
+	pthread_rwlock_unlock(&s->lock);
+	return ret;
+}
+
+unsigned long shard_htable_count(struct shard_htable *t)
+{
+	unsigned long count = 0;
+	unsigned i;
+
+	for (i = 0; i < 1U << t->shard_bits; i++) {
+		pthread_rwlock_rdlock(&t->shards[i].lock);
+		count += t->shards[i].table.nentries;
+		pthread_rwlock_unlock(&t->shards[i].lock);
+	}
+	return count;
+}
+
+/* ===== batches ===== */
+
+enum batch_op {
+	BATCH_INSERT,
+	BATCH_GET,
+	BATCH_REMOVE
+};
+
+/* do op on up to BATCH keys, locking each shard once */
+static size_t do_batch(struct shard_htable *t, enum batch_op op,
+		       const uint64_t *keys, const void *const *vals,
+		       const void **out, size_t n)
+{
+	unsigned short start[SHARD_HTABLE_MAX_SHARDS + 1] = {0};
+	unsigned char shard[BATCH];
+	unsigned short order[BATCH];
+	unsigned long nshards = 1UL << t->shard_bits;
+	size_t done = 0;
+	unsigned long s;
+	unsigned i;
+
+	/* counting sort the keys by shard */
+	for (i = 0; i < n; i++) {
+		shard[i] = shard_of(t, keys[i]) - t->shards;
+		start[shard[i] + 1]++;
+	}
+	for (s = 0; s < nshards; s++)
+		start[s + 1] += start[s];
+	for (i = 0; i < n; i++)
+		order[start[shard[i]]++] = i;
+
+	/* start[s] is now the end of shard s's run, and the start of s + 1's */
+	for (s = 0, i = 0; s < nshards; s++) {
+		struct shard_htable_shard *sh = &t->shards[s];
+
+		if (i == start[s])
+			continue;
+
+		if (op == BATCH_GET)
+			pthread_rwlock_rdlock(&sh->lock);
+		else
+			pthread_rwlock_wrlock(&sh->lock);
+		for (; i < start[s]; i++) {
+			unsigned k = order[i];
+
+			switch (op) {
+			case BATCH_INSERT:
+				done += swiss_htable_insert(&sh->table, keys[k],
+							    vals[k]);
+				break;
+			case BATCH_GET:
+				done += swiss_htable_get(&sh->table, keys[k],
+							 &out[k]);
+				break;
+			case BATCH_REMOVE:
+				/* values can be NULL, so count entries */
+				done += sh->table.nentries;
+				swiss_htable_remove(&sh->table, keys[k]);
+				done -= sh->table.nentries;
+				break;
+			}
+		}
+		pthread_rwlock_unlock(&sh->lock);
+	}
+	return done;
+}
+
+size_t shard_htable_insert_batch(struct shard_htable *t,
+				 const uint64_t *keys,
+				 const void *const *vals, size_t n)
+{
+	size_t i, done = 0;
+
+	for (i = 0; i < n; i += BATCH)
+		done += do_batch(t, BATCH_INSERT, keys + i, vals + i, NULL,
+				 n - i < BATCH ? n - i : BATCH);
+	return done;
+}
+
+size_t shard_htable_get_batch(struct shard_htable *t, const uint64_t *keys,
+			      const void **out, size_t n)
+{
+	size_t i, done = 0;
+
+	for (i = 0; i < n; i += BATCH)
+		done += do_batch(t, BATCH_GET, keys + i, NULL, out + i,
+				 n - i < BATCH ? n - i : BATCH);
+	return done;
+}
+
+size_t shard_htable_remove_batch(struct shard_htable *t,
+				 const uint64_t *keys, size_t n)
+{
+	size_t i, done = 0;
+
+	for (i = 0; i < n; i += BATCH)
+		done += do_batch(t, BATCH_REMOVE, keys + i, NULL, NULL,
+				 n - i < BATCH ? n - i : BATCH);
+	return done;
+}
@@ -0,0 +1,264 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file splay_tree.c
+ *
+ * \author Eric Mueller
+ *
+ * \brief Implementation of a top-down splay tree.
+ */
+
+#include "splay_tree.h"
+#include <stdint.h>
+
+#define LEFT (0UL)
+#define RIGHT (1UL)
+
+static inline struct splay_node *data_to_node(struct splay_head *hd,
+					      void *data)
+{
+	return (struct splay_node *)((uintptr_t)data + hd->offset);
+}
+
+static inline void *node_to_data(struct splay_head *hd, struct splay_node *n)
+{
+	return (void *)((uintptr_t)n - hd->offset);
+}
+
+/*
+ * Top down splaying works by walking down from the root, splitting the tree
+ * into three parts: a 'left' tree of nodes known to be less than the key, a
+ * 'right' tree of nodes known to be greater, and the 'middle' tree still to
+ * be searched. Nodes peeled off the middle tree are hung off the largest
+ * node of the left tree or the smallest node of the right tree, which are
+ * tracked in hook[LEFT] and hook[RIGHT]. Both trees start out hanging off a
+ * dummy node on the stack. When the walk stops, the middle tree's root becomes
+ * the new root, with the left and right trees reassembled under it.
+ *
+ * When two steps in a row go the same direction we rotate first (zig-zig),
+ * which is what gives splay trees their amortized bounds.
+ */
+static struct splay_node *assemble(struct splay_node *t,
+				   struct splay_node *dummy,
+				   struct splay_node **hook)
+{
+	hook[LEFT]->chld[RIGHT] = t->chld[LEFT];
+	hook[RIGHT]->chld[LEFT] = t->chld[RIGHT];
+	t->chld[LEFT] = dummy->chld[RIGHT];
+	t->chld[RIGHT] = dummy->chld[LEFT];
+	return t;
+}
+
+/*
+ * splay the node matching key (or the last node on its search path if there
+ * is none) to the root of t. *cmp is set to the comparison of key with the
+ * new root. t must not be NULL.
+ */
+static struct splay_node *splay(struct splay_head *hd, struct splay_node *t,
+				void *key, long *cmp)
+{
+	struct splay_node dummy = {{NULL, NULL}};
+	struct splay_node *hook[2] = {&dummy, &dummy};
+	struct splay_node *c;
+	long tcmp = hd->cmp(key, node_to_data(hd, t));
+	long ccmp;
+	unsigned long dir;
+
+	while (tcmp != 0) {
+		dir = tcmp > 0 ? RIGHT : LEFT;
+		c = t->chld[dir];
+		if (!c)
+			break;
+		ccmp = hd->cmp(key, node_to_data(hd, c));
+
+		/* zig-zig: rotate c above t, then keep going from c */
+		if (ccmp != 0 && (ccmp > 0 ? RIGHT : LEFT) == dir) {
+			t->chld[dir] = c->chld[!dir];
+			c->chld[!dir] = t;
+			t = c;
+			tcmp = ccmp;
+			c = t->chld[dir];
+			if (!c)
+				break;
+			ccmp = hd->cmp(key, node_to_data(hd, c));
+		}
+
+		/* t and everything on its !dir side is on the !dir side of key */
+		hook[!dir]->chld[dir] = t;
+		hook[!dir] = t;
+		t = c;
+		tcmp = ccmp;
+	}
+
+	*cmp = tcmp;
+	return assemble(t, &dummy, hook);
+}
+
+/* splay the first (dir == LEFT) or last (dir == RIGHT) node of t to the root */
+static struct splay_node *splay_edge(struct splay_node *t, unsigned long dir)
+{
+	struct splay_node dummy = {{NULL, NULL}};
+	struct splay_node *hook[2] = {&dummy, &dummy};
+	struct splay_node *c;
+
+	while ((c = t->chld[dir])) {
+		/* always zig-zig */
+		t->chld[dir] = c->chld[!dir];
+		c->chld[!dir] = t;
+		t = c;
+		if (!(c = t->chld[dir]))
+			break;
+		hook[!dir]->chld[dir] = t;
+		hook[!dir] = t;
+		t = c;
+	}
+	return assemble(t, &dummy, hook);
+}
+
+void *splay_insert(struct splay_head *hd, void *new)
+{
+	struct splay_node *n = data_to_node(hd, new);
+	struct splay_node *t;
+	unsigned long dir;
+	long cmp;
+
+	if (!hd->root) {
+		n->chld[LEFT] = NULL;
+		n->chld[RIGHT] = NULL;
+		hd->root = n;
+		hd->nnodes++;
+		return NULL;
+	}
+
+	t = hd->root = splay(hd, hd->root, new, &cmp);
+	if (cmp == 0)
+		return node_to_data(hd, t);
+
+	/* t is new's neighbor, so split t's tree around new */
+	dir = cmp > 0 ? RIGHT : LEFT;
+	n->chld[dir] = t->chld[dir];
+	n->chld[!dir] = t;
+	t->chld[dir] = NULL;
+	hd->root = n;
+	hd->nnodes++;
+	return NULL;
+}
+
+void splay_delete(struct splay_head *hd, void *victim)
+{
+	struct splay_node *t;
+	long cmp;
+
+	if (!hd->root)
+		return;
+
+	t = hd->root = splay(hd, hd->root, victim, &cmp);
+	if (cmp != 0)
+		return;
+
+	/*
+	 * everything on the left is smaller than victim, so splaying victim in
+	 * the left subtree brings its largest node up, which has no right child.
+	 */
+	if (t->chld[LEFT]) {
+		hd->root = splay_edge(t->chld[LEFT], RIGHT);
+		hd->root->chld[RIGHT] = t->chld[RIGHT];
+	} else {
+		hd->root = t->chld[RIGHT];
+	}
+	hd->nnodes--;
+}
+
+void *splay_find(struct splay_head *hd, void *findee)
+{
+	long cmp;
+
+	if (!hd->root || !findee)
+		return NULL;
+	hd->root = splay(hd, hd->root, findee, &cmp);
+	return cmp == 0 ? node_to_data(hd, hd->root) : NULL;
+}
+
+void *splay_first(struct splay_head *hd)
+{
+	if (!hd->root)
+		return NULL;
+	hd->root = splay_edge(hd->root, LEFT);
+	return node_to_data(hd, hd->root);
+}
+
+void *splay_last(struct splay_head *hd)
+{
+	if (!hd->root)
+		return NULL;
+	hd->root = splay_edge(hd->root, RIGHT);
+	return node_to_data(hd, hd->root);
+}
+
+/*
+ * bring start to the root, then bring its neighbor to the top of the subtree
+ * on the dir side. The neighbor is then one step away when it is splayed to
+ * the root on the next call, so in order traversal is amortized O(1).
+ */
+static void *neighbor(struct splay_head *hd, void *start, unsigned long dir)
+{
+	struct splay_node *t;
+	long cmp;
+
+	if (!start || !hd->root)
+		return NULL;
+	t = hd->root = splay(hd, hd->root, start, &cmp);
+	if (!t->chld[dir])
+		return NULL;
+	t->chld[dir] = splay_edge(t->chld[dir], !dir);
+	return node_to_data(hd, t->chld[dir]);
+}
+
+void *splay_next(struct splay_head *hd, void *start)
+{
+	return neighbor(hd, start, RIGHT);
+}
+
+void *splay_prev(struct splay_head *hd, void *start)
+{
+	return neighbor(hd, start, LEFT);
+}
+
+void splay_clear(struct splay_head *hd, void (*f)(void *))
+{
+	struct splay_node *t = hd->root;
+	struct splay_node *next;
+
+	/*
+	 * rotate left children up until the root has none, then the root can
+	 * go. Each rotation moves a node off the left spine for good, so this
+	 * is O(n) without recursion or a stack.
+	 */
+	while (t) {
+		if (t->chld[LEFT]) {
+			next = t->chld[LEFT];
+			t->chld[LEFT] = next->chld[RIGHT];
+			next->chld[RIGHT] = t;
+			t = next;
+			continue;
+		}
+		next = t->chld[RIGHT];
+		if (f)
+			f(node_to_data(hd, t));
+		t = next;
+	}
+	hd->root = NULL;
+	hd->nnodes = 0;
+}
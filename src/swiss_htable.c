@@ -0,0 +1,424 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file swiss_htable.c
+ *
+ * \author Eric Mueller
+ *
+ * \brief Implementation of an open addressing hash table with one byte of
+ * metadata per slot, probed 16 slots at a time.
+ *
+ * \detail See swiss_htable.h, and for more detail on the design
+ *
+ *     https://www.youtube.com/watch?v=ncHmEUmJZf4
+ *
+ * The probe sequence visits groups of 16 slots starting at H1, then H1 + 16,
+ * H1 + 16 + 32, ... (triangular numbers of groups), which visits every group
+ * once when the number of slots is a power of two. Groups don't have to be
+ * aligned, which is why the control bytes at the start are copied past the
+ * end.
+ */
+
+#include "swiss_htable.h"
+#include "util.h"
+#include "fasthash.h"
+#ifdef _POSIX_C_SOURCE
+  #undef _POSIX_C_SOURCE
+#endif
+#define _POSIX_C_SOURCE 200112L
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* this definition isn't portable but it's good enough for now */
+#define CACHELINE (64)
+
+#define GROUP SWISS_HTABLE_GROUP
+#define MIN_SLOTS (GROUP)
+
+/* full slots hold H2, which is 0 to 127, so they never have the top bit set */
+#define CTRL_EMPTY ((int8_t)-128)
+#define CTRL_DELETED ((int8_t)-2)
+
+static inline uint64_t swiss_hash(const struct swiss_head *head, uint64_t key)
+{
+	return fasthash64_key(key, head->seed);
+}
+
+static inline unsigned long h1(uint64_t hash)
+{
+	return hash >> 7;
+}
+
+static inline int8_t h2(uint64_t hash)
+{
+	return hash & 0x7f;
+}
+
+static inline bool is_full(int8_t c)
+{
+	return c >= 0;
+}
+
+/* ===== operations on a group of control bytes, returning bitmasks ===== */
+
+#ifdef __SSE2__
+
+/* slots in the group whose control byte is c */
+static inline unsigned match(const int8_t *g, int8_t c)
+{
+	__m128i ctrl = _mm_loadu_si128((const __m128i *)g);
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(c), ctrl));
+}
+
+/* slots in the group that are empty or deleted (the top bit is set) */
+static inline unsigned match_free(const int8_t *g)
+{
+	return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)g));
+}
+
+#else
+
+static inline unsigned match(const int8_t *g, int8_t c)
+{
+	unsigned i, mask = 0;
+
+	for (i = 0; i < GROUP; i++)
+		mask |= (unsigned)(g[i] == c) << i;
+	return mask;
+}
+
+static inline unsigned match_free(const int8_t *g)
+{
+	unsigned i, mask = 0;
+
+	for (i = 0; i < GROUP; i++)
+		mask |= (unsigned)(g[i] < 0) << i;
+	return mask;
+}
+
+#endif /* __SSE2__ */
+
+static inline unsigned match_empty(const int8_t *g)
+{
+	return match(g, CTRL_EMPTY);
+}
+
+/* ===== control bytes and probing ===== */
+
+/* set a control byte, and its copy past the end if it has one */
+static inline void set_ctrl(struct swiss_head *head, unsigned long i,
+			    int8_t c)
+{
+	head->ctrl[i] = c;
+	if (i < GROUP - 1)
+		head->ctrl[head->mask + 1 + i] = c;
+}
+
+/* maximum number of entries in a table with nslots slots */
+static unsigned long max_entries(unsigned long nslots)
+{
+	return nslots - nslots / 8;
+}
+
+/* index of the first empty or deleted slot in hash's probe sequence */
+static unsigned long find_free(const struct swiss_head *head, uint64_t hash)
+{
+	unsigned long pos = h1(hash) & head->mask, stride = 0;
+	unsigned m;
+
+	/* there is always an empty slot, so this terminates */
+	while (!(m = match_free(head->ctrl + pos))) {
+		stride += GROUP;
+		pos = (pos + stride) & head->mask;
+	}
+	return (pos + __builtin_ctz(m)) & head->mask;
+}
+
+/* index of the slot holding key, or -1 */
+static long find(const struct swiss_head *head, uint64_t key, uint64_t hash)
+{
+	unsigned long pos = h1(hash) & head->mask, stride = 0;
+	int8_t tag = h2(hash);
+	unsigned m;
+
+	if (!head->ctrl)
+		return -1;
+
+	for (;;) {
+		const int8_t *g = head->ctrl + pos;
+
+		for (m = match(g, tag); m; m &= m - 1) {
+			unsigned long i = (pos + __builtin_ctz(m)) & head->mask;
+			if (head->slots[i].key == key)
+				return i;
+		}
+
+		/* an empty slot ends every probe sequence that reaches it */
+		if (match_empty(g))
+			return -1;
+
+		stride += GROUP;
+		pos = (pos + stride) & head->mask;
+		assert(stride <= head->mask + GROUP);
+	}
+}
+
+/* ======= initialization, destruction, resizing and rehashing ======= */
+
+/* allocate empty arrays for nslots slots, without touching the head */
+static bool alloc_arrays(unsigned long nslots, int8_t **ctrl,
+			 struct swiss_slot **slots)
+{
+	void *mem;
+
+	if (posix_memalign(&mem, CACHELINE, nslots + GROUP - 1))
+		return false;
+	*ctrl = mem;
+	if (posix_memalign(&mem, CACHELINE, nslots * sizeof **slots)) {
+		free(*ctrl);
+		return false;
+	}
+	*slots = mem;
+	memset(*ctrl, CTRL_EMPTY, nslots + GROUP - 1);
+	return true;
+}
+
+/* move everything into new arrays with nslots slots */
+static bool do_resize(struct swiss_head *head, unsigned long nslots)
+{
+	int8_t *old_ctrl = head->ctrl;
+	struct swiss_slot *old_slots = head->slots;
+	unsigned long old_nslots = head->ctrl ? head->mask + 1 : 0;
+	unsigned long i;
+
+	if (!alloc_arrays(nslots, &head->ctrl, &head->slots)) {
+		head->ctrl = old_ctrl;
+		head->slots = old_slots;
+		return false;
+	}
+	head->mask = nslots - 1;
+
+	/* no duplicates and no tombstones, so just drop each one in */
+	for (i = 0; i < old_nslots; i++) {
+		uint64_t hash;
+		unsigned long j;
+
+		if (!is_full(old_ctrl[i]))
+			continue;
+		hash = swiss_hash(head, old_slots[i].key);
+		j = find_free(head, hash);
+		set_ctrl(head, j, h2(hash));
+		head->slots[j] = old_slots[i];
+	}
+
+	free(old_ctrl);
+	free(old_slots);
+	head->capacity = max_entries(nslots);
+	head->growth_left = head->capacity - head->nentries;
+	return true;
+}
+
+/*
+ * rehash the table in place, turning tombstones back into empty slots. This
+ * is the algorithm from abseil's drop_deletes_without_resize: mark every full
+ * slot deleted and every deleted slot empty, then walk the slots and put each
+ * 'deleted' (i.e. not yet placed) element where it belongs. If that is a slot
+ * holding another unplaced element, swap them and place the other one next.
+ */
+static void rehash_in_place(struct swiss_head *head)
+{
+	unsigned long i, nslots = head->mask + 1;
+
+	for (i = 0; i < nslots; i++)
+		head->ctrl[i] = is_full(head->ctrl[i]) ? CTRL_DELETED
+						       : CTRL_EMPTY;
+	memcpy(head->ctrl + nslots, head->ctrl, GROUP - 1);
+
+	for (i = 0; i < nslots; i++) {
+		uint64_t hash;
+		unsigned long j, start;
+
+		if (head->ctrl[i] != CTRL_DELETED)
+			continue;
+
+		hash = swiss_hash(head, head->slots[i].key);
+		j = find_free(head, hash);
+		start = h1(hash) & head->mask;
+
+		/* already in the right group, so it can stay where it is */
+		if (((i - start) & head->mask) / GROUP
+		    == ((j - start) & head->mask) / GROUP) {
+			set_ctrl(head, i, h2(hash));
+			continue;
+		}
+
+		if (head->ctrl[j] == CTRL_EMPTY) {
+			set_ctrl(head, j, h2(hash));
+			head->slots[j] = head->slots[i];
+			set_ctrl(head, i, CTRL_EMPTY);
+		} else {
+			struct swiss_slot tmp = head->slots[j];
+
+			set_ctrl(head, j, h2(hash));
+			head->slots[j] = head->slots[i];
+			head->slots[i] = tmp;
+			i--;
+		}
+	}
+
+	head->growth_left = head->capacity - head->nentries;
+}
+
+/*
+ * make room for an insert into an empty slot. If a lot of the table is
+ * tombstones, clearing them out makes enough room, otherwise double it.
+ */
+static bool make_room(struct swiss_head *head)
+{
+	unsigned long nslots = head->mask + 1;
+
+	if (nslots > GROUP && head->nentries * 32 <= nslots * 25) {
+		rehash_in_place(head);
+		head->stat_rehashes++;
+		return true;
+	}
+	if (!do_resize(head, nslots * 2))
+		return false;
+	head->stat_resizes++;
+	return true;
+}
+
+bool swiss_htable_init(struct swiss_head *head, unsigned long capacity)
+{
+	unsigned long nslots = MIN_SLOTS;
+
+	if (!seed_rng())
+		return false;
+
+	while (max_entries(nslots) < capacity)
+		nslots *= 2;
+
+	head->ctrl = NULL;
+	head->slots = NULL;
+	head->nentries = 0;
+	head->seed = pcg64_random();
+	return do_resize(head, nslots);
+}
+
+void swiss_htable_destroy(struct swiss_head *head)
+{
+	free(head->ctrl);
+	free(head->slots);
+	head->ctrl = NULL;
+	head->slots = NULL;
+	head->nentries = 0;
+	head->capacity = 0;
+	head->mask = 0;
+	head->growth_left = 0;
+}
+
+/* ======= insertion, deletion, and query methods ======= */
+
+bool swiss_htable_insert(struct swiss_head *head, uint64_t key,
+			 void const *val)
+{
+	uint64_t hash = swiss_hash(head, key);
+	unsigned long i;
+
+	if (find(head, key, hash) >= 0)
+		return true;
+
+	i = find_free(head, hash);
+	if (head->growth_left == 0 && head->ctrl[i] == CTRL_EMPTY) {
+		if (!make_room(head))
+			return false;
+		i = find_free(head, hash);
+	}
+
+	head->growth_left -= head->ctrl[i] == CTRL_EMPTY;
+	set_ctrl(head, i, h2(hash));
+	head->slots[i].key = key;
+	head->slots[i].val = val;
+	head->nentries++;
+	return true;
+}
+
+bool swiss_htable_exists(struct swiss_head const *head, uint64_t key)
+{
+	return find(head, key, swiss_hash(head, key)) >= 0;
+}
+
+const void *swiss_htable_remove(struct swiss_head *head, uint64_t key)
+{
+	long i = find(head, key, swiss_hash(head, key));
+	unsigned before, after;
+	const void *val;
+
+	if (i < 0)
+		return NULL;
+	val = head->slots[i].val;
+
+	/*
+	 * if there is an empty slot within the 16 before and after i, with
+	 * fewer than 16 slots between them, no probe can have passed over i
+	 * looking for something else, so it can go straight back to empty
+	 * instead of being a tombstone.
+	 */
+	before = match_empty(head->ctrl + ((i - GROUP) & head->mask));
+	after = match_empty(head->ctrl + i);
+	if (before && after
+	    && (__builtin_clz(before) - (32 - GROUP)) + __builtin_ctz(after)
+	       < GROUP) {
+		set_ctrl(head, i, CTRL_EMPTY);
+		head->growth_left++;
+	} else {
+		set_ctrl(head, i, CTRL_DELETED);
+	}
+	head->nentries--;
+	return val;
+}
+
+bool swiss_htable_get(struct swiss_head const *head, uint64_t key,
+		      void const **out)
+{
+	long i = find(head, key, swiss_hash(head, key));
+
+	if (i < 0)
+		return false;
+	*out = head->slots[i].val;
+	return true;
+}
+
+bool swiss_htable_resize(struct swiss_head *head, bool grow)
+{
+	unsigned long nslots = head->mask + 1;
+
+	if (grow) {
+		if (!do_resize(head, nslots * 2))
+			return false;
+	} else {
+		if (nslots <= MIN_SLOTS || head->nentries > head->capacity / 4)
+			return false;
+		if (!do_resize(head, nslots / 2))
+			return false;
+	}
+	head->stat_resizes++;
+	return true;
+}
@@ -0,0 +1,270 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file timer_wheel.c
+ *
+ * \author Eric Mueller
+ *
+ * \brief Implementation of a hierarchical timing wheel.
+ *
+ * \detail A timer d ticks out goes in the lowest level whose slots span
+ * d, i.e. level l with d < 2^(slot_bits * (l + 1)), in the slot for the
+ * level's bits of its expiry tick. Every time level 0 wraps around (the low
+ * slot_bits bits of now are 0), the slot of level 1 for the new now comes
+ * due and is cascaded, and if level 1 wrapped as well the slot of level 2
+ * does, and so on. Because a timer on level l is at least 2^(slot_bits * l)
+ * ticks out, its slot is never the one that was just cascaded, unless it is
+ * a whole turn of the level away, which is exactly when it comes due.
+ */
+
+#include "timer_wheel.h"
+#include "util.h"
+#include <stdlib.h>
+
+static inline uint64_t nslots(const struct timer_wheel *w)
+{
+	return 1ULL << w->slot_bits;
+}
+
+/* words of the nonempty bitmap per level */
+static inline uint64_t bitmap_words(const struct timer_wheel *w)
+{
+	return div_round_up_ul(nslots(w), 64);
+}
+
+static inline struct list_head *slot_at(struct timer_wheel *w, unsigned level,
+					uint64_t i)
+{
+	return &w->slots[((uint64_t)level << w->slot_bits) + i];
+}
+
+static inline void mark(struct timer_wheel *w, struct list_head *slot,
+			bool nonempty)
+{
+	uint64_t i, level, idx, *word;
+
+	if (slot == &w->due)
+		return;
+	i = slot - w->slots;
+	level = i >> w->slot_bits;
+	idx = i & (nslots(w) - 1);
+	word = &w->nonempty[level * bitmap_words(w) + idx / 64];
+	if (nonempty)
+		*word |= 1ULL << (idx % 64);
+	else
+		*word &= ~(1ULL << (idx % 64));
+}
+
+/* put an unarmed timer in its slot, relative to w->now */
+static void place(struct timer_wheel *w, struct timer_wheel_timer *t)
+{
+	uint64_t range = 1ULL << (w->slot_bits * w->levels);
+	uint64_t expires = t->expires, delta;
+	unsigned level = 0;
+
+	if (expires < w->now) {
+		t->slot = &w->due;
+		list_push_back(t->slot, t);
+		return;
+	}
+	delta = expires - w->now;
+	if (delta >= range) {
+		/* too far out, park it as far out as we can go */
+		delta = range - 1;
+		expires = w->now + delta;
+	}
+	while (delta >> (w->slot_bits * (level + 1)))
+		level++;
+
+	t->slot = slot_at(w, level, (expires >> (w->slot_bits * level))
+			  & (nslots(w) - 1));
+	list_push_back(t->slot, t);
+	if (t->slot->length == 1)
+		mark(w, t->slot, true);
+}
+
+static void unplace(struct timer_wheel *w, struct timer_wheel_timer *t)
+{
+	list_delete(t->slot, t);
+	if (t->slot->length == 0)
+		mark(w, t->slot, false);
+	t->slot = NULL;
+}
+
+/* move the timers in a slot of a higher level to the levels below it */
+static void cascade(struct timer_wheel *w, unsigned level)
+{
+	uint64_t i = (w->now >> (w->slot_bits * level)) & (nslots(w) - 1);
+	struct list_head *slot = slot_at(w, level, i);
+	struct timer_wheel_timer *t;
+
+	if (slot->length == 0)
+		return;
+	mark(w, slot, false);
+	while ((t = list_pop_front(slot)))
+		place(w, t);
+}
+
+/*
+ * move every timer in a slot that is due to the end of expired. The others
+ * were parked there because they were out of range, which only happens at
+ * level 0 when it is the only level, and are placed again.
+ */
+static unsigned long collect(struct timer_wheel *w, struct list_head *slot,
+			     struct list_head *expired)
+{
+	unsigned long n = 0;
+	struct timer_wheel_timer *t;
+
+	if (!slot->length)
+		return 0;
+	mark(w, slot, false);
+	while ((t = list_pop_front(slot))) {
+		if (t->expires > w->now) {
+			place(w, t);
+			continue;
+		}
+		t->slot = NULL;
+		list_push_back(expired, t);
+		n++;
+	}
+	w->count -= n;
+	return n;
+}
+
+/*
+ * index of the first nonempty slot of level 0 at or after i, or nslots if
+ * there isn't one before the end of the level
+ */
+static uint64_t next_nonempty(const struct timer_wheel *w, uint64_t i)
+{
+	uint64_t word, end = bitmap_words(w);
+	uint64_t bits;
+
+	for (word = i / 64; word < end; word++) {
+		bits = w->nonempty[word];
+		if (word == i / 64)
+			bits &= ~0ULL << (i % 64);
+		if (bits)
+			return word * 64 + __builtin_ctzll(bits);
+	}
+	return nslots(w);
+}
+
+bool timer_wheel_init(struct timer_wheel *w, uint64_t granularity,
+		      unsigned slot_bits, unsigned levels, uint64_t now)
+{
+	uint64_t i, n;
+
+	if (!granularity || slot_bits < TIMER_WHEEL_SLOT_BITS_MIN
+	    || slot_bits > TIMER_WHEEL_SLOT_BITS_MAX || !levels
+	    || levels > TIMER_WHEEL_MAX_LEVELS || slot_bits * levels >= 64)
+		return false;
+
+	w->granularity = granularity;
+	w->slot_bits = slot_bits;
+	w->levels = levels;
+	w->now = now / granularity;
+	w->count = 0;
+
+	n = (uint64_t)levels << slot_bits;
+	w->slots = malloc(n * sizeof *w->slots);
+	w->nonempty = calloc(levels * bitmap_words(w), sizeof *w->nonempty);
+	if (!w->slots || !w->nonempty) {
+		free(w->slots);
+		free(w->nonempty);
+		w->slots = NULL;
+		w->nonempty = NULL;
+		return false;
+	}
+	for (i = 0; i < n; i++) {
+		TIMER_WHEEL_LIST(empty);
+		w->slots[i] = empty;
+	}
+	w->due = w->slots[0];
+	return true;
+}
+
+void timer_wheel_destroy(struct timer_wheel *w)
+{
+	free(w->slots);
+	free(w->nonempty);
+	w->slots = NULL;
+	w->nonempty = NULL;
+	w->count = 0;
+}
+
+void timer_wheel_arm(struct timer_wheel *w, struct timer_wheel_timer *t,
+		     uint64_t expires)
+{
+	if (t->slot)
+		unplace(w, t);
+	else
+		w->count++;
+
+	/* round up, so timers never fire early */
+	t->expires = expires / w->granularity
+		+ (expires % w->granularity != 0);
+	place(w, t);
+}
+
+bool timer_wheel_cancel(struct timer_wheel *w, struct timer_wheel_timer *t)
+{
+	if (!t->slot)
+		return false;
+	unplace(w, t);
+	w->count--;
+	return true;
+}
+
+unsigned long timer_wheel_advance(struct timer_wheel *w, uint64_t now,
+				  struct list_head *expired)
+{
+	uint64_t target = now / w->granularity, mask = nslots(w) - 1;
+	unsigned long fired = collect(w, &w->due, expired);
+
+	while (w->now <= target) {
+		uint64_t i = w->now & mask, next;
+		unsigned level;
+
+		if (!w->count) {
+			w->now = target + 1;
+			break;
+		}
+
+		/* level 0 wrapped, see which of the levels above did too */
+		if (i == 0) {
+			for (level = 1; level < w->levels; level++)
+				if ((w->now >> (w->slot_bits * level)) & mask)
+					break;
+			if (level == w->levels)
+				level--;
+			for (; level > 0; level--)
+				cascade(w, level);
+		}
+
+		fired += collect(w, slot_at(w, 0, i), expired);
+
+		/*
+		 * skip ahead to the next timer, or the end of the level, but
+		 * not past target: timers armed later could belong there.
+		 */
+		next = next_nonempty(w, i + 1);
+		if (next - i > target - w->now)
+			next = i + target - w->now + 1;
+		w->now += next - i;
+	}
+	return fired;
+}
@@ -0,0 +1,156 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file ulist.c
+ *
+ * \author Eric Mueller
+ *
+ * \brief Implementation of an unrolled list of pointers.
+ */
+
+#include "ulist.h"
+#ifdef _POSIX_C_SOURCE
+  #undef _POSIX_C_SOURCE
+#endif
+#define _POSIX_C_SOURCE 200112L
+#include <assert.h>
+#include <stdlib.h>
+
+/*
+ * get an empty block, with begin and end at pos. pos is 0 for a block that
+ * will be filled from the front, or ULIST_BLOCK_ITEMS for one filled from the
+ * back.
+ */
+static struct ulist_block *get_block(struct ulist *ul, unsigned pos)
+{
+	struct ulist_block *b = ul->spare;
+	void *mem;
+
+	if (b) {
+		ul->spare = NULL;
+	} else {
+		if (posix_memalign(&mem, ULIST_CACHELINE, sizeof *b))
+			return NULL;
+		b = mem;
+	}
+	b->next = NULL;
+	b->prev = NULL;
+	b->begin = pos;
+	b->end = pos;
+	return b;
+}
+
+/* unlink a block that just became empty, keeping it as the spare */
+static void put_block(struct ulist *ul, struct ulist_block *b)
+{
+	if (b->prev)
+		b->prev->next = b->next;
+	else
+		ul->first = b->next;
+	if (b->next)
+		b->next->prev = b->prev;
+	else
+		ul->last = b->prev;
+
+	free(ul->spare);
+	ul->spare = b;
+}
+
+void ulist_destroy(struct ulist *ul)
+{
+	struct ulist_block *b = ul->first, *next;
+
+	while (b) {
+		next = b->next;
+		free(b);
+		b = next;
+	}
+	free(ul->spare);
+	*ul = ULIST_INITIALIZER;
+}
+
+bool ulist_push_back(struct ulist *ul, void *data)
+{
+	struct ulist_block *b = ul->last;
+
+	if (!b || b->end == ULIST_BLOCK_ITEMS) {
+		b = get_block(ul, 0);
+		if (!b)
+			return false;
+		b->prev = ul->last;
+		if (ul->last)
+			ul->last->next = b;
+		else
+			ul->first = b;
+		ul->last = b;
+	}
+
+	b->items[b->end++] = data;
+	ul->length++;
+	return true;
+}
+
+bool ulist_push_front(struct ulist *ul, void *data)
+{
+	struct ulist_block *b = ul->first;
+
+	if (!b || b->begin == 0) {
+		b = get_block(ul, ULIST_BLOCK_ITEMS);
+		if (!b)
+			return false;
+		b->next = ul->first;
+		if (ul->first)
+			ul->first->prev = b;
+		else
+			ul->last = b;
+		ul->first = b;
+	}
+
+	b->items[--b->begin] = data;
+	ul->length++;
+	return true;
+}
+
+void *ulist_pop_back(struct ulist *ul)
+{
+	struct ulist_block *b = ul->last;
+	void *data;
+
+	if (!b)
+		return NULL;
+
+	assert(b->end > b->begin);
+	data = b->items[--b->end];
+	ul->length--;
+	if (b->begin == b->end)
+		put_block(ul, b);
+	return data;
+}
+
+void *ulist_pop_front(struct ulist *ul)
+{
+	struct ulist_block *b = ul->first;
+	void *data;
+
+	if (!b)
+		return NULL;
+
+	assert(b->end > b->begin);
+	data = b->items[b->begin++];
+	ul->length--;
+	if (b->begin == b->end)
+		put_block(ul, b);
+	return data;
+}
@@ -0,0 +1,138 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file bigmem_test.c
+ *
+ * \author Eric Mueller
+ *
+ * \brief Tests for the allocation options in bigmem.h, and for the
+ * structures that use them.
+ */
+
+#include "test.h"
+#include "bigmem.h"
+#include "bloom.h"
+#include "cuckoo_htable.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+/*
+ * what needs to be tested:
+ *    1. every combination of options gives zeroed, aligned, writable memory,
+ *       and frees it again.
+ *    2. sizes that aren't a multiple of a page or huge page work.
+ *    3. a cuckoo table and a bloom filter work the same with options set,
+ *       including through a resize of the table.
+ */
+
+#define TEST_SIZE ((3UL << 20) + 123)
+#define TEST_KEYS (1UL << 16)
+
+static const struct bigmem_opts all_opts[] = {
+	{false, BIGMEM_POLICY_DEFAULT, 0, 0},
+	{true, BIGMEM_POLICY_DEFAULT, 0, 0},
+	{false, BIGMEM_POLICY_LOCAL, 0, 0},
+	{false, BIGMEM_POLICY_INTERLEAVE, 0, 0},
+	{false, BIGMEM_POLICY_BIND, 0, 0},
+	{false, BIGMEM_POLICY_DEFAULT, 0, 1},
+	{false, BIGMEM_POLICY_DEFAULT, 0, 4},
+	{true, BIGMEM_POLICY_INTERLEAVE, 0, 3},
+};
+
+#define NR_OPTS (sizeof all_opts / sizeof all_opts[0])
+
+static void check_alloc(size_t size, const struct bigmem_opts *opts)
+{
+	unsigned char *mem = bigmem_alloc(size, opts);
+	size_t i;
+
+	ASSERT_TRUE(mem, "bigmem_alloc failed\n");
+	ASSERT_TRUE((uintptr_t)mem % 64 == 0,
+		    "memory is not cacheline aligned\n");
+	for (i = 0; i < size; i++) {
+		ASSERT_TRUE(mem[i] == 0, "memory is not zeroed\n");
+		mem[i] = i;
+	}
+	bigmem_free(mem, size, opts);
+}
+
+void test_alloc()
+{
+	unsigned i;
+
+	check_alloc(TEST_SIZE, NULL);
+	for (i = 0; i < NR_OPTS; i++) {
+		check_alloc(TEST_SIZE, &all_opts[i]);
+		check_alloc(1, &all_opts[i]);
+	}
+	bigmem_free(NULL, TEST_SIZE, &all_opts[1]);
+}
+
+void test_cuckoo_htable()
+{
+	unsigned long i;
+	uint64_t v;
+	unsigned o;
+
+	for (o = 0; o < NR_OPTS; o++) {
+		CUCKOO_HASH_TABLE(t);
+		t.mem = all_opts[o];
+		ASSERT_TRUE(cuckoo_htable_init(&t, TEST_KEYS / 4),
+			    "cuckoo_htable_init failed\n");
+		for (i = 0; i < TEST_KEYS; i++)
+			ASSERT_TRUE(cuckoo_htable_insert_u64(&t, i, i * 3),
+				    "cuckoo_htable_insert_u64 failed\n");
+		ASSERT_TRUE(t.stat_resizes, "table did not grow\n");
+		for (i = 0; i < TEST_KEYS; i++) {
+			ASSERT_TRUE(cuckoo_htable_get_u64(&t, i, &v),
+				    "key went missing\n");
+			ASSERT_TRUE(v == i * 3, "value changed\n");
+		}
+		cuckoo_htable_destroy(&t);
+	}
+}
+
+void test_bloom()
+{
+	unsigned long i;
+	unsigned o;
+
+	for (o = 0; o < NR_OPTS; o++) {
+		BLOOM_FILTER(bf, TEST_KEYS, BLOOM_P_DEFAULT);
+		struct bloom copy;
+
+		bf.mem = all_opts[o];
+		ASSERT_TRUE(bloom_init(&bf), "bloom_init failed\n");
+		ASSERT_TRUE(bloom_init_from(&copy, &bf),
+			    "bloom_init_from failed\n");
+		for (i = 0; i < TEST_KEYS; i++)
+			bloom_insert(&bf, i);
+		for (i = 0; i < TEST_KEYS; i++) {
+			ASSERT_TRUE(bloom_query(&bf, i), "key went missing\n");
+			ASSERT_FALSE(bloom_query(&copy, i),
+				     "copy is not empty\n");
+		}
+		bloom_destroy(&copy);
+		bloom_destroy(&bf);
+	}
+}
+
+int main(void)
+{
+	REGISTER_TEST(test_alloc);
+	REGISTER_TEST(test_cuckoo_htable);
+	REGISTER_TEST(test_bloom);
+	return run_all_tests();
+}
@@ -0,0 +1,251 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file clock_cache_test.c
+ *
+ * \author Eric Mueller
+ *
+ * \brief Tests for the cache defined in clock_cache.h
+ */
+
+#include "test.h"
+#include "clock_cache.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define NTHREADS 4
+#define PER_THREAD (200 * 1000)
+
+static const void *val_of(uint64_t key)
+{
+	return (const void *)(uintptr_t)(key * 3 + 1);
+}
+
+/* keys passed to the eviction callback, in order */
+static uint64_t evicted[64];
+static unsigned nevicted;
+
+static void record(uint64_t key, const void *val, void *private)
+{
+	(void)private;
+	if (val == val_of(key) && nevicted < 64)
+		evicted[nevicted++] = key;
+}
+
+static bool cached(struct clock_cache *c, uint64_t key)
+{
+	struct clock_cache_entry *e = clock_cache_lookup(c, key);
+	bool ret = e && clock_cache_value(e) == val_of(key);
+
+	if (e)
+		clock_cache_release(c, e);
+	return ret;
+}
+
+void test_basic()
+{
+	struct clock_cache c;
+	struct clock_cache_stats st;
+
+	nevicted = 0;
+	ASSERT_TRUE(clock_cache_init(&c, 4, 400, record, NULL),
+		    "init failed\n");
+	for (uint64_t i = 0; i < 100; i++)
+		ASSERT_TRUE(clock_cache_insert(&c, i, val_of(i), 1),
+			    "insert failed\n");
+	for (uint64_t i = 0; i < 100; i++)
+		ASSERT_TRUE(cached(&c, i), "lookup failed\n");
+	ASSERT_FALSE(cached(&c, 100), "found a key that wasn't inserted\n");
+
+	ASSERT_TRUE(clock_cache_remove(&c, 5), "remove failed\n");
+	ASSERT_FALSE(clock_cache_remove(&c, 5), "removed a key twice\n");
+	ASSERT_TRUE(nevicted == 1 && evicted[0] == 5,
+		    "remove didn't call the eviction callback\n");
+	ASSERT_FALSE(clock_cache_insert(&c, 200, val_of(200), 101),
+		     "inserted something bigger than a shard\n");
+
+	clock_cache_stats(&c, &st);
+	ASSERT_TRUE(st.hits == 100 && st.misses == 1 && st.inserts == 100
+		    && st.evictions == 0 && st.entries == 99 && st.used == 99,
+		    "stats were wrong\n");
+
+	clock_cache_destroy(&c);
+	ASSERT_TRUE(nevicted == 64, "destroy didn't evict everything\n");
+}
+
+/* with one shard the eviction order is exactly CLOCK's */
+void test_clock_order()
+{
+	struct clock_cache c;
+
+	nevicted = 0;
+	ASSERT_TRUE(clock_cache_init(&c, 1, 4, record, NULL), "init failed\n");
+	for (uint64_t i = 1; i <= 4; i++)
+		clock_cache_insert(&c, i, val_of(i), 1);
+	ASSERT_TRUE(cached(&c, 1) && cached(&c, 2), "lookup failed\n");
+
+	/* the hand clears 1 and 2, then takes 3, then 4 */
+	clock_cache_insert(&c, 5, val_of(5), 1);
+	ASSERT_TRUE(nevicted == 1 && evicted[0] == 3,
+		    "evicted a referenced entry\n");
+	clock_cache_insert(&c, 6, val_of(6), 1);
+	ASSERT_TRUE(nevicted == 2 && evicted[1] == 4,
+		    "evicted the wrong entry\n");
+
+	/* 1 and 2 were cleared last time around, so now they go */
+	clock_cache_insert(&c, 7, val_of(7), 2);
+	ASSERT_TRUE(nevicted == 4 && evicted[2] == 1 && evicted[3] == 2,
+		    "didn't evict enough for a bigger charge\n");
+	ASSERT_TRUE(cached(&c, 5) && cached(&c, 6) && cached(&c, 7),
+		    "lost an entry that should be cached\n");
+	clock_cache_destroy(&c);
+}
+
+/* pinned entries aren't evicted, and removed ones outlive their handles */
+void test_handles()
+{
+	struct clock_cache c;
+	struct clock_cache_entry *one, *two;
+	struct clock_cache_stats st;
+
+	nevicted = 0;
+	ASSERT_TRUE(clock_cache_init(&c, 1, 2, record, NULL), "init failed\n");
+	clock_cache_insert(&c, 1, val_of(1), 1);
+	clock_cache_insert(&c, 2, val_of(2), 1);
+	one = clock_cache_lookup(&c, 1);
+	two = clock_cache_lookup(&c, 2);
+	ASSERT_TRUE(one && two, "lookup failed\n");
+
+	ASSERT_TRUE(clock_cache_insert(&c, 3, val_of(3), 1), "insert failed\n");
+	clock_cache_stats(&c, &st);
+	ASSERT_TRUE(nevicted == 0 && st.entries == 3 && st.used == 3,
+		    "evicted a pinned entry\n");
+
+	ASSERT_TRUE(clock_cache_remove(&c, 1), "remove failed\n");
+	ASSERT_FALSE(cached(&c, 1), "found a removed key\n");
+	ASSERT_TRUE(nevicted == 0 && clock_cache_value(one) == val_of(1),
+		    "evicted a removed entry with a handle on it\n");
+	clock_cache_release(&c, one);
+	ASSERT_TRUE(nevicted == 1 && evicted[0] == 1,
+		    "release didn't evict a removed entry\n");
+
+	/* replacing a value works the same way */
+	ASSERT_TRUE(clock_cache_insert(&c, 2, NULL, 1), "insert failed\n");
+	ASSERT_TRUE(nevicted == 1 && clock_cache_value(two) == val_of(2),
+		    "evicted a replaced entry with a handle on it\n");
+	clock_cache_release(&c, two);
+	ASSERT_TRUE(nevicted == 2 && evicted[1] == 2,
+		    "release didn't evict a replaced entry\n");
+	two = clock_cache_lookup(&c, 2);
+	ASSERT_TRUE(two && clock_cache_value(two) == NULL,
+		    "insert didn't replace the value\n");
+	clock_cache_release(&c, two);
+
+	clock_cache_destroy(&c);
+}
+
+static unsigned long live;
+
+static void free_val(uint64_t key, const void *val, void *private)
+{
+	(void)key;
+	(void)private;
+	free((void *)val);
+	__atomic_sub_fetch(&live, 1, __ATOMIC_RELAXED);
+}
+
+struct worker {
+	struct clock_cache *c;
+	uint64_t seed;
+	bool ok;
+};
+
+/* values are freed on eviction, so reading one that's gone would be bad */
+static void *work(void *arg)
+{
+	struct worker *w = arg;
+	uint64_t x = w->seed;
+
+	w->ok = true;
+	for (unsigned long i = 0; i < PER_THREAD; i++) {
+		struct clock_cache_entry *e;
+		uint64_t key, *val;
+
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		/* a few hot keys and a lot of cold ones */
+		key = x % (x & 1 ? 64 : 4096);
+
+		e = clock_cache_lookup(w->c, key);
+		if (e) {
+			w->ok &= *(const uint64_t *)clock_cache_value(e) == key;
+			clock_cache_release(w->c, e);
+			continue;
+		}
+		val = malloc(sizeof *val);
+		*val = key;
+		__atomic_add_fetch(&live, 1, __ATOMIC_RELAXED);
+		if (!clock_cache_insert(w->c, key, val, 1))
+			free_val(key, val, NULL);
+		if (x % 16 == 0)
+			clock_cache_remove(w->c, key ^ 1);
+	}
+	return NULL;
+}
+
+void test_threads()
+{
+	struct clock_cache c;
+	struct clock_cache_stats st;
+	struct worker w[NTHREADS];
+	pthread_t tid[NTHREADS];
+	bool ok = true;
+
+	ASSERT_TRUE(clock_cache_init(&c, 8, 512, free_val, NULL),
+		    "init failed\n");
+	for (int i = 0; i < NTHREADS; i++) {
+		w[i].c = &c;
+		w[i].seed = 42 + i;
+		pthread_create(&tid[i], NULL, work, &w[i]);
+	}
+	for (int i = 0; i < NTHREADS; i++) {
+		pthread_join(tid[i], NULL);
+		ok &= w[i].ok;
+	}
+	ASSERT_TRUE(ok, "a thread got the wrong value\n");
+
+	clock_cache_stats(&c, &st);
+	ASSERT_TRUE(st.hits + st.misses == NTHREADS * PER_THREAD,
+		    "lost some lookups\n");
+	ASSERT_TRUE(st.evictions > 0 && st.hits > st.misses,
+		    "hot keys didn't stay cached\n");
+	ASSERT_TRUE(st.used == st.entries && st.used <= 512,
+		    "cache went over capacity\n");
+	ASSERT_TRUE(live == st.entries, "leaked or lost some values\n");
+
+	clock_cache_destroy(&c);
+	ASSERT_TRUE(live == 0, "destroy leaked some values\n");
+}
+
+int main(void)
+{
+	REGISTER_TEST(test_basic);
+	REGISTER_TEST(test_clock_order);
+	REGISTER_TEST(test_handles);
+	REGISTER_TEST(test_threads);
+	return run_all_tests();
+}
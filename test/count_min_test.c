@@ -0,0 +1,149 @@
+/*
+ * Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file count_min_test.c
+ *
+ * \author Eric Mueller
+ *
+ * \brief Tests for the sketch defined in count_min.h
+ */
+
+#include "test.h"
+#include "count_min.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NKEYS (100 * 1000)
+#define EPS (1e-3)
+#define DELTA (1e-2)
+
+/* a skewed stream: key i is counted NKEYS / (i + 1) times */
+static uint32_t count_of(uint64_t key)
+{
+	return NKEYS / (key + 1);
+}
+
+static void add_stream(struct count_min *cm, uint64_t first, uint64_t last)
+{
+	for (uint64_t key = first; key < last; key++)
+		count_min_add(cm, key, count_of(key));
+}
+
+void test_init_destroy()
+{
+	COUNT_MIN_SKETCH(cm, EPS, DELTA);
+
+	ASSERT_TRUE(count_min_init(&cm), "init failed\n");
+	ASSERT_TRUE(cm.width >= M_E / EPS && (cm.width & (cm.width - 1)) == 0,
+		    "width was wrong\n");
+	ASSERT_TRUE(cm.depth == (unsigned long)ceil(log(1 / DELTA)),
+		    "depth was wrong\n");
+	ASSERT_TRUE(count_min_query(&cm, 42) == 0,
+		    "empty sketch had a count\n");
+	count_min_destroy(&cm);
+	ASSERT_TRUE(cm.counters == NULL, "destroy didn't clear counters\n");
+}
+
+void test_error_bound()
+{
+	COUNT_MIN_SKETCH(cm, EPS, DELTA);
+	unsigned long under = 0, over = 0;
+
+	ASSERT_TRUE(count_min_init(&cm), "init failed\n");
+	add_stream(&cm, 0, NKEYS);
+	for (uint64_t key = 0; key < NKEYS; key++) {
+		uint32_t est = count_min_query(&cm, key);
+
+		under += est < count_of(key);
+		over += est > count_of(key) + EPS * cm.total;
+	}
+	ASSERT_TRUE(under == 0, "an estimate was too low\n");
+	ASSERT_TRUE(over <= DELTA * NKEYS, "too many estimates were too high\n");
+
+	/* the heavy hitters stand well clear of the noise */
+	for (uint64_t key = 0; key < 10; key++)
+		ASSERT_TRUE(count_min_query(&cm, key)
+			    < count_of(key) + EPS * cm.total,
+			    "a heavy hitter was off by too much\n");
+	count_min_destroy(&cm);
+}
+
+void test_saturate()
+{
+	COUNT_MIN_SKETCH(cm, EPS, DELTA);
+
+	ASSERT_TRUE(count_min_init(&cm), "init failed\n");
+	count_min_add(&cm, 1, UINT32_MAX - 1);
+	count_min_add(&cm, 1, 10);
+	ASSERT_TRUE(count_min_query(&cm, 1) == UINT32_MAX,
+		    "count wrapped around\n");
+	count_min_destroy(&cm);
+}
+
+void test_union()
+{
+	COUNT_MIN_SKETCH(cm0, EPS, DELTA);
+	COUNT_MIN_SKETCH(cm1, EPS, DELTA);
+	COUNT_MIN_SKETCH(into, EPS, DELTA);
+	COUNT_MIN_SKETCH(other, EPS, DELTA);
+	bool ok = true;
+
+	ASSERT_TRUE(count_min_init(&cm0), "init failed\n");
+	ASSERT_TRUE(count_min_init_from(&cm1, &cm0), "init_from failed\n");
+	ASSERT_TRUE(count_min_same_class(&cm0, &cm1), "classes differed\n");
+	add_stream(&cm0, 0, NKEYS / 2);
+	add_stream(&cm1, NKEYS / 4, NKEYS);
+
+	/* into uninitialized */
+	ASSERT_TRUE(count_min_union(&into, &cm0, &cm1), "union failed\n");
+	ASSERT_TRUE(into.total == cm0.total + cm1.total, "total was wrong\n");
+	for (uint64_t key = 0; key < NKEYS; key++) {
+		uint32_t real = count_of(key)
+			* (1 + (key >= NKEYS / 4 && key < NKEYS / 2));
+
+		ok &= count_min_query(&into, key) >= real;
+		/* a min of sums is at least the sum of the mins */
+		ok &= count_min_query(&into, key) >= count_min_query(&cm0, key)
+			+ count_min_query(&cm1, key);
+	}
+	ASSERT_TRUE(ok, "union had an estimate that was too low\n");
+
+	/* in place */
+	ASSERT_TRUE(count_min_union(&cm0, &cm0, &cm1), "union failed\n");
+	ASSERT_TRUE(memcmp(cm0.counters, into.counters,
+			   cm0.width * cm0.depth * sizeof *cm0.counters) == 0,
+		    "in place union was different\n");
+
+	/* different classes */
+	ASSERT_TRUE(count_min_init(&other), "init failed\n");
+	ASSERT_FALSE(count_min_union(&into, &cm0, &other),
+		     "merged sketches with different seeds\n");
+
+	count_min_destroy(&cm0);
+	count_min_destroy(&cm1);
+	count_min_destroy(&into);
+	count_min_destroy(&other);
+}
+
+int main(void)
+{
+	REGISTER_TEST(test_init_destroy);
+	REGISTER_TEST(test_error_bound);
+	REGISTER_TEST(test_saturate);
+	REGISTER_TEST(test_union);
+	return run_all_tests();
+}
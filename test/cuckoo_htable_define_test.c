@@ -0,0 +1,185 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file cuckoo_htable_define_test.c
+ *
+ * \author Eric Mueller
+ *
+ * \brief Tests for the tables generated by cuckoo_htable_define.h
+ */
+
+#include "test.h"
+#include "cuckoo_htable_define.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * what needs to be tested:
+ *    1. a table with integer keys and values: inserted keys can be found,
+ *       others can't, through many doublings.
+ *    2. insert leaves an existing key alone, upsert replaces its value, and
+ *       lookup gives a pointer that updates the value in place.
+ *    3. removed keys are gone and the rest are still there.
+ *    4. keys and values that are structs are hashed, compared and stored by
+ *       value, including keys that only differ in a field the hash ignores.
+ *    5. a small table doesn't grow before it's full.
+ */
+
+#define n (1000 * 1000)
+
+static inline uint64_t mix64(uint64_t k, uint64_t seed)
+{
+	k ^= seed;
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+	return k;
+}
+
+#define U64_EQ(a, b) ((a) == (b))
+
+CUCKOO_HTABLE_DEFINE(u64_table, uint64_t, uint64_t, mix64, U64_EQ)
+
+struct point {
+	int x;
+	int y;
+	/* not hashed, so points differing only here collide */
+	int tag;
+};
+
+struct stats {
+	double sum;
+	unsigned long count;
+};
+
+static inline uint64_t point_hash(struct point p, uint64_t seed)
+{
+	return mix64(((uint64_t)(uint32_t)p.x << 32) | (uint32_t)p.y, seed);
+}
+
+static inline bool point_eq(struct point a, struct point b)
+{
+	return a.x == b.x && a.y == b.y && a.tag == b.tag;
+}
+
+CUCKOO_HTABLE_DEFINE(point_table, struct point, struct stats, point_hash,
+		     point_eq)
+
+void test_u64()
+{
+	struct u64_table t;
+	uint64_t v, *p;
+
+	ASSERT_TRUE(u64_table_init(&t, 16), "init failed\n");
+	for (size_t i = 0; i < n; i++)
+		ASSERT_TRUE(u64_table_insert(&t, i * 7, i), "insert failed\n");
+	ASSERT_TRUE(t.nentries == n && t.capacity >= n,
+		    "table has the wrong size\n");
+
+	for (size_t i = 0; i < n; i++) {
+		ASSERT_TRUE(u64_table_get(&t, i * 7, &v) && v == i,
+			    "inserted key was lost\n");
+		ASSERT_FALSE(u64_table_get(&t, i * 7 + 1, &v),
+			     "found a key that wasn't inserted\n");
+	}
+
+	ASSERT_TRUE(u64_table_insert(&t, 0, 42) && u64_table_get(&t, 0, &v)
+		    && v == 0, "insert replaced a value\n");
+	ASSERT_TRUE(u64_table_upsert(&t, 0, 42) && u64_table_get(&t, 0, &v)
+		    && v == 42, "upsert didn't replace a value\n");
+	p = u64_table_lookup(&t, 7);
+	ASSERT_TRUE(p && *p == 1, "lookup failed\n");
+	*p = 99;
+	ASSERT_TRUE(u64_table_get(&t, 7, &v) && v == 99,
+		    "lookup pointer didn't update the value\n");
+	ASSERT_TRUE(t.nentries == n, "nentries changed\n");
+
+	for (size_t i = 0; i < n; i += 2)
+		ASSERT_TRUE(u64_table_remove(&t, i * 7, NULL),
+			    "remove failed\n");
+	ASSERT_FALSE(u64_table_remove(&t, 0, &v), "removed a key twice\n");
+	ASSERT_TRUE(t.nentries == n / 2, "nentries is wrong\n");
+	for (size_t i = 1; i < n; i += 2)
+		ASSERT_TRUE(u64_table_get(&t, i * 7, &v)
+			    && v == (i == 1 ? 99 : i),
+			    "remove took the wrong key\n");
+
+	u64_table_destroy(&t);
+
+	/* one bucket per array, which holds 4 keys with room to spare */
+	ASSERT_TRUE(u64_table_init(&t, 1), "init failed\n");
+	for (size_t i = 0; i < 4; i++)
+		ASSERT_TRUE(u64_table_insert(&t, i, i), "insert failed\n");
+	ASSERT_TRUE(t.capacity == 2 * CUCKOO_DEFINE_SLOTS,
+		    "small table grew early\n");
+	u64_table_destroy(&t);
+}
+
+void test_struct_keys()
+{
+	struct point_table t;
+	struct stats s, *sp;
+
+	ASSERT_TRUE(point_table_init(&t, 1000), "init failed\n");
+	for (int x = 0; x < 100; x++)
+		for (int y = 0; y < 100; y++)
+			for (int tag = 0; tag < 3; tag++) {
+				struct point p = {x, y, tag};
+				struct stats st = {x + y + tag, 1};
+
+				ASSERT_TRUE(point_table_insert(&t, p, st),
+					    "insert failed\n");
+			}
+	ASSERT_TRUE(t.nentries == 100 * 100 * 3, "nentries is wrong\n");
+
+	for (int x = 0; x < 100; x++)
+		for (int y = 0; y < 100; y++)
+			for (int tag = 0; tag < 3; tag++) {
+				struct point p = {x, y, tag};
+
+				memset(&s, 0, sizeof s);
+				ASSERT_TRUE(point_table_get(&t, p, &s)
+					    && s.sum == x + y + tag
+					    && s.count == 1,
+					    "struct value was lost\n");
+			}
+
+	struct point q = {3, 4, 1};
+	sp = point_table_lookup(&t, q);
+	ASSERT_TRUE(sp, "lookup failed\n");
+	sp->sum += 10;
+	sp->count++;
+	ASSERT_TRUE(point_table_get(&t, q, &s) && s.sum == 18 && s.count == 2,
+		    "update in place was lost\n");
+
+	ASSERT_TRUE(point_table_remove(&t, q, &s) && s.count == 2,
+		    "remove failed\n");
+	q.tag = 0;
+	ASSERT_TRUE(point_table_get(&t, q, &s) && s.sum == 7,
+		    "remove took a colliding key\n");
+
+	point_table_destroy(&t);
+}
+
+int main(void)
+{
+	srand(time(NULL));
+	REGISTER_TEST(test_u64);
+	REGISTER_TEST(test_struct_keys);
+	return run_all_tests();
+}
@@ -22,8 +22,12 @@
 
 #include "test.h"
 #include "cuckoo_htable.h"
+#include <fcntl.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
 
 /*
  * what needs to be tested:
@@ -42,6 +46,7 @@ struct value { int x; int y; };
 void print_stats(struct cuckoo_head *head)
 {
         printf("stat_resizes: %lu\n", head->stat_resizes);
+        printf("stat_shrinks: %lu\n", head->stat_shrinks);
         printf("stat_rehashes: %lu\n", head->stat_rehashes);
         printf("stat_rehash_fails: %lu\n", head->stat_rehash_fails);
         printf("stat_rehash_fails_max: %lu\n", head->stat_rehash_fails_max);
@@ -151,6 +156,104 @@ void test_insert_resize()
 	cuckoo_htable_destroy(&t);
 }
 
+/*
+ * filling a table to 93% of its slots, where it grows, shouldn't make it
+ * grow early, and the values moved around to make room should all still be
+ * there and right.
+ */
+void test_insert_high_load()
+{
+	CUCKOO_HASH_TABLE(t);
+	ASSERT_TRUE(cuckoo_htable_init(&t, n / 4), "init failed\n");
+	size_t fill = t.capacity * 93 / 100;
+
+	struct value *data = malloc(sizeof (struct value) * fill);
+	ASSERT_TRUE(data, "malloc barfed\n");
+
+	for (size_t i = 0; i < fill; i++)
+		ASSERT_TRUE(cuckoo_htable_insert(&t, i * 2654435761UL,
+						 &data[i]),
+			    "insert failed.\n");
+	ASSERT_TRUE(t.stat_resizes == 0, "table grew before its maximum load.\n");
+
+	for (size_t i = 0; i < fill; i++) {
+		const void *out = NULL;
+		ASSERT_TRUE(cuckoo_htable_get(&t, i * 2654435761UL, &out)
+			    && out == &data[i],
+			    "value was lost or clobbered at high load.\n");
+	}
+
+	print_stats(&t);
+	cuckoo_htable_destroy(&t);
+	free(data);
+
+	/* a tiny table shouldn't grow before it's even half full either */
+	CUCKOO_HASH_TABLE(small);
+	ASSERT_TRUE(cuckoo_htable_init(&small, 16), "init failed\n");
+	for (size_t i = 0; i < small.capacity / 2; i++)
+		ASSERT_TRUE(cuckoo_htable_insert(&small, i, &small),
+			    "insert failed.\n");
+	ASSERT_TRUE(small.stat_resizes == 0, "small table grew early.\n");
+	cuckoo_htable_destroy(&small);
+}
+
+/*
+ * with 3 or 4 hash functions the table should fill up further still, and
+ * everything should work the same way, through a resize and removals too.
+ */
+void test_ntables()
+{
+	/* where cuckoo_htable.c grows the table */
+	static const unsigned loads[] = {[2] = 93, [3] = 97, [4] = 98};
+	CUCKOO_HASH_TABLE(bad);
+
+	ASSERT_FALSE(cuckoo_htable_init_ntables(&bad, 16, 1),
+		     "init accepted 1 table.\n");
+	ASSERT_FALSE(cuckoo_htable_init_ntables(&bad, 16,
+						CUCKOO_HTABLE_MAX_TABLES + 1),
+		     "init accepted too many tables.\n");
+
+	for (unsigned d = 2; d <= CUCKOO_HTABLE_MAX_TABLES; d++) {
+		CUCKOO_HASH_TABLE(t);
+		ASSERT_TRUE(cuckoo_htable_init_ntables(&t, n / 16, d),
+			    "init failed\n");
+		size_t fill = t.capacity * loads[d] / 100;
+
+		struct value *data = malloc(sizeof (struct value) * 2 * fill);
+		ASSERT_TRUE(data, "malloc barfed\n");
+
+		for (size_t i = 0; i < fill; i++)
+			ASSERT_TRUE(cuckoo_htable_insert(&t, i, &data[i]),
+				    "insert failed.\n");
+		ASSERT_TRUE(t.stat_resizes == 0,
+			    "table grew before its maximum load.\n");
+
+		/* and past it, so it has to grow */
+		for (size_t i = fill; i < 2 * fill; i++)
+			ASSERT_TRUE(cuckoo_htable_insert(&t, i, &data[i]),
+				    "insert failed.\n");
+		ASSERT_TRUE(t.stat_resizes >= 1 && t.tables.ntables == d,
+			    "resize was wrong.\n");
+
+		for (size_t i = 0; i < 2 * fill; i++) {
+			const void *out = NULL;
+			ASSERT_TRUE(cuckoo_htable_get(&t, i, &out)
+				    && out == &data[i],
+				    "value was lost or clobbered.\n");
+		}
+		for (size_t i = 0; i < 2 * fill; i += 2)
+			ASSERT_TRUE(cuckoo_htable_remove(&t, i) == &data[i],
+				    "remove returned the wrong value.\n");
+		for (size_t i = 0; i < 2 * fill; i++)
+			ASSERT_TRUE(cuckoo_htable_exists(&t, i) == (i % 2 == 1),
+				    "exists was wrong after removing.\n");
+		ASSERT_TRUE(t.nentries == fill, "nentries was wrong.\n");
+
+		cuckoo_htable_destroy(&t);
+		free(data);
+	}
+}
+
 /*
  * 3. exists:
  *     - After inserting stuff, exists should return true for that key.
@@ -241,6 +344,75 @@ void test_remove()
 	free(data);
 }
 
+/*
+ * a table that grew and then lost most of its keys should shrink back, but
+ * not below its initial size, and not back and forth when keys come and go
+ * around one size.
+ */
+void test_shrink()
+{
+	CUCKOO_HASH_TABLE(t);
+	ASSERT_TRUE(cuckoo_htable_init(&t, 1024), "init failed\n");
+	unsigned long init_buckets = t.tables.table_buckets;
+	uint64_t out;
+
+	for (size_t i = 0; i < n; i++)
+		ASSERT_TRUE(cuckoo_htable_insert_u64(&t, i, i * 3),
+			    "insert failed.\n");
+	unsigned long grown = t.capacity;
+
+	/* nightly purge: all but a few percent of the keys go */
+	for (size_t i = n / 32; i < n; i++)
+		ASSERT_TRUE(cuckoo_htable_remove_u64(&t, i, &out)
+			    && out == i * 3, "remove failed.\n");
+	ASSERT_TRUE(t.stat_shrinks > 0 && t.capacity < grown / 4,
+		    "table didn't shrink.\n");
+	ASSERT_TRUE(t.nentries >= t.capacity / 8
+		    && t.nentries <= t.capacity / 2,
+		    "table shrunk to the wrong size.\n");
+	for (size_t i = 0; i < n / 32; i++)
+		ASSERT_TRUE(cuckoo_htable_get_u64(&t, i, &out)
+			    && out == i * 3,
+			    "key was lost in the shrink.\n");
+
+	/* churn around the current size doesn't resize */
+	unsigned long resizes = t.stat_resizes;
+	for (size_t j = 0; j < 16; j++) {
+		for (size_t i = n / 32; i < n / 16; i++)
+			ASSERT_TRUE(cuckoo_htable_insert_u64(&t, i, i),
+				    "insert failed.\n");
+		for (size_t i = n / 32; i < n / 16; i++)
+			ASSERT_TRUE(cuckoo_htable_remove_u64(&t, i, &out),
+				    "remove failed.\n");
+	}
+	ASSERT_TRUE(t.stat_resizes == resizes, "churn resized the table.\n");
+
+	/* and emptying it stops at the initial size */
+	for (size_t i = 0; i < n / 32; i++)
+		ASSERT_TRUE(cuckoo_htable_remove_u64(&t, i, &out),
+			    "remove failed.\n");
+	ASSERT_TRUE(t.nentries == 0 && t.tables.table_buckets == init_buckets,
+		    "table shrunk below its initial size.\n");
+
+	print_stats(&t);
+	cuckoo_htable_destroy(&t);
+
+	/* the shrink threshold isn't rounded down on small tables */
+	CUCKOO_HASH_TABLE(small);
+	ASSERT_TRUE(cuckoo_htable_init(&small, 16), "init failed\n");
+	init_buckets = small.tables.table_buckets;
+	for (size_t i = 0; i < 80; i++)
+		ASSERT_TRUE(cuckoo_htable_insert_u64(&small, i, i),
+			    "insert failed.\n");
+	ASSERT_TRUE(small.capacity == 128, "small table didn't grow.\n");
+	for (size_t i = 12; i < 80; i++)
+		ASSERT_TRUE(cuckoo_htable_remove_u64(&small, i, &out),
+			    "remove failed.\n");
+	ASSERT_TRUE(small.tables.table_buckets == init_buckets,
+		    "small table didn't shrink.\n");
+	cuckoo_htable_destroy(&small);
+}
+
 /*
  * 5. get:
  *     - After inserting an element, we should be able to get it out.
@@ -292,6 +464,344 @@ void test_get()
 	free(data);
 }
 
+/*
+ * 6. upsert and get_or_insert:
+ *     - upsert should insert new keys and replace the values of old ones,
+ *       handing back the old value.
+ *     - get_or_insert should hand back the value already in the table, or
+ *       insert the given one.
+ */
+void test_upsert()
+{
+	CUCKOO_HASH_TABLE(t);
+	ASSERT_TRUE(cuckoo_htable_init(&t, 16), "init failed\n");
+
+	struct value *data = malloc(sizeof (struct value) * 2 * n);
+	ASSERT_TRUE(data, "malloc barfed\n");
+
+	for (size_t i = 0; i < n; i++) {
+		const void *old = &data[0];
+		ASSERT_TRUE(cuckoo_htable_upsert(&t, i, &data[i], &old),
+			    "upsert failed.\n");
+		ASSERT_TRUE(old == &data[0], "upsert modified old for a new "
+			    "key.\n");
+	}
+	ASSERT_TRUE(t.nentries == n, "nentries was wrong after upserting.\n");
+
+	for (size_t i = 0; i < n; i++) {
+		const void *old = NULL, *val = NULL;
+		ASSERT_TRUE(cuckoo_htable_upsert(&t, i, &data[n + i], &old),
+			    "upsert failed.\n");
+		ASSERT_TRUE(old == &data[i], "upsert returned the wrong old "
+			    "value.\n");
+		ASSERT_TRUE(cuckoo_htable_get(&t, i, &val)
+			    && val == &data[n + i], "upsert didn't replace the "
+			    "value.\n");
+	}
+	ASSERT_TRUE(t.nentries == n, "replacing values changed nentries.\n");
+
+	/* NULL old is allowed */
+	ASSERT_TRUE(cuckoo_htable_upsert(&t, 0, NULL, NULL), "upsert failed.\n");
+
+	cuckoo_htable_destroy(&t);
+	free(data);
+}
+
+void test_get_or_insert()
+{
+	CUCKOO_HASH_TABLE(t);
+	ASSERT_TRUE(cuckoo_htable_init(&t, 16), "init failed\n");
+
+	struct value *data = malloc(sizeof (struct value) * 2 * n);
+	ASSERT_TRUE(data, "malloc barfed\n");
+
+	for (size_t i = 0; i < n; i++) {
+		const void *out = NULL;
+		ASSERT_TRUE(cuckoo_htable_get_or_insert(&t, i, &data[i], &out),
+			    "get_or_insert failed.\n");
+		ASSERT_TRUE(out == &data[i], "get_or_insert didn't return the "
+			    "inserted value.\n");
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		const void *out = NULL;
+		ASSERT_TRUE(cuckoo_htable_get_or_insert(&t, i, &data[n + i],
+							&out),
+			    "get_or_insert failed.\n");
+		ASSERT_TRUE(out == &data[i], "get_or_insert didn't return the "
+			    "existing value.\n");
+	}
+	ASSERT_TRUE(t.nentries == n, "nentries was wrong after "
+		    "get_or_insert.\n");
+
+	cuckoo_htable_destroy(&t);
+	free(data);
+}
+
+/*
+ * 7. integer values:
+ *     - any 64 bit value can be stored inline, including ones with the low
+ *       bits set, 0, and all ones, and they survive resizing.
+ *     - the u64 versions of upsert, get_or_insert and remove behave like the
+ *       pointer versions.
+ *     - pointers no longer have to be aligned.
+ */
+static uint64_t u64_val(size_t i)
+{
+	return i * 0x9e3779b97f4a7c15ULL;
+}
+
+void test_u64()
+{
+	CUCKOO_HASH_TABLE(t);
+	ASSERT_TRUE(cuckoo_htable_init(&t, 16), "init failed\n");
+
+	for (size_t i = 0; i < n; i++)
+		ASSERT_TRUE(cuckoo_htable_insert_u64(&t, i, u64_val(i)),
+			    "insert_u64 failed.\n");
+	ASSERT_TRUE(cuckoo_htable_insert_u64(&t, n, 0)
+		    && cuckoo_htable_insert_u64(&t, n + 1, UINT64_MAX),
+		    "insert_u64 failed.\n");
+	ASSERT_TRUE(t.stat_resizes > 0, "table didn't grow.\n");
+
+	for (size_t i = 0; i < n; i++) {
+		uint64_t out = 0;
+		ASSERT_TRUE(cuckoo_htable_get_u64(&t, i, &out)
+			    && out == u64_val(i),
+			    "get_u64 returned the wrong value.\n");
+	}
+	uint64_t out = 1;
+	ASSERT_TRUE(cuckoo_htable_get_u64(&t, n, &out) && out == 0,
+		    "0 wasn't stored.\n");
+	ASSERT_TRUE(cuckoo_htable_get_u64(&t, n + 1, &out)
+		    && out == UINT64_MAX, "all ones wasn't stored.\n");
+	ASSERT_FALSE(cuckoo_htable_get_u64(&t, n + 2, &out),
+		     "get_u64 found a key that isn't there.\n");
+
+	/* upsert reports the old value only when there was one */
+	out = 42;
+	ASSERT_TRUE(cuckoo_htable_upsert_u64(&t, 7, 1234, &out)
+		    && out == u64_val(7), "upsert_u64 old value was wrong.\n");
+	out = 42;
+	ASSERT_TRUE(cuckoo_htable_upsert_u64(&t, n + 2, 5, &out) && out == 42,
+		    "upsert_u64 touched old for a new key.\n");
+	ASSERT_TRUE(cuckoo_htable_get_or_insert_u64(&t, 7, 99, &out)
+		    && out == 1234, "get_or_insert_u64 didn't get.\n");
+	ASSERT_TRUE(cuckoo_htable_get_or_insert_u64(&t, n + 3, 99, &out)
+		    && out == 99, "get_or_insert_u64 didn't insert.\n");
+
+	ASSERT_TRUE(cuckoo_htable_remove_u64(&t, 7, &out) && out == 1234,
+		    "remove_u64 returned the wrong value.\n");
+	ASSERT_FALSE(cuckoo_htable_remove_u64(&t, 7, &out),
+		     "remove_u64 removed a key twice.\n");
+	ASSERT_TRUE(t.nentries == n + 3, "nentries was wrong.\n");
+
+	/* odd pointers go in and come out as they are */
+	static char buf[16];
+	const void *p = NULL;
+	ASSERT_TRUE(cuckoo_htable_upsert(&t, 8, buf + 1, NULL)
+		    && cuckoo_htable_get(&t, 8, &p) && p == buf + 1,
+		    "unaligned pointer was mangled.\n");
+
+	cuckoo_htable_destroy(&t);
+}
+
+/*
+ * multimaps:
+ *     - a key can have any number of values, including the same one twice,
+ *       and they all come back from get_all and the iterator, through
+ *       resizes.
+ *     - removing values one by one, down to one and then none, works.
+ *     - values too big to tag are refused.
+ */
+void test_multimap()
+{
+	CUCKOO_HASH_TABLE(t);
+	ASSERT_TRUE(cuckoo_htable_init(&t, 16), "init failed\n");
+	const size_t nkeys = n / 8;
+	uint64_t vals[64], v;
+	struct cuckoo_multi_iter it;
+
+	/* key i gets i % 20 values: 0, 10, 20, ... and an extra copy of 0 */
+	for (size_t i = 0; i < nkeys; i++)
+		for (size_t j = 0; j < i % 20; j++)
+			ASSERT_TRUE(cuckoo_htable_multi_insert(&t, i, j * 10),
+				    "multi_insert failed.\n");
+	for (size_t i = 0; i < nkeys; i += 20)
+		ASSERT_TRUE(cuckoo_htable_multi_insert(&t, i + 5, 0),
+			    "multi_insert failed.\n");
+	ASSERT_TRUE(t.stat_resizes > 0, "table didn't grow.\n");
+	ASSERT_TRUE(t.nentries == nkeys - nkeys / 20,
+		    "nentries should count keys.\n");
+	ASSERT_FALSE(cuckoo_htable_multi_insert(&t, 1, CUCKOO_HTABLE_MULTI_MAX
+						+ 1), "took an untaggable value.\n");
+
+	for (size_t i = 0; i < nkeys; i++) {
+		size_t count = i % 20 + (i % 20 == 5);
+		uint64_t sum = 0, want = 0;
+
+		ASSERT_TRUE(cuckoo_htable_get_all(&t, i, vals, 64) == count,
+			    "get_all returned the wrong count.\n");
+		for (size_t j = 0; j < count; j++)
+			sum += vals[j];
+		for (size_t j = 0; j < i % 20; j++)
+			want += j * 10;
+		ASSERT_TRUE(sum == want, "get_all returned wrong values.\n");
+
+		cuckoo_htable_multi_iter_init(&t, i, &it);
+		for (sum = 0; cuckoo_htable_multi_iter_next(&it, &v);
+		     count--)
+			sum += v;
+		ASSERT_TRUE(count == 0 && sum == want,
+			    "iterator returned wrong values.\n");
+		ASSERT_TRUE(cuckoo_htable_multi_get(&t, i, &v) == (i % 20 != 0),
+			    "multi_get was wrong.\n");
+	}
+	ASSERT_TRUE(cuckoo_htable_get_all(&t, 7, vals, 2) == 7,
+		    "get_all didn't report the full count.\n");
+
+	/* key 3 has 0, 10 and 20: take them away one at a time */
+	ASSERT_FALSE(cuckoo_htable_multi_remove(&t, 3, 30),
+		     "removed a value the key doesn't have.\n");
+	ASSERT_TRUE(cuckoo_htable_multi_remove(&t, 3, 10)
+		    && cuckoo_htable_multi_remove(&t, 3, 0),
+		    "multi_remove failed.\n");
+	ASSERT_TRUE(cuckoo_htable_get_all(&t, 3, vals, 64) == 1
+		    && vals[0] == 20, "the last value is wrong.\n");
+	ASSERT_FALSE(cuckoo_htable_multi_remove(&t, 3, 0),
+		     "removed a value twice.\n");
+	ASSERT_TRUE(cuckoo_htable_multi_remove(&t, 3, 20)
+		    && !cuckoo_htable_exists(&t, 3),
+		    "key outlived its values.\n");
+
+	ASSERT_TRUE(cuckoo_htable_multi_remove_all(&t, 19) == 19
+		    && cuckoo_htable_multi_remove_all(&t, 1) == 1
+		    && cuckoo_htable_multi_remove_all(&t, 1) == 0,
+		    "multi_remove_all returned the wrong count.\n");
+	ASSERT_TRUE(cuckoo_htable_get_all(&t, 19, vals, 64) == 0,
+		    "key survived multi_remove_all.\n");
+
+	cuckoo_htable_multi_destroy(&t);
+}
+
+/*
+ * a table resized and rehashed from several threads should end up with
+ * exactly the same contents as one done on a single thread.
+ */
+void test_parallel_resize()
+{
+	CUCKOO_HASH_TABLE(t);
+	t.resize_threads = 4;
+	ASSERT_TRUE(cuckoo_htable_init_ntables(&t, 1 << 16, 3),
+		    "init failed\n");
+	uint64_t out;
+
+	for (size_t i = 0; i < n; i++)
+		ASSERT_TRUE(cuckoo_htable_insert_u64(&t, i, i ^ 0xabcd),
+			    "insert failed.\n");
+	ASSERT_TRUE(t.stat_resizes > 0 && t.nentries == n,
+		    "table didn't grow.\n");
+	ASSERT_TRUE(cuckoo_htable_resize(&t, true), "resize failed.\n");
+	for (size_t i = 0; i < n; i++)
+		ASSERT_TRUE(cuckoo_htable_get_u64(&t, i, &out)
+			    && out == (i ^ 0xabcd), "value was lost.\n");
+
+	for (size_t i = 0; i < n; i++)
+		if (i % 16 != 1)
+			ASSERT_TRUE(cuckoo_htable_remove_u64(&t, i, &out),
+				    "remove failed.\n");
+	ASSERT_TRUE(t.stat_shrinks > 0, "table didn't shrink.\n");
+	for (size_t i = 0; i < n; i++)
+		ASSERT_TRUE(cuckoo_htable_exists(&t, i) == (i % 16 == 1),
+			    "shrink lost a key.\n");
+
+	print_stats(&t);
+	cuckoo_htable_destroy(&t);
+}
+
+/*
+ * a table in a file:
+ *     - survives being closed and opened again, through resizes, with its
+ *       contents and entry count.
+ *     - survives its process dying without closing it.
+ *     - can't be opened twice at once, and a file that isn't a table can't
+ *       be opened at all.
+ */
+void test_file()
+{
+	char path[] = "/tmp/cuckoo_htable_test.XXXXXX";
+	int fd = mkstemp(path);
+	uint64_t out;
+	pid_t pid;
+	int status;
+
+	ASSERT_TRUE(fd >= 0, "mkstemp failed\n");
+	ASSERT_TRUE(write(fd, "not a table", 11) == 11, "write failed\n");
+	close(fd);
+	CUCKOO_HASH_TABLE(junk);
+	ASSERT_FALSE(cuckoo_htable_open_file(&junk, path),
+		     "opened a file that isn't a table.\n");
+
+	CUCKOO_HASH_TABLE(t);
+	ASSERT_TRUE(cuckoo_htable_create_file(&t, path, 16, 3),
+		    "create_file failed\n");
+	for (size_t i = 0; i < n / 4; i++)
+		ASSERT_TRUE(cuckoo_htable_insert_u64(&t, i, i * 3),
+			    "insert failed.\n");
+	ASSERT_TRUE(t.stat_resizes > 0, "table didn't grow.\n");
+	ASSERT_TRUE(cuckoo_htable_checkpoint(&t), "checkpoint failed\n");
+
+	CUCKOO_HASH_TABLE(other);
+	ASSERT_FALSE(cuckoo_htable_open_file(&other, path),
+		     "table was opened twice.\n");
+	cuckoo_htable_destroy(&t);
+
+	ASSERT_TRUE(cuckoo_htable_open_file(&t, path), "open_file failed\n");
+	ASSERT_TRUE(t.nentries == n / 4 && t.tables.ntables == 3,
+		    "table came back wrong.\n");
+	for (size_t i = 0; i < n / 4; i++)
+		ASSERT_TRUE(cuckoo_htable_get_u64(&t, i, &out) && out == i * 3,
+			    "value was lost.\n");
+
+	cuckoo_htable_destroy(&t);
+
+	/* a process dies with the table open, after changing it */
+	fflush(stdout);
+	pid = fork();
+	ASSERT_TRUE(pid >= 0, "fork failed\n");
+	if (pid == 0) {
+		if (!cuckoo_htable_open_file(&t, path))
+			_exit(1);
+		for (size_t i = 0; i < n / 8; i++)
+			cuckoo_htable_remove_u64(&t, i, &out);
+		cuckoo_htable_insert_u64(&t, n, 42);
+		_exit(0);
+	}
+	ASSERT_TRUE(waitpid(pid, &status, 0) == pid && WIFEXITED(status)
+		    && WEXITSTATUS(status) == 0, "child failed\n");
+
+	ASSERT_TRUE(cuckoo_htable_open_file(&t, path), "open_file failed\n");
+	ASSERT_TRUE(t.nentries == n / 4 - n / 8 + 1,
+		    "entries weren't recounted.\n");
+	ASSERT_TRUE(cuckoo_htable_get_u64(&t, n, &out) && out == 42,
+		    "value was lost.\n");
+	for (size_t i = 0; i < n / 4; i++)
+		ASSERT_TRUE(cuckoo_htable_exists(&t, i) == (i >= n / 8),
+			    "removal was lost.\n");
+
+	print_stats(&t);
+	cuckoo_htable_destroy(&t);
+
+	/* a header whose min_buckets is past the table size is refused */
+	uint64_t min_buckets = UINT64_MAX;
+	fd = open(path, O_RDWR);
+	ASSERT_TRUE(fd >= 0 && pwrite(fd, &min_buckets, sizeof min_buckets, 40)
+		    == sizeof min_buckets, "pwrite failed\n");
+	close(fd);
+	ASSERT_FALSE(cuckoo_htable_open_file(&t, path),
+		     "opened a table with a bad min_buckets.\n");
+	unlink(path);
+}
 
 int main(void) 
 {
@@ -300,9 +810,18 @@ int main(void)
 	REGISTER_TEST(test_insert_same);
 	REGISTER_TEST(test_insert_noresize);
 	REGISTER_TEST(test_insert_resize);
+	REGISTER_TEST(test_insert_high_load);
+	REGISTER_TEST(test_ntables);
 	REGISTER_TEST(test_exists);
 	REGISTER_TEST(test_remove);
+	REGISTER_TEST(test_shrink);
 	REGISTER_TEST(test_get);
+	REGISTER_TEST(test_upsert);
+	REGISTER_TEST(test_get_or_insert);
+	REGISTER_TEST(test_u64);
+	REGISTER_TEST(test_multimap);
+	REGISTER_TEST(test_parallel_resize);
+	REGISTER_TEST(test_file);
 	return run_all_tests();
 }
 
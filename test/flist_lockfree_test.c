@@ -0,0 +1,223 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file flist_lockfree_test.c
+ *
+ * \author Eric Mueller
+ *
+ * \brief Tests for the lock-free stack and queue in flist_lockfree.h
+ */
+
+#include "flist_lockfree.h"
+#include "test.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NTHREADS 4
+#define PER_THREAD 100000
+#define NITEMS (NTHREADS * PER_THREAD)
+
+struct item {
+	unsigned long id;
+	unsigned long producer;
+	struct flist link;
+};
+
+static struct item *alloc_items(unsigned long nr)
+{
+	struct item *items = calloc(nr, sizeof *items);
+	unsigned long i;
+
+	ASSERT_TRUE(items, "calloc barfed\n");
+	for (i = 0; i < nr; i++) {
+		items[i].id = i;
+		items[i].producer = i / PER_THREAD;
+	}
+	return items;
+}
+
+/* single threaded sanity: lifo order, empty pops, pop_all */
+void test_stack_single()
+{
+	FLIST_STACK(s, struct item, link);
+	FLIST_HEAD(drained, struct item, link);
+	struct item *items = alloc_items(1000);
+	struct item *it;
+	unsigned long i;
+
+	ASSERT_TRUE(flist_stack_empty(&s), "new stack was not empty\n");
+	ASSERT_TRUE(flist_stack_pop(&s) == NULL,
+		    "pop from empty stack returned something\n");
+
+	for (i = 0; i < 1000; i++)
+		flist_stack_push(&s, &items[i]);
+	for (i = 1000; i-- > 500; ) {
+		it = flist_stack_pop(&s);
+		ASSERT_TRUE(it == &items[i], "stack was not lifo\n");
+	}
+
+	flist_stack_pop_all(&s, &drained);
+	ASSERT_TRUE(flist_stack_empty(&s), "stack not empty after pop_all\n");
+	ASSERT_TRUE(drained.length == 500, "pop_all lost elements\n");
+
+	/* bottom of the stack ends up first */
+	i = 0;
+	for (it = flist_first(&drained); it; it = flist_next(&drained, it))
+		ASSERT_TRUE(it == &items[i++], "pop_all order was wrong\n");
+
+	free(items);
+}
+
+static struct flist_stack g_stack;
+
+/* each thread repeatedly pops something and pushes it back */
+static void *stack_churn(void *arg)
+{
+	unsigned long i;
+	(void)arg;
+
+	for (i = 0; i < PER_THREAD; i++) {
+		struct item *it = flist_stack_pop(&g_stack);
+		if (it)
+			flist_stack_push(&g_stack, it);
+	}
+	return NULL;
+}
+
+/* concurrent push/pop must neither lose nor duplicate elements */
+void test_stack_concurrent()
+{
+	pthread_t threads[NTHREADS];
+	struct item *items = alloc_items(NTHREADS * 8);
+	unsigned char *seen = calloc(NTHREADS * 8, 1);
+	struct item *it;
+	unsigned long i, count = 0;
+	bool dup = false;
+
+	g_stack = FLIST_STACK_INITIALIZER(struct item, link);
+	for (i = 0; i < NTHREADS * 8; i++)
+		flist_stack_push(&g_stack, &items[i]);
+
+	for (i = 0; i < NTHREADS; i++)
+		pthread_create(&threads[i], NULL, stack_churn, NULL);
+	for (i = 0; i < NTHREADS; i++)
+		pthread_join(threads[i], NULL);
+
+	while ((it = flist_stack_pop(&g_stack))) {
+		dup |= seen[it->id];
+		seen[it->id] = 1;
+		count++;
+	}
+	ASSERT_FALSE(dup, "stack duplicated an element\n");
+	ASSERT_TRUE(count == NTHREADS * 8, "stack lost elements\n");
+
+	free(seen);
+	free(items);
+}
+
+/* single threaded sanity: fifo order, empty pops, re-pushing popped nodes */
+void test_mpsc_single()
+{
+	FLIST_MPSC(q, struct item, link);
+	struct item *items = alloc_items(1000);
+	struct item *it;
+	unsigned long i;
+
+	ASSERT_TRUE(flist_mpsc_empty(&q), "new queue was not empty\n");
+	ASSERT_TRUE(flist_mpsc_pop(&q) == NULL,
+		    "pop from empty queue returned something\n");
+
+	for (i = 0; i < 1000; i++)
+		flist_mpsc_push(&q, &items[i]);
+	for (i = 0; i < 1000; i++) {
+		it = flist_mpsc_pop(&q);
+		ASSERT_TRUE(it == &items[i], "queue was not fifo\n");
+		if (i % 3 == 0)
+			flist_mpsc_push(&q, it);
+	}
+	for (i = 0; i < 1000; i += 3) {
+		it = flist_mpsc_pop(&q);
+		ASSERT_TRUE(it == &items[i], "re-pushed items out of order\n");
+	}
+	ASSERT_TRUE(flist_mpsc_pop(&q) == NULL, "queue had extra elements\n");
+	ASSERT_TRUE(flist_mpsc_empty(&q), "drained queue was not empty\n");
+
+	free(items);
+}
+
+struct producer_arg {
+	struct flist_mpsc *q;
+	struct item *items;
+};
+
+static void *mpsc_produce(void *arg)
+{
+	struct producer_arg *pa = arg;
+	unsigned long i;
+
+	for (i = 0; i < PER_THREAD; i++)
+		flist_mpsc_push(pa->q, &pa->items[i]);
+	return NULL;
+}
+
+/* concurrent producers: everything arrives, per-producer order is kept */
+void test_mpsc_concurrent()
+{
+	struct flist_mpsc q;
+	pthread_t threads[NTHREADS];
+	struct producer_arg args[NTHREADS];
+	struct item *items = alloc_items(NITEMS);
+	unsigned long last[NTHREADS];
+	unsigned long i, got = 0;
+	bool in_order = true;
+
+	flist_mpsc_init(&q, offsetof(struct item, link));
+	memset(last, 0, sizeof last);
+
+	for (i = 0; i < NTHREADS; i++) {
+		args[i] = (struct producer_arg){&q, &items[i * PER_THREAD]};
+		pthread_create(&threads[i], NULL, mpsc_produce, &args[i]);
+	}
+
+	while (got < NITEMS) {
+		struct item *it = flist_mpsc_pop(&q);
+		unsigned long seq;
+
+		if (!it)
+			continue;
+		seq = it->id - it->producer * PER_THREAD + 1;
+		in_order &= seq == last[it->producer] + 1;
+		last[it->producer] = seq;
+		got++;
+	}
+
+	for (i = 0; i < NTHREADS; i++)
+		pthread_join(threads[i], NULL);
+
+	ASSERT_TRUE(in_order, "queue reordered a producer's elements\n");
+	ASSERT_TRUE(flist_mpsc_pop(&q) == NULL, "queue had extra elements\n");
+
+	free(items);
+}
+
+int main(void)
+{
+	REGISTER_TEST(test_stack_single);
+	REGISTER_TEST(test_stack_concurrent);
+	REGISTER_TEST(test_mpsc_single);
+	REGISTER_TEST(test_mpsc_concurrent);
+	return run_all_tests();
+}
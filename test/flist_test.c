@@ -312,6 +312,198 @@ void test_flist_for_each_range()
 	flist_for_each_range(&test_list, &free, flist_first(&test_list), NULL);
 }
 
+/* sort */
+static long point_x_cmp(void *lhs, void *rhs)
+{
+	int lx = ((struct point_t *)lhs)->x;
+	int rx = ((struct point_t *)rhs)->x;
+	return (lx > rx) - (lx < rx);
+}
+
+/* order by x, then by y, which the tests set to the original position */
+static int point_xy_qsort_cmp(const void *lhs, const void *rhs)
+{
+	const struct point_t *l = lhs, *r = rhs;
+	if (l->x != r->x)
+		return (l->x > r->x) - (l->x < r->x);
+	return (l->y > r->y) - (l->y < r->y);
+}
+
+/* fill a list from control, in order */
+static void build_list(struct point_t *control, struct flist_head *hd, size_t size)
+{
+	for (size_t i = size; i > 0; i--)
+		flist_push_front(hd, copy_point(&control[i - 1]));
+}
+
+/*
+ * sort copies of control with flist_sort and check them against qsort. y
+ * records the original position so qsort can reproduce a stable sort.
+ */
+static void check_sort(struct point_t *control, size_t size, const char *msg)
+{
+	FLIST_HEAD(tlist, struct point_t, l);
+
+	for (size_t i = 0; i < size; i++)
+		control[i].y = (int)i;
+	build_list(control, &tlist, size);
+	flist_sort(&tlist, &point_x_cmp);
+	qsort(control, size, sizeof *control, &point_xy_qsort_cmp);
+	assert_equal(control, &tlist, size, msg);
+
+	flist_for_each(&tlist, &free);
+}
+
+void test_flist_sort()
+{
+	INIT_TEST_DATA(control, tlist, data_length);
+
+	/* random, then with lots of duplicates */
+	check_sort(control, data_length,
+		   "test_flist_sort: random list was sorted wrong.\n");
+	for (size_t i = 0; i < data_length; i++)
+		control[i].x %= 16;
+	check_sort(control, data_length,
+		   "test_flist_sort: sort with duplicates was wrong or"
+		   " unstable.\n");
+
+	/* already sorted and reversed */
+	for (size_t i = 0; i < data_length; i++)
+		control[i].x = (int)i;
+	check_sort(control, data_length,
+		   "test_flist_sort: sorted list was sorted wrong.\n");
+	for (size_t i = 0; i < data_length; i++)
+		control[i].x = (int)(data_length - i);
+	check_sort(control, data_length,
+		   "test_flist_sort: reversed list was sorted wrong.\n");
+
+	/* empty and short lists, including the non power of two lengths */
+	flist_sort(&tlist, &point_x_cmp);
+	ASSERT_TRUE(tlist.length == 0 && flist_first(&tlist) == NULL,
+		    "test_flist_sort: sorting an empty list changed it.\n");
+	for (size_t n = 1; n < 20; n++) {
+		gen_test_data(control, n);
+		check_sort(control, n,
+			   "test_flist_sort: short list was sorted wrong.\n");
+	}
+}
+
+/* merge */
+void test_flist_merge()
+{
+	INIT_TEST_DATA(control, tlist, data_length);
+	FLIST_HEAD(mergee, struct point_t, l);
+	size_t half = data_length / 2;
+
+	for (size_t i = 0; i < data_length; i++) {
+		control[i].x %= 1000;
+		control[i].y = (int)i;
+	}
+	qsort(control, half, sizeof *control, &point_xy_qsort_cmp);
+	qsort(control + half, data_length - half, sizeof *control,
+	      &point_xy_qsort_cmp);
+	build_list(control, &tlist, half);
+	build_list(control + half, &mergee, data_length - half);
+
+	flist_merge(&tlist, &mergee, &point_x_cmp);
+	ASSERT_TRUE(mergee.length == 0 && flist_first(&mergee) == NULL,
+		    "test_flist_merge: mergee was not empty.\n");
+
+	/* y is the original position, so ties go to tlist as they should */
+	qsort(control, data_length, sizeof *control, &point_xy_qsort_cmp);
+	assert_equal(control, &tlist, data_length,
+		     "test_flist_merge: merged list was wrong.\n");
+
+	/* merging an empty list is a no-op, and into one is a move */
+	flist_merge(&tlist, &mergee, &point_x_cmp);
+	assert_equal(control, &tlist, data_length,
+		     "test_flist_merge: merging an empty list changed the"
+		     " list.\n");
+	flist_merge(&mergee, &tlist, &point_x_cmp);
+	assert_equal(control, &mergee, data_length,
+		     "test_flist_merge: merge into an empty list was"
+		     " wrong.\n");
+
+	flist_for_each(&mergee, &free);
+}
+
+/* prefetching iteration */
+void test_flist_for_each_prefetch()
+{
+	INIT_TEST_DATA(control, tlist, data_length);
+	static const unsigned long distances[] = {0, 1, 8, data_length * 2};
+	size_t i;
+
+	build_list(control, &tlist, data_length);
+	for (size_t d = 0; d < sizeof distances / sizeof distances[0]; d++) {
+		i = 0;
+		flist_for_each_prefetch(&tlist, struct point_t, p, distances[d]) {
+			ASSERT_TRUE(i < data_length && point_equal(p, &control[i]),
+				    "test_flist_for_each_prefetch: visited the"
+				    " wrong element.\n");
+			i++;
+		}
+		ASSERT_TRUE(i == data_length, "test_flist_for_each_prefetch:"
+			    " did not visit every element.\n");
+	}
+
+	/* the distance is evaluated once */
+	i = 0;
+	flist_for_each_prefetch(&tlist, struct point_t, p, i++)
+		(void)p;
+	ASSERT_TRUE(i == 1, "test_flist_for_each_prefetch: distance was"
+		    " evaluated more than once.\n");
+
+	/* break works, and freeing the current element is safe */
+	i = 0;
+	flist_for_each_prefetch(&tlist, struct point_t, p, 4) {
+		if (++i == 10)
+			break;
+	}
+	ASSERT_TRUE(i == 10, "test_flist_for_each_prefetch: break did not"
+		    " stop the loop.\n");
+	flist_for_each_prefetch(&tlist, struct point_t, p, 4)
+		free(p);
+}
+
+/* batch visiting */
+struct batch_state {
+	struct point_t *control;
+	size_t seen;
+	size_t k;
+	bool ok;
+};
+
+static void check_batch(void **batch, size_t n, void *private)
+{
+	struct batch_state *st = private;
+
+	st->ok &= n > 0 && n <= st->k;
+	for (size_t i = 0; i < n; i++) {
+		st->ok &= point_equal(batch[i], &st->control[st->seen++]);
+		free(batch[i]);
+	}
+}
+
+void test_flist_for_each_batch()
+{
+	INIT_TEST_DATA(control, tlist, data_length);
+	static const size_t ks[] = {1, 7, 64, data_length, data_length + 1};
+	void *buf[data_length + 1];
+
+	for (size_t j = 0; j < sizeof ks / sizeof ks[0]; j++) {
+		struct batch_state st = {control, 0, ks[j], true};
+
+		FLIST_HEAD(blist, struct point_t, l);
+		build_list(control, &blist, data_length);
+		/* check_batch frees everything */
+		flist_for_each_batch(&blist, buf, ks[j], &check_batch, &st);
+		ASSERT_TRUE(st.ok && st.seen == data_length,
+			    "test_flist_for_each_batch: batches were wrong.\n");
+	}
+	(void)tlist;
+}
+
 int main(int argc, char **argv)
 {
 	(void)argc;
@@ -325,5 +517,9 @@ int main(int argc, char **argv)
 	REGISTER_TEST(test_flist_pop_front_many);
 	REGISTER_TEST(test_flist_splice);
 	REGISTER_TEST(test_flist_for_each_range);
+	REGISTER_TEST(test_flist_sort);
+	REGISTER_TEST(test_flist_merge);
+	REGISTER_TEST(test_flist_for_each_prefetch);
+	REGISTER_TEST(test_flist_for_each_batch);
 	return run_all_tests();
 }
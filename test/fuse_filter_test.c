@@ -0,0 +1,167 @@
+/*
+ * Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file fuse_filter_test.c
+ *
+ * \author Eric Mueller
+ *
+ * \brief Tests for the filter defined in fuse_filter.h
+ */
+
+#include "test.h"
+#include "fuse_filter.h"
+#include "pcg_variants.h"
+#include <stdlib.h>
+
+#define NKEYS (1 << 20)
+#define FALSEP_SLACK 1.2
+
+static uint64_t *random_keys(size_t n)
+{
+	uint64_t *keys = malloc(n * sizeof *keys);
+
+	ASSERT_TRUE(keys, "couldn't allocate keys\n");
+	for (size_t i = 0; i < n; i++)
+		keys[i] = pcg64_random();
+	return keys;
+}
+
+static void check_filter(unsigned bits)
+{
+	FUSE_FILTER(f, bits);
+	uint64_t *keys = random_keys(NKEYS);
+	size_t false_pos = 0;
+	bool ok = true;
+
+	ASSERT_TRUE(fuse_filter_build(&f, keys, NKEYS), "build failed\n");
+	ASSERT_TRUE(f.array_length < NKEYS * 1.15, "filter was too big\n");
+	for (size_t i = 0; i < NKEYS; i++)
+		ok &= fuse_filter_query(&f, keys[i]);
+	ASSERT_TRUE(ok, "query returned false for a key in the filter\n");
+
+	for (size_t i = 0; i < NKEYS; i++)
+		false_pos += fuse_filter_query(&f, pcg64_random());
+	ASSERT_TRUE((double)false_pos / NKEYS
+		    < FALSEP_SLACK / (1 << bits) + 1e-5,
+		    "got too many false positives\n");
+
+	fuse_filter_destroy(&f);
+	ASSERT_TRUE(f.fingerprints == NULL, "destroy didn't free\n");
+	free(keys);
+}
+
+void test_query()
+{
+	check_filter(8);
+	check_filter(16);
+}
+
+void test_small()
+{
+	uint64_t *keys = random_keys(100);
+	bool ok = true;
+
+	for (size_t n = 0; n <= 100; n++) {
+		FUSE_FILTER(f, 16);
+
+		ok &= fuse_filter_build(&f, keys, n);
+		for (size_t i = 0; i < n; i++)
+			ok &= fuse_filter_query(&f, keys[i]);
+		fuse_filter_destroy(&f);
+	}
+	ASSERT_TRUE(ok, "a small filter failed\n");
+	free(keys);
+}
+
+void test_repeats()
+{
+	FUSE_FILTER(f, 8);
+	uint64_t *keys = random_keys(NKEYS);
+	bool ok = true;
+
+	/* every key twice, and a few a lot more */
+	for (size_t i = NKEYS / 2; i < NKEYS; i++)
+		keys[i] = keys[i - NKEYS / 2];
+	for (size_t i = 0; i < 1000; i++)
+		keys[i] = keys[0];
+
+	ASSERT_TRUE(fuse_filter_build(&f, keys, NKEYS), "build failed\n");
+	for (size_t i = 0; i < NKEYS; i++)
+		ok &= fuse_filter_query(&f, keys[i]);
+	ASSERT_TRUE(ok, "query returned false for a key in the filter\n");
+	fuse_filter_destroy(&f);
+	free(keys);
+}
+
+void test_bad_params()
+{
+	FUSE_FILTER(f, 12);
+	uint64_t key = 1;
+
+	ASSERT_FALSE(fuse_filter_build(&f, &key, 1),
+		     "built a filter with 12 bit fingerprints\n");
+}
+
+void test_serialize()
+{
+	FUSE_FILTER(f, 16);
+	FUSE_FILTER(g, 8);
+	uint64_t *keys = random_keys(10000);
+	size_t len;
+	uint8_t *buf;
+	bool ok = true;
+
+	ASSERT_TRUE(fuse_filter_build(&f, keys, 10000), "build failed\n");
+	len = fuse_filter_serialized_size(&f);
+	buf = malloc(len);
+	fuse_filter_serialize(&f, buf);
+
+	ASSERT_TRUE(fuse_filter_deserialize(&g, buf, len),
+		    "deserialize failed\n");
+	ASSERT_TRUE(g.bits == 16 && g.seed == f.seed
+		    && g.array_length == f.array_length,
+		    "deserialized filter had the wrong parameters\n");
+	for (size_t i = 0; i < 10000; i++) {
+		uint64_t other = pcg64_random();
+
+		ok &= fuse_filter_query(&g, keys[i]);
+		ok &= fuse_filter_query(&g, other)
+			== fuse_filter_query(&f, other);
+	}
+	ASSERT_TRUE(ok, "deserialized filter answered differently\n");
+	fuse_filter_destroy(&g);
+
+	ASSERT_FALSE(fuse_filter_deserialize(&g, buf, len - 1),
+		     "deserialized a truncated filter\n");
+	buf[0] ^= 1;
+	ASSERT_FALSE(fuse_filter_deserialize(&g, buf, len),
+		     "deserialized a filter with a bad magic number\n");
+
+	fuse_filter_destroy(&f);
+	free(buf);
+	free(keys);
+}
+
+int main(void)
+{
+	pcg64_srandom(42u, 54u);
+	REGISTER_TEST(test_query);
+	REGISTER_TEST(test_small);
+	REGISTER_TEST(test_repeats);
+	REGISTER_TEST(test_bad_params);
+	REGISTER_TEST(test_serialize);
+	return run_all_tests();
+}
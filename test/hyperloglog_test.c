@@ -0,0 +1,182 @@
+/*
+ * Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file hyperloglog_test.c
+ *
+ * \author Eric Mueller
+ *
+ * \brief Tests for the sketch defined in hyperloglog.h
+ */
+
+#include "test.h"
+#include "hyperloglog.h"
+#include <math.h>
+#include <stdlib.h>
+
+/* 4 standard errors at the default precision */
+#define DENSE_ERR (4 * 1.04 / 128)
+
+static double rel_err(double est, double real)
+{
+	return fabs(est - real) / real;
+}
+
+void test_init_destroy()
+{
+	HYPERLOGLOG(h, HYPERLOGLOG_P_DEFAULT);
+	HYPERLOGLOG(tiny, 0);
+
+	ASSERT_TRUE(hyperloglog_init(&h), "init failed\n");
+	ASSERT_TRUE(h.sparse && !h.regs, "new sketch wasn't sparse\n");
+	ASSERT_TRUE(hyperloglog_count(&h) == 0, "empty sketch had a count\n");
+	hyperloglog_destroy(&h);
+	ASSERT_TRUE(!h.sparse && !h.regs, "destroy didn't free everything\n");
+
+	/* too small to have a sparse mode */
+	ASSERT_TRUE(hyperloglog_init(&tiny), "init failed\n");
+	ASSERT_TRUE(tiny.p == HYPERLOGLOG_P_MIN && tiny.regs,
+		    "precision wasn't clamped\n");
+	ASSERT_TRUE(hyperloglog_count(&tiny) == 0,
+		    "empty sketch had a count\n");
+	for (uint64_t i = 0; i < 1000; i++)
+		hyperloglog_insert(&tiny, i);
+	/* 16 registers are too few for anything but a rough estimate */
+	ASSERT_TRUE(hyperloglog_count(&tiny) > 0
+		    && hyperloglog_count(&tiny) < 4000,
+		    "estimate was way off\n");
+	hyperloglog_destroy(&tiny);
+}
+
+/* estimates stay accurate through the switch from sparse to dense */
+void test_accuracy()
+{
+	static const unsigned long checks[] = {
+		1, 10, 100, 1000, 3000, 10000, 30000, 100000, 1000000
+	};
+	HYPERLOGLOG(h, HYPERLOGLOG_P_DEFAULT);
+	unsigned c = 0;
+
+	ASSERT_TRUE(hyperloglog_init(&h), "init failed\n");
+	for (uint64_t i = 1; i <= 1000000; i++) {
+		ASSERT_TRUE(hyperloglog_insert(&h, i), "insert failed\n");
+		if (i != checks[c])
+			continue;
+		c++;
+		if (h.sparse)
+			ASSERT_TRUE(rel_err(hyperloglog_count(&h), i) < 0.01,
+				    "sparse estimate was off\n");
+		else
+			ASSERT_TRUE(rel_err(hyperloglog_count(&h), i)
+				    < DENSE_ERR, "dense estimate was off\n");
+	}
+	ASSERT_TRUE(h.regs && !h.sparse, "sketch never went dense\n");
+
+	/* duplicates don't count */
+	for (uint64_t i = 1; i <= 1000; i++)
+		hyperloglog_insert(&h, i);
+	ASSERT_TRUE(rel_err(hyperloglog_count(&h), 1000000) < DENSE_ERR,
+		    "duplicates changed the estimate\n");
+	hyperloglog_destroy(&h);
+}
+
+static void check_union(uint64_t n0, uint64_t n1)
+{
+	HYPERLOGLOG(h0, HYPERLOGLOG_P_DEFAULT);
+	HYPERLOGLOG(h1, HYPERLOGLOG_P_DEFAULT);
+	HYPERLOGLOG(all, HYPERLOGLOG_P_DEFAULT);
+	HYPERLOGLOG(into, HYPERLOGLOG_P_DEFAULT);
+
+	ASSERT_TRUE(hyperloglog_init(&h0), "init failed\n");
+	ASSERT_TRUE(hyperloglog_init_from(&h1, &h0), "init_from failed\n");
+	ASSERT_TRUE(hyperloglog_init_from(&all, &h0), "init_from failed\n");
+	/* the sets overlap by half of the smaller one */
+	for (uint64_t i = 0; i < n0; i++) {
+		hyperloglog_insert(&h0, i);
+		hyperloglog_insert(&all, i);
+	}
+	for (uint64_t i = n0 - n0 / 2; i < n0 - n0 / 2 + n1; i++) {
+		hyperloglog_insert(&h1, i);
+		hyperloglog_insert(&all, i);
+	}
+
+	/* into uninitialized; the result is just like one sketch */
+	ASSERT_TRUE(hyperloglog_union(&into, &h0, &h1), "union failed\n");
+	ASSERT_TRUE(hyperloglog_count(&into) == hyperloglog_count(&all),
+		    "union differed from inserting everything\n");
+
+	/* in place, both ways around */
+	ASSERT_TRUE(hyperloglog_union(&h1, &h0, &h1), "union failed\n");
+	ASSERT_TRUE(hyperloglog_count(&h1) == hyperloglog_count(&all),
+		    "in place union differed\n");
+	ASSERT_TRUE(hyperloglog_union(&h0, &h0, &h1), "union failed\n");
+	ASSERT_TRUE(hyperloglog_count(&h0) == hyperloglog_count(&all),
+		    "in place union differed\n");
+
+	hyperloglog_destroy(&h0);
+	hyperloglog_destroy(&h1);
+	hyperloglog_destroy(&all);
+	hyperloglog_destroy(&into);
+}
+
+void test_union()
+{
+	HYPERLOGLOG(h0, HYPERLOGLOG_P_DEFAULT);
+	HYPERLOGLOG(h1, HYPERLOGLOG_P_DEFAULT);
+	HYPERLOGLOG(into, HYPERLOGLOG_P_DEFAULT);
+
+	/* sparse and sparse, sparse and dense, dense and sparse, dense */
+	check_union(100, 200);
+	check_union(100, 100000);
+	check_union(100000, 100);
+	check_union(200000, 300000);
+
+	/*
+	 * the lists add up to more than a sparse list can hold, but not once
+	 * the keys in both are counted once, so the union stays sparse
+	 */
+	HYPERLOGLOG(s0, 13);
+	HYPERLOGLOG(s1, 13);
+	ASSERT_TRUE(hyperloglog_init(&s0), "init failed\n");
+	ASSERT_TRUE(hyperloglog_init_from(&s1, &s0), "init_from failed\n");
+	for (uint64_t i = 0; i < 700; i++) {
+		hyperloglog_insert(&s0, i);
+		hyperloglog_insert(&s1, i + 300);
+	}
+	ASSERT_TRUE(hyperloglog_union(&s0, &s0, &s1), "union failed\n");
+	ASSERT_TRUE(s0.sparse && !s0.regs, "union went dense\n");
+	ASSERT_TRUE(rel_err(hyperloglog_count(&s0), 1000) < 0.01,
+		    "sparse union was off\n");
+	hyperloglog_destroy(&s0);
+	hyperloglog_destroy(&s1);
+
+	ASSERT_TRUE(hyperloglog_init(&h0), "init failed\n");
+	ASSERT_TRUE(hyperloglog_init(&h1), "init failed\n");
+	ASSERT_FALSE(hyperloglog_same_class(&h0, &h1),
+		     "sketches with different seeds were the same class\n");
+	ASSERT_FALSE(hyperloglog_union(&into, &h0, &h1),
+		     "merged sketches with different seeds\n");
+	hyperloglog_destroy(&h0);
+	hyperloglog_destroy(&h1);
+	hyperloglog_destroy(&into);
+}
+
+int main(void)
+{
+	REGISTER_TEST(test_init_destroy);
+	REGISTER_TEST(test_accuracy);
+	REGISTER_TEST(test_union);
+	return run_all_tests();
+}
@@ -0,0 +1,218 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file objpool_test.c
+ *
+ * \author Eric Mueller
+ *
+ * \brief Tests for the object pool defined in objpool.h
+ */
+
+#include "test.h"
+#include "objpool.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NOBJS (100 * 1000)
+#define NTHREADS 4
+
+struct obj {
+	unsigned long a;
+	unsigned long b;
+	char pad[40];
+};
+
+static int ptr_cmp(const void *lhs, const void *rhs)
+{
+	uintptr_t l = *(const uintptr_t *)lhs, r = *(const uintptr_t *)rhs;
+	return l < r ? -1 : l > r;
+}
+
+/* objects must be distinct, aligned and not overlap */
+static void assert_distinct(void **objs, size_t n, size_t size, size_t align)
+{
+	bool aligned = true, disjoint = true;
+	size_t i;
+
+	qsort(objs, n, sizeof *objs, ptr_cmp);
+	for (i = 0; i < n; i++) {
+		aligned &= ((uintptr_t)objs[i] & (align - 1)) == 0;
+		if (i)
+			disjoint &= (char *)objs[i - 1] + size <= (char *)objs[i];
+	}
+	ASSERT_TRUE(aligned, "objects were not aligned\n");
+	ASSERT_TRUE(disjoint, "objects overlapped\n");
+}
+
+void test_alloc_free()
+{
+	struct objpool pool;
+	void **objs = malloc(sizeof *objs * NOBJS);
+	size_t i;
+
+	ASSERT_TRUE(objpool_init(&pool, sizeof(struct obj), 0, 0),
+		    "init failed\n");
+
+	for (i = 0; i < NOBJS; i++) {
+		objs[i] = objpool_alloc(&pool);
+		ASSERT_TRUE(objs[i] != NULL, "alloc failed\n");
+		memset(objs[i], 0xff, sizeof(struct obj));
+	}
+	assert_distinct(objs, NOBJS, sizeof(struct obj), sizeof(void *));
+
+	/* free everything and make sure we get the same memory back */
+	for (i = 0; i < NOBJS; i++)
+		objpool_free(&pool, objs[i]);
+	{
+		unsigned long slabs = pool.stat_slabs;
+		for (i = 0; i < NOBJS; i++)
+			objs[i] = objpool_alloc(&pool);
+		ASSERT_TRUE(pool.stat_slabs == slabs,
+			    "freed objects were not reused\n");
+	}
+	assert_distinct(objs, NOBJS, sizeof(struct obj), sizeof(void *));
+
+	objpool_free(&pool, NULL);
+	objpool_destroy(&pool);
+	free(objs);
+}
+
+void test_cacheline_align()
+{
+	struct objpool pool;
+	void *objs[1000];
+	size_t i;
+
+	ASSERT_TRUE(objpool_init(&pool, 24, OBJPOOL_CACHELINE, 0),
+		    "init failed\n");
+	ASSERT_TRUE(pool.objsize == OBJPOOL_CACHELINE,
+		    "object size was not rounded to the alignment\n");
+	for (i = 0; i < 1000; i++)
+		objs[i] = objpool_alloc(&pool);
+	assert_distinct(objs, 1000, OBJPOOL_CACHELINE, OBJPOOL_CACHELINE);
+	objpool_destroy(&pool);
+}
+
+void test_bulk()
+{
+	struct objpool pool;
+	void **objs = malloc(sizeof *objs * NOBJS);
+
+	ASSERT_TRUE(objpool_init(&pool, sizeof(struct obj), 0, 0),
+		    "init failed\n");
+	ASSERT_TRUE(objpool_alloc_bulk(&pool, objs, NOBJS) == NOBJS,
+		    "bulk alloc came up short\n");
+	assert_distinct(objs, NOBJS, sizeof(struct obj), sizeof(void *));
+	objpool_free_bulk(&pool, objs, NOBJS);
+	ASSERT_TRUE(objpool_alloc_bulk(&pool, objs, NOBJS / 2) == NOBJS / 2,
+		    "bulk alloc came up short\n");
+	objpool_destroy(&pool);
+	free(objs);
+}
+
+void test_poison()
+{
+#ifndef NDEBUG
+	struct objpool pool;
+	unsigned char *p;
+	bool poisoned = true;
+	size_t i;
+
+	ASSERT_TRUE(objpool_init(&pool, sizeof(struct obj), 0, OBJPOOL_POISON),
+		    "init failed\n");
+	p = objpool_alloc(&pool);
+	memset(p, 0, sizeof(struct obj));
+	objpool_free(&pool, p);
+
+	/* the pool still owns the memory, so peeking is fine here */
+	for (i = 0; i < sizeof(struct obj); i++)
+		poisoned &= p[i] != 0;
+	ASSERT_TRUE(poisoned, "freed object was not poisoned\n");
+
+	/* and handing it back out passes the poison check */
+	ASSERT_TRUE(objpool_alloc(&pool) == p, "object was not reused\n");
+	objpool_destroy(&pool);
+#endif
+}
+
+static struct objpool g_pool;
+
+/* alloc a bunch, hand half to the next thread via a shared array */
+static void *churn(void *arg)
+{
+	void **mine = arg;
+	size_t i, round;
+
+	for (round = 0; round < 10; round++) {
+		for (i = 0; i < NOBJS / NTHREADS; i++) {
+			struct obj *o = objpool_alloc(&g_pool);
+			if (!o)
+				return (void *)1;
+			o->a = (uintptr_t)o;
+			mine[i] = o;
+		}
+		for (i = 0; i < NOBJS / NTHREADS; i++) {
+			struct obj *o = mine[i];
+			if (o->a != (uintptr_t)o)
+				return (void *)1;
+			objpool_free(&g_pool, o);
+		}
+	}
+
+	/* leave some allocated for the main thread to free */
+	return (void *)(uintptr_t)(objpool_alloc_bulk(&g_pool, mine, 100) != 100);
+}
+
+void test_threads()
+{
+	pthread_t threads[NTHREADS];
+	void **objs = malloc(sizeof *objs * NOBJS);
+	bool ok = true;
+	size_t i;
+
+	ASSERT_TRUE(objpool_init(&g_pool, sizeof(struct obj), 0, OBJPOOL_POISON),
+		    "init failed\n");
+
+	for (i = 0; i < NTHREADS; i++)
+		pthread_create(&threads[i], NULL, churn,
+			       &objs[i * (NOBJS / NTHREADS)]);
+	for (i = 0; i < NTHREADS; i++) {
+		void *ret;
+		pthread_join(threads[i], &ret);
+		ok &= ret == NULL;
+	}
+	ASSERT_TRUE(ok, "a thread saw a bad object\n");
+
+	/* free objects allocated by other (now dead) threads */
+	for (i = 0; i < NTHREADS; i++)
+		objpool_free_bulk(&g_pool, &objs[i * (NOBJS / NTHREADS)], 100);
+
+	ASSERT_TRUE(g_pool.caches.length == 1,
+		    "exited threads' caches were not released\n");
+	objpool_destroy(&g_pool);
+	free(objs);
+}
+
+int main(void)
+{
+	REGISTER_TEST(test_alloc_free);
+	REGISTER_TEST(test_cacheline_align);
+	REGISTER_TEST(test_bulk);
+	REGISTER_TEST(test_poison);
+	REGISTER_TEST(test_threads);
+	return run_all_tests();
+}
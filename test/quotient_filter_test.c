@@ -0,0 +1,212 @@
+/*
+ * Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file quotient_filter_test.c
+ *
+ * \author Eric Mueller
+ *
+ * \brief Tests for the quotient filter defined in quotient_filter.h
+ */
+
+#include "test.h"
+#include "quotient_filter.h"
+#include "pcg_variants.h"
+#include <stdlib.h>
+
+#define NKEYS (1 << 16)
+
+/*
+ * with this many remainder bits, fingerprints of a few thousand keys never
+ * collide, so the filter should agree with a model exactly.
+ */
+#define WIDE_R (40)
+
+void test_init_destroy()
+{
+	QUOTIENT_FILTER(qf, 10, 8);
+	QUOTIENT_FILTER(bad, 10, 60);
+
+	ASSERT_TRUE(quotient_filter_init(&qf), "init failed\n");
+	ASSERT_TRUE(qf.table && qf.nentries == 0, "init didn't set up table\n");
+	ASSERT_FALSE(quotient_filter_query(&qf, 42),
+		     "empty filter had a key\n");
+	quotient_filter_destroy(&qf);
+	ASSERT_TRUE(qf.table == NULL, "destroy didn't clear the table\n");
+
+	ASSERT_FALSE(quotient_filter_init(&bad),
+		     "init accepted q + r > 64\n");
+}
+
+/*
+ * random inserts and removes on a small filter, so clusters are long and
+ * wrap around the end of the table, checked against an array of counts.
+ */
+void test_random()
+{
+	QUOTIENT_FILTER(qf, 6, WIDE_R);
+	static unsigned counts[512];
+	unsigned long total = 0;
+	bool ok = true;
+
+	ASSERT_TRUE(quotient_filter_init(&qf), "init failed\n");
+	for (unsigned long i = 0; i < 200000; i++) {
+		uint64_t key = pcg32_boundedrand(512);
+
+		/* a few more inserts than removes, so the filter grows slowly */
+		if (pcg32_boundedrand(9) < 5) {
+			ok &= quotient_filter_insert(&qf, key);
+			counts[key]++;
+			total++;
+		} else {
+			ok &= quotient_filter_remove(&qf, key) == !!counts[key];
+			if (counts[key]) {
+				counts[key]--;
+				total--;
+			}
+		}
+		ok &= quotient_filter_count(&qf, key) == counts[key];
+		ok &= qf.nentries == total;
+	}
+	ASSERT_TRUE(ok, "filter disagreed with the model\n");
+
+	for (uint64_t key = 0; key < 512; key++)
+		ok &= quotient_filter_count(&qf, key) == counts[key];
+	ASSERT_TRUE(ok, "filter disagreed with the model at the end\n");
+
+	/* empty it out completely */
+	for (uint64_t key = 0; key < 512; key++)
+		while (counts[key]--)
+			ok &= quotient_filter_remove(&qf, key);
+	ASSERT_TRUE(ok && qf.nentries == 0, "couldn't remove everything\n");
+	for (uint64_t key = 0; key < 512; key++)
+		ok &= !quotient_filter_query(&qf, key);
+	ASSERT_TRUE(ok, "empty filter had keys\n");
+	quotient_filter_destroy(&qf);
+}
+
+void test_resize()
+{
+	QUOTIENT_FILTER(qf, 4, WIDE_R);
+	unsigned qbits;
+	bool ok = true;
+
+	ASSERT_TRUE(quotient_filter_init(&qf), "init failed\n");
+	for (uint64_t key = 0; key < 5000; key++)
+		ok &= quotient_filter_insert(&qf, key);
+	ASSERT_TRUE(ok, "insert failed\n");
+	ASSERT_TRUE(qf.qbits > 4 && qf.qbits + qf.rbits == 4 + WIDE_R,
+		    "filter didn't grow properly\n");
+
+	qbits = qf.qbits;
+	ASSERT_TRUE(quotient_filter_resize(&qf) && qf.qbits == qbits + 1,
+		    "resize failed\n");
+	for (uint64_t key = 0; key < 10000; key++)
+		ok &= quotient_filter_count(&qf, key) == (key < 5000);
+	ASSERT_TRUE(ok, "resizing lost or added keys\n");
+	quotient_filter_destroy(&qf);
+}
+
+/* once there's no remainder left to give up, inserts eventually fail */
+void test_full()
+{
+	QUOTIENT_FILTER(qf, 4, 1);
+	unsigned long inserted = 0;
+
+	ASSERT_TRUE(quotient_filter_init(&qf), "init failed\n");
+	ASSERT_FALSE(quotient_filter_resize(&qf), "resized with r = 1\n");
+	for (uint64_t key = 0; key < 100; key++)
+		inserted += quotient_filter_insert(&qf, key);
+	ASSERT_TRUE(inserted == 15 && qf.nentries == 15,
+		    "filter didn't fill up to the last slot\n");
+	quotient_filter_destroy(&qf);
+}
+
+void test_merge()
+{
+	QUOTIENT_FILTER(qf0, 8, WIDE_R);
+	struct quotient_filter qf1;
+	QUOTIENT_FILTER(into, 1, 1);
+	QUOTIENT_FILTER(other, 12, WIDE_R - 4);
+	bool ok = true;
+
+	ASSERT_TRUE(quotient_filter_init(&qf0), "init failed\n");
+	ASSERT_TRUE(quotient_filter_init(&other), "init failed\n");
+	ASSERT_TRUE(quotient_filter_init_from(&qf1, &qf0), "init_from failed\n");
+	ASSERT_TRUE(quotient_filter_same_class(&qf0, &qf1),
+		    "filters from init_from weren't the same class\n");
+	ASSERT_FALSE(quotient_filter_merge(&into, &qf0, &other),
+		     "merged filters with different seeds\n");
+
+	/* 0..2999 into one, 2000..5999 into the other, so some overlap */
+	for (uint64_t key = 0; key < 3000; key++)
+		ok &= quotient_filter_insert(&qf0, key);
+	for (uint64_t key = 2000; key < 6000; key++)
+		ok &= quotient_filter_insert(&qf1, key);
+	ASSERT_TRUE(ok, "insert failed\n");
+
+	ASSERT_TRUE(quotient_filter_merge(&into, &qf0, &qf1), "merge failed\n");
+	ASSERT_TRUE(into.nentries == 7000, "merge lost entries\n");
+	for (uint64_t key = 0; key < 8000; key++)
+		ok &= quotient_filter_count(&into, key)
+			== (unsigned long)((key < 6000)
+						   + (key >= 2000 && key < 3000));
+	ASSERT_TRUE(ok, "merged counts were wrong\n");
+
+	/* merging into an input */
+	ASSERT_TRUE(quotient_filter_merge(&qf0, &qf0, &into), "merge failed\n");
+	for (uint64_t key = 0; key < 8000; key++)
+		ok &= quotient_filter_count(&qf0, key)
+			== (unsigned long)((key < 6000) + (key < 3000)
+						   + (key >= 2000 && key < 3000));
+	ASSERT_TRUE(ok, "merging in place gave the wrong counts\n");
+
+	quotient_filter_destroy(&qf0);
+	quotient_filter_destroy(&qf1);
+	quotient_filter_destroy(&into);
+	quotient_filter_destroy(&other);
+}
+
+void test_false_positive()
+{
+	QUOTIENT_FILTER(qf, 16, 10);
+	unsigned long false_pos = 0;
+	double falsep;
+
+	ASSERT_TRUE(quotient_filter_init(&qf), "init failed\n");
+	for (unsigned long i = 0; i < NKEYS / 2; i++)
+		quotient_filter_insert(&qf, pcg64_random());
+	for (unsigned long i = 0; i < 16 * NKEYS; i++)
+		false_pos += quotient_filter_query(&qf, pcg64_random());
+
+	/* about load * 2^-r, and the load here is 1/2 */
+	falsep = (double)false_pos / (16 * NKEYS);
+	ASSERT_TRUE(falsep < 1.2 / 2048 && falsep > 0.8 / 2048,
+		    "false positive rate was off\n");
+	quotient_filter_destroy(&qf);
+}
+
+int main(void)
+{
+	pcg32_srandom(42u, 54u);
+	pcg64_srandom(42u, 54u);
+	REGISTER_TEST(test_init_destroy);
+	REGISTER_TEST(test_random);
+	REGISTER_TEST(test_resize);
+	REGISTER_TEST(test_full);
+	REGISTER_TEST(test_merge);
+	REGISTER_TEST(test_false_positive);
+	return run_all_tests();
+}
@@ -0,0 +1,337 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file roaring_test.c
+ *
+ * \author Eric Mueller
+ *
+ * \brief Tests for the compressed bitmap defined in roaring.h
+ */
+
+#include "test.h"
+#include "roaring.h"
+#include "bloom.h"
+#include "radix_tree.h"
+#include "pcg_variants.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * most tests work in a universe of 2^20 integers so that we can keep a plain
+ * byte-per-integer control set, while still spanning 16 containers.
+ */
+#define UNIVERSE (1UL << 20)
+
+/* fill r and control with about n random integers below UNIVERSE */
+static void fill_random(struct roaring *r, unsigned char *control,
+			unsigned long n)
+{
+	unsigned long i;
+
+	for (i = 0; i < n; i++) {
+		uint32_t x = pcg32_random() % UNIVERSE;
+		ASSERT_TRUE(roaring_add(r, x), "add failed\n");
+		control[x] = 1;
+	}
+}
+
+/* check r against control, via contains, cardinality and iteration */
+static void assert_matches(const struct roaring *r,
+			   const unsigned char *control, const char *msg)
+{
+	unsigned long i, card = 0;
+	bool contains_ok = true, iter_ok = true;
+	uint32_t prev = 0;
+	bool first = true;
+
+	for (i = 0; i < UNIVERSE; i++) {
+		card += control[i];
+		contains_ok &= roaring_contains(r, i) == !!control[i];
+	}
+	ASSERT_TRUE(contains_ok, msg);
+	ASSERT_TRUE(roaring_cardinality(r) == card, msg);
+
+	roaring_for_each(r, it, x) {
+		iter_ok &= x < UNIVERSE && control[x];
+		iter_ok &= first || x > prev;
+		prev = x;
+		first = false;
+		card--;
+	}
+	ASSERT_TRUE(iter_ok && card == 0, msg);
+}
+
+void test_add_contains()
+{
+	ROARING_BITMAP(r);
+	unsigned char *control = calloc(UNIVERSE, 1);
+
+	ASSERT_TRUE(roaring_cardinality(&r) == 0, "new bitmap not empty\n");
+	ASSERT_FALSE(roaring_contains(&r, 7), "empty bitmap contains 7\n");
+
+	/* sparse, so array containers */
+	fill_random(&r, control, 2000);
+	assert_matches(&r, control, "sparse bitmap was wrong\n");
+
+	/* dense, so bitmap containers */
+	fill_random(&r, control, 400000);
+	assert_matches(&r, control, "dense bitmap was wrong\n");
+
+	/* the extremes of the key space */
+	ASSERT_TRUE(roaring_add(&r, 0) && roaring_add(&r, UINT32_MAX),
+		    "add failed\n");
+	ASSERT_TRUE(roaring_contains(&r, UINT32_MAX), "lost UINT32_MAX\n");
+	ASSERT_TRUE(roaring_remove(&r, UINT32_MAX) == 1, "remove failed\n");
+	control[0] = 1;
+	assert_matches(&r, control, "bitmap was wrong after extremes\n");
+
+	roaring_destroy(&r);
+	free(control);
+}
+
+void test_remove()
+{
+	ROARING_BITMAP(r);
+	unsigned char *control = calloc(UNIVERSE, 1);
+	unsigned long i;
+
+	fill_random(&r, control, 400000);
+
+	/* remove most things so bitmaps turn back into arrays */
+	for (i = 0; i < UNIVERSE; i++) {
+		if (i % 37 == 0)
+			continue;
+		ASSERT_TRUE(roaring_remove(&r, i) == !!control[i],
+			    "remove returned the wrong thing\n");
+		control[i] = 0;
+	}
+	assert_matches(&r, control, "bitmap was wrong after removes\n");
+
+	for (i = 0; i < UNIVERSE; i++)
+		roaring_remove(&r, i);
+	ASSERT_TRUE(r.ncontainers == 0, "empty containers were kept\n");
+
+	roaring_destroy(&r);
+	free(control);
+}
+
+void test_ranges_and_runs()
+{
+	ROARING_BITMAP(r);
+	unsigned char *control = calloc(UNIVERSE, 1);
+	unsigned long i;
+
+	/* spans several containers, including full ones */
+	ASSERT_TRUE(roaring_add_range(&r, 1000, 300000), "add_range failed\n");
+	memset(&control[1000], 1, 300000 - 1000);
+	ASSERT_TRUE(roaring_add_range(&r, 500000, 500001),
+		    "add_range failed\n");
+	control[500000] = 1;
+	assert_matches(&r, control, "bitmap was wrong after add_range\n");
+
+	/* punch holes in the runs, then re-optimize */
+	for (i = 2000; i < 300000; i += 1000) {
+		roaring_remove(&r, i);
+		control[i] = 0;
+	}
+	assert_matches(&r, control, "bitmap was wrong after removes\n");
+	ASSERT_TRUE(roaring_run_optimize(&r), "run_optimize failed\n");
+	assert_matches(&r, control, "bitmap was wrong after run_optimize\n");
+
+	fill_random(&r, control, 1000);
+	assert_matches(&r, control, "bitmap was wrong after adds to runs\n");
+
+	/* whole key space */
+	roaring_destroy(&r);
+	ASSERT_TRUE(roaring_add_range(&r, 0, UINT64_C(1) << 32),
+		    "add_range failed\n");
+	ASSERT_TRUE(roaring_cardinality(&r) == UINT64_C(1) << 32,
+		    "full bitmap had the wrong cardinality\n");
+
+	roaring_destroy(&r);
+	free(control);
+}
+
+void test_rank_select()
+{
+	ROARING_BITMAP(r);
+	unsigned char *control = calloc(UNIVERSE, 1);
+	unsigned long i, rank = 0;
+	bool rank_ok = true, select_ok = true;
+	uint32_t x;
+
+	fill_random(&r, control, 300000);
+	roaring_add_range(&r, 900000, 1000000);
+	memset(&control[900000], 1, 100000);
+
+	for (i = 0; i < UNIVERSE; i++) {
+		if (control[i]) {
+			select_ok &= roaring_select(&r, rank, &x) && x == i;
+			rank++;
+		}
+		rank_ok &= roaring_rank(&r, i) == rank;
+	}
+	ASSERT_TRUE(rank_ok, "rank was wrong\n");
+	ASSERT_TRUE(select_ok, "select was wrong\n");
+	ASSERT_FALSE(roaring_select(&r, rank, &x),
+		     "select past the end succeeded\n");
+
+	roaring_run_optimize(&r);
+	ASSERT_TRUE(roaring_rank(&r, 950000) == roaring_rank(&r, 899999) + 50001,
+		    "rank in a run container was wrong\n");
+
+	roaring_destroy(&r);
+	free(control);
+}
+
+/* run each set operation on every combination of sparse/dense/run inputs */
+void test_set_ops()
+{
+	unsigned long i, j, k;
+
+	for (i = 0; i < 3; i++) {
+		for (j = 0; j < 3; j++) {
+			ROARING_BITMAP(a);
+			ROARING_BITMAP(b);
+			ROARING_BITMAP(out);
+			unsigned char *ca = calloc(UNIVERSE, 1);
+			unsigned char *cb = calloc(UNIVERSE, 1);
+			unsigned char *co = calloc(UNIVERSE, 1);
+			unsigned long sizes[] = {3000, 300000, 0};
+
+			fill_random(&a, ca, sizes[i]);
+			fill_random(&b, cb, sizes[j]);
+			if (i == 2) {
+				roaring_add_range(&a, 10000, 600000);
+				memset(&ca[10000], 1, 590000);
+				roaring_run_optimize(&a);
+			}
+			if (j == 2) {
+				roaring_add_range(&b, 300000, 900000);
+				memset(&cb[300000], 1, 600000);
+				roaring_run_optimize(&b);
+			}
+
+			ASSERT_TRUE(roaring_union(&out, &a, &b),
+				    "union failed\n");
+			for (k = 0; k < UNIVERSE; k++)
+				co[k] = ca[k] | cb[k];
+			assert_matches(&out, co, "union was wrong\n");
+
+			ASSERT_TRUE(roaring_intersection(&out, &a, &b),
+				    "intersection failed\n");
+			for (k = 0; k < UNIVERSE; k++)
+				co[k] = ca[k] & cb[k];
+			assert_matches(&out, co, "intersection was wrong\n");
+
+			ASSERT_TRUE(roaring_difference(&out, &a, &b),
+				    "difference failed\n");
+			for (k = 0; k < UNIVERSE; k++)
+				co[k] = ca[k] & !cb[k];
+			assert_matches(&out, co, "difference was wrong\n");
+
+			/* into may alias an operand */
+			ASSERT_TRUE(roaring_union(&a, &a, &b), "union failed\n");
+			for (k = 0; k < UNIVERSE; k++)
+				co[k] = ca[k] | cb[k];
+			assert_matches(&a, co, "aliased union was wrong\n");
+
+			roaring_destroy(&a);
+			roaring_destroy(&b);
+			roaring_destroy(&out);
+			free(ca);
+			free(cb);
+			free(co);
+		}
+	}
+}
+
+void test_equals()
+{
+	ROARING_BITMAP(a);
+	ROARING_BITMAP(b);
+	unsigned long i;
+
+	for (i = 0; i < 70000; i++)
+		roaring_add(&a, i);
+	roaring_add_range(&b, 0, 70000);
+
+	/* different representations, same members */
+	ASSERT_TRUE(roaring_equals(&a, &b), "equal bitmaps were not equal\n");
+	roaring_remove(&b, 69999);
+	ASSERT_FALSE(roaring_equals(&a, &b), "unequal bitmaps were equal\n");
+
+	roaring_destroy(&a);
+	roaring_destroy(&b);
+}
+
+void test_bloom_interop()
+{
+	ROARING_BITMAP(r);
+	BLOOM_FILTER(bf, 100000, BLOOM_P_DEFAULT);
+	bool ok = true;
+
+	ASSERT_TRUE(bloom_init(&bf), "bloom_init failed\n");
+	roaring_add_range(&r, 123456, 123456 + 100000);
+	roaring_insert_bloom(&r, &bf);
+
+	roaring_for_each(&r, it, x)
+		ok &= bloom_query(&bf, x);
+	ASSERT_TRUE(ok, "bloom filter missed a key from the bitmap\n");
+
+	bloom_destroy(&bf);
+	roaring_destroy(&r);
+}
+
+static void noop_dtor(void *node, void *private)
+{
+	(void)node;
+	(void)private;
+}
+
+void test_radix_interop()
+{
+	RADIX_HEAD(tree);
+	ROARING_BITMAP(r);
+	static const unsigned long keys[] = {3, 64, 65, 4000, 70000, 1UL << 31};
+	unsigned long i;
+
+	for (i = 0; i < sizeof keys / sizeof keys[0]; i++)
+		radix_insert(&tree, keys[i], &keys[i]);
+
+	ASSERT_TRUE(roaring_add_radix(&r, &tree), "add_radix failed\n");
+	ASSERT_TRUE(roaring_cardinality(&r) == sizeof keys / sizeof keys[0],
+		    "add_radix added the wrong number of keys\n");
+	for (i = 0; i < sizeof keys / sizeof keys[0]; i++)
+		ASSERT_TRUE(roaring_contains(&r, keys[i]),
+			    "add_radix missed a key\n");
+
+	radix_destroy(&tree, noop_dtor, NULL);
+	roaring_destroy(&r);
+}
+
+int main(void)
+{
+	pcg32_srandom(42u, 54u);
+	REGISTER_TEST(test_add_contains);
+	REGISTER_TEST(test_remove);
+	REGISTER_TEST(test_ranges_and_runs);
+	REGISTER_TEST(test_rank_select);
+	REGISTER_TEST(test_set_ops);
+	REGISTER_TEST(test_equals);
+	REGISTER_TEST(test_bloom_interop);
+	REGISTER_TEST(test_radix_interop);
+	return run_all_tests();
+}
@@ -0,0 +1,333 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file rtree_test.c
+ *
+ * \author Eric Mueller
+ *
+ * \brief Tests for the R*-tree defined in rtree.h
+ */
+
+#include "test.h"
+#include "rtree.h"
+#include "pcg_variants.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define N 20000
+
+struct item {
+	struct rtree_rect r;
+	bool present;
+	bool seen;
+};
+
+static rtree_coord_t rand_coord(double scale)
+{
+	return (rtree_coord_t)(pcg32_random() / 4294967296.0 * scale);
+}
+
+/* small random rectangles in a 1000x1000 square, some degenerate */
+static void random_items(struct item *items, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		rtree_coord_t x = rand_coord(1000), y = rand_coord(1000);
+		items[i].r = (struct rtree_rect){x, y, x + rand_coord(10),
+						 y + rand_coord(10)};
+		if (i % 10 == 0)
+			items[i].r.maxx = x;
+		items[i].present = false;
+		items[i].seen = false;
+	}
+}
+
+static bool overlaps(const struct rtree_rect *a, const struct rtree_rect *b)
+{
+	return a->minx <= b->maxx && a->maxx >= b->minx
+		&& a->miny <= b->maxy && a->maxy >= b->miny;
+}
+
+static bool mark_seen(void *data, const struct rtree_rect *r, void *private)
+{
+	struct item *it = data;
+	(void)private;
+	it->seen |= memcmp(r, &it->r, sizeof *r) == 0;
+	return true;
+}
+
+/* run some window queries and check them against a linear scan */
+static void assert_searches_match(struct rtree *t, struct item *items,
+				  size_t n)
+{
+	bool ok = true;
+	size_t q, i;
+
+	for (q = 0; q < 50; q++) {
+		rtree_coord_t x = rand_coord(1000), y = rand_coord(1000);
+		rtree_coord_t w = rand_coord(100), h = rand_coord(100);
+		struct rtree_rect win = {x, y, x + w, y + h};
+		size_t expect = 0, found;
+
+		for (i = 0; i < n; i++) {
+			items[i].seen = false;
+			expect += items[i].present && overlaps(&items[i].r, &win);
+		}
+		found = rtree_search(t, &win, mark_seen, NULL);
+		ok &= found == expect;
+		for (i = 0; i < n; i++)
+			ok &= items[i].seen
+				== (items[i].present && overlaps(&items[i].r, &win));
+	}
+	ASSERT_TRUE(ok, "window query disagreed with a linear scan\n");
+}
+
+static double dist(const struct rtree_rect *r, double x, double y)
+{
+	double dx = x < r->minx ? r->minx - x : x > r->maxx ? x - r->maxx : 0;
+	double dy = y < r->miny ? r->miny - y : y > r->maxy ? y - r->maxy : 0;
+	return sqrt(dx * dx + dy * dy);
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double l = *(const double *)a, r = *(const double *)b;
+	return (l > r) - (l < r);
+}
+
+static void assert_nearest_match(struct rtree *t, struct item *items,
+				 size_t n)
+{
+	double *all = malloc(n * sizeof *all);
+	void *out[20];
+	rtree_coord_t d[20];
+	bool ok = true;
+	size_t q, i, m;
+
+	for (q = 0; q < 50; q++) {
+		double x = rand_coord(1000), y = rand_coord(1000);
+		long found = rtree_nearest(t, x, y, 20, out, d);
+
+		for (i = 0, m = 0; i < n; i++)
+			if (items[i].present)
+				all[m++] = dist(&items[i].r, x, y);
+		qsort(all, m, sizeof *all, cmp_double);
+
+		ok &= found == (long)(m < 20 ? m : 20);
+		for (i = 0; ok && i < (size_t)found; i++) {
+			struct item *it = out[i];
+			ok &= it->present;
+			ok &= fabs(d[i] - all[i]) < 1e-3;
+			ok &= fabs(dist(&it->r, x, y) - d[i]) < 1e-3;
+		}
+	}
+	ASSERT_TRUE(ok, "nearest neighbors disagreed with a linear scan\n");
+	free(all);
+}
+
+void test_insert_search()
+{
+	RTREE(t);
+	struct item *items = malloc(N * sizeof *items);
+	size_t i;
+
+	random_items(items, N);
+	ASSERT_TRUE(rtree_search(&t, &items[0].r, NULL, NULL) == 0,
+		    "empty tree found something\n");
+	ASSERT_TRUE(rtree_height(&t) == 0, "empty tree had height\n");
+
+	for (i = 0; i < N; i++) {
+		ASSERT_TRUE(rtree_insert(&t, &items[i].r, &items[i]),
+			    "insert failed\n");
+		items[i].present = true;
+		if (i == 100)
+			assert_searches_match(&t, items, N);
+	}
+	ASSERT_TRUE(t.nitems == N, "nitems was wrong\n");
+	ASSERT_TRUE(rtree_height(&t) >= 3 && rtree_height(&t) <= 6,
+		    "tree had an unreasonable height\n");
+	assert_searches_match(&t, items, N);
+
+	rtree_destroy(&t);
+	ASSERT_TRUE(t.root == NULL && t.nitems == 0,
+		    "destroyed tree was not empty\n");
+	free(items);
+}
+
+void test_delete()
+{
+	RTREE(t);
+	struct item *items = malloc(N * sizeof *items);
+	struct rtree_rect other = {-1, -1, -1, -1};
+	size_t i;
+
+	random_items(items, N);
+	for (i = 0; i < N; i++) {
+		rtree_insert(&t, &items[i].r, &items[i]);
+		items[i].present = true;
+	}
+
+	ASSERT_FALSE(rtree_delete(&t, &other, &items[0]),
+		     "deleted with the wrong rect\n");
+	ASSERT_FALSE(rtree_delete(&t, &items[0].r, &items[1]),
+		     "deleted with the wrong data\n");
+
+	for (i = 0; i < N; i += 2) {
+		ASSERT_TRUE(rtree_delete(&t, &items[i].r, &items[i]),
+			    "delete failed\n");
+		items[i].present = false;
+	}
+	ASSERT_TRUE(t.nitems == N / 2, "nitems was wrong\n");
+	ASSERT_FALSE(rtree_delete(&t, &items[0].r, &items[0]),
+		     "deleted twice\n");
+	assert_searches_match(&t, items, N);
+	assert_nearest_match(&t, items, N);
+
+	/* delete everything, with some inserts mixed in */
+	for (i = 1; i < N; i += 2) {
+		ASSERT_TRUE(rtree_delete(&t, &items[i].r, &items[i]),
+			    "delete failed\n");
+		items[i].present = false;
+		if (i % 1000 == 1) {
+			rtree_insert(&t, &items[i - 1].r, &items[i - 1]);
+			items[i - 1].present = true;
+		}
+	}
+	assert_searches_match(&t, items, N);
+	for (i = 0; i < N; i++)
+		if (items[i].present)
+			rtree_delete(&t, &items[i].r, &items[i]);
+	ASSERT_TRUE(t.nitems == 0 && rtree_height(&t) == 0,
+		    "tree was not empty after deleting everything\n");
+
+	rtree_destroy(&t);
+	free(items);
+}
+
+void test_nearest()
+{
+	RTREE(t);
+	struct item *items = malloc(N * sizeof *items);
+	void *out[4];
+	size_t i;
+
+	ASSERT_TRUE(rtree_nearest(&t, 0, 0, 4, out, NULL) == 0,
+		    "empty tree had neighbors\n");
+
+	random_items(items, 3);
+	for (i = 0; i < 3; i++) {
+		rtree_insert(&t, &items[i].r, &items[i]);
+		items[i].present = true;
+	}
+	ASSERT_TRUE(rtree_nearest(&t, 0, 0, 4, out, NULL) == 3,
+		    "small tree had the wrong number of neighbors\n");
+	rtree_destroy(&t);
+
+	random_items(items, N);
+	for (i = 0; i < N; i++) {
+		rtree_insert(&t, &items[i].r, &items[i]);
+		items[i].present = true;
+	}
+	assert_nearest_match(&t, items, N);
+
+	rtree_destroy(&t);
+	free(items);
+}
+
+void test_bulk_load()
+{
+	RTREE(t);
+	struct item *items = malloc(N * sizeof *items);
+	struct rtree_rect *rects = malloc(N * sizeof *rects);
+	void **data = malloc(N * sizeof *data);
+	size_t sizes[] = {1, 16, 17, 300, N};
+	size_t s, i;
+
+	for (s = 0; s < sizeof sizes / sizeof sizes[0]; s++) {
+		size_t n = sizes[s];
+
+		random_items(items, n);
+		for (i = 0; i < n; i++) {
+			rects[i] = items[i].r;
+			data[i] = &items[i];
+			items[i].present = true;
+		}
+		ASSERT_TRUE(rtree_bulk_load(&t, rects, data, n),
+			    "bulk load failed\n");
+		ASSERT_TRUE(t.nitems == n, "nitems was wrong\n");
+		assert_searches_match(&t, items, n);
+		assert_nearest_match(&t, items, n);
+		ASSERT_FALSE(rtree_bulk_load(&t, rects, data, n),
+			     "bulk loaded a non-empty tree\n");
+
+		/* a bulk loaded tree is a normal tree */
+		for (i = 0; i < n; i += 3) {
+			ASSERT_TRUE(rtree_delete(&t, &items[i].r, &items[i]),
+				    "delete from bulk loaded tree failed\n");
+			items[i].present = false;
+		}
+		for (i = 0; i < n; i += 6) {
+			rtree_insert(&t, &items[i].r, &items[i]);
+			items[i].present = true;
+		}
+		assert_searches_match(&t, items, n);
+		rtree_destroy(&t);
+	}
+
+	free(items);
+	free(rects);
+	free(data);
+}
+
+static bool stop_early(void *data, const struct rtree_rect *r,
+		       void *private)
+{
+	(void)data;
+	(void)r;
+	return --*(int *)private > 0;
+}
+
+void test_search_stop()
+{
+	RTREE(t);
+	struct rtree_rect r = {0, 0, 1, 1};
+	struct rtree_rect all = {-1, -1, 2, 2};
+	int items[100], budget = 10;
+	size_t i;
+
+	for (i = 0; i < 100; i++)
+		rtree_insert(&t, &r, &items[i]);
+	ASSERT_TRUE(rtree_search(&t, &all, NULL, NULL) == 100,
+		    "identical rects were not all found\n");
+	ASSERT_TRUE(rtree_search(&t, &all, stop_early, &budget) == 10,
+		    "search did not stop when asked\n");
+	for (i = 0; i < 100; i++)
+		ASSERT_TRUE(rtree_delete(&t, &r, &items[i]),
+			    "delete of an identical rect failed\n");
+	rtree_destroy(&t);
+}
+
+int main(void)
+{
+	pcg32_srandom(42u, 54u);
+	REGISTER_TEST(test_insert_search);
+	REGISTER_TEST(test_delete);
+	REGISTER_TEST(test_nearest);
+	REGISTER_TEST(test_bulk_load);
+	REGISTER_TEST(test_search_stop);
+	return run_all_tests();
+}
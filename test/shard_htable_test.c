@@ -0,0 +1,171 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file shard_htable_test.c
+ *
+ * \author Eric Mueller
+ *
+ * \brief Tests for the sharded hash table defined in shard_htable.h
+ */
+
+#include "test.h"
+#include "shard_htable.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define NTHREADS 4
+#define PER_THREAD (128 * 1024)
+
+static const void *val_of(uint64_t key)
+{
+	return (const void *)(uintptr_t)(key * 3 + 1);
+}
+
+void test_basic()
+{
+	struct shard_htable t;
+	const void *val = NULL;
+
+	ASSERT_TRUE(shard_htable_init(&t, 5, 100), "init failed\n");
+	ASSERT_TRUE(t.shard_bits == 3, "shards weren't rounded up\n");
+
+	for (uint64_t i = 0; i < 100000; i++)
+		ASSERT_TRUE(shard_htable_insert(&t, i, val_of(i)),
+			    "insert failed\n");
+	ASSERT_TRUE(shard_htable_count(&t) == 100000, "count was wrong\n");
+	ASSERT_TRUE(shard_htable_get(&t, 500, &val) && val == val_of(500),
+		    "get returned the wrong value\n");
+	ASSERT_FALSE(shard_htable_exists(&t, 100000), "found a missing key\n");
+	ASSERT_TRUE(shard_htable_remove(&t, 500) == val_of(500),
+		    "remove returned the wrong value\n");
+	ASSERT_FALSE(shard_htable_exists(&t, 500), "found a removed key\n");
+
+	/* every shard got some keys */
+	for (unsigned i = 0; i < 8; i++)
+		ASSERT_TRUE(t.shards[i].table.nentries > 10000,
+			    "keys weren't spread over the shards\n");
+	shard_htable_destroy(&t);
+
+	ASSERT_TRUE(shard_htable_init(&t, 100000, 0), "init failed\n");
+	ASSERT_TRUE(1U << t.shard_bits == SHARD_HTABLE_MAX_SHARDS,
+		    "shards weren't capped\n");
+	shard_htable_destroy(&t);
+}
+
+void test_batch()
+{
+	struct shard_htable t;
+	size_t n = 1000;
+	uint64_t *keys = malloc(2 * n * sizeof *keys);
+	const void **vals = malloc(2 * n * sizeof *vals);
+	bool ok = true;
+
+	ASSERT_TRUE(shard_htable_init(&t, 16, n), "init failed\n");
+	for (size_t i = 0; i < 2 * n; i++) {
+		keys[i] = i * 7;
+		vals[i] = val_of(keys[i]);
+	}
+
+	ASSERT_TRUE(shard_htable_insert_batch(&t, keys, vals, n) == n,
+		    "insert_batch failed\n");
+	ASSERT_TRUE(shard_htable_count(&t) == n, "count was wrong\n");
+
+	for (size_t i = 0; i < 2 * n; i++)
+		vals[i] = NULL;
+	ASSERT_TRUE(shard_htable_get_batch(&t, keys, vals, 2 * n) == n,
+		    "get_batch found the wrong number of keys\n");
+	for (size_t i = 0; i < 2 * n; i++)
+		ok &= vals[i] == (i < n ? val_of(keys[i]) : NULL);
+	ASSERT_TRUE(ok, "get_batch returned the wrong values\n");
+
+	ASSERT_TRUE(shard_htable_remove_batch(&t, keys + n / 2, n) == n / 2,
+		    "remove_batch removed the wrong number of keys\n");
+	for (size_t i = 0; i < 2 * n; i++)
+		ok &= shard_htable_exists(&t, keys[i]) == (i < n / 2);
+	ASSERT_TRUE(ok, "remove_batch removed the wrong keys\n");
+
+	shard_htable_destroy(&t);
+	free(keys);
+	free(vals);
+}
+
+struct worker {
+	struct shard_htable *t;
+	uint64_t base;
+	bool ok;
+};
+
+/* insert a disjoint range of keys, read it back, remove half of it */
+static void *work(void *arg)
+{
+	struct worker *w = arg;
+	uint64_t keys[64];
+	const void *vals[64];
+	uint64_t i, j;
+
+	w->ok = true;
+	for (i = 0; i < PER_THREAD; i++)
+		w->ok &= shard_htable_insert(w->t, w->base + i,
+					     val_of(w->base + i));
+	for (i = 0; i < PER_THREAD; i++) {
+		const void *val = NULL;
+		w->ok &= shard_htable_get(w->t, w->base + i, &val);
+		w->ok &= val == val_of(w->base + i);
+	}
+	for (i = 0; i < PER_THREAD; i += 128) {
+		for (j = 0; j < 64; j++)
+			keys[j] = w->base + i + 2 * j;
+		w->ok &= shard_htable_remove_batch(w->t, keys, 64) == 64;
+		w->ok &= shard_htable_get_batch(w->t, keys, vals, 64) == 0;
+	}
+	return NULL;
+}
+
+void test_threads()
+{
+	struct shard_htable t;
+	struct worker w[NTHREADS];
+	pthread_t tid[NTHREADS];
+	bool ok = true;
+
+	ASSERT_TRUE(shard_htable_init(&t, 4 * NTHREADS, 1000),
+		    "init failed\n");
+	for (int i = 0; i < NTHREADS; i++) {
+		w[i].t = &t;
+		w[i].base = (uint64_t)i * PER_THREAD;
+		pthread_create(&tid[i], NULL, work, &w[i]);
+	}
+	for (int i = 0; i < NTHREADS; i++) {
+		pthread_join(tid[i], NULL);
+		ok &= w[i].ok;
+	}
+	ASSERT_TRUE(ok, "a thread saw the wrong thing\n");
+	ASSERT_TRUE(shard_htable_count(&t) == NTHREADS * PER_THREAD / 2,
+		    "count was wrong after concurrent updates\n");
+
+	for (uint64_t k = 0; k < NTHREADS * PER_THREAD; k++)
+		ok &= shard_htable_exists(&t, k) == (k % 2 == 1);
+	ASSERT_TRUE(ok, "table had the wrong keys after concurrent updates\n");
+	shard_htable_destroy(&t);
+}
+
+int main(void)
+{
+	REGISTER_TEST(test_basic);
+	REGISTER_TEST(test_batch);
+	REGISTER_TEST(test_threads);
+	return run_all_tests();
+}
@@ -0,0 +1,254 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file splay_tree_test.c
+ *
+ * \author Eric Mueller
+ *
+ * \brief Test suite for functions defined in splay_tree.h
+ */
+
+#include "splay_tree.h"
+#include "test.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+struct test_struct {
+	int x;
+	struct splay_node splay;
+};
+
+static size_t count_nodes(struct splay_node *n)
+{
+	if (!n)
+		return 0;
+	return 1 + count_nodes(n->chld[0]) + count_nodes(n->chld[1]);
+}
+
+static struct test_struct *to_data(struct splay_head *hd, struct splay_node *n)
+{
+	return (struct test_struct *)((uintptr_t)n - hd->offset);
+}
+
+/* check the bst property: every node in n is within (lo, hi) */
+static bool valid_node(struct splay_head *hd, struct splay_node *n,
+		       struct test_struct *lo, struct test_struct *hi)
+{
+	struct test_struct *d;
+
+	if (!n)
+		return true;
+	d = to_data(hd, n);
+	if (lo && hd->cmp(lo, d) >= 0)
+		return false;
+	if (hi && hd->cmp(d, hi) >= 0)
+		return false;
+	return valid_node(hd, n->chld[0], lo, d)
+		&& valid_node(hd, n->chld[1], d, hi);
+}
+
+static void assert_is_valid_tree(struct splay_head *hd)
+{
+	ASSERT_TRUE(hd->nnodes == count_nodes(hd->root),
+		    "is_valid_tree: hd->nnodes is wrong.\n");
+	ASSERT_TRUE(valid_node(hd, hd->root, NULL, NULL),
+		    "is_valid_tree: tree was out of order.\n");
+}
+
+static long point_cmp(void *lhs, void *rhs)
+{
+	int rx = ((struct test_struct *)rhs)->x;
+	int lx = ((struct test_struct *)lhs)->x;
+
+	if (lx < rx)
+		return -1;
+	else if (lx > rx)
+		return 1;
+	else
+		return 0;
+}
+
+/**** tests ****/
+
+#define n 10000
+
+void test_insert()
+{
+	SPLAY_TREE(t, &point_cmp, struct test_struct, splay);
+	static struct test_struct data[n * 2];
+
+	for (size_t i = 0; i < n; i++) {
+		data[i].x = i * 2;
+		ASSERT_TRUE(splay_insert(&t, &data[i]) == NULL,
+			    "test_insert: insert reported a duplicate.\n");
+		ASSERT_TRUE(t.root == &data[i].splay,
+			    "test_insert: inserted element was not the root.\n");
+	}
+	assert_is_valid_tree(&t);
+
+	for (size_t i = 0; i < n; i++) {
+		data[n + i].x = i * 2;
+		ASSERT_TRUE(splay_insert(&t, &data[n + i]) == &data[i],
+			    "test_insert: duplicate was not detected.\n");
+	}
+	ASSERT_TRUE(t.nnodes == n, "test_insert: nnodes is wrong.\n");
+	assert_is_valid_tree(&t);
+
+	for (size_t i = 0; i < n; i++) {
+		ASSERT_TRUE(splay_find(&t, &data[i]) == &data[i],
+			    "test_insert: could not find inserted element.\n");
+		ASSERT_TRUE(t.root == &data[i].splay,
+			    "test_insert: found element was not the root.\n");
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		struct test_struct missing = {.x = i * 2 + 1};
+		ASSERT_TRUE(splay_find(&t, &missing) == NULL,
+			    "test_insert: found element that was not"
+			    " inserted.\n");
+	}
+	assert_is_valid_tree(&t);
+}
+
+void test_random()
+{
+	SPLAY_TREE(t, &point_cmp, struct test_struct, splay);
+	static struct test_struct data[n];
+	size_t inserted = 0;
+
+	for (size_t i = 0; i < n; i++) {
+		data[i].x = rand();
+		inserted += splay_insert(&t, &data[i]) == NULL;
+		if (i % 1000 == 0)
+			assert_is_valid_tree(&t);
+	}
+	ASSERT_TRUE(t.nnodes == inserted, "test_random: nnodes is wrong.\n");
+	assert_is_valid_tree(&t);
+
+	for (size_t i = 0; i < n; i++) {
+		struct test_struct *e = splay_find(&t, &data[i]);
+		ASSERT_TRUE(e && e->x == data[i].x,
+			    "test_random: could not find inserted element.\n");
+	}
+}
+
+void test_delete()
+{
+	SPLAY_TREE(t, &point_cmp, struct test_struct, splay);
+	static struct test_struct data[n];
+
+	for (size_t i = 0; i < n; i++) {
+		data[i].x = i;
+		splay_insert(&t, &data[i]);
+	}
+
+	/* delete in an order unrelated to the keys */
+	for (size_t i = 0; i < n; i++) {
+		size_t j = (i * 7919) % n;
+		splay_delete(&t, &data[j]);
+		ASSERT_TRUE(splay_find(&t, &data[j]) == NULL,
+			    "test_delete: found element after deleting it.\n");
+		ASSERT_TRUE(t.nnodes == n - (i + 1),
+			    "test_delete: nnodes is wrong.\n");
+		if (i % 1000 == 0)
+			assert_is_valid_tree(&t);
+	}
+	ASSERT_TRUE(t.root == NULL, "test_delete: tree was not empty.\n");
+
+	/* deleting from an empty tree is a no-op */
+	splay_delete(&t, &data[0]);
+	ASSERT_TRUE(t.nnodes == 0, "test_delete: nnodes is wrong.\n");
+}
+
+void test_iterators()
+{
+	SPLAY_TREE(t, &point_cmp, struct test_struct, splay);
+	static struct test_struct data[n];
+
+	ASSERT_TRUE(splay_first(&t) == NULL && splay_last(&t) == NULL,
+		    "test_iterators: empty tree had a first or last.\n");
+
+	for (size_t i = 0; i < n; i++) {
+		data[i].x = (i * 7919) % n;
+		splay_insert(&t, &data[i]);
+	}
+
+	void *node = splay_first(&t);
+	for (size_t i = 0; i < n; i++) {
+		struct test_struct *d = node;
+		ASSERT_TRUE(d && d->x == (int)i,
+			    "test_iterators: traversed out of order.\n");
+		if (i > 0)
+			ASSERT_TRUE(splay_next(&t, splay_prev(&t, node)) == node,
+				    "test_iterators: next of prev was not"
+				    " the current node.\n");
+		else
+			ASSERT_TRUE(splay_prev(&t, node) == NULL,
+				    "test_iterators: prev of first was not"
+				    " NULL.\n");
+		node = splay_next(&t, node);
+	}
+	ASSERT_TRUE(node == NULL, "test_iterators: next of last was not"
+		    " NULL.\n");
+	assert_is_valid_tree(&t);
+
+	struct test_struct *last = splay_last(&t);
+	ASSERT_TRUE(last && last->x == n - 1,
+		    "test_iterators: splay_last was wrong.\n");
+
+	int expect = 0;
+	splay_for_each(&t, struct test_struct, i) {
+		ASSERT_TRUE(i->x == expect, "test_iterators: for_each"
+			    " traversed out of order.\n");
+		expect++;
+	}
+	ASSERT_TRUE(expect == n, "test_iterators: for_each missed nodes.\n");
+}
+
+void test_clear()
+{
+	SPLAY_TREE(t, &point_cmp, struct test_struct, splay);
+
+	for (size_t i = 0; i < n; i++) {
+		struct test_struct *e = malloc(sizeof *e);
+		ASSERT_TRUE(e, "malloc failed!\n");
+		e->x = rand();
+		if (splay_insert(&t, e))
+			free(e);
+	}
+
+	splay_clear(&t, free);
+	ASSERT_TRUE(t.root == NULL && t.nnodes == 0,
+		    "test_clear: tree was not empty.\n");
+	/* valgrind will catch errors */
+}
+
+/**** main ****/
+
+int main(int argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+	srand(time(NULL));
+	REGISTER_TEST(test_insert);
+	REGISTER_TEST(test_random);
+	REGISTER_TEST(test_delete);
+	REGISTER_TEST(test_iterators);
+	REGISTER_TEST(test_clear);
+	return run_all_tests();
+}
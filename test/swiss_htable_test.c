@@ -0,0 +1,202 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file swiss_htable_test.c
+ *
+ * \author Eric Mueller
+ *
+ * \brief Tests for the hash table defined in swiss_htable.h
+ */
+
+#include "test.h"
+#include "swiss_htable.h"
+#include "pcg_variants.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+#define n (1000 * 1000)
+
+static const void *val_of(uint64_t key)
+{
+	return (const void *)(uintptr_t)(key * 3 + 1);
+}
+
+void test_init_destroy()
+{
+	SWISS_HASH_TABLE(t);
+
+	ASSERT_TRUE(swiss_htable_init(&t, 1000), "init failed\n");
+	ASSERT_TRUE(t.capacity >= 1000, "capacity was too small\n");
+	ASSERT_TRUE(t.nentries == 0, "new table was not empty\n");
+	ASSERT_FALSE(swiss_htable_exists(&t, 0), "empty table had a key\n");
+
+	swiss_htable_destroy(&t);
+	ASSERT_TRUE(t.capacity == 0 && t.nentries == 0 && t.ctrl == NULL,
+		    "table was not zeroed after calling destroy\n");
+	ASSERT_FALSE(swiss_htable_exists(&t, 0),
+		     "destroyed table had a key\n");
+}
+
+void test_insert_get()
+{
+	SWISS_HASH_TABLE(t);
+	const void *val;
+
+	ASSERT_TRUE(swiss_htable_init(&t, 1), "init failed\n");
+
+	/* NULL values and repeated keys */
+	ASSERT_TRUE(swiss_htable_insert(&t, 42, NULL), "insert failed\n");
+	ASSERT_TRUE(swiss_htable_insert(&t, 42, val_of(42)), "insert failed\n");
+	ASSERT_TRUE(t.nentries == 1, "repeated insert added an entry\n");
+	val = val_of(1);
+	ASSERT_TRUE(swiss_htable_get(&t, 42, &val) && val == NULL,
+		    "repeated insert changed the value\n");
+	ASSERT_TRUE(swiss_htable_remove(&t, 42) == NULL && t.nentries == 0,
+		    "remove failed\n");
+
+	for (uint64_t i = 0; i < n; i++)
+		ASSERT_TRUE(swiss_htable_insert(&t, i * 7919, val_of(i)),
+			    "insert failed\n");
+	ASSERT_TRUE(t.nentries == n && t.stat_resizes > 0,
+		    "table didn't grow\n");
+	ASSERT_TRUE(t.nentries <= t.capacity && t.capacity < t.mask + 1,
+		    "table was overfull\n");
+
+	for (uint64_t i = 0; i < n; i++) {
+		val = NULL;
+		ASSERT_TRUE(swiss_htable_get(&t, i * 7919, &val)
+			    && val == val_of(i),
+			    "get returned the wrong value\n");
+		val = NULL;
+		ASSERT_FALSE(swiss_htable_get(&t, i * 7919 + 1, &val),
+			     "get found a key that wasn't inserted\n");
+		ASSERT_TRUE(val == NULL, "get modified out on a miss\n");
+	}
+
+	swiss_htable_destroy(&t);
+}
+
+/* random operations on keys in a small range, checked against an array */
+void test_random()
+{
+	SWISS_HASH_TABLE(t);
+	static bool present[1 << 16];
+	unsigned long count = 0;
+	bool ok = true;
+
+	ASSERT_TRUE(swiss_htable_init(&t, 16), "init failed\n");
+	for (unsigned long i = 0; i < 4 * n; i++) {
+		uint64_t key = pcg32_boundedrand(1 << 16);
+		const void *val = NULL;
+
+		switch (pcg32_boundedrand(3)) {
+		case 0:
+			swiss_htable_insert(&t, key, val_of(key));
+			count += !present[key];
+			present[key] = true;
+			break;
+		case 1:
+			ok &= swiss_htable_remove(&t, key)
+				== (present[key] ? val_of(key) : NULL);
+			count -= present[key];
+			present[key] = false;
+			break;
+		case 2:
+			ok &= swiss_htable_get(&t, key, &val) == present[key];
+			ok &= !present[key] || val == val_of(key);
+			break;
+		}
+		ok &= t.nentries == count;
+	}
+	ASSERT_TRUE(ok, "table disagreed with the model\n");
+
+	for (uint64_t key = 0; key < 1 << 16; key++)
+		ok &= swiss_htable_exists(&t, key) == present[key];
+	ASSERT_TRUE(ok, "table disagreed with the model at the end\n");
+	swiss_htable_destroy(&t);
+}
+
+/*
+ * inserting and removing with a steady number of entries leaves tombstones,
+ * which should get cleared out by rehashing in place instead of growing.
+ */
+void test_tombstones()
+{
+	SWISS_HASH_TABLE(t);
+	unsigned long capacity, live;
+	bool ok = true;
+
+	/* full enough that tombstones pile up, but not enough to grow */
+	ASSERT_TRUE(swiss_htable_init(&t, 1000), "init failed\n");
+	capacity = t.capacity;
+	live = capacity * 3 / 4;
+
+	for (uint64_t i = 0; i < live; i++)
+		swiss_htable_insert(&t, i, val_of(i));
+	for (uint64_t i = live; i < 200 * live; i++) {
+		ok &= swiss_htable_remove(&t, i - live) == val_of(i - live);
+		swiss_htable_insert(&t, i, val_of(i));
+	}
+	ASSERT_TRUE(ok, "remove returned the wrong value\n");
+	ASSERT_TRUE(t.capacity == capacity && t.stat_resizes == 0,
+		    "table grew with a steady number of entries\n");
+	ASSERT_TRUE(t.stat_rehashes > 0, "table was never rehashed\n");
+
+	for (uint64_t i = 0; i < 200 * live; i++)
+		ok &= swiss_htable_exists(&t, i) == (i >= 199 * live);
+	ASSERT_TRUE(ok, "rehashing lost or resurrected entries\n");
+	swiss_htable_destroy(&t);
+}
+
+void test_resize()
+{
+	SWISS_HASH_TABLE(t);
+	unsigned long capacity;
+	bool ok = true;
+
+	ASSERT_TRUE(swiss_htable_init(&t, 10000), "init failed\n");
+	for (uint64_t i = 0; i < 10000; i++)
+		swiss_htable_insert(&t, i, val_of(i));
+	capacity = t.capacity;
+
+	ASSERT_FALSE(swiss_htable_resize(&t, false),
+		     "shrank a table that was too full\n");
+	ASSERT_TRUE(swiss_htable_resize(&t, true) && t.capacity > capacity,
+		    "grow failed\n");
+	for (uint64_t i = 0; i < 9000; i++)
+		swiss_htable_remove(&t, i);
+	ASSERT_TRUE(swiss_htable_resize(&t, false), "shrink failed\n");
+	ASSERT_TRUE(swiss_htable_resize(&t, false), "shrink failed\n");
+	ASSERT_TRUE(t.capacity < capacity, "table didn't shrink\n");
+
+	for (uint64_t i = 0; i < 10000; i++) {
+		const void *val = NULL;
+		ok &= swiss_htable_get(&t, i, &val) == (i >= 9000);
+		ok &= i < 9000 || val == val_of(i);
+	}
+	ASSERT_TRUE(ok, "resizing lost entries\n");
+	swiss_htable_destroy(&t);
+}
+
+int main(void)
+{
+	pcg32_srandom(42u, 54u);
+	REGISTER_TEST(test_init_destroy);
+	REGISTER_TEST(test_insert_get);
+	REGISTER_TEST(test_random);
+	REGISTER_TEST(test_tombstones);
+	REGISTER_TEST(test_resize);
+	return run_all_tests();
+}
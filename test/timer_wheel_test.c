@@ -0,0 +1,215 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file timer_wheel_test.c
+ *
+ * \author Eric Mueller
+ *
+ * \brief Tests for the timing wheel defined in timer_wheel.h
+ */
+
+#include "test.h"
+#include "timer_wheel.h"
+#include "util.h"
+#include "pcg_variants.h"
+#include <stdlib.h>
+
+#define NTIMERS (1 << 12)
+
+struct conn {
+	unsigned long id;
+	uint64_t deadline;
+	uint64_t armed_at;
+	bool armed;
+	struct timer_wheel_timer timeout;
+};
+
+void test_init_destroy()
+{
+	struct timer_wheel w;
+
+	ASSERT_FALSE(timer_wheel_init(&w, 0, 8, 4, 0),
+		     "init accepted a granularity of 0\n");
+	ASSERT_FALSE(timer_wheel_init(&w, 1, 16, 4, 0),
+		     "init accepted 64 bits of range\n");
+	ASSERT_FALSE(timer_wheel_init(&w, 1, 8, TIMER_WHEEL_MAX_LEVELS + 1, 0),
+		     "init accepted too many levels\n");
+	ASSERT_TRUE(timer_wheel_init(&w, 1, 8, 4, 0), "init failed\n");
+	timer_wheel_destroy(&w);
+	ASSERT_TRUE(w.slots == NULL, "destroy didn't free the slots\n");
+}
+
+void test_arm_cancel()
+{
+	struct timer_wheel w;
+	struct timer_wheel_timer a, b;
+	TIMER_WHEEL_LIST(expired);
+
+	ASSERT_TRUE(timer_wheel_init(&w, 10, 4, 3, 1000), "init failed\n");
+	timer_wheel_timer_init(&a);
+	timer_wheel_timer_init(&b);
+	ASSERT_FALSE(timer_wheel_pending(&a), "new timer was armed\n");
+	ASSERT_FALSE(timer_wheel_cancel(&w, &a), "cancelled a new timer\n");
+
+	timer_wheel_arm(&w, &a, 1055);
+	timer_wheel_arm(&w, &b, 1100);
+	ASSERT_TRUE(timer_wheel_pending(&a) && w.count == 2, "arm failed\n");
+
+	/* rounded up to a tick, never early */
+	ASSERT_TRUE(timer_wheel_advance(&w, 1059, &expired) == 0,
+		    "timer fired early\n");
+	ASSERT_TRUE(timer_wheel_advance(&w, 1060, &expired) == 1
+		    && list_first(&expired) == &a && !timer_wheel_pending(&a),
+		    "timer didn't fire on time\n");
+	list_pop_front(&expired);
+
+	/* re-arming moves it, cancelling takes it out */
+	timer_wheel_arm(&w, &b, 2000);
+	ASSERT_TRUE(w.count == 1, "re-arming changed the count\n");
+	ASSERT_TRUE(timer_wheel_advance(&w, 1500, &expired) == 0,
+		    "re-armed timer fired at its old time\n");
+	ASSERT_TRUE(timer_wheel_cancel(&w, &b) && !timer_wheel_pending(&b)
+		    && w.count == 0, "cancel failed\n");
+	ASSERT_TRUE(timer_wheel_advance(&w, 5000, &expired) == 0,
+		    "cancelled timer fired\n");
+
+	/* times in the past fire on the next advance */
+	timer_wheel_arm(&w, &a, 10);
+	ASSERT_TRUE(timer_wheel_advance(&w, 5000, &expired) == 1,
+		    "overdue timer didn't fire\n");
+	timer_wheel_destroy(&w);
+}
+
+/* timers far beyond the range of the wheel are held and fire on time */
+void test_far_future()
+{
+	struct timer_wheel w;
+	struct timer_wheel_timer t;
+	TIMER_WHEEL_LIST(expired);
+	uint64_t now;
+
+	/* the wheel covers 2^6 ticks */
+	ASSERT_TRUE(timer_wheel_init(&w, 1, 3, 2, 0), "init failed\n");
+	timer_wheel_timer_init(&t);
+	timer_wheel_arm(&w, &t, 1000);
+	for (now = 0; now < 1000; now += 7)
+		ASSERT_TRUE(timer_wheel_advance(&w, now, &expired) == 0,
+			    "far timer fired early\n");
+	ASSERT_TRUE(timer_wheel_advance(&w, 1000, &expired) == 1,
+		    "far timer didn't fire\n");
+	timer_wheel_destroy(&w);
+}
+
+/*
+ * random arms, re-arms and cancels with time moving forward by random
+ * steps, checked against the deadline stored in each conn. Every timer
+ * should fire exactly once, in the first advance at or after its deadline.
+ */
+static void random_ops(unsigned slot_bits, unsigned levels)
+{
+	static struct conn conns[NTIMERS];
+	struct timer_wheel w;
+	TIMER_WHEEL_LIST(expired);
+	struct timer_wheel_timer *t;
+	unsigned long armed = 0;
+	uint64_t now = 12345, last;
+	bool ok = true;
+
+	ASSERT_TRUE(timer_wheel_init(&w, 1, slot_bits, levels, now),
+		    "init failed\n");
+	for (unsigned long i = 0; i < NTIMERS; i++) {
+		conns[i].id = i;
+		conns[i].armed = false;
+		timer_wheel_timer_init(&conns[i].timeout);
+	}
+
+	for (unsigned long step = 0; step < 200000; step++) {
+		struct conn *c = &conns[pcg32_boundedrand(NTIMERS)];
+
+		switch (pcg32_boundedrand(4)) {
+		case 0:
+		case 1:
+			/* mostly short timeouts, some very long ones */
+			c->deadline = now + (pcg32_boundedrand(8)
+				? pcg32_boundedrand(1000)
+				: pcg32_boundedrand(1 << 20));
+			c->armed_at = now;
+			armed += !c->armed;
+			c->armed = true;
+			timer_wheel_arm(&w, &c->timeout, c->deadline);
+			break;
+		case 2:
+			ok &= timer_wheel_cancel(&w, &c->timeout) == c->armed;
+			armed -= c->armed;
+			c->armed = false;
+			break;
+		case 3:
+			last = now;
+			now += pcg32_boundedrand(pcg32_boundedrand(16) ? 20 : 5000);
+			timer_wheel_advance(&w, now, &expired);
+			while ((t = list_pop_front(&expired))) {
+				c = container_of(t, struct conn, timeout);
+				/* due, and not due at the last advance */
+				ok &= c->armed && c->deadline <= now;
+				ok &= c->deadline > last || c->armed_at >= last;
+				ok &= !timer_wheel_pending(t);
+				c->armed = false;
+				armed--;
+			}
+			/* and now and then, check that nothing was missed */
+			for (unsigned long i = 0; !(step & 255) && i < NTIMERS; i++)
+				ok &= !conns[i].armed || conns[i].deadline > now;
+			break;
+		}
+		ok &= w.count == armed;
+	}
+	ASSERT_TRUE(ok, "wheel disagreed with the deadlines\n");
+
+	/* run everything out */
+	timer_wheel_advance(&w, now + (1 << 20), &expired);
+	ASSERT_TRUE(expired.length == armed && w.count == 0,
+		    "not every timer fired\n");
+	timer_wheel_destroy(&w);
+}
+
+void test_random()
+{
+	random_ops(8, 4);
+}
+
+void test_random_small_wheel()
+{
+	/* slots that don't fill a bitmap word, and lots of parked timers */
+	random_ops(2, 3);
+}
+
+void test_random_one_level()
+{
+	/* nothing to cascade to, so parked timers wait in level 0 */
+	random_ops(8, 1);
+	random_ops(4, 1);
+}
+
+int main(void)
+{
+	pcg32_srandom(42u, 54u);
+	REGISTER_TEST(test_init_destroy);
+	REGISTER_TEST(test_arm_cancel);
+	REGISTER_TEST(test_far_future);
+	REGISTER_TEST(test_random);
+	REGISTER_TEST(test_random_small_wheel);
+	REGISTER_TEST(test_random_one_level);
+	return run_all_tests();
+}
@@ -0,0 +1,249 @@
+/* Copyright 2014 Eric Mueller
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * \file ulist_test.c
+ *
+ * \author Eric Mueller
+ *
+ * \brief Tests for the unrolled list defined in ulist.h
+ */
+
+#include "test.h"
+#include "ulist.h"
+#include "pcg_variants.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+#define N 100000
+
+/* a deque of N elements in an array twice as big, starting in the middle */
+struct model {
+	unsigned long items[2 * N];
+	size_t begin;
+	size_t end;
+};
+
+static void *to_ptr(unsigned long x)
+{
+	return (void *)(uintptr_t)x;
+}
+
+/* check that both iteration macros agree with the model */
+static void assert_matches(struct ulist *ul, struct model *m)
+{
+	bool ok = ul->length == m->end - m->begin;
+	size_t i;
+
+	i = m->begin;
+	ulist_for_each(ul, char, p)
+		ok &= i < m->end && p == to_ptr(m->items[i++]);
+	ok &= i == m->end;
+
+	i = m->end;
+	ulist_for_each_reverse(ul, char, p)
+		ok &= i > m->begin && p == to_ptr(m->items[--i]);
+	ok &= i == m->begin;
+
+	if (m->begin != m->end) {
+		ok &= ulist_first(ul) == to_ptr(m->items[m->begin]);
+		ok &= ulist_last(ul) == to_ptr(m->items[m->end - 1]);
+	} else {
+		ok &= ulist_first(ul) == NULL && ulist_last(ul) == NULL;
+	}
+	ASSERT_TRUE(ok, "list did not match the model\n");
+}
+
+void test_push_pop()
+{
+	ULIST(ul);
+	size_t i;
+
+	ASSERT_TRUE(ulist_pop_back(&ul) == NULL && ulist_pop_front(&ul) == NULL,
+		    "popped from an empty list\n");
+
+	/* fifo both ways */
+	for (i = 1; i <= N; i++)
+		ASSERT_TRUE(ulist_push_back(&ul, to_ptr(i)), "push failed\n");
+	ASSERT_TRUE(ul.length == N, "length was wrong\n");
+	for (i = 1; i <= N; i++)
+		ASSERT_TRUE(ulist_pop_front(&ul) == to_ptr(i),
+			    "pop_front returned the wrong pointer\n");
+	ASSERT_TRUE(ul.length == 0 && ul.first == NULL && ul.last == NULL,
+		    "list was not empty\n");
+
+	for (i = 1; i <= N; i++)
+		ulist_push_front(&ul, to_ptr(i));
+	for (i = 1; i <= N; i++)
+		ASSERT_TRUE(ulist_pop_back(&ul) == to_ptr(i),
+			    "pop_back returned the wrong pointer\n");
+
+	/* lifo both ways */
+	for (i = 1; i <= N; i++)
+		ulist_push_back(&ul, to_ptr(i));
+	for (i = N; i >= 1; i--)
+		ASSERT_TRUE(ulist_pop_back(&ul) == to_ptr(i),
+			    "pop_back returned the wrong pointer\n");
+	for (i = 1; i <= N; i++)
+		ulist_push_front(&ul, to_ptr(i));
+	for (i = N; i >= 1; i--)
+		ASSERT_TRUE(ulist_pop_front(&ul) == to_ptr(i),
+			    "pop_front returned the wrong pointer\n");
+
+	ASSERT_TRUE(ul.length == 0, "list was not empty\n");
+	ulist_destroy(&ul);
+}
+
+void test_random()
+{
+	ULIST(ul);
+	static struct model m;
+	unsigned long next = 1;
+	size_t i;
+
+	m.begin = m.end = N;
+	for (i = 0; i < N; i++) {
+		switch (pcg32_boundedrand(4)) {
+		case 0:
+			if (m.begin == 0)
+				break;
+			ulist_push_front(&ul, to_ptr(next));
+			m.items[--m.begin] = next++;
+			break;
+		case 1:
+			if (m.end == 2 * N)
+				break;
+			ulist_push_back(&ul, to_ptr(next));
+			m.items[m.end++] = next++;
+			break;
+		case 2:
+			ASSERT_TRUE(ulist_pop_front(&ul) == (m.begin == m.end
+				    ? NULL : to_ptr(m.items[m.begin++])),
+				    "pop_front returned the wrong pointer\n");
+			break;
+		case 3:
+			ASSERT_TRUE(ulist_pop_back(&ul) == (m.begin == m.end
+				    ? NULL : to_ptr(m.items[--m.end])),
+				    "pop_back returned the wrong pointer\n");
+			break;
+		}
+		if (i % 10000 == 0)
+			assert_matches(&ul, &m);
+	}
+	assert_matches(&ul, &m);
+	ulist_destroy(&ul);
+	ASSERT_TRUE(ul.length == 0 && ul.first == NULL && ul.spare == NULL,
+		    "destroyed list was not empty\n");
+}
+
+void test_for_each()
+{
+	ULIST(ul);
+	size_t i, n = 0;
+
+	ulist_for_each(&ul, char, p)
+		n += p != NULL;
+	ASSERT_TRUE(n == 0, "iterated over an empty list\n");
+
+	for (i = 1; i <= 1000; i++)
+		ulist_push_back(&ul, to_ptr(i));
+
+	/* break leaves every level of the loop */
+	ulist_for_each(&ul, char, p) {
+		n++;
+		if (p == to_ptr(200))
+			break;
+	}
+	ASSERT_TRUE(n == 200, "break did not stop the loop\n");
+
+	n = 0;
+	ulist_for_each_reverse(&ul, char, p) {
+		n++;
+		if (p == to_ptr(800))
+			break;
+	}
+	ASSERT_TRUE(n == 201, "break did not stop the reverse loop\n");
+
+	/* continue goes to the next element */
+	n = 0;
+	ulist_for_each(&ul, char, p) {
+		if ((uintptr_t)p % 2)
+			continue;
+		n++;
+	}
+	ASSERT_TRUE(n == 500, "continue skipped the wrong elements\n");
+
+	/* pushes onto the end during iteration are visited */
+	n = 0;
+	ulist_for_each(&ul, char, p) {
+		if ((uintptr_t)p <= 1000)
+			ulist_push_back(&ul, to_ptr((uintptr_t)p + 1000));
+		n++;
+	}
+	ASSERT_TRUE(n == 2000 && ul.length == 2000,
+		    "pushes during iteration were not visited\n");
+
+	n = 0;
+	ulist_for_each_reverse(&ul, char, p) {
+		if ((uintptr_t)p > 1000 && (uintptr_t)p <= 2000)
+			ulist_push_front(&ul, to_ptr((uintptr_t)p + 2000));
+		n++;
+	}
+	ASSERT_TRUE(n == 3000 && ul.length == 3000,
+		    "pushes during reverse iteration were not visited\n");
+
+	ulist_destroy(&ul);
+}
+
+void test_blocks()
+{
+	ULIST(ul);
+	struct ulist_block *b;
+	size_t i, nblocks = 0;
+
+	ASSERT_TRUE(sizeof(struct ulist_block) <= ULIST_BLOCK_SIZE,
+		    "blocks were too big\n");
+
+	for (i = 0; i < 10 * ULIST_BLOCK_ITEMS; i++)
+		ulist_push_back(&ul, to_ptr(i + 1));
+	for (b = ul.first; b; b = b->next) {
+		ASSERT_TRUE((uintptr_t)b % ULIST_CACHELINE == 0,
+			    "block was not aligned\n");
+		ASSERT_TRUE(b->end - b->begin == ULIST_BLOCK_ITEMS,
+			    "block was not full\n");
+		nblocks++;
+	}
+	ASSERT_TRUE(nblocks == 10, "wrong number of blocks\n");
+
+	/* bouncing over a block boundary reuses the spare block */
+	b = ul.last;
+	for (i = 0; i < 100; i++) {
+		ulist_push_back(&ul, to_ptr(1));
+		ulist_pop_back(&ul);
+	}
+	ASSERT_TRUE(ul.spare && ul.last == b,
+		    "spare block was not kept\n");
+
+	ulist_destroy(&ul);
+}
+
+int main(void)
+{
+	pcg32_srandom(42u, 54u);
+	REGISTER_TEST(test_push_pop);
+	REGISTER_TEST(test_random);
+	REGISTER_TEST(test_for_each);
+	REGISTER_TEST(test_blocks);
+	return run_all_tests();
+}